@@ -36,7 +36,7 @@ Buffer::Buffer(size_t limit) :
 }
 
 Buffer::Buffer(std::vector<uint8_t> data) :
-	data(data), write_head(data.size()) {
+	data(std::move(data)), write_head(this->data.size()) {
 }
 
 Buffer::~Buffer() {
@@ -149,6 +149,16 @@ std::vector<uint8_t> Buffer::GetData() {
 	return std::vector<uint8_t>(data.begin() + read_head, data.begin() + write_head);
 }
 
+std::vector<uint8_t> Buffer::TakeData() {
+	data.resize(write_head);
+	data.erase(data.begin(), data.begin() + read_head);
+	read_head = 0;
+	write_head = 0;
+	std::vector<uint8_t> out = std::move(data);
+	data.clear();
+	return out;
+}
+
 std::string Buffer::GetString() {
 	return std::string(data.begin() + read_head, data.begin() + write_head);
 }
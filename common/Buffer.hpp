@@ -105,6 +105,9 @@ class Buffer {
 	size_t WriteAvailableHint();
 
 	std::vector<uint8_t> GetData();
+	// Moves the unread data out instead of copying it, and leaves the
+	// buffer empty.
+	std::vector<uint8_t> TakeData();
 
 	void Compact(); // guarantees that data pending read won't be moved around
 
@@ -0,0 +1,230 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Compression.hpp"
+
+#include<algorithm>
+
+#include<string.h>
+
+namespace twili {
+namespace util {
+
+static const size_t MinMatch = 4;
+static const size_t LastLiterals = 5; // the last 5 bytes are always literals
+static const size_t MatchFindLimit = 12; // and no match may start in the last 12
+static const size_t MaxOffset = 0xffff;
+static const int HashLog = 12;
+
+static uint32_t Read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static void WriteLength(std::vector<uint8_t> &out, size_t length) {
+	for(; length >= 255; length-= 255) {
+		out.push_back(255);
+	}
+	out.push_back((uint8_t) length);
+}
+
+static void WriteSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t literal_length, size_t offset, size_t match_length) {
+	size_t ml = match_length - MinMatch;
+	out.push_back((uint8_t) ((std::min(literal_length, (size_t) 15) << 4) | std::min(ml, (size_t) 15)));
+	if(literal_length >= 15) {
+		WriteLength(out, literal_length - 15);
+	}
+	out.insert(out.end(), literals, literals + literal_length);
+	out.push_back(offset & 0xff);
+	out.push_back(offset >> 8);
+	if(ml >= 15) {
+		WriteLength(out, ml - 15);
+	}
+}
+
+std::vector<uint8_t> CompressLZ4(const uint8_t *src, size_t size) {
+	std::vector<uint8_t> out;
+	out.reserve(size + (size / 255) + 16);
+
+	size_t anchor = 0;
+	if(size > MatchFindLimit) {
+		std::vector<uint32_t> table(1 << HashLog, 0);
+		size_t limit = size - MatchFindLimit;
+		size_t ip = 0;
+		while(ip < limit) {
+			uint32_t seq = Read32(src + ip);
+			uint32_t hash = (seq * 2654435761u) >> (32 - HashLog);
+			size_t candidate = table[hash];
+			table[hash] = (uint32_t) ip;
+			if(candidate < ip && ip - candidate <= MaxOffset && Read32(src + candidate) == seq) {
+				size_t match_length = MinMatch;
+				while(ip + match_length < size - LastLiterals && src[candidate + match_length] == src[ip + match_length]) {
+					match_length++;
+				}
+				WriteSequence(out, src + anchor, ip - anchor, ip - candidate, match_length);
+				ip+= match_length;
+				anchor = ip;
+			} else {
+				// skip faster through data that isn't compressing
+				ip+= 1 + ((ip - anchor) >> 6);
+			}
+		}
+	}
+
+	size_t literal_length = size - anchor;
+	out.push_back((uint8_t) (std::min(literal_length, (size_t) 15) << 4));
+	if(literal_length >= 15) {
+		WriteLength(out, literal_length - 15);
+	}
+	out.insert(out.end(), src + anchor, src + size);
+	return out;
+}
+
+static bool ReadLength(const uint8_t *src, size_t src_size, size_t &ip, size_t &length) {
+	uint8_t b;
+	do {
+		if(ip >= src_size) {
+			return false;
+		}
+		b = src[ip++];
+		length+= b;
+	} while(b == 255);
+	return true;
+}
+
+bool DecompressLZ4(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_size) {
+	size_t ip = 0;
+	size_t op = 0;
+	while(ip < src_size) {
+		uint8_t token = src[ip++];
+
+		size_t literal_length = token >> 4;
+		if(literal_length == 15 && !ReadLength(src, src_size, ip, literal_length)) {
+			return false;
+		}
+		if(literal_length > src_size - ip || literal_length > dst_size - op) {
+			return false;
+		}
+		if(literal_length > 0) { // dst may be null if dst_size is zero
+			memcpy(dst + op, src + ip, literal_length);
+		}
+		ip+= literal_length;
+		op+= literal_length;
+
+		if(ip == src_size) { // last sequence has no match
+			break;
+		}
+
+		if(src_size - ip < 2) {
+			return false;
+		}
+		size_t offset = src[ip] | (src[ip + 1] << 8);
+		ip+= 2;
+		if(offset == 0 || offset > op) {
+			return false;
+		}
+
+		size_t match_length = token & 15;
+		if(match_length == 15 && !ReadLength(src, src_size, ip, match_length)) {
+			return false;
+		}
+		match_length+= MinMatch;
+		if(match_length > dst_size - op) {
+			return false;
+		}
+		if(offset >= match_length) {
+			memcpy(dst + op, dst + op - offset, match_length);
+		} else {
+			// overlapping match repeats the last `offset` bytes
+			for(size_t i = 0; i < match_length; i++) {
+				dst[op + i] = dst[op + i - offset];
+			}
+		}
+		op+= match_length;
+	}
+	return op == dst_size;
+}
+
+}
+
+namespace protocol {
+
+void CompressPayload(MessageHeader &mh, std::vector<uint8_t> &payload) {
+	if(payload.size() < COMPRESSION_THRESHOLD || payload.size() > COMPRESSION_MAX_SIZE) {
+		return;
+	}
+	std::vector<uint8_t> block = util::CompressLZ4(payload.data(), payload.size());
+	if(block.size() + sizeof(uint64_t) >= payload.size()) {
+		return;
+	}
+	uint64_t size = payload.size();
+	payload.resize(sizeof(size) + block.size());
+	memcpy(payload.data(), &size, sizeof(size));
+	memcpy(payload.data() + sizeof(size), block.data(), block.size());
+	mh.payload_size = payload.size();
+	mh.flags|= FLAG_COMPRESSED;
+}
+
+static bool Expand(MessageHeader &mh, const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+	uint64_t expanded_size;
+	if(size < sizeof(expanded_size)) {
+		return false;
+	}
+	memcpy(&expanded_size, data, sizeof(expanded_size));
+	if(expanded_size > COMPRESSION_MAX_SIZE) {
+		return false;
+	}
+	out.resize(expanded_size);
+	if(!util::DecompressLZ4(data + sizeof(expanded_size), size - sizeof(expanded_size), out.data(), out.size())) {
+		return false;
+	}
+	mh.payload_size = expanded_size;
+	mh.flags&= ~FLAG_COMPRESSED;
+	return true;
+}
+
+bool DecompressPayload(MessageHeader &mh, std::vector<uint8_t> &payload) {
+	if(!(mh.flags & FLAG_COMPRESSED)) {
+		return true;
+	}
+	std::vector<uint8_t> expanded;
+	if(!Expand(mh, payload.data(), payload.size(), expanded)) {
+		return false;
+	}
+	payload = std::move(expanded);
+	return true;
+}
+
+bool DecompressPayload(MessageHeader &mh, util::Buffer &payload) {
+	if(!(mh.flags & FLAG_COMPRESSED)) {
+		return true;
+	}
+	std::vector<uint8_t> expanded;
+	if(!Expand(mh, payload.Read(), payload.ReadAvailable(), expanded)) {
+		return false;
+	}
+	payload.Clear();
+	payload.Write(expanded.data(), expanded.size());
+	return true;
+}
+
+}
+}
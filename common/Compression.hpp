@@ -0,0 +1,55 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<vector>
+#include<stdint.h>
+
+#include "Protocol.hpp"
+#include "Buffer.hpp"
+
+namespace twili {
+namespace util {
+
+// LZ4 block format. Output of CompressLZ4 can be read by any LZ4 block
+// decoder, but it doesn't carry the uncompressed size.
+std::vector<uint8_t> CompressLZ4(const uint8_t *data, size_t size);
+// Fails if the input is malformed or doesn't decompress to exactly
+// `dst_size` bytes.
+bool DecompressLZ4(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_size);
+
+}
+
+namespace protocol {
+
+// Compressed payloads are a little-endian uint64_t uncompressed size,
+// followed by an LZ4 block.
+
+// Replaces the payload with its compressed form and sets FLAG_COMPRESSED,
+// if the payload is in the compressible size range and actually shrinks.
+void CompressPayload(MessageHeader &mh, std::vector<uint8_t> &payload);
+// Expands the payload if FLAG_COMPRESSED is set, fixing up the header to
+// match. Returns false on a malformed payload.
+bool DecompressPayload(MessageHeader &mh, std::vector<uint8_t> &payload);
+bool DecompressPayload(MessageHeader &mh, util::Buffer &payload);
+
+}
+}
@@ -38,15 +38,34 @@ struct MessageHeader {
 	uint32_t tag;
 	uint64_t payload_size;
 	uint32_t object_count;
+	uint32_t flags; // used to be padding, so older peers may send garbage here
 };
 
-const int VERSION = 2;
+static_assert(sizeof(MessageHeader) == 32, "MessageHeader layout must not change");
+
+// 3: USB bridge accepts request headers queued behind an unfinished payload
+// 4: payloads may be LZ4-compressed once negotiated during IDENTIFY
+// 5: ITwibPipeReader queues up to READ_WINDOW outstanding READs
+const int VERSION = 5;
+
+// Set on a message whose payload is compressed. Only honored once
+// compression has been negotiated on the connection.
+const uint32_t FLAG_COMPRESSED = 1;
+// Put in the flags of an IDENTIFY request to ask the device to compress
+// its responses, and to accept compressed requests after the identify
+// response. This is a magic value instead of a bit because older hosts
+// left the flags uninitialized.
+const uint32_t COMPRESSION_OFFER = 0x345a4c54;
+// Payloads outside this range are always sent uncompressed.
+const uint64_t COMPRESSION_THRESHOLD = 0x1000;
+const uint64_t COMPRESSION_MAX_SIZE = 0x80000;
 
 class ITwibMetaInterface {
  public:
 	enum class Command : uint32_t {
 		LIST_DEVICES = 10,
 		CONNECT_TCP = 11,
+		GET_METRICS = 12,
 	};
 };
 
@@ -70,14 +89,51 @@ class ITwibDeviceInterface {
 		WAIT_TO_DEBUG_APPLICATION = 24,
 		WAIT_TO_DEBUG_TITLE = 25,
 		REBOOT_UNSAFE = 26,
+		OPEN_CORE_DUMP = 27,
+	};
+};
+
+// Flags for the header of a request going from a host to a device. Devices
+// take an IDENTIFY without the compression offer to mean that the host has
+// stopped decompressing, so the offer has to go on every IDENTIFY, including
+// ones passed along for clients.
+inline uint32_t RequestFlags(uint32_t object_id, uint32_t command_id) {
+	if(object_id == 0 && command_id == (uint32_t) ITwibDeviceInterface::Command::IDENTIFY) {
+		return COMPRESSION_OFFER;
+	}
+	return 0;
+}
+
+// Selects which memory regions go into a core dump opened with
+// OPEN_CORE_DUMP. Unreadable regions and I/O mappings are always left out.
+struct CoreDumpFilter {
+	uint64_t memory_types; // bit (1 << memory_type) set for each type to include
+	uint32_t permissions; // regions must have all of these permission bits
+	uint32_t flags;
+	uint64_t max_region_size; // regions larger than this are left out; 0 for no limit
+
+	enum : uint32_t {
+		SKIP_ZERO_PAGES = 1, // leave pages of zeroes out of the file
 	};
 };
 
+// One range of a vectored READ_MEMORY_V request. The response carries a
+// result code for each range, followed by the data for every range that
+// read successfully, concatenated in request order.
+struct MemoryRange {
+	uint64_t address;
+	uint64_t size;
+};
+
 class ITwibPipeReader {
  public:
 	enum class Command : uint32_t {
 		READ = 10,
 	};
+
+	// how many READs a reader may have outstanding at once. They are
+	// answered in the order they were sent, as data shows up.
+	static constexpr uint64_t READ_WINDOW = 4;
 };
 
 class ITwibPipeWriter {
@@ -105,7 +161,11 @@ class ITwibDebugger {
 		GET_TARGET_ENTRY = 21,
 		LAUNCH_DEBUG_PROCESS = 22,
 		GET_NRO_INFOS = 24,
+		READ_MEMORY_V = 25,
 	};
+
+	// upper bound on the sum of range sizes in one READ_MEMORY_V request
+	static constexpr uint64_t READ_MEMORY_V_MAX_SIZE = 0x100000;
 };
 
 class ITwibProcessMonitor {
@@ -146,6 +206,28 @@ class ITwibFileAccessor {
 		FLUSH = 12,
 		SET_SIZE = 13,
 		GET_SIZE = 14,
+		HASH_BLOCKS = 15,
+	};
+
+	// upper bound on the data returned by one READ request. The device may
+	// return less than was asked for, so larger reads should be split up.
+	static constexpr uint64_t READ_MAX_SIZE = 0x40000;
+
+	// limits on one HASH_BLOCKS request, so that the device doesn't spend
+	// too long reading before it answers. Larger hashes should be split up.
+	static constexpr uint64_t HASH_MIN_BLOCK_SIZE = 0x1000;
+	static constexpr uint64_t HASH_MAX_BLOCK_SIZE = 0x100000;
+	static constexpr uint64_t HASH_MAX_BLOCK_COUNT = 0x400;
+	static constexpr uint64_t HASH_MAX_BYTES = 0x400000;
+};
+
+// Core dumps can be read the same way as files, so these share command IDs
+// with ITwibFileAccessor.
+class ITwibCoreDump {
+ public:
+	enum class Command : uint32_t {
+		READ = 10,
+		GET_SIZE = 14,
 	};
 };
 
@@ -0,0 +1,81 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "SendQueue.hpp"
+
+#include<algorithm>
+
+namespace twili {
+namespace util {
+
+// enough to keep a steady stream of chunks going without holding onto
+// the memory from a burst
+static const size_t MaxSpareChunks = 2;
+
+SendQueue::SendQueue(size_t chunk_size) :
+	chunk_size(std::max(chunk_size, (size_t) 1)) {
+}
+
+void SendQueue::Push(const uint8_t *data, size_t size) {
+	this->size+= size;
+	while(size > 0) {
+		if(chunks.empty() || chunks.back().size() == chunk_size) {
+			if(spare.empty()) {
+				chunks.emplace_back();
+				chunks.back().reserve(chunk_size);
+			} else {
+				chunks.push_back(std::move(spare.back()));
+				spare.pop_back();
+			}
+		}
+		std::vector<uint8_t> &back = chunks.back();
+		size_t amount = std::min(size, chunk_size - back.size());
+		back.insert(back.end(), data, data + amount);
+		data+= amount;
+		size-= amount;
+	}
+}
+
+size_t SendQueue::Size() const {
+	return size;
+}
+
+bool SendQueue::Empty() const {
+	return size == 0;
+}
+
+void SendQueue::Clear() {
+	while(!chunks.empty()) {
+		Recycle();
+	}
+	size = 0;
+}
+
+void SendQueue::Recycle() {
+	if(spare.size() < MaxSpareChunks) {
+		chunks.front().clear();
+		spare.push_back(std::move(chunks.front()));
+	}
+	chunks.pop_front();
+	read_offset = 0;
+}
+
+} // namespace util
+} // namespace twili
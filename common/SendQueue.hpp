@@ -0,0 +1,83 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<deque>
+#include<vector>
+
+#include<stddef.h>
+#include<stdint.h>
+
+namespace twili {
+namespace util {
+
+// Bytes waiting to go out on a stream socket. Whoever produces responses
+// calls Push, and whoever owns the socket calls Drain when it's writable.
+// Data is kept in fixed-size chunks that get recycled, so a busy
+// connection doesn't keep reallocating one big buffer. Not thread-safe by
+// itself.
+class SendQueue {
+ public:
+	SendQueue(size_t chunk_size);
+
+	void Push(const uint8_t *data, size_t size);
+
+	// Offers queued data to send(data, size), oldest first, until the
+	// queue is empty or send() takes less than it was offered. send()
+	// returns how many bytes it took, 0 if it would block, or a negative
+	// value on error. Returns false if send() failed.
+	template<typename F>
+	bool Drain(F &&send) {
+		while(!chunks.empty()) {
+			std::vector<uint8_t> &front = chunks.front();
+			size_t available = front.size() - read_offset;
+			if(available > 0) {
+				auto r = send(front.data() + read_offset, available);
+				if(r < 0) {
+					return false;
+				}
+				read_offset+= r;
+				size-= r;
+				if((size_t) r < available) {
+					return true;
+				}
+			}
+			Recycle();
+		}
+		return true;
+	}
+
+	size_t Size() const;
+	bool Empty() const;
+	void Clear();
+
+ private:
+	const size_t chunk_size;
+	std::deque<std::vector<uint8_t>> chunks;
+	std::vector<std::vector<uint8_t>> spare;
+	size_t read_offset = 0; // into chunks.front()
+	size_t size = 0;
+
+	void Recycle(); // drops chunks.front()
+};
+
+} // namespace util
+} // namespace twili
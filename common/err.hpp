@@ -77,6 +77,7 @@
 #define TWILI_ERR_BAD_REQUEST TWILI_ERR_PROTOCOL_BAD_REQUEST // old alias
 #define TWILI_ERR_PROTOCOL_BAD_RESPONSE TWILI_RESULT(1006)
 #define TWILI_ERR_BAD_RESPONSE TWILI_ERR_PROTOCOL_BAD_RESPONSE // old alias
+#define TWILI_ERR_PROTOCOL_REQUEST_TIMED_OUT TWILI_RESULT(1007)
 
 #define TWILI_TIPC_ERR_UNEXPECTED_RESPONSE_TAG TWILI_RESULT(2001)
 #define TWILI_TIPC_ERR_UNEXPECTED_RESPONSE_RAW_COUNT TWILI_RESULT(2002)
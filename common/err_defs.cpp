@@ -73,6 +73,7 @@ static auto descriptions = std::array {
 	describe(User,     TWILI_ERR_PROTOCOL_UNRECOGNIZED_DEVICE, "Unrecognized device", "The bridge daemon did not recognize the requested device."),
 	describe(Api,      TWILI_ERR_PROTOCOL_BAD_REQUEST, "Bad request", "The request was malformed."),
 	describe(Api,      TWILI_ERR_PROTOCOL_BAD_RESPONSE, "Bad response", "The response was malformed."),
+	describe(User,     TWILI_ERR_PROTOCOL_REQUEST_TIMED_OUT, "Request timed out", "The device did not respond to the request in time."),
 
 	describe(Internal, TWILI_TIPC_ERR_UNEXPECTED_RESPONSE_TAG, "Unexpected TIPC response tag", nullptr),
 	describe(Internal, TWILI_TIPC_ERR_UNEXPECTED_RESPONSE_RAW_COUNT, "Unexpected TIPC response raw count", nullptr),
@@ -22,6 +22,7 @@
 
 #include<stdio.h>
 #include<errno.h>
+#include<string.h>
 
 namespace twili {
 namespace util {
@@ -73,5 +74,91 @@ std::optional<std::vector<uint8_t>> ReadFile(const char *path) {
 	return buffer;
 }
 
+namespace {
+
+const uint64_t Prime1 = 11400714785074694791ULL;
+const uint64_t Prime2 = 14029467366897019727ULL;
+const uint64_t Prime3 = 1609587929392839161ULL;
+const uint64_t Prime4 = 9650029242287828579ULL;
+const uint64_t Prime5 = 2870177450012600261ULL;
+
+inline uint64_t Rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const uint8_t *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v)); // both sides are little-endian
+	return v;
+}
+
+inline uint32_t Read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+	acc+= input * Prime2;
+	acc = Rotl(acc, 31);
+	return acc * Prime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+	acc^= Round(0, val);
+	return acc * Prime1 + Prime4;
+}
+
+} // anonymous namespace
+
+uint64_t HashBlock(const uint8_t *data, size_t size) {
+	const uint8_t *p = data;
+	const uint8_t *end = data + size;
+	uint64_t h;
+
+	if(size >= 32) {
+		uint64_t v1 = Prime1 + Prime2;
+		uint64_t v2 = Prime2;
+		uint64_t v3 = 0;
+		uint64_t v4 = -Prime1;
+		do {
+			v1 = Round(v1, Read64(p)); p+= 8;
+			v2 = Round(v2, Read64(p)); p+= 8;
+			v3 = Round(v3, Read64(p)); p+= 8;
+			v4 = Round(v4, Read64(p)); p+= 8;
+		} while(p + 32 <= end);
+		h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+		h = MergeRound(h, v1);
+		h = MergeRound(h, v2);
+		h = MergeRound(h, v3);
+		h = MergeRound(h, v4);
+	} else {
+		h = Prime5;
+	}
+
+	h+= size;
+
+	for(; p + 8 <= end; p+= 8) {
+		h^= Round(0, Read64(p));
+		h = Rotl(h, 27) * Prime1 + Prime4;
+	}
+	if(p + 4 <= end) {
+		h^= (uint64_t) Read32(p) * Prime1;
+		h = Rotl(h, 23) * Prime2 + Prime3;
+		p+= 4;
+	}
+	for(; p < end; p++) {
+		h^= (*p) * Prime5;
+		h = Rotl(h, 11) * Prime1;
+	}
+
+	h^= h >> 33;
+	h*= Prime2;
+	h^= h >> 29;
+	h*= Prime3;
+	h^= h >> 32;
+	return h;
+}
+
 }
 }
@@ -27,5 +27,9 @@ namespace util {
 
 std::optional<std::vector<uint8_t>> ReadFile(const char *path);
 
+// XXH64 with a zero seed. Used to compare file blocks between host and
+// device, so both sides have to agree on it.
+uint64_t HashBlock(const uint8_t *data, size_t size);
+
 }
 }
@@ -0,0 +1,53 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "BufferPool.hpp"
+
+namespace twili {
+namespace twib {
+namespace common {
+
+static thread_local std::vector<std::vector<uint8_t>> pool;
+
+std::vector<uint8_t> BufferPool::Acquire() {
+	if(pool.empty()) {
+		std::vector<uint8_t> vec;
+		vec.reserve(InitialCapacity);
+		return vec;
+	}
+	std::vector<uint8_t> vec = std::move(pool.back());
+	pool.pop_back();
+	return vec;
+}
+
+void BufferPool::Release(std::vector<uint8_t> &&vec) {
+	if(vec.capacity() < InitialCapacity || vec.capacity() > MaxCapacity || pool.size() >= MaxPooled) {
+		return;
+	}
+	if(pool.capacity() < MaxPooled) {
+		pool.reserve(MaxPooled);
+	}
+	vec.clear();
+	pool.push_back(std::move(vec));
+}
+
+} // namespace common
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,51 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<vector>
+
+#include<stddef.h>
+#include<stdint.h>
+
+namespace twili {
+namespace twib {
+namespace common {
+
+// Recycles message payload vectors so that small requests and responses
+// don't go through the allocator every time. Each thread has its own pool,
+// so no locking is needed. A vector may be released on a different thread
+// than the one that acquired it.
+class BufferPool {
+ public:
+	static constexpr size_t InitialCapacity = 0x400;
+	// Bigger vectors are freed instead of pooled, so that one large transfer
+	// doesn't keep its memory around forever.
+	static constexpr size_t MaxCapacity = 0x10000;
+	static constexpr size_t MaxPooled = 16;
+
+	// Returns an empty vector, with some capacity already reserved.
+	static std::vector<uint8_t> Acquire();
+	static void Release(std::vector<uint8_t> &&vec);
+};
+
+} // namespace common
+} // namespace twib
+} // namespace twili
@@ -23,6 +23,7 @@
 #include<forward_list>
 #include<stdarg.h>
 #include<string.h>
+#include<algorithm>
 
 #ifdef _WIN32
 #include<Windows.h>
@@ -48,6 +49,7 @@ namespace log {
 const size_t BUFFER_SIZE = 2048;
 
 std::forward_list<std::shared_ptr<Logger>> logs;
+std::atomic<Level> min_level(Level::Max); // nothing gets logged until a logger is added
 
 void init_color() {
 #ifdef _WIN32
@@ -138,6 +140,10 @@ char *Logger::format(char *buf, int size, bool color, Level lvl, const char *fna
 Logger::~Logger() {
 }
 
+Level Logger::MinLevel() {
+  return Level::Debug;
+}
+
 FileLogger::FileLogger(FILE *fp, Level minlvl, Level maxlvl) {
   this->file = fp;
   this->minlevel = minlvl;
@@ -148,6 +154,10 @@ FileLogger::~FileLogger() {
   fclose(this->file);
 }
 
+Level FileLogger::MinLevel() {
+  return this->minlevel;
+}
+
 void FileLogger::do_log(Level lvl, const char *fname, int line, const char *msg) {
   if(lvl >= this->minlevel && lvl < this->maxlevel) {
     char buf[BUFFER_SIZE + 256];
@@ -166,6 +176,10 @@ void PrettyFileLogger::do_log(Level lvl, const char *fname, int line, const char
 
 #if WITH_SYSTEMD == 1
 void SystemdLogger::do_log(Level lvl, const char *fname, int line, const char *msg) {
+	if(lvl < this->minlevel || lvl >= this->maxlevel) {
+		return;
+	}
+	
 	const char *lvl_str;
 	switch(lvl) {
 	case Level::Debug:   lvl_str = SD_DEBUG; break;
@@ -181,8 +195,103 @@ void SystemdLogger::do_log(Level lvl, const char *fname, int line, const char *m
 }
 #endif // WITH_SYSTEMD == 1
 
+AsyncLogger::AsyncLogger(std::shared_ptr<Logger> sink, size_t capacity) :
+	sink(sink),
+	ring(capacity),
+	thread(&AsyncLogger::Run, this) {
+}
+
+AsyncLogger::~AsyncLogger() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condvar.notify_one();
+	thread.join();
+}
+
+void AsyncLogger::do_log(Level lvl, const char *fname, int line, const char *msg) {
+	Record record = {lvl, line, fname, std::min(strlen(msg), BUFFER_SIZE - 1)};
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(sizeof(record) + record.length > ring.size() - used) {
+			dropped++;
+			return;
+		}
+		Put(&record, sizeof(record));
+		Put(msg, record.length);
+	}
+	condvar.notify_one();
+}
+
+Level AsyncLogger::MinLevel() {
+	return sink->MinLevel();
+}
+
+// caller must hold the mutex and have checked for space
+void AsyncLogger::Put(const void *data, size_t size) {
+	size_t write_head = (read_head + used) % ring.size();
+	size_t first = std::min(size, ring.size() - write_head);
+	memcpy(ring.data() + write_head, data, first);
+	memcpy(ring.data(), (const char*) data + first, size - first);
+	used+= size;
+}
+
+// caller must hold the mutex
+void AsyncLogger::Get(void *data, size_t size) {
+	size_t first = std::min(size, ring.size() - read_head);
+	memcpy(data, ring.data() + read_head, first);
+	memcpy((char*) data + first, ring.data(), size - first);
+	read_head = (read_head + size) % ring.size();
+	used-= size;
+}
+
+void AsyncLogger::Run() {
+	char buf[BUFFER_SIZE];
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true) {
+		condvar.wait(lock, [this]() { return used > 0 || dropped > 0 || stopping; });
+		if(dropped > 0) {
+			uint64_t count = dropped;
+			dropped = 0;
+			lock.unlock();
+			snprintf(buf, sizeof(buf), "log buffer full, dropped %lu messages", (unsigned long) count);
+			sink->do_log(Level::Warning, __FILE__, __LINE__, buf);
+			lock.lock();
+			continue;
+		}
+		if(used == 0) { // stopping, and everything's been flushed
+			return;
+		}
+
+		Record record;
+		Get(&record, sizeof(record));
+		Get(buf, record.length); // came from a BUFFER_SIZE buffer in _log, so it fits
+		buf[record.length] = 0;
+		
+		// format and write without holding up anybody who wants to log
+		lock.unlock();
+		sink->do_log(record.lvl, record.fname, record.line, buf);
+		lock.lock();
+	}
+}
+
 void add_log(std::shared_ptr<Logger> l) {
   logs.push_front(l);
+  if(l->MinLevel() < min_level.load()) {
+    min_level = l->MinLevel();
+  }
+}
+
+void remove_log(std::shared_ptr<Logger> l) {
+  logs.remove(l);
+  Level lowest = Level::Max;
+  for(auto &i : logs) {
+    if(i->MinLevel() < lowest) {
+      lowest = i->MinLevel();
+    }
+  }
+  min_level = lowest;
 }
 
 } // namespace log
@@ -20,8 +20,13 @@
 
 #pragma once
 
+#include<atomic>
+#include<condition_variable>
 #include<memory>
+#include<mutex>
 #include<ostream>
+#include<thread>
+#include<vector>
 
 #include "common/config.hpp"
 
@@ -82,14 +87,32 @@ enum class Level {
 	Max
 };
 
+#if TWIB_STRIP_DEBUG_LOGS == 1
+#define TWIB_LOG_STATIC_MIN_LEVEL ::twili::log::Level::Info
+#else
+#define TWIB_LOG_STATIC_MIN_LEVEL ::twili::log::Level::Debug
+#endif
+
+// Messages below every logger's minimum level are dropped before their
+// arguments are even formatted. Levels below TWIB_LOG_STATIC_MIN_LEVEL are
+// compiled out entirely.
 #define LogMessage(lvl, format, ...) \
-	_log(::twili::log::Level::lvl, __FILE__, __LINE__,	\
-			 format, ##__VA_ARGS__);
+	do { \
+		if(::twili::log::Level::lvl >= TWIB_LOG_STATIC_MIN_LEVEL && \
+			 ::twili::log::Level::lvl >= ::twili::log::min_level.load(std::memory_order_relaxed)) { \
+			_log(::twili::log::Level::lvl, __FILE__, __LINE__,	\
+					 format, ##__VA_ARGS__); \
+		} \
+	} while(0)
+
+// lowest level that any logger wants to see
+extern std::atomic<Level> min_level;
 
 class Logger {
  public:
 	virtual ~Logger();
 	virtual void do_log(Level lvl, const char *fname, int line, const char *msg) = 0;
+	virtual Level MinLevel();
  protected:
 	char *format(char *buf, int size, bool use_color, Level lvl, const char *fname, int line, const char *msg);
 };
@@ -100,6 +123,7 @@ class FileLogger : public Logger {
 	virtual ~FileLogger();
 
 	virtual void do_log(Level lvl, const char *fname, int line, const char *msg);
+	virtual Level MinLevel() override;
  protected:
 	FILE *file;
 	Level minlevel;
@@ -123,8 +147,45 @@ class SystemdLogger : public FileLogger {
 };
 #endif // WITH_SYSTEMD == 1
 
+// Hands messages off to another logger on a background thread, so that
+// whoever logged them doesn't wait on the terminal or disk. Messages are
+// kept in a fixed-size ring buffer; if it fills up, new messages are
+// dropped (and counted) rather than blocking.
+class AsyncLogger : public Logger {
+ public:
+	AsyncLogger(std::shared_ptr<Logger> sink, size_t capacity = 0x40000);
+	virtual ~AsyncLogger(); // flushes whatever is left
+
+	virtual void do_log(Level lvl, const char *fname, int line, const char *msg) override;
+	virtual Level MinLevel() override;
+ private:
+	struct Record {
+		Level lvl;
+		int line;
+		const char *fname; // always __FILE__, so it outlives the record
+		size_t length;
+	};
+
+	std::shared_ptr<Logger> sink;
+	std::vector<char> ring;
+	size_t read_head = 0;
+	size_t used = 0;
+	uint64_t dropped = 0;
+	bool stopping = false;
+
+	std::mutex mutex;
+	std::condition_variable condvar;
+	std::thread thread;
+
+	void Put(const void *data, size_t size);
+	void Get(void *data, size_t size);
+	void Run();
+};
+
 void _log(Level lvl, const char *fname, int line, const char *format, ...);
+// Like add_log, these must not race with anybody logging.
 void add_log(std::shared_ptr<Logger> l);
+void remove_log(std::shared_ptr<Logger> l);
 void init_color();
 
 } // namespace log
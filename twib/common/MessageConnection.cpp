@@ -20,23 +20,33 @@
 
 #include "MessageConnection.hpp"
 
+#include<algorithm>
+
+#include "BufferPool.hpp"
+#include "Compression.hpp"
+
 namespace twili {
 namespace twib {
 namespace common {
 
-MessageConnection::MessageConnection() : out_buffer_sema(1) {
+MessageConnection::MessageConnection() : out_queue_sema(1) {
 }
 
 MessageConnection::~MessageConnection() {
 }
 
 MessageConnection::Request *MessageConnection::Process() {
-	while(in_buffer.ReadAvailable() > 0 || RequestInput()) {
+	while(true) {
 		if(!has_current_mh) {
 			if(in_buffer.Read(current_rq.mh)) {
 				has_current_mh = true;
-				current_rq.payload.Clear();
-				has_current_payload = false;
+				if(current_rq.payload.capacity() == 0) { // moved out by the last caller
+					current_rq.payload = BufferPool::Acquire();
+				}
+				current_rq.payload.clear();
+				current_rq.payload.resize(current_rq.mh.payload_size);
+				current_rq.object_ids.Clear();
+				payload_received = 0;
 			} else {
 				in_buffer.Reserve(sizeof(protocol::MessageHeader));
 				if(RequestInput()) { continue; }
@@ -44,12 +54,11 @@ MessageConnection::Request *MessageConnection::Process() {
 			}
 		}
 
-		if(!has_current_payload) {
-			if(in_buffer.Read(current_rq.payload, current_rq.mh.payload_size)) {
-				has_current_payload = true;
-				current_rq.object_ids.Clear();
-			} else {
-				in_buffer.Reserve(current_rq.mh.payload_size);
+		if(payload_received < current_rq.mh.payload_size) {
+			size_t size = std::min(in_buffer.ReadAvailable(), (size_t) (current_rq.mh.payload_size - payload_received));
+			in_buffer.Read(current_rq.payload.data() + payload_received, size);
+			payload_received+= size;
+			if(payload_received < current_rq.mh.payload_size) {
 				if(RequestInput()) { continue; }
 				return nullptr;
 			}
@@ -57,7 +66,11 @@ MessageConnection::Request *MessageConnection::Process() {
 
 		if(in_buffer.Read(current_rq.object_ids, current_rq.mh.object_count * sizeof(uint32_t))) {
 			has_current_mh = false;
-			has_current_payload = false;
+			if(compression && !protocol::DecompressPayload(current_rq.mh, current_rq.payload)) {
+				LogMessage(Error, "failed to decompress message payload");
+				error_flag = true;
+				return nullptr;
+			}
 			return &current_rq;
 		} else {
 			in_buffer.Reserve(current_rq.mh.object_count * sizeof(uint32_t));
@@ -65,19 +78,105 @@ MessageConnection::Request *MessageConnection::Process() {
 			return nullptr;
 		}
 	}
-	return nullptr;
 }
 
-void MessageConnection::SendMessage(const protocol::MessageHeader &mh, const std::vector<uint8_t> &payload, const std::vector<uint32_t> &object_ids) {
+std::tuple<uint8_t*, size_t> MessageConnection::ReserveInput(size_t hint) {
+	if(has_current_mh && in_buffer.ReadAvailable() == 0) {
+		size_t remaining = current_rq.mh.payload_size - payload_received;
+		// small remainders go through in_buffer so we can pick up the
+		// next header in the same read
+		if(remaining >= hint) {
+			input_direct = true;
+			return std::make_tuple(current_rq.payload.data() + payload_received, remaining);
+		}
+	}
+	input_direct = false;
+	return in_buffer.Reserve(hint);
+}
+
+void MessageConnection::MarkInputWritten(size_t size) {
+	if(input_direct) {
+		payload_received+= size;
+	} else {
+		in_buffer.MarkWritten(size);
+	}
+}
+
+void MessageConnection::SendMessage(const protocol::MessageHeader &mh, std::vector<uint8_t> payload, std::vector<uint32_t> object_ids) {
+	protocol::MessageHeader out_mh = mh;
+	if(compression) {
+		protocol::CompressPayload(out_mh, payload);
+	}
 	{
-		std::lock_guard<Semaphore> lock(out_buffer_sema);
-		out_buffer.Write(mh);
-		out_buffer.Write(payload);
-		out_buffer.Write(object_ids);
+		std::lock_guard<Semaphore> lock(out_queue_sema);
+		OutgoingMessage &msg = out_queue.emplace_back();
+		msg.mh = out_mh;
+		msg.payload = std::move(payload);
+		msg.object_ids = std::move(object_ids);
+		out_size+= msg.GetSize();
 	}
 	RequestOutput();
 }
 
+void MessageConnection::EnableCompression() {
+	compression = true;
+}
+
+size_t MessageConnection::GetOutputSize() {
+	std::lock_guard<Semaphore> lock(out_queue_sema);
+	return out_size;
+}
+
+bool MessageConnection::HasOutput() {
+	return out_head < out_queue.size();
+}
+
+size_t MessageConnection::GatherOutput(std::tuple<const uint8_t*, size_t> *fragments, size_t max_fragments) {
+	size_t count = 0;
+	size_t skip = out_offset;
+	for(auto i = out_queue.begin() + out_head; i != out_queue.end() && count < max_fragments; i++) {
+		std::tuple<const uint8_t*, size_t> parts[] = {
+			{(const uint8_t*) &i->mh, sizeof(i->mh)},
+			{i->payload.data(), i->payload.size()},
+			{(const uint8_t*) i->object_ids.data(), i->object_ids.size() * sizeof(uint32_t)},
+		};
+		for(auto &part : parts) {
+			if(skip >= std::get<1>(part)) { // also skips empty parts
+				skip-= std::get<1>(part);
+				continue;
+			}
+			if(count >= max_fragments) {
+				break;
+			}
+			fragments[count++] = std::make_tuple(std::get<0>(part) + skip, std::get<1>(part) - skip);
+			skip = 0;
+		}
+	}
+	return count;
+}
+
+void MessageConnection::MarkOutputWritten(size_t size) {
+	out_size-= size;
+	out_offset+= size;
+	while(out_head < out_queue.size() && out_offset >= out_queue[out_head].GetSize()) {
+		out_offset-= out_queue[out_head].GetSize();
+		BufferPool::Release(std::move(out_queue[out_head].payload));
+		out_head++;
+	}
+	if(out_head == out_queue.size()) {
+		out_queue.clear();
+		out_head = 0;
+	} else if(out_head >= 64 && out_head * 2 >= out_queue.size()) {
+		// don't let a queue that never quite drains grow without bound
+		out_queue.erase(out_queue.begin(), out_queue.begin() + out_head);
+		out_head = 0;
+	}
+}
+
+size_t MessageConnection::OutgoingMessage::GetSize() const {
+	return sizeof(mh) + payload.size() + object_ids.size() * sizeof(uint32_t);
+}
+
 } // namespace common
 } // namespace twib
 } // namespace twili
@@ -20,9 +20,12 @@
 
 #pragma once
 
+#include<atomic>
 #include<mutex>
 #include<memory>
 #include<optional>
+#include<tuple>
+#include<vector>
 
 #include "Semaphore.hpp"
 #include "Protocol.hpp"
@@ -41,30 +44,77 @@ class MessageConnection {
 	class Request {
 	 public:
 		protocol::MessageHeader mh;
-		util::Buffer payload;
+		// Callers may move the payload out of the request; it is not
+		// reused after Process() returns the next message. Payloads come
+		// from BufferPool, so hand them back to it when you're done.
+		std::vector<uint8_t> payload;
 		util::Buffer object_ids;
 	};
 
 	// The use of a pointer here is truly lamentable. I would've much preferred to use std::optional<Request&>
 	Request *Process(); // NULL pointer means no message
 
-	void SendMessage(const protocol::MessageHeader &mh, const std::vector<uint8_t> &payload, const std::vector<uint32_t> &object_ids);
+	// The payload and object IDs are queued as-is and written out from
+	// there, so move them in if you don't need them anymore. The payload is
+	// released to BufferPool once it has been written.
+	void SendMessage(const protocol::MessageHeader &mh, std::vector<uint8_t> payload, std::vector<uint32_t> object_ids);
+
+	// Call once the peer has agreed to compression. From then on, payloads in
+	// the compressible size range are sent compressed, and compressed
+	// payloads are expanded before Process() returns them.
+	void EnableCompression();
+
+	// Bytes queued by SendMessage that haven't been written out yet.
+	size_t GetOutputSize();
 
 	bool error_flag = false;
  protected:
-	util::Buffer in_buffer;
+	// Returns somewhere to put incoming data, and how much of it we want.
+	// While a large payload is being received, this points straight into
+	// the payload of the message being assembled so it doesn't need to be
+	// copied out of in_buffer afterwards.
+	std::tuple<uint8_t*, size_t> ReserveInput(size_t hint);
+	void MarkInputWritten(size_t size);
 
-	Semaphore out_buffer_sema;
-	util::Buffer out_buffer;
+	// Must hold out_queue_sema for these.
+	bool HasOutput();
+	// Fills fragments with up to max_fragments pieces of pending output, in
+	// the order they should be written.
+	size_t GatherOutput(std::tuple<const uint8_t*, size_t> *fragments, size_t max_fragments);
+	void MarkOutputWritten(size_t size);
+	
+	Semaphore out_queue_sema;
 
 	// these turn true if more data was obtained
 	virtual bool RequestInput() = 0;
 	virtual bool RequestOutput() = 0;
 
  private:
+	class OutgoingMessage {
+	 public:
+		protocol::MessageHeader mh;
+		std::vector<uint8_t> payload;
+		std::vector<uint32_t> object_ids;
+
+		size_t GetSize() const;
+	};
+	
+	util::Buffer in_buffer;
+	bool input_direct = false;
+	
+	// Written messages are dropped from the front by advancing out_head. The
+	// vector keeps its storage once it drains, so a steady trickle of
+	// messages doesn't allocate, which std::deque's node churn does.
+	std::vector<OutgoingMessage> out_queue;
+	size_t out_head = 0; // first unwritten message in out_queue
+	size_t out_offset = 0; // how much of out_queue[out_head] has been written
+	size_t out_size = 0; // total unwritten bytes in out_queue
+	
 	Request current_rq;
 	bool has_current_mh = false;
-	bool has_current_payload = false;
+	size_t payload_received = 0;
+
+	std::atomic<bool> compression = false;
 };
 
 } // namespace common
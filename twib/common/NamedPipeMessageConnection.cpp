@@ -84,7 +84,7 @@ void NamedPipeMessageConnection::InputMember::Signal() {
 	}
 
 	LogMessage(Debug, "got 0x%x bytes in", bytes_transferred);
-	connection.in_buffer.MarkWritten(bytes_transferred);
+	connection.MarkInputWritten(bytes_transferred);
 	connection.is_reading = false;
 }
 
@@ -108,7 +108,7 @@ void NamedPipeMessageConnection::OutputMember::Signal() {
 
 	LogMessage(Debug, "wrote 0x%x bytes", bytes_transferred);
 	connection.out_buffer.MarkRead(bytes_transferred);
-	connection.out_buffer_sema.notify();
+	connection.out_queue_sema.notify();
 	connection.is_writing = false;
 }
 
@@ -125,10 +125,10 @@ bool NamedPipeMessageConnection::RequestInput() {
 	std::lock_guard<std::mutex> guard(state_mutex);
 	if(!is_reading) {
 		LogMessage(Debug, "was in idle state");
-		std::tuple<uint8_t*, size_t> target = in_buffer.Reserve(8192);
+		std::tuple<uint8_t*, size_t> target = ReserveInput(8192);
 		DWORD bytes_read;
 		if(ReadFile(pipe.handle, (void*)std::get<0>(target), std::get<1>(target), &bytes_read, &input_member.overlap)) {
-			in_buffer.MarkWritten(bytes_read);
+			MarkInputWritten(bytes_read);
 			LogMessage(Debug, "completed synchronously");
 			return true;
 		} else {
@@ -151,19 +151,30 @@ bool NamedPipeMessageConnection::RequestOutput() {
 	LogMessage(Debug, "requesting output");
 	std::lock_guard<std::mutex> guard(state_mutex);
 	if(!is_writing) {
-		out_buffer_sema.wait();
-		LogMessage(Debug, "locked out_buffer_lock");
+		out_queue_sema.wait();
+		LogMessage(Debug, "locked out_queue_sema");
+		if(out_buffer.ReadAvailable() == 0) {
+			// WriteFile can't gather, so flatten whatever is queued
+			std::tuple<const uint8_t*, size_t> fragments[platform::Socket::MaxSendFragments];
+			size_t count;
+			while((count = GatherOutput(fragments, platform::Socket::MaxSendFragments)) > 0) {
+				for(size_t i = 0; i < count; i++) {
+					out_buffer.Write(std::get<0>(fragments[i]), std::get<1>(fragments[i]));
+					MarkOutputWritten(std::get<1>(fragments[i]));
+				}
+			}
+		}
 		if(out_buffer.ReadAvailable() > 0) {
 			DWORD bytes_written;
 			if(WriteFile(pipe.handle, (void*)out_buffer.Read(), out_buffer.ReadAvailable(), &bytes_written, &output_member.overlap)) {
 				out_buffer.MarkRead(bytes_written);
-				out_buffer_sema.notify();
+				out_queue_sema.notify();
 				LogMessage(Debug, "completed synchronously");
 				return true;
 			} else {
 				if(GetLastError() != ERROR_IO_PENDING) {
 					error_flag = true;
-					out_buffer_sema.notify();
+					out_queue_sema.notify();
 					LogMessage(Debug, "failed");
 					return false;
 				}
@@ -172,7 +183,7 @@ bool NamedPipeMessageConnection::RequestOutput() {
 				return false;
 			}
 		} else {
-			out_buffer_sema.notify();
+			out_queue_sema.notify();
 		}
 	} else {
 		return false;
@@ -67,6 +67,7 @@ protected:
 private:
 	bool is_reading = false;
 	bool is_writing = false;
+	util::Buffer out_buffer;
 	std::mutex state_mutex;
 	platform::windows::Pipe pipe;
 	platform::EventLoop::Notifier &notifier;
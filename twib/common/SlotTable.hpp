@@ -0,0 +1,144 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<optional>
+#include<utility>
+#include<vector>
+
+#include<stdint.h>
+
+namespace twili {
+namespace twib {
+namespace common {
+
+// Maps keys that we hand out ourselves (request tags, client IDs) to values
+// with O(1) insert and lookup. Keys come from a counter and a value lives in
+// slot (key & mask), so the upper bits of a key act as a generation count:
+// a stale key for a slot that has since been reused won't match. The table
+// is kept at most half full so that finding a free slot rarely takes more
+// than one probe, and it only allocates when it needs to grow.
+//
+// Keys 0 and 0xffffffff are never handed out. Not thread-safe.
+template<typename T>
+class SlotTable {
+ public:
+	// initial_size must be a power of two
+	SlotTable(size_t initial_size = 256) : slots(initial_size), mask(initial_size - 1) {
+	}
+
+	uint32_t Insert(T &&value) {
+		if((count + 1) * 2 > slots.size()) {
+			Grow();
+		}
+		while(true) {
+			uint32_t key = next_key++;
+			if(key == 0 || key == 0xffffffff) {
+				continue;
+			}
+			Slot &slot = slots[key & mask];
+			if(slot.value) {
+				continue;
+			}
+			slot.key = key;
+			slot.value.emplace(std::move(value));
+			count++;
+			return key;
+		}
+	}
+
+	T *Find(uint32_t key) {
+		Slot &slot = slots[key & mask];
+		if(!slot.value || slot.key != key) {
+			return nullptr;
+		}
+		return &*slot.value;
+	}
+
+	std::optional<T> Take(uint32_t key) {
+		Slot &slot = slots[key & mask];
+		if(!slot.value || slot.key != key) {
+			return std::nullopt;
+		}
+		std::optional<T> value = std::move(slot.value);
+		slot.value.reset();
+		count--;
+		return value;
+	}
+
+	// Calls func(key, value) for each entry.
+	template<typename F>
+	void ForEach(F &&func) {
+		for(Slot &slot : slots) {
+			if(slot.value) {
+				func(slot.key, *slot.value);
+			}
+		}
+	}
+
+	std::vector<T> TakeAll() {
+		std::vector<T> values;
+		values.reserve(count);
+		for(Slot &slot : slots) {
+			if(slot.value) {
+				values.emplace_back(std::move(*slot.value));
+				slot.value.reset();
+			}
+		}
+		count = 0;
+		return values;
+	}
+
+	size_t Size() const {
+		return count;
+	}
+	
+ private:
+	struct Slot {
+		uint32_t key = 0;
+		std::optional<T> value;
+	};
+
+	std::vector<Slot> slots;
+	uint32_t mask;
+	uint32_t next_key = 1;
+	size_t count = 0;
+
+	void Grow() {
+		// Keys that are in different slots mod n are also in different
+		// slots mod 2n, so nothing collides here.
+		std::vector<Slot> grown(slots.size() * 2);
+		uint32_t grown_mask = grown.size() - 1;
+		for(Slot &slot : slots) {
+			if(slot.value) {
+				Slot &dst = grown[slot.key & grown_mask];
+				dst.key = slot.key;
+				dst.value = std::move(slot.value);
+			}
+		}
+		slots = std::move(grown);
+		mask = grown_mask;
+	}
+};
+
+} // namespace common
+} // namespace twib
+} // namespace twili
@@ -34,35 +34,46 @@ SocketMessageConnection::ConnectionMember::ConnectionMember(SocketMessageConnect
 }
 
 bool SocketMessageConnection::ConnectionMember::WantsRead() {
-	return true;
+	return !connection.input_paused;
 }
 
 bool SocketMessageConnection::ConnectionMember::WantsWrite() {
-	std::lock_guard<Semaphore> lock(connection.out_buffer_sema); // ReadAvailable() might not be atomic
-	return connection.out_buffer.ReadAvailable() > 0;
+	std::lock_guard<Semaphore> lock(connection.out_queue_sema);
+	return connection.HasOutput();
 }
 
 void SocketMessageConnection::ConnectionMember::SignalRead() {
-	std::tuple<uint8_t*, size_t> target = connection.in_buffer.Reserve(8192);
+	std::tuple<uint8_t*, size_t> target = connection.ReserveInput(8192);
 	ssize_t r = socket.Recv(std::get<0>(target), std::get<1>(target), 0);
 	if(r <= 0) {
 		connection.error_flag = true;
 	} else {
-		connection.in_buffer.MarkWritten(r);
+		connection.MarkInputWritten(r);
 	}
 }
 
 void SocketMessageConnection::ConnectionMember::SignalWrite() {
-	LogMessage(Debug, "pumping out 0x%lx bytes", connection.out_buffer.ReadAvailable());
-	std::lock_guard<Semaphore> lock(connection.out_buffer_sema);
-	if(connection.out_buffer.ReadAvailable() > 0) {
-		ssize_t r = socket.Send(connection.out_buffer.Read(), connection.out_buffer.ReadAvailable(), 0);
+	std::lock_guard<Semaphore> lock(connection.out_queue_sema);
+	std::tuple<const uint8_t*, size_t> fragments[platform::Socket::MaxSendFragments];
+	size_t count = connection.GatherOutput(fragments, platform::Socket::MaxSendFragments);
+	LogMessage(Debug, "pumping out %zu fragments", count);
+	if(count > 0) {
+#ifdef MSG_DONTWAIT
+		// a peer that isn't reading shouldn't be able to stall the whole event thread
+		int flags = MSG_DONTWAIT;
+#else
+		int flags = 0;
+#endif
+		ssize_t r = socket.SendV(fragments, count, flags);
 		if(r < 0) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				return;
+			}
 			connection.error_flag = true;
 			return;
 		}
 		if(r > 0) {
-			connection.out_buffer.MarkRead(r);
+			connection.MarkOutputWritten(r);
 		}
 	}
 }
@@ -78,6 +89,7 @@ bool SocketMessageConnection::RequestInput() {
 }
 
 bool SocketMessageConnection::RequestOutput() {
+	member.RequestInterestUpdate();
 	notifier.Notify();
 	return false;
 }
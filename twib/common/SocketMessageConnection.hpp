@@ -47,6 +47,10 @@ class SocketMessageConnection : public MessageConnection {
 		SocketMessageConnection &connection;
 	} member;
 
+	// Stops reading from the socket while set. Only touch this from the
+	// event thread, then call member.RequestInterestUpdate().
+	bool input_paused = false;
+
  protected:
 	virtual bool RequestInput() override;
 	virtual bool RequestOutput() override;
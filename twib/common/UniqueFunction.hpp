@@ -0,0 +1,156 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<cstddef>
+#include<new>
+#include<type_traits>
+#include<utility>
+
+namespace twili {
+namespace twib {
+namespace common {
+
+template<typename Signature>
+class UniqueFunction;
+
+// Like std::function, but move-only, so it can hold move-only callables, and
+// with enough inline storage that the usual lambdas that capture a few
+// references or a std::function don't need a heap allocation.
+template<typename R, typename... Args>
+class UniqueFunction<R(Args...)> {
+ public:
+	static constexpr size_t InlineSize = 64;
+
+	UniqueFunction() = default;
+	UniqueFunction(std::nullptr_t) {
+	}
+
+	template<typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, UniqueFunction>::value>>
+	UniqueFunction(F &&f) {
+		using T = std::decay_t<F>;
+		if constexpr(IsInline<T>()) {
+			new (&storage) T(std::forward<F>(f));
+		} else {
+			new (&storage) T*(new T(std::forward<F>(f)));
+		}
+		ops = &OpsFor<T>;
+	}
+
+	UniqueFunction(UniqueFunction &&other) noexcept {
+		MoveFrom(other);
+	}
+
+	UniqueFunction &operator=(UniqueFunction &&other) noexcept {
+		if(this != &other) {
+			Reset();
+			MoveFrom(other);
+		}
+		return *this;
+	}
+
+	UniqueFunction(const UniqueFunction &other) = delete;
+	UniqueFunction &operator=(const UniqueFunction &other) = delete;
+
+	~UniqueFunction() {
+		Reset();
+	}
+
+	R operator()(Args... args) {
+		return ops->invoke(&storage, std::forward<Args>(args)...);
+	}
+
+	explicit operator bool() const {
+		return ops != nullptr;
+	}
+
+ private:
+	struct Ops {
+		R (*invoke)(void *storage, Args&&... args);
+		void (*move)(void *dst, void *src); // also destroys src
+		void (*destroy)(void *storage);
+	};
+
+	template<typename T>
+	static constexpr bool IsInline() {
+		return sizeof(T) <= InlineSize &&
+			alignof(T) <= alignof(std::max_align_t) &&
+			std::is_nothrow_move_constructible<T>::value;
+	}
+
+	template<typename T>
+	static T &Get(void *storage) {
+		if constexpr(IsInline<T>()) {
+			return *std::launder(reinterpret_cast<T*>(storage));
+		} else {
+			return **std::launder(reinterpret_cast<T**>(storage));
+		}
+	}
+
+	template<typename T>
+	static R Invoke(void *storage, Args&&... args) {
+		return Get<T>(storage)(std::forward<Args>(args)...);
+	}
+
+	template<typename T>
+	static void Move(void *dst, void *src) {
+		if constexpr(IsInline<T>()) {
+			new (dst) T(std::move(Get<T>(src)));
+			Get<T>(src).~T();
+		} else {
+			new (dst) T*(&Get<T>(src)); // just steal the pointer
+		}
+	}
+
+	template<typename T>
+	static void Destroy(void *storage) {
+		if constexpr(IsInline<T>()) {
+			Get<T>(storage).~T();
+		} else {
+			delete &Get<T>(storage);
+		}
+	}
+
+	template<typename T>
+	static constexpr Ops OpsFor = {&Invoke<T>, &Move<T>, &Destroy<T>};
+
+	void MoveFrom(UniqueFunction &other) {
+		if(other.ops) {
+			other.ops->move(&storage, &other.storage);
+			ops = other.ops;
+			other.ops = nullptr;
+		}
+	}
+
+	void Reset() {
+		if(ops) {
+			ops->destroy(&storage);
+			ops = nullptr;
+		}
+	}
+
+	const Ops *ops = nullptr;
+	std::aligned_storage_t<InlineSize, alignof(std::max_align_t)> storage;
+};
+
+} // namespace common
+} // namespace twib
+} // namespace twili
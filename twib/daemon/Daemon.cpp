@@ -27,36 +27,24 @@
 #include<stdlib.h>
 #include<string.h>
 
-#if WITH_SYSTEMD == 1
-#include<systemd/sd-daemon.h>
-#endif
-
-#if WITH_LAUNCHD == 1
-#include<launch.h>
-#endif
+#include<algorithm>
 
 #include<msgpack11.hpp>
-#include<CLI/CLI.hpp>
-
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-#include "NamedPipeFrontend.hpp"
-#endif
 
-#include "SocketFrontend.hpp"
 #include "Protocol.hpp"
 #include "err.hpp"
 
-#include <iostream>
-#include <ostream>
 #include <string>
-#include <csignal>
 
 namespace twili {
 namespace twib {
 namespace daemon {
 
-Daemon::Daemon() :
-	local_client(std::make_shared<LocalClient>(*this))
+Daemon::Daemon(std::chrono::milliseconds request_timeout, size_t dispatch_threads) :
+	local_client(std::make_shared<LocalClient>(*this)),
+	request_timeout(request_timeout),
+	shards(std::max(dispatch_threads, (size_t) 1)),
+	start_time(std::chrono::steady_clock::now())
 // this comma placement is really gross, but for some reason C++ doesn't seem to allow commas at the end of member initializer lists
 #if TWIBD_TCP_BACKEND_ENABLED
 	, tcp(*this)
@@ -66,8 +54,15 @@ Daemon::Daemon() :
 #endif
 #if TWIBD_LIBUSBK_BACKEND_ENABLED
 	, usbk(*this)
+#endif
+#if TWIBD_SIM_BACKEND_ENABLED
+	, sim(*this)
 #endif
 	{
+	// shard 0 is run by whoever calls Process()
+	for(size_t i = 1; i < shards.size(); i++) {
+		shards[i].thread = std::thread(&Daemon::ShardThread, this, std::ref(shards[i]));
+	}
 	AddClient(local_client);
 #if TWIBD_LIBUSB_BACKEND_ENABLED
 	usb.Probe();
@@ -79,16 +74,23 @@ Daemon::Daemon() :
 
 Daemon::~Daemon() {
 	LogMessage(Debug, "destroying twibd");
+	shutting_down = true;
+	for(size_t i = 1; i < shards.size(); i++) {
+		shards[i].queue.enqueue(std::monostate {});
+		shards[i].thread.join();
+	}
 }
 
 void Daemon::AddDevice(std::shared_ptr<Device> device) {
-	std::lock_guard<std::mutex> lock(device_map_mutex);
+	std::unique_lock<std::shared_mutex> lock(device_map_mutex);
 	LogMessage(Info, "adding device with id %08x", device->device_id);
+	backend_counters[device->GetBridgeType()].devices_added++;
 	std::weak_ptr<Device> &entry = devices[device->device_id];
 	std::shared_ptr<Device> entry_lock = entry.lock();
 
 	if(!entry_lock || entry_lock->GetPriority() <= device->GetPriority()) { // don't let tcp devices clobber usb devices
 		entry = device;
+		device->pending_requests.SetTimeout(request_timeout);
 
 		LogMessage(Debug, "resetting objects on new device");
 		local_client->SendRequest(
@@ -97,73 +99,93 @@ void Daemon::AddDevice(std::shared_ptr<Device> device) {
 }
 
 void Daemon::AddClient(std::shared_ptr<Client> client) {
-	std::lock_guard<std::mutex> lock(client_map_mutex);
+	std::unique_lock<std::shared_mutex> lock(client_map_mutex);
 
-	uint32_t client_id;
-	do {
-		client_id = rng();
-	} while(clients.find(client_id) != clients.end());
-	client->client_id = client_id;
-	LogMessage(Info, "adding client with newly assigned id %08x", client_id);
-
-	clients[client_id] = client;
+	client->client_id = clients.Insert(client);
+	LogMessage(Info, "adding client with newly assigned id %08x", client->client_id);
 }
 
 void Daemon::Awaken() {
-	dispatch_queue.enqueue(std::monostate {});
+	shards[0].queue.enqueue(std::monostate {});
 }
 
 void Daemon::PostRequest(Request &&request) {
-	dispatch_queue.enqueue(request);
+	ShardFor(request.device_id).queue.enqueue(std::move(request));
 }
 
 void Daemon::PostResponse(Response &&response) {
-	dispatch_queue.enqueue(response);
+	ShardFor(response.device_id).queue.enqueue(std::move(response));
 }
 
 void Daemon::RemoveClient(std::shared_ptr<Client> client) {
-	std::lock_guard<std::mutex> lock(client_map_mutex);
-	clients.erase(clients.find(client->client_id));
+	std::unique_lock<std::shared_mutex> lock(client_map_mutex);
+	clients.Take(client->client_id);
 	LogMessage(Info, "removing client %08x", client->client_id);
 }
 
 void Daemon::RemoveDevice(std::shared_ptr<Device> device) {
-	std::lock_guard<std::mutex> lock(device_map_mutex);
+	std::unique_lock<std::shared_mutex> lock(device_map_mutex);
 	LogMessage(Info, "removing device %08x", device->device_id);
+	backend_counters[device->GetBridgeType()].devices_removed++;
 	auto i = devices.find(device->device_id);
 	if(i != devices.end()) {
 		devices.erase(i);
 	}
 }
 
+#if TWIBD_SIM_BACKEND_ENABLED
+std::string Daemon::AttachSimulatedDevice(backend::sim::SimDevice::Config config) {
+	return sim.Attach(config);
+}
+#endif
+
 // voodoo
 template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
 template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
 
+Daemon::Shard &Daemon::ShardFor(uint32_t device_id) {
+	return shards[device_id % shards.size()];
+}
+
+void Daemon::ShardThread(Shard &shard) {
+	while(!shutting_down) {
+		Job job;
+		shard.queue.wait_dequeue(job);
+		Dispatch(job);
+	}
+}
+
 void Daemon::Process() {
-	std::variant<std::monostate, Request, Response> v;
-	LogMessage(Debug, "Process: dequeueing job...");
-	dispatch_queue.wait_dequeue(v);
-	LogMessage(Debug, "Process: dequeued job: %d", v.index());
+	Job job;
+	if(request_timeout.count() > 0) {
+		// wake up every so often to time out requests even if nothing
+		// else is going on
+		shards[0].queue.wait_dequeue_timed(job, std::chrono::milliseconds(250));
+	} else {
+		shards[0].queue.wait_dequeue(job);
+	}
+	Dispatch(job);
 
+	if(request_timeout.count() > 0) {
+		ExpireRequests();
+	}
+}
+
+void Daemon::Dispatch(Job &job) {
 	std::visit(overloaded {
 			[&](std::monostate &ms) {
 				// just a wake-up signal
 			},
 			[&](Request &rq) {
-				LogMessage(Debug, "dispatching request");
-				LogMessage(Debug, "  client id: %08x", rq.client->client_id);
-				LogMessage(Debug, "  device id: %08x", rq.device_id);
-				LogMessage(Debug, "  object id: %08x", rq.object_id);
-				LogMessage(Debug, "  command id: %08x", rq.command_id);
-				LogMessage(Debug, "  tag: %08x", rq.tag);
+				requests_dispatched.fetch_add(1, std::memory_order_relaxed);
+				LogMessage(Debug, "dispatching request: client %08x, device %08x, object 0x%x, command 0x%x, tag 0x%x", rq.client->client_id, rq.device_id, rq.object_id, rq.command_id, rq.tag);
 
 				if(rq.device_id == 0) {
 					PostResponse(HandleRequest(rq));
 				} else {
 					std::shared_ptr<Device> device;
 					{
-						std::lock_guard<std::mutex> lock(device_map_mutex);
+						std::shared_lock<std::shared_mutex> lock(device_map_mutex);
 						auto i = devices.find(rq.device_id);
 						if(i == devices.end()) {
 							PostResponse(rq.RespondError(TWILI_ERR_PROTOCOL_UNRECOGNIZED_DEVICE));
@@ -176,39 +198,22 @@ void Daemon::Process() {
 						}
 					}
 					if(rq.command_id == 0xffffffff) {
-						LogMessage(Debug, "detected close request for 0x%x", rq.object_id);
 						std::shared_ptr<Client> client = rq.client;
 						if(client) {
 							// disown the object that's being closed
-							for(auto i = client->owned_objects.begin(); i != client->owned_objects.end(); ){
-								if((*i)->object_id == rq.object_id) {
-									// need to mark this so that it doesn't send another close request
-									(*i)->valid = false;
-									i = client->owned_objects.erase(i);
-									LogMessage(Debug, "  disowned from client");
-								} else {
-									i++;
-								}
+							if(client->Disown(rq.device_id, rq.object_id)) {
+								LogMessage(Debug, "disowned object 0x%x from client", rq.object_id);
 							}
 						} else {
 							LogMessage(Warning, "failed to locate client for disownership");
 						}
 					}
-					LogMessage(Debug, "sending request via device");
 					device->SendRequest(std::move(rq));
-					LogMessage(Debug, "sent request via device");
 				}
 			},
 			[&](Response &rs) {
-				LogMessage(Debug, "dispatching response");
-				LogMessage(Debug, "  client id: %08x", rs.client_id);
-				LogMessage(Debug, "  object id: %08x", rs.object_id);
-				LogMessage(Debug, "  result code: %08x", rs.result_code);
-				LogMessage(Debug, "  tag: %08x", rs.tag);
-				LogMessage(Debug, "  objects:");
-				for(auto o : rs.objects) {
-					LogMessage(Debug, "    0x%x", o->object_id);
-				}
+				responses_dispatched.fetch_add(1, std::memory_order_relaxed);
+				LogMessage(Debug, "dispatching response: client %08x, object 0x%x, result 0x%x, tag 0x%x, %zu objects", rs.client_id, rs.object_id, rs.result_code, rs.tag, rs.objects.size());
 
 				std::shared_ptr<Client> client = GetClient(rs.client_id);
 				if(!client) {
@@ -217,15 +222,31 @@ void Daemon::Process() {
 				}
 				// add any objects this response included to the client's
 				// owned object list, to keep the BridgeObject object alive
-				client->owned_objects.insert(
-					client->owned_objects.end(),
-					rs.objects.begin(),
-					rs.objects.end());
+				client->Own(rs.objects);
 				client->PostResponse(rs);
 			}
-		}, v);
+		}, job);
+}
 
-	LogMessage(Debug, "finished process loop");
+void Daemon::ExpireRequests() {
+	std::vector<std::shared_ptr<Device>> live_devices;
+	{
+		std::shared_lock<std::shared_mutex> lock(device_map_mutex);
+		for(auto &i : devices) {
+			if(std::shared_ptr<Device> device = i.second.lock()) {
+				live_devices.push_back(device);
+			}
+		}
+	}
+
+	for(auto &device : live_devices) {
+		for(WeakRequest &rq : device->pending_requests.Expire()) {
+			LogMessage(Warning, "request timed out (device %08x, object 0x%x, command 0x%x)", device->device_id, rq.object_id, rq.command_id);
+			if(rq.client_id != 0xffffffff) {
+				PostResponse(rq.RespondError(TWILI_ERR_PROTOCOL_REQUEST_TIMED_OUT));
+			}
+		}
+	}
 }
 
 Response Daemon::HandleRequest(Request &rq) {
@@ -241,14 +262,15 @@ Response Daemon::HandleRequest(Request &rq) {
 			Response r = rq.RespondOk();
 			std::vector<msgpack11::MsgPack> device_packs;
 			{
-				std::lock_guard<std::mutex> lock(device_map_mutex);
+				std::shared_lock<std::shared_mutex> lock(device_map_mutex);
 				for(auto i = devices.begin(); i != devices.end(); i++) {
 					auto device = i->second.lock();
 					device_packs.push_back(
 						msgpack11::MsgPack::object {
 							{"device_id", device->device_id},
 								{"bridge_type", device->GetBridgeType()},
-									{"identification", device->identification}
+									{"identification", device->identification},
+										{"requests", device->pending_requests.GetStatistics()}
 						});
 				}
 			}
@@ -262,11 +284,22 @@ Response Daemon::HandleRequest(Request &rq) {
 
 			r.payload = response_payload.GetData();
 
+			return r; }
+		case protocol::ITwibMetaInterface::Command::GET_METRICS: {
+			LogMessage(Debug, "command 2 issued to twibd meta object: GET_METRICS");
+			Response r = rq.RespondOk();
+			util::Buffer response_payload;
+
+			std::string ser = CollectMetrics().dump();
+			response_payload.Write<uint64_t>(ser.size());
+			response_payload.Write(ser);
+
+			r.payload = response_payload.GetData();
 			return r; }
 		case protocol::ITwibMetaInterface::Command::CONNECT_TCP: {
 			LogMessage(Debug, "command 1 issued to twibd meta object: CONNECT_TCP");
 
-			util::Buffer buffer(rq.payload);
+			util::Buffer buffer(std::move(rq.payload));
 			uint64_t hostname_len, port_len;
 			std::string hostname, port;
 			if(!buffer.Read<uint64_t>(hostname_len) ||
@@ -292,16 +325,79 @@ Response Daemon::HandleRequest(Request &rq) {
 	}
 }
 
+msgpack11::MsgPack Daemon::CollectMetrics() {
+	msgpack11::MsgPack::array queue_depths;
+	for(Shard &shard : shards) {
+		queue_depths.push_back((uint64_t) shard.queue.size_approx());
+	}
+
+	msgpack11::MsgPack::array device_packs;
+	msgpack11::MsgPack::object backend_packs;
+	{
+		std::shared_lock<std::shared_mutex> lock(device_map_mutex);
+		for(auto &i : devices) {
+			std::shared_ptr<Device> device = i.second.lock();
+			if(!device) {
+				continue;
+			}
+			device_packs.push_back(
+				msgpack11::MsgPack::object {
+					{"device_id", device->device_id},
+					{"bridge_type", device->GetBridgeType()},
+					{"bytes_in", device->bytes_in.load(std::memory_order_relaxed)},
+					{"bytes_out", device->bytes_out.load(std::memory_order_relaxed)},
+					{"requests", device->pending_requests.GetStatistics()},
+					{"commands", device->pending_requests.GetCommandStatistics()},
+				});
+		}
+		for(auto &i : backend_counters) {
+			backend_packs[i.first] = msgpack11::MsgPack::object {
+				{"devices_added", i.second.devices_added},
+				{"devices_removed", i.second.devices_removed},
+			};
+		}
+	}
+
+	msgpack11::MsgPack::array client_packs;
+	{
+		std::shared_lock<std::shared_mutex> lock(client_map_mutex);
+		clients.ForEach([&](uint32_t, std::weak_ptr<Client> &weak) {
+			std::shared_ptr<Client> client = weak.lock();
+			if(!client) {
+				return;
+			}
+			client_packs.push_back(
+				msgpack11::MsgPack::object {
+					{"client_id", client->client_id},
+					{"owned_objects", (uint64_t) client->OwnedObjectCount()},
+					{"output_queued", client->output_queued.load(std::memory_order_relaxed)},
+					{"output_high_water", client->output_high_water.load(std::memory_order_relaxed)},
+					{"output_throttle_count", client->output_throttle_count.load(std::memory_order_relaxed)},
+				});
+		});
+	}
+
+	return msgpack11::MsgPack::object {
+		{"uptime_ms", (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count()},
+		{"requests_dispatched", requests_dispatched.load(std::memory_order_relaxed)},
+		{"responses_dispatched", responses_dispatched.load(std::memory_order_relaxed)},
+		{"dispatch_queue_depths", queue_depths},
+		{"devices", device_packs},
+		{"backends", backend_packs},
+		{"clients", client_packs},
+	};
+}
+
 std::shared_ptr<Client> Daemon::GetClient(uint32_t client_id) {
 	std::shared_ptr<Client> client;
 	{
-		std::lock_guard<std::mutex> lock(client_map_mutex);
-		auto i = clients.find(client_id);
-		if(i == clients.end()) {
+		std::shared_lock<std::shared_mutex> lock(client_map_mutex);
+		std::weak_ptr<Client> *weak = clients.Find(client_id);
+		if(!weak) {
 			LogMessage(Debug, "client id 0x%x is not in map", client_id);
 			return std::shared_ptr<Client>();
 		}
-		client = i->second.lock();
+		client = weak->lock();
 		if(!client) {
 			LogMessage(Debug, "client id 0x%x weak pointer expired", client_id);
 			return std::shared_ptr<Client>();
@@ -314,216 +410,6 @@ std::shared_ptr<Client> Daemon::GetClient(uint32_t client_id) {
 	return client;
 }
 
-#if TWIB_TCP_FRONTEND_ENABLED == 1
-static std::shared_ptr<frontend::SocketFrontend> CreateTCPFrontend(Daemon &daemon, uint16_t port) {
-	struct sockaddr_in6 addr;
-	memset(&addr, 0, sizeof(addr));
-	addr.sin6_family = AF_INET6;
-	addr.sin6_port = htons(port);
-	addr.sin6_addr = in6addr_any;
-	return std::make_shared<frontend::SocketFrontend>(daemon, AF_INET6, SOCK_STREAM, (struct sockaddr*) &addr, sizeof(addr));
-}
-#endif
-
-#if TWIB_UNIX_FRONTEND_ENABLED == 1
-static std::shared_ptr<frontend::SocketFrontend> CreateUNIXFrontend(Daemon &daemon, std::string path) {
-	struct sockaddr_un addr;
-	memset(&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
-	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
-	return std::make_shared<frontend::SocketFrontend>(daemon, AF_UNIX, SOCK_STREAM, (struct sockaddr*) &addr, sizeof(addr));
-}
-#endif
-
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-static std::shared_ptr<frontend::NamedPipeFrontend> CreateNamedPipeFrontend(Daemon &daemon) {
-	return std::make_shared<frontend::NamedPipeFrontend>(daemon, "foo");
-}
-#endif
-
 } // namespace daemon
 } // namespace twib
 } // namespace twili
-
-using namespace twili;
-using namespace twili::twib;
-
-daemon::Daemon *g_Daemon;
-std::sig_atomic_t g_Running;
-
-extern "C" void sigint_handler(int) {
-	g_Running = 0;
-	g_Daemon->Awaken();
-}
-
-int main(int argc, char *argv[]) {
-#ifdef _WIN32
-	WSADATA wsaData;
-	int err;
-	err = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (err != 0) {
-		printf("WSASStartup failed with error: %d\n", err);
-		return 1;
-	}
-#endif
-
-	CLI::App app {"Twili debug monitor daemon"};
-
-	int verbosity = 3;
-	app.add_flag("-v,--verbose", verbosity, "Enable verbose messages. Use twice to enable debug messages");
-
-	bool systemd_mode = false;
-#if WITH_SYSTEMD == 1
-	app.add_flag("--systemd", systemd_mode, "Log in systemd format and obtain sockets from systemd (disables unix and tcp frontends)");
-#endif
-
-	bool launchd_mode = false;
-#if WITH_LAUNCHD == 1
-	app.add_flag("--launchd", launchd_mode, "Obtain sockets from launchd (disables unix and tcp frontends)");
-#endif
-
-#if TWIB_UNIX_FRONTEND_ENABLED == 1
-	bool unix_frontend_enabled = true;
-	app.add_flag_function(
-		"--unix",
-		[&unix_frontend_enabled](int count) {
-			unix_frontend_enabled = true;
-		}, "Enable UNIX socket frontend");
-	app.add_flag_function(
-		"--no-unix",
-		[&unix_frontend_enabled](int count) {
-			unix_frontend_enabled = false;
-		}, "Disable UNIX socket frontend");
-	std::string unix_frontend_path = TWIB_UNIX_FRONTEND_DEFAULT_PATH;
-	app.add_option(
-		"-P,--unix-path", unix_frontend_path,
-		"Path for the twibd UNIX socket frontend")
-		->envname("TWIB_UNIX_FRONTEND_PATH");
-#endif
-
-#if TWIB_TCP_FRONTEND_ENABLED == 1
-	bool tcp_frontend_enabled = true;
-	app.add_flag_function(
-		"--tcp",
-		[&tcp_frontend_enabled](int count) {
-			tcp_frontend_enabled = true;
-		}, "Enable TCP socket frontend");
-	app.add_flag_function(
-		"--no-tcp",
-		[&tcp_frontend_enabled](int count) {
-			tcp_frontend_enabled = false;
-		}, "Disable TCP socket frontend");
-	uint16_t tcp_frontend_port;
-	app.add_option(
-		"-p,--tcp-port", tcp_frontend_port,
-		"Port for the twibd TCP socket frontend")
-		->envname("TWIB_TCP_FRONTEND_PORT");
-#endif
-
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-	bool named_pipe_frontend_enabled = true;
-	app.add_flag_function(
-		"--named-pipe",
-		[&named_pipe_frontend_enabled](int count) {
-			named_pipe_frontend_enabled = true;
-		}, "Enable named pipe frontend");
-	app.add_flag_function(
-		"--no-named-pipe",
-		[&named_pipe_frontend_enabled](int count) {
-			named_pipe_frontend_enabled = false;
-		}, "Disable named pipe frontend");
-#endif
-
-	try {
-		app.parse(argc, argv);
-	} catch(const CLI::ParseError &e) {
-		return app.exit(e);
-	}
-
-	log::Level min_log_level = log::Level::Message;
-	if(verbosity >= 1) {
-		min_log_level = log::Level::Info;
-	}
-	if(verbosity >= 2) {
-		min_log_level = log::Level::Debug;
-	}
-#if WITH_SYSTEMD == 1
-	if(systemd_mode) {
-		add_log(std::make_shared<log::SystemdLogger>(stderr, min_log_level));
-	}
-#endif
-	if(!systemd_mode) {
-		log::init_color();
-		log::add_log(std::make_shared<log::PrettyFileLogger>(stdout, min_log_level, log::Level::Error));
-		log::add_log(std::make_shared<log::PrettyFileLogger>(stderr, log::Level::Error));
-	}
-
-	LogMessage(Message, "starting twibd");
-	daemon::Daemon daemon;
-	g_Daemon = &daemon;
-	g_Running = true;
-
-	std::vector<std::shared_ptr<daemon::frontend::Frontend>> frontends;
-	if(!systemd_mode && !launchd_mode) {
-#if TWIB_TCP_FRONTEND_ENABLED == 1
-		if(tcp_frontend_enabled) {
-			frontends.push_back(daemon::CreateTCPFrontend(daemon, tcp_frontend_port));
-		}
-#endif
-#if TWIB_UNIX_FRONTEND_ENABLED == 1
-		if(unix_frontend_enabled) {
-			frontends.push_back(daemon::CreateUNIXFrontend(daemon, unix_frontend_path));
-		}
-#endif
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-		if(named_pipe_frontend_enabled) {
-			frontends.push_back(daemon::CreateNamedPipeFrontend(daemon));
-		}
-#endif
-	}
-
-#if WITH_SYSTEMD == 1
-	if(systemd_mode) {
-		int num_fds = sd_listen_fds(false);
-		if(num_fds < 0) {
-			LogMessage(Warning, "failed to get FDs from systemd");
-		} else {
-			LogMessage(Info, "got %d sockets from systemd", num_fds);
-			for(int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + num_fds; fd++) {
-				if(sd_is_socket(fd, 0, SOCK_STREAM, 1) == 1) {
-					frontends.push_back(std::make_shared<daemon::frontend::SocketFrontend>(daemon, platform::Socket(fd)));
-				} else {
-					LogMessage(Warning, "got an FD from systemd that wasn't a SOCK_STREAM: %d", fd);
-				}
-			}
-		}
-		sd_notify(false, "READY=1");
-	}
-#endif
-
-#if WITH_LAUNCHD == 1
-	if(launchd_mode) {
-		int *fds = nullptr;
-		size_t num_fds = 0;
-		int err = launch_activate_socket("twibd-listener", &fds, &num_fds);
-		if(err != 0 || fds == nullptr || num_fds == 0) {
-			LogMessage(Warning, "failed to get FDs from launchd");
-		} else {
-			LogMessage(Info, "got %zu sockets from launchd", num_fds);
-			for(size_t i = 0; i < num_fds; i++) {
-				frontends.push_back(std::make_shared<daemon::frontend::SocketFrontend>(daemon, platform::Socket(fds[i])));
-			}
-		}
-		if(fds != nullptr) {
-			free(fds);
-		}
-	}
-#endif
-
-	std::signal(SIGINT, &sigint_handler);
-
-	while(g_Running) {
-		daemon.Process();
-	}
-	return 0;
-}
@@ -22,17 +22,20 @@
 
 #include "platform/platform.hpp"
 
+#include<chrono>
+#include<atomic>
 #include<list>
 #include<thread>
 #include<mutex>
+#include<shared_mutex>
 #include<variant>
 #include<map>
-#include<random>
 #include<condition_variable>
 
 #include "common/blockingconcurrentqueue.h"
 #include "common/config.hpp"
 #include "common/Logger.hpp"
+#include "common/SlotTable.hpp"
 
 #if TWIBD_TCP_BACKEND_ENABLED
 #include "TCPBackend.hpp"
@@ -43,6 +46,9 @@
 #if TWIBD_LIBUSBK_BACKEND_ENABLED
 #include "USBKBackend.hpp"
 #endif
+#if TWIBD_SIM_BACKEND_ENABLED
+#include "SimBackend.hpp"
+#endif
 
 #include "Messages.hpp"
 #include "Device.hpp"
@@ -55,7 +61,9 @@ namespace daemon {
 
 class Daemon {
  public:
-	Daemon();
+	// Requests that a device hasn't answered within request_timeout are
+	// failed. Zero waits forever.
+	Daemon(std::chrono::milliseconds request_timeout, size_t dispatch_threads);
 	~Daemon();
 
 	void AddDevice(std::shared_ptr<Device> device);
@@ -66,6 +74,9 @@ class Daemon {
 	void RemoveDevice(std::shared_ptr<Device> device);
 	void RemoveClient(std::shared_ptr<Client> client);
 	
+	// Handles one job for the first dispatch shard, which also owns the
+	// meta object and request timeouts. The other shards run on their own
+	// threads.
 	void Process();
 	Response HandleRequest(Request &request);
 	std::shared_ptr<Client> GetClient(uint32_t client_id);
@@ -73,16 +84,50 @@ class Daemon {
 	std::shared_ptr<LocalClient> local_client;
 
 	InitialScanLock initial_scan_lock;
+
+#if TWIBD_SIM_BACKEND_ENABLED
+	// Returns "Ok", or what went wrong.
+	std::string AttachSimulatedDevice(backend::sim::SimDevice::Config config);
+#endif
  private:
-	moodycamel::BlockingConcurrentQueue<std::variant<std::monostate, Request, Response>> dispatch_queue;
+	using Job = std::variant<std::monostate, Request, Response>;
+
+	// Everything for a given device goes through the same shard, so
+	// requests and responses for one device stay in order while different
+	// devices are dispatched in parallel.
+	class Shard {
+	 public:
+		moodycamel::BlockingConcurrentQueue<Job> queue;
+		std::thread thread;
+	};
+	
+	const std::chrono::milliseconds request_timeout;
+	std::vector<Shard> shards;
+	std::atomic<bool> shutting_down = false;
+
+	Shard &ShardFor(uint32_t device_id);
+	void ShardThread(Shard &shard);
+	void Dispatch(Job &job);
+	void ExpireRequests();
+	msgpack11::MsgPack CollectMetrics();
+
+	class BackendCounters {
+	 public:
+		uint64_t devices_added = 0;
+		uint64_t devices_removed = 0;
+	};
+
+	const std::chrono::steady_clock::time_point start_time;
+	std::atomic<uint64_t> requests_dispatched = 0;
+	std::atomic<uint64_t> responses_dispatched = 0;
 	
-	std::mutex device_map_mutex;
+	// looked up for every message, but rarely changed
+	std::shared_mutex device_map_mutex;
 	std::map<uint32_t, std::weak_ptr<Device>> devices;
+	std::map<std::string, BackendCounters> backend_counters; // keyed by bridge type
 	
-	std::mutex client_map_mutex;
-	std::map<uint32_t, std::weak_ptr<Client>> clients;
-
-	std::random_device rng;
+	std::shared_mutex client_map_mutex;
+	common::SlotTable<std::weak_ptr<Client>> clients; // client IDs are keys
 
 #if TWIBD_TCP_BACKEND_ENABLED
 	backend::TCPBackend tcp;
@@ -93,6 +138,9 @@ class Daemon {
 #if TWIBD_LIBUSBK_BACKEND_ENABLED
 	backend::USBKBackend usbk;
 #endif
+#if TWIBD_SIM_BACKEND_ENABLED
+	backend::SimBackend sim;
+#endif
 };
 
 } // namespace daemon
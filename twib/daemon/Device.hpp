@@ -20,11 +20,13 @@
 
 #pragma once
 
+#include<atomic>
 #include<string>
 #include<stdint.h>
 #include<msgpack11.hpp>
 
 #include "Messages.hpp"
+#include "PendingRequestTable.hpp"
 
 namespace twili {
 namespace twib {
@@ -32,7 +34,7 @@ namespace daemon {
 
 class Device {
  public:
-	virtual void SendRequest(const Request &&r) = 0;
+	virtual void SendRequest(Request &&r) = 0;
 	virtual int GetPriority() = 0;
 	virtual std::string GetBridgeType() = 0;
 	
@@ -41,6 +43,14 @@ class Device {
 	std::string serial_number;
 	bool deletion_flag = false;
 	uint32_t device_id;
+	PendingRequestTable pending_requests;
+
+	// Message sizes as seen by twibd, before any compression. Only read for
+	// metrics, so ordering doesn't matter.
+	inline void RecordSent(size_t size) { bytes_out.fetch_add(size, std::memory_order_relaxed); }
+	inline void RecordReceived(size_t size) { bytes_in.fetch_add(size, std::memory_order_relaxed); }
+	std::atomic<uint64_t> bytes_in = 0;
+	std::atomic<uint64_t> bytes_out = 0;
 };
 
 } // namespace daemon
@@ -33,15 +33,10 @@ std::future<Response> LocalClient::SendRequest(Request rq) {
 	std::future<Response> future;
 	{
 		std::lock_guard<std::mutex> lock(response_map_mutex);
-		static std::random_device rng;
-		
-		uint32_t tag = rng();
-		rq.tag = tag;
-		rq.client = shared_from_this();
-		
 		std::promise<Response> promise;
 		future = promise.get_future();
-		response_map[tag] = std::move(promise);
+		rq.tag = response_map.Insert(std::move(promise));
+		rq.client = shared_from_this();
 	}
 
 	daemon.PostRequest(std::move(rq));
@@ -50,18 +45,16 @@ std::future<Response> LocalClient::SendRequest(Request rq) {
 }
 
 void LocalClient::PostResponse(Response &r) {
-	std::promise<Response> promise;
+	std::optional<std::promise<Response>> promise;
 	{
 		std::lock_guard<std::mutex> lock(response_map_mutex);
-		auto it = response_map.find(r.tag);
-		if(it == response_map.end()) {
-			LogMessage(Warning, "dropping response for unknown tag 0x%x", r.tag);
-			return;
-		}
-		promise.swap(it->second);
-		response_map.erase(it);
+		promise = response_map.Take(r.tag);
+	}
+	if(!promise) {
+		LogMessage(Warning, "dropping response for unknown tag 0x%x", r.tag);
+		return;
 	}
-	promise.set_value(r);
+	promise->set_value(std::move(r));
 }
 
 } // namespace daemon
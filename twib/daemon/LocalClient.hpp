@@ -21,10 +21,11 @@
 #pragma once
 
 #include<future>
-#include<map>
 #include<mutex>
 #include<memory>
 
+#include "common/SlotTable.hpp"
+
 #include "Messages.hpp"
 
 namespace twili {
@@ -42,7 +43,7 @@ class LocalClient : public daemon::Client {
 
 	Daemon &daemon;
 
-	std::map<uint32_t, std::promise<Response>> response_map;
+	common::SlotTable<std::promise<Response>> response_map; // tags are keys
 	std::mutex response_map_mutex;
 };
 
@@ -0,0 +1,320 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Daemon.hpp"
+
+#include "common/config.hpp"
+#include "platform/platform.hpp"
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+
+#if WITH_SYSTEMD == 1
+#include<systemd/sd-daemon.h>
+#endif
+
+#if WITH_LAUNCHD == 1
+#include<launch.h>
+#endif
+
+#include<CLI/CLI.hpp>
+
+#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
+#include "NamedPipeFrontend.hpp"
+#endif
+
+#include "SocketFrontend.hpp"
+
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <csignal>
+
+namespace twili {
+namespace twib {
+namespace daemon {
+
+#if TWIB_TCP_FRONTEND_ENABLED == 1
+static std::shared_ptr<frontend::SocketFrontend> CreateTCPFrontend(Daemon &daemon, uint16_t port) {
+	struct sockaddr_in6 addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin6_family = AF_INET6;
+	addr.sin6_port = htons(port);
+	addr.sin6_addr = in6addr_any;
+	return std::make_shared<frontend::SocketFrontend>(daemon, AF_INET6, SOCK_STREAM, (struct sockaddr*) &addr, sizeof(addr));
+}
+#endif
+
+#if TWIB_UNIX_FRONTEND_ENABLED == 1
+static std::shared_ptr<frontend::SocketFrontend> CreateUNIXFrontend(Daemon &daemon, std::string path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+	return std::make_shared<frontend::SocketFrontend>(daemon, AF_UNIX, SOCK_STREAM, (struct sockaddr*) &addr, sizeof(addr));
+}
+#endif
+
+#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
+static std::shared_ptr<frontend::NamedPipeFrontend> CreateNamedPipeFrontend(Daemon &daemon) {
+	return std::make_shared<frontend::NamedPipeFrontend>(daemon, "foo");
+}
+#endif
+
+} // namespace daemon
+} // namespace twib
+} // namespace twili
+
+using namespace twili;
+using namespace twili::twib;
+
+daemon::Daemon *g_Daemon;
+std::sig_atomic_t g_Running;
+
+extern "C" void sigint_handler(int) {
+	g_Running = 0;
+	g_Daemon->Awaken();
+}
+
+int main(int argc, char *argv[]) {
+#ifdef _WIN32
+	WSADATA wsaData;
+	int err;
+	err = WSAStartup(MAKEWORD(2, 2), &wsaData);
+	if (err != 0) {
+		printf("WSASStartup failed with error: %d\n", err);
+		return 1;
+	}
+#endif
+
+	CLI::App app {"Twili debug monitor daemon"};
+
+	int verbosity = 3;
+	app.add_flag("-v,--verbose", verbosity, "Enable verbose messages. Use twice to enable debug messages");
+
+	bool systemd_mode = false;
+#if WITH_SYSTEMD == 1
+	app.add_flag("--systemd", systemd_mode, "Log in systemd format and obtain sockets from systemd (disables unix and tcp frontends)");
+#endif
+
+	bool launchd_mode = false;
+#if WITH_LAUNCHD == 1
+	app.add_flag("--launchd", launchd_mode, "Obtain sockets from launchd (disables unix and tcp frontends)");
+#endif
+
+#if TWIB_UNIX_FRONTEND_ENABLED == 1
+	bool unix_frontend_enabled = true;
+	app.add_flag_function(
+		"--unix",
+		[&unix_frontend_enabled](int count) {
+			unix_frontend_enabled = true;
+		}, "Enable UNIX socket frontend");
+	app.add_flag_function(
+		"--no-unix",
+		[&unix_frontend_enabled](int count) {
+			unix_frontend_enabled = false;
+		}, "Disable UNIX socket frontend");
+	std::string unix_frontend_path = TWIB_UNIX_FRONTEND_DEFAULT_PATH;
+	app.add_option(
+		"-P,--unix-path", unix_frontend_path,
+		"Path for the twibd UNIX socket frontend")
+		->envname("TWIB_UNIX_FRONTEND_PATH");
+#endif
+
+#if TWIB_TCP_FRONTEND_ENABLED == 1
+	bool tcp_frontend_enabled = true;
+	app.add_flag_function(
+		"--tcp",
+		[&tcp_frontend_enabled](int count) {
+			tcp_frontend_enabled = true;
+		}, "Enable TCP socket frontend");
+	app.add_flag_function(
+		"--no-tcp",
+		[&tcp_frontend_enabled](int count) {
+			tcp_frontend_enabled = false;
+		}, "Disable TCP socket frontend");
+	uint16_t tcp_frontend_port;
+	app.add_option(
+		"-p,--tcp-port", tcp_frontend_port,
+		"Port for the twibd TCP socket frontend")
+		->envname("TWIB_TCP_FRONTEND_PORT");
+#endif
+
+#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
+	bool named_pipe_frontend_enabled = true;
+	app.add_flag_function(
+		"--named-pipe",
+		[&named_pipe_frontend_enabled](int count) {
+			named_pipe_frontend_enabled = true;
+		}, "Enable named pipe frontend");
+	app.add_flag_function(
+		"--no-named-pipe",
+		[&named_pipe_frontend_enabled](int count) {
+			named_pipe_frontend_enabled = false;
+		}, "Disable named pipe frontend");
+#endif
+
+	unsigned int request_timeout = 0;
+	app.add_option(
+		"-t,--request-timeout", request_timeout,
+		"Fail requests that a device hasn't answered after this many seconds (0 waits forever)")
+		->envname("TWIBD_REQUEST_TIMEOUT");
+
+	unsigned int dispatch_threads = std::max(1u, std::min(std::thread::hardware_concurrency(), 4u));
+	app.add_option(
+		"-j,--dispatch-threads", dispatch_threads,
+		"Number of threads to dispatch messages on. Messages for different devices may be dispatched in parallel");
+
+	bool async_log = false;
+	app.add_flag("--async-log", async_log, "Write log messages from a background thread, dropping them if it falls behind");
+
+#if TWIBD_SIM_BACKEND_ENABLED == 1
+	std::vector<std::string> sim_roots;
+	app.add_option(
+		"--sim", sim_roots,
+		"Attach a simulated device backed by this directory. May be given more than once");
+	unsigned int sim_latency = 0;
+	app.add_option(
+		"--sim-latency", sim_latency,
+		"Milliseconds simulated devices wait before answering a request");
+	uint64_t sim_bandwidth = 0;
+	app.add_option(
+		"--sim-bandwidth", sim_bandwidth,
+		"Bytes per second simulated devices can send and receive, each way (0 for unlimited)");
+#endif
+
+	try {
+		app.parse(argc, argv);
+	} catch(const CLI::ParseError &e) {
+		return app.exit(e);
+	}
+
+	log::Level min_log_level = log::Level::Message;
+	if(verbosity >= 1) {
+		min_log_level = log::Level::Info;
+	}
+	if(verbosity >= 2) {
+		min_log_level = log::Level::Debug;
+	}
+#if WITH_SYSTEMD == 1
+	if(systemd_mode) {
+		std::shared_ptr<log::Logger> systemd_log = std::make_shared<log::SystemdLogger>(stderr, min_log_level);
+		if(async_log) {
+			systemd_log = std::make_shared<log::AsyncLogger>(systemd_log);
+		}
+		add_log(systemd_log);
+	}
+#endif
+	if(!systemd_mode) {
+		log::init_color();
+		std::shared_ptr<log::Logger> stdout_log = std::make_shared<log::PrettyFileLogger>(stdout, min_log_level, log::Level::Error);
+		if(async_log) {
+			// errors still go out synchronously, so they don't get lost
+			stdout_log = std::make_shared<log::AsyncLogger>(stdout_log);
+		}
+		log::add_log(stdout_log);
+		log::add_log(std::make_shared<log::PrettyFileLogger>(stderr, log::Level::Error));
+	}
+
+	LogMessage(Message, "starting twibd");
+	daemon::Daemon daemon {std::chrono::seconds(request_timeout), dispatch_threads};
+	g_Daemon = &daemon;
+	g_Running = true;
+
+	std::vector<std::shared_ptr<daemon::frontend::Frontend>> frontends;
+	if(!systemd_mode && !launchd_mode) {
+#if TWIB_TCP_FRONTEND_ENABLED == 1
+		if(tcp_frontend_enabled) {
+			frontends.push_back(daemon::CreateTCPFrontend(daemon, tcp_frontend_port));
+		}
+#endif
+#if TWIB_UNIX_FRONTEND_ENABLED == 1
+		if(unix_frontend_enabled) {
+			frontends.push_back(daemon::CreateUNIXFrontend(daemon, unix_frontend_path));
+		}
+#endif
+#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
+		if(named_pipe_frontend_enabled) {
+			frontends.push_back(daemon::CreateNamedPipeFrontend(daemon));
+		}
+#endif
+	}
+
+#if WITH_SYSTEMD == 1
+	if(systemd_mode) {
+		int num_fds = sd_listen_fds(false);
+		if(num_fds < 0) {
+			LogMessage(Warning, "failed to get FDs from systemd");
+		} else {
+			LogMessage(Info, "got %d sockets from systemd", num_fds);
+			for(int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + num_fds; fd++) {
+				if(sd_is_socket(fd, 0, SOCK_STREAM, 1) == 1) {
+					frontends.push_back(std::make_shared<daemon::frontend::SocketFrontend>(daemon, platform::Socket(fd)));
+				} else {
+					LogMessage(Warning, "got an FD from systemd that wasn't a SOCK_STREAM: %d", fd);
+				}
+			}
+		}
+		sd_notify(false, "READY=1");
+	}
+#endif
+
+#if WITH_LAUNCHD == 1
+	if(launchd_mode) {
+		int *fds = nullptr;
+		size_t num_fds = 0;
+		int err = launch_activate_socket("twibd-listener", &fds, &num_fds);
+		if(err != 0 || fds == nullptr || num_fds == 0) {
+			LogMessage(Warning, "failed to get FDs from launchd");
+		} else {
+			LogMessage(Info, "got %zu sockets from launchd", num_fds);
+			for(size_t i = 0; i < num_fds; i++) {
+				frontends.push_back(std::make_shared<daemon::frontend::SocketFrontend>(daemon, platform::Socket(fds[i])));
+			}
+		}
+		if(fds != nullptr) {
+			free(fds);
+		}
+	}
+#endif
+
+#if TWIBD_SIM_BACKEND_ENABLED == 1
+	for(size_t i = 0; i < sim_roots.size(); i++) {
+		daemon::backend::sim::SimDevice::Config config;
+		config.root = sim_roots[i];
+		config.serial_number = "sim-" + std::to_string(i);
+		config.nickname = platform::fs::BaseName(sim_roots[i].c_str());
+		config.latency = std::chrono::milliseconds(sim_latency);
+		config.bandwidth = sim_bandwidth;
+		std::string msg = daemon.AttachSimulatedDevice(config);
+		if(msg != "Ok") {
+			LogMessage(Error, "failed to attach simulated device at %s: %s", sim_roots[i].c_str(), msg.c_str());
+		}
+	}
+#endif
+
+	std::signal(SIGINT, &sigint_handler);
+
+	while(g_Running) {
+		daemon.Process();
+	}
+	return 0;
+}
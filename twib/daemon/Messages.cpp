@@ -29,7 +29,7 @@ Response::Response() {
 
 Response::Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t result_code, uint32_t tag, std::vector<uint8_t> payload) :
 	client_id(client_id), device_id(device_id), object_id(object_id),
-	result_code(result_code), tag(tag), payload(payload) {
+	result_code(result_code), tag(tag), payload(std::move(payload)) {
 }
 
 Response::Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t result_code, uint32_t tag) :
@@ -37,12 +37,36 @@ Response::Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, u
 	result_code(result_code), tag(tag) {
 }
 
+void Client::Own(const std::vector<std::shared_ptr<BridgeObject>> &objects) {
+	std::lock_guard<std::mutex> lock(owned_objects_mutex);
+	for(auto &object : objects) {
+		owned_objects.insert_or_assign(((uint64_t) object->device_id << 32) | object->object_id, object);
+	}
+}
+
+bool Client::Disown(uint32_t device_id, uint32_t object_id) {
+	std::lock_guard<std::mutex> lock(owned_objects_mutex);
+	auto i = owned_objects.find(((uint64_t) device_id << 32) | object_id);
+	if(i == owned_objects.end()) {
+		return false;
+	}
+	// need to mark this so that it doesn't send another close request
+	i->second->valid = false;
+	owned_objects.erase(i);
+	return true;
+}
+
+size_t Client::OwnedObjectCount() {
+	std::lock_guard<std::mutex> lock(owned_objects_mutex);
+	return owned_objects.size();
+}
+
 WeakRequest::WeakRequest() {
 }
 
 WeakRequest::WeakRequest(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, std::vector<uint8_t> payload) :
 	client_id(client_id), device_id(device_id), object_id(object_id),
-	command_id(command_id), tag(tag), payload(payload) {
+	command_id(command_id), tag(tag), payload(std::move(payload)) {
 }
 
 WeakRequest::WeakRequest(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag) :
@@ -63,7 +87,7 @@ Request::Request() {
 
 Request::Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, std::vector<uint8_t> payload) :
 	client(client), device_id(device_id), object_id(object_id),
-	command_id(command_id), tag(tag), payload(payload) {
+	command_id(command_id), tag(tag), payload(std::move(payload)) {
 }
 
 Request::Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag) :
@@ -80,7 +104,9 @@ Response Request::RespondOk() {
 }
 
 WeakRequest Request::Weak() const {
-	return WeakRequest(client ? client->client_id : 0xffffffff, device_id, object_id, command_id, tag, payload);
+	// the payload isn't needed to route a response or fail a request, so
+	// don't drag a copy of it around
+	return WeakRequest(client ? client->client_id : 0xffffffff, device_id, object_id, command_id, tag);
 }
 
 } // namespace daemon
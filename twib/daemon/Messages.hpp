@@ -20,8 +20,11 @@
 
 #pragma once
 
+#include<atomic>
 #include<vector>
 #include<memory>
+#include<mutex>
+#include<unordered_map>
 
 #include<stdint.h>
 
@@ -50,8 +53,26 @@ class Client : public std::enable_shared_from_this<Client> {
  public:
 	uint32_t client_id;
 	bool deletion_flag = false;
+	// implementations are free to move the payload out of r. may be
+	// called from more than one dispatcher thread at once.
 	virtual void PostResponse(Response &r) = 0;
-	std::vector<std::shared_ptr<BridgeObject>> owned_objects;
+
+	// Keeps objects alive for as long as the client holds on to them.
+	void Own(const std::vector<std::shared_ptr<BridgeObject>> &objects);
+	// Forgets an object that the client is closing itself, so that no
+	// extra close request gets sent for it.
+	bool Disown(uint32_t device_id, uint32_t object_id);
+	size_t OwnedObjectCount();
+
+	// Kept up to date by frontends that limit how much output a client can
+	// leave unread, for twib stats.
+	std::atomic<uint64_t> output_queued = 0;
+	std::atomic<uint64_t> output_high_water = 0;
+	std::atomic<uint64_t> output_throttle_count = 0;
+ private:
+	std::mutex owned_objects_mutex;
+	// keyed by device id and object id
+	std::unordered_map<uint64_t, std::shared_ptr<BridgeObject>> owned_objects;
 };
 
 class WeakRequest {
@@ -58,6 +58,7 @@ void NamedPipeFrontend::Client::PostResponse(Response &r) {
 	mh.tag = r.tag;
 	mh.payload_size = r.payload.size();
 	mh.object_count = r.objects.size();
+	mh.flags = 0;
 	
 	std::vector<uint32_t> object_ids(r.objects.size(), 0);
 	std::transform(
@@ -66,7 +67,7 @@ void NamedPipeFrontend::Client::PostResponse(Response &r) {
 			return object->object_id;
 		});
 
-	connection.SendMessage(mh, r.payload, object_ids);
+	connection.SendMessage(mh, std::move(r.payload), std::move(object_ids));
 }
 
 NamedPipeFrontend::Logic::Logic(NamedPipeFrontend &frontend) : frontend(frontend) {
@@ -89,7 +90,7 @@ void NamedPipeFrontend::Logic::Prepare(platform::EventLoop &loop) {
 					rq->mh.object_id,
 					rq->mh.command_id,
 					rq->mh.tag,
-					std::vector<uint8_t>(rq->payload.Read(), rq->payload.Read() + rq->payload.ReadAvailable())));
+					std::move(rq->payload)));
 			LogMessage(Debug, "posted request");
 		}
 
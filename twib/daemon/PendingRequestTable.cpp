@@ -0,0 +1,247 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "PendingRequestTable.hpp"
+
+#include<algorithm>
+
+#include<string.h>
+
+#include "common/Logger.hpp"
+#include "Protocol.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+
+namespace {
+
+const char *const DeviceInterface = "ITwibDeviceInterface";
+const char *const UnknownInterface = "unknown";
+
+// The requests that hand out new objects, and the interfaces of the objects
+// they hand out.
+struct Creation {
+	const char *interface;
+	uint32_t command_id;
+	const char *created;
+};
+
+const Creation Creations[] = {
+	{"ITwibDeviceInterface", (uint32_t) protocol::ITwibDeviceInterface::Command::CREATE_MONITORED_PROCESS, "ITwibProcessMonitor"},
+	{"ITwibDeviceInterface", (uint32_t) protocol::ITwibDeviceInterface::Command::OPEN_NAMED_PIPE, "ITwibPipeReader"},
+	{"ITwibDeviceInterface", (uint32_t) protocol::ITwibDeviceInterface::Command::OPEN_ACTIVE_DEBUGGER, "ITwibDebugger"},
+	{"ITwibDeviceInterface", (uint32_t) protocol::ITwibDeviceInterface::Command::OPEN_FILESYSTEM_ACCESSOR, "ITwibFilesystemAccessor"},
+	{"ITwibDeviceInterface", (uint32_t) protocol::ITwibDeviceInterface::Command::OPEN_CORE_DUMP, "ITwibCoreDump"},
+	{"ITwibProcessMonitor", (uint32_t) protocol::ITwibProcessMonitor::Command::OPEN_STDIN, "ITwibPipeWriter"},
+	{"ITwibProcessMonitor", (uint32_t) protocol::ITwibProcessMonitor::Command::OPEN_STDOUT, "ITwibPipeReader"},
+	{"ITwibProcessMonitor", (uint32_t) protocol::ITwibProcessMonitor::Command::OPEN_STDERR, "ITwibPipeReader"},
+	{"ITwibFilesystemAccessor", (uint32_t) protocol::ITwibFilesystemAccessor::Command::OPEN_FILE, "ITwibFileAccessor"},
+	{"ITwibFilesystemAccessor", (uint32_t) protocol::ITwibFilesystemAccessor::Command::OPEN_DIRECTORY, "ITwibDirectoryAccessor"},
+};
+
+const char *CreatedInterface(const char *interface, uint32_t command_id) {
+	for(const Creation &c : Creations) {
+		if(strcmp(c.interface, interface) == 0 && c.command_id == command_id) {
+			return c.created;
+		}
+	}
+	return UnknownInterface;
+}
+
+} // namespace
+
+PendingRequestTable::PendingRequestTable() : epoch(Clock::now()) {
+	object_interfaces[0] = DeviceInterface;
+}
+
+void PendingRequestTable::SetTimeout(std::chrono::milliseconds timeout) {
+	std::lock_guard<std::mutex> lock(mutex);
+	this->timeout = timeout;
+}
+
+void PendingRequestTable::Add(const Request &rq) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Entry entry;
+	entry.request = rq.Weak();
+	entry.issued = Clock::now();
+	uint32_t client_id = entry.request.client_id;
+	uint64_t key = Key(client_id, rq.tag);
+	if(timeout.count() > 0) {
+		entry.deadline = entry.issued + timeout;
+		// round up so that the slot is never visited before the deadline
+		wheel[(TickOf(*entry.deadline) + 1) % WheelSlots].push_back(key);
+	}
+	if(!entries.insert_or_assign(key, std::move(entry)).second) {
+		LogMessage(Warning, "client 0x%x reused tag 0x%x while it was still in flight", client_id, rq.tag);
+	}
+	peak_in_flight = std::max(peak_in_flight, entries.size());
+}
+
+std::optional<WeakRequest> PendingRequestTable::Complete(uint32_t client_id, uint32_t tag, const std::vector<std::shared_ptr<BridgeObject>> &objects) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto i = entries.find(Key(client_id, tag));
+	if(i == entries.end()) {
+		return std::nullopt;
+	}
+
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - i->second.issued).count();
+	size_t bucket = 0;
+	while(bucket + 1 < LatencyBuckets && ms >= ((uint64_t) 1 << bucket)) {
+		bucket++;
+	}
+	latency_histogram[bucket]++;
+	const WeakRequest &request = i->second.request;
+	const char *interface = InterfaceOf(request.object_id);
+	command_latency_histograms[std::make_pair(interface, request.command_id)][bucket]++;
+	completed++;
+
+	if(request.command_id == 0xffffffff) {
+		if(request.object_id == 0) {
+			// closes everything except object 0
+			object_interfaces.clear();
+			object_interfaces[0] = DeviceInterface;
+		} else {
+			object_interfaces.erase(request.object_id);
+		}
+	}
+	for(const std::shared_ptr<BridgeObject> &object : objects) {
+		object_interfaces[object->object_id] = CreatedInterface(interface, request.command_id);
+	}
+
+	WeakRequest rq = std::move(i->second.request);
+	entries.erase(i);
+	return rq;
+}
+
+std::vector<WeakRequest> PendingRequestTable::Expire() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<WeakRequest> expired;
+	Clock::time_point now = Clock::now();
+	uint64_t now_tick = TickOf(now);
+
+	// if we fell more than a whole rotation behind, every slot is due
+	uint64_t first_tick = std::max(current_tick + 1, now_tick >= WheelSlots ? now_tick - WheelSlots + 1 : 0);
+	for(uint64_t tick = first_tick; tick <= now_tick; tick++) {
+		std::vector<uint64_t> &slot = wheel[tick % WheelSlots];
+		for(auto k = slot.begin(); k != slot.end(); ) {
+			auto i = entries.find(*k);
+			if(i == entries.end() || !i->second.deadline) {
+				k = slot.erase(k); // already completed
+			} else if(*i->second.deadline <= now) {
+				expired.push_back(std::move(i->second.request));
+				entries.erase(i);
+				k = slot.erase(k);
+			} else {
+				k++; // due on a later rotation, or a newer request reusing the tag
+			}
+		}
+	}
+	current_tick = std::max(current_tick, now_tick);
+	timed_out+= expired.size();
+	return expired;
+}
+
+std::vector<WeakRequest> PendingRequestTable::TakeAll() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<WeakRequest> all;
+	for(auto &i : entries) {
+		all.push_back(std::move(i.second.request));
+	}
+	entries.clear();
+	for(auto &slot : wheel) {
+		slot.clear();
+	}
+	return all;
+}
+
+size_t PendingRequestTable::InFlight() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
+
+msgpack11::MsgPack PendingRequestTable::GetStatistics() {
+	std::lock_guard<std::mutex> lock(mutex);
+	msgpack11::MsgPack::array bounds;
+	msgpack11::MsgPack::array histogram;
+	for(size_t i = 0; i < LatencyBuckets; i++) {
+		if(i + 1 < LatencyBuckets) {
+			bounds.push_back((uint64_t) 1 << i);
+		}
+		histogram.push_back(latency_histogram[i]);
+	}
+	return msgpack11::MsgPack::object {
+		{"in_flight", (uint64_t) entries.size()},
+		{"peak_in_flight", (uint64_t) peak_in_flight},
+		{"completed", completed},
+		{"timed_out", timed_out},
+		{"timeout_ms", (int64_t) timeout.count()},
+		{"latency_bounds_ms", bounds},
+		{"latency_histogram", histogram},
+	};
+}
+
+msgpack11::MsgPack PendingRequestTable::GetCommandStatistics() {
+	std::lock_guard<std::mutex> lock(mutex);
+	msgpack11::MsgPack::array commands;
+	for(auto &i : command_latency_histograms) {
+		uint64_t count = 0;
+		for(uint64_t n : i.second) {
+			count+= n;
+		}
+		auto percentile = [&](uint64_t p) {
+			uint64_t seen = 0;
+			for(size_t bucket = 0; bucket < LatencyBuckets; bucket++) {
+				seen+= i.second[bucket];
+				if(seen * 100 >= count * p) {
+					// the last bucket has no upper bound, so this is a lower bound there
+					return (uint64_t) 1 << std::min(bucket, LatencyBuckets - 2);
+				}
+			}
+			return (uint64_t) 1 << (LatencyBuckets - 2);
+		};
+		commands.push_back(msgpack11::MsgPack::object {
+				{"interface", i.first.first},
+				{"command_id", i.first.second},
+				{"count", count},
+				{"p50_ms", percentile(50)},
+				{"p90_ms", percentile(90)},
+				{"p99_ms", percentile(99)},
+			});
+	}
+	return commands;
+}
+
+uint64_t PendingRequestTable::Key(uint32_t client_id, uint32_t tag) {
+	return ((uint64_t) client_id << 32) | tag;
+}
+
+const char *PendingRequestTable::InterfaceOf(uint32_t object_id) {
+	auto i = object_interfaces.find(object_id);
+	return i == object_interfaces.end() ? UnknownInterface : i->second;
+}
+
+uint64_t PendingRequestTable::TickOf(Clock::time_point time) {
+	return (time - epoch) / WheelTick;
+}
+
+} // namespace daemon
+} // namespace twib
+} // namespace twili
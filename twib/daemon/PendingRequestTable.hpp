@@ -0,0 +1,116 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<array>
+#include<chrono>
+#include<map>
+#include<mutex>
+#include<optional>
+#include<string>
+#include<unordered_map>
+#include<vector>
+
+#include<stdint.h>
+#include<msgpack11.hpp>
+
+#include "Messages.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+
+// Requests that have been sent to a device and are waiting on a response,
+// keyed by client and tag. Requests can be given a deadline, tracked with a
+// timer wheel so that checking for expired requests doesn't need to look at
+// every request in flight. Safe to use from multiple threads.
+class PendingRequestTable {
+ public:
+	PendingRequestTable();
+
+	// Applies to requests added after this. Zero means requests never time
+	// out.
+	void SetTimeout(std::chrono::milliseconds timeout);
+
+	void Add(const Request &rq);
+	// Looks up and removes the request that a response belongs to. Returns
+	// nothing if the request already timed out, in which case the response
+	// should be dropped. Objects the response created are remembered as
+	// implementing whatever interface that request hands out.
+	std::optional<WeakRequest> Complete(uint32_t client_id, uint32_t tag, const std::vector<std::shared_ptr<BridgeObject>> &objects);
+	// Removes and returns requests whose deadlines have passed.
+	std::vector<WeakRequest> Expire();
+	// Removes and returns everything, for when the device goes away.
+	std::vector<WeakRequest> TakeAll();
+
+	size_t InFlight();
+	// In-flight depth, completion and timeout counts, and a histogram of
+	// response latencies.
+	msgpack11::MsgPack GetStatistics();
+	// Response count and latency percentiles for each command, by interface
+	// name and command ID. The percentiles are the upper bounds of the
+	// histogram buckets they fall in.
+	msgpack11::MsgPack GetCommandStatistics();
+
+ private:
+	using Clock = std::chrono::steady_clock;
+	static constexpr size_t WheelSlots = 256;
+	static constexpr std::chrono::milliseconds WheelTick = std::chrono::milliseconds(100);
+	// bucket 0 counts latencies under 1 ms, bucket i counts latencies
+	// under 2^i ms, and the last bucket counts everything else
+	static constexpr size_t LatencyBuckets = 18;
+
+	class Entry {
+	 public:
+		WeakRequest request;
+		Clock::time_point issued;
+		std::optional<Clock::time_point> deadline;
+	};
+
+	static uint64_t Key(uint32_t client_id, uint32_t tag);
+	const char *InterfaceOf(uint32_t object_id);
+	uint64_t TickOf(Clock::time_point time);
+
+	std::mutex mutex;
+	std::chrono::milliseconds timeout = std::chrono::milliseconds(0);
+	std::unordered_map<uint64_t, Entry> entries;
+
+	// Slots hold the keys of requests whose deadlines fall within their
+	// tick, or a multiple of WheelSlots ticks later. Keys are left behind
+	// when a request completes and cleaned up when their slot comes around.
+	std::array<std::vector<uint64_t>, WheelSlots> wheel;
+	const Clock::time_point epoch;
+	uint64_t current_tick = 0;
+
+	size_t peak_in_flight = 0;
+	uint64_t completed = 0;
+	uint64_t timed_out = 0;
+	std::array<uint64_t, LatencyBuckets> latency_histogram = {};
+	// Object 0 is always the device interface. Other objects are only known
+	// if we saw the response that created them.
+	std::unordered_map<uint32_t, const char*> object_interfaces;
+	// keyed by interface name and command ID
+	std::map<std::pair<std::string, uint32_t>, std::array<uint64_t, LatencyBuckets>> command_latency_histograms;
+};
+
+} // namespace daemon
+} // namespace twib
+} // namespace twili
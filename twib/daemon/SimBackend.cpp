@@ -0,0 +1,205 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "SimBackend.hpp"
+
+#include "platform/platform.hpp"
+
+#include "Daemon.hpp"
+#include "err.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+
+SimBackend::SimBackend(Daemon &daemon) :
+	daemon(daemon),
+	server_logic(*this),
+	event_loop(server_logic) {
+	event_loop.Begin();
+}
+
+SimBackend::~SimBackend() {
+	event_loop.Destroy();
+	event_loop.Clear(); // devices may outlive us
+}
+
+std::string SimBackend::Attach(sim::SimDevice::Config config) {
+	int fds[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		return platform::NetErrStr();
+	}
+	platform::Socket host_end {platform::File(fds[0])};
+	platform::Socket device_end {platform::File(fds[1])};
+
+	std::shared_ptr<Device> device = std::make_shared<Device>(std::move(host_end), *this);
+	device->sim = std::make_unique<sim::SimDevice>(config, std::move(device_end));
+	LogMessage(Info, "attached simulated device at %s", config.root.c_str());
+
+	{
+		std::unique_lock<std::mutex> lock(devices_mutex);
+		devices.push_back(device);
+	}
+	device->Begin();
+	event_loop.GetNotifier().Notify();
+	return "Ok";
+}
+
+SimBackend::Device::Device(platform::Socket &&socket, SimBackend &backend) :
+	backend(backend),
+	connection(std::move(socket), backend.event_loop.GetNotifier()) {
+}
+
+SimBackend::Device::~Device() {
+	for(auto r : pending_requests.TakeAll()) {
+		if(r.client_id != 0xffffffff) {
+			backend.daemon.PostResponse(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
+		}
+	}
+}
+
+void SimBackend::Device::Begin() {
+	SendRequest(Request(std::shared_ptr<Client>(), 0x0, 0x0, (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY, 0xFFFFFFFF, std::vector<uint8_t>()));
+}
+
+void SimBackend::Device::IncomingMessage(protocol::MessageHeader &mh, std::vector<uint8_t> &&payload, util::Buffer &object_ids) {
+	response_in.device_id = device_id;
+	response_in.client_id = mh.client_id;
+	response_in.object_id = mh.object_id;
+	response_in.result_code = mh.result_code;
+	response_in.tag = mh.tag;
+	response_in.payload = std::move(payload);
+	RecordReceived(sizeof(mh) + response_in.payload.size() + mh.object_count * sizeof(uint32_t));
+
+	// create BridgeObjects
+	response_in.objects.resize(mh.object_count);
+	for(uint32_t i = 0; i < mh.object_count; i++) {
+		uint32_t id;
+		if(!object_ids.Read(id)) {
+			LogMessage(Error, "not enough object IDs");
+			return;
+		}
+		response_in.objects[i] = std::make_shared<BridgeObject>(backend.daemon, device_id, id);
+	}
+
+	// remove from pending requests
+	if(!pending_requests.Complete(response_in.client_id, response_in.tag, response_in.objects)) {
+		LogMessage(Info, "dropping response to request that already timed out");
+		return;
+	}
+
+	if(response_in.client_id == 0xFFFFFFFF) { // identification meta-client
+		Identified(response_in);
+	} else {
+		backend.daemon.PostResponse(std::move(response_in));
+	}
+}
+
+void SimBackend::Device::Identified(Response &r) {
+	if(r.result_code != 0) {
+		LogMessage(Warning, "simulated device identification error: 0x%x", r.result_code);
+		deletion_flag = true;
+		return;
+	}
+	std::string err;
+	msgpack11::MsgPack obj = msgpack11::MsgPack::parse(std::string(r.payload.begin() + 8, r.payload.end()), err);
+	identification = obj;
+	device_nickname = obj["device_nickname"].string_value();
+	serial_number = obj["serial_number"].string_value();
+
+	LogMessage(Info, "nickname: %s", device_nickname.c_str());
+	LogMessage(Info, "serial number: %s", serial_number.c_str());
+
+	device_id = std::hash<std::string>()(serial_number);
+	LogMessage(Info, "assigned device id: %08x", device_id);
+
+	if(obj["protocol"].int_value() >= 4) {
+		connection.EnableCompression();
+	}
+	ready_flag = true;
+}
+
+void SimBackend::Device::SendRequest(Request &&r) {
+	protocol::MessageHeader mhdr;
+	mhdr.client_id = r.client ? r.client->client_id : 0xffffffff;
+	mhdr.object_id = r.object_id;
+	mhdr.command_id = r.command_id;
+	mhdr.tag = r.tag;
+	mhdr.payload_size = r.payload.size();
+	mhdr.object_count = 0;
+	mhdr.flags = protocol::RequestFlags(r.object_id, r.command_id);
+
+	pending_requests.Add(r);
+	RecordSent(sizeof(mhdr) + r.payload.size());
+
+	connection.SendMessage(mhdr, std::move(r.payload), std::vector<uint32_t>());
+}
+
+int SimBackend::Device::GetPriority() {
+	return 0; // anything real wins
+}
+
+std::string SimBackend::Device::GetBridgeType() {
+	return "sim";
+}
+
+SimBackend::ServerLogic::ServerLogic(SimBackend &backend) : backend(backend) {
+}
+
+void SimBackend::ServerLogic::Prepare(platform::EventLoop &loop) {
+	std::unique_lock<std::mutex> lock(backend.devices_mutex);
+	for(auto i = backend.devices.begin(); i != backend.devices.end(); ) {
+		if(!(*i)->member_added_flag) {
+			loop.AddMember((*i)->connection.member);
+			(*i)->member_added_flag = true;
+		}
+
+		common::MessageConnection::Request *rq;
+		while((rq = (*i)->connection.Process()) != nullptr) {
+			(*i)->IncomingMessage(rq->mh, std::move(rq->payload), rq->object_ids);
+		}
+
+		if((*i)->connection.error_flag) {
+			(*i)->deletion_flag = true;
+		}
+
+		if((*i)->deletion_flag) {
+			if((*i)->added_flag) {
+				backend.daemon.RemoveDevice(*i);
+			}
+			loop.RemoveMember((*i)->connection.member);
+			i = backend.devices.erase(i);
+			continue;
+		} else {
+			if((*i)->ready_flag && !(*i)->added_flag) {
+				backend.daemon.AddDevice((*i));
+				(*i)->added_flag = true;
+			}
+		}
+
+		i++;
+	}
+}
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
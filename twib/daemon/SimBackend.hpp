@@ -0,0 +1,98 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "platform/platform.hpp"
+
+#include<list>
+#include<memory>
+#include<mutex>
+
+#include "common/SocketMessageConnection.hpp"
+
+#include "Buffer.hpp"
+#include "Device.hpp"
+#include "Messages.hpp"
+#include "Protocol.hpp"
+#include "SimDevice.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+
+class Daemon;
+
+namespace backend {
+
+// Devices that are simulated inside twibd, for testing and benchmarking
+// without a console. Each one talks the bridge protocol over a socketpair,
+// the same way a TCP device would.
+class SimBackend {
+ public:
+	SimBackend(Daemon &daemon);
+	~SimBackend();
+
+	// Returns "Ok", or what went wrong.
+	std::string Attach(sim::SimDevice::Config config);
+
+	class Device : public daemon::Device, public std::enable_shared_from_this<Device> {
+	 public:
+		Device(platform::Socket &&socket, SimBackend &backend);
+		~Device();
+
+		void Begin();
+		void Identified(Response &r);
+		void IncomingMessage(protocol::MessageHeader &mh, std::vector<uint8_t> &&payload, util::Buffer &object_ids);
+		virtual void SendRequest(Request &&r) override;
+		virtual int GetPriority() override;
+		virtual std::string GetBridgeType() override;
+
+		SimBackend &backend;
+		common::SocketMessageConnection connection;
+		Response response_in;
+		bool ready_flag = false;
+		bool added_flag = false;
+		bool member_added_flag = false;
+
+		// destroyed first, so it hangs up before the connection goes away
+		std::unique_ptr<sim::SimDevice> sim;
+	};
+
+ private:
+	Daemon &daemon;
+	std::mutex devices_mutex;
+	std::list<std::shared_ptr<Device>> devices;
+
+	class ServerLogic : public platform::EventLoop::Logic {
+	 public:
+		ServerLogic(SimBackend &backend);
+		virtual void Prepare(platform::EventLoop &loop) override;
+	 private:
+		SimBackend &backend;
+	} server_logic;
+
+	platform::EventLoop event_loop;
+};
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,365 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "SimDevice.hpp"
+
+#include<algorithm>
+#include<fstream>
+#include<sstream>
+
+#include<stdlib.h>
+#include<string.h>
+
+#include "common/Logger.hpp"
+#include "Compression.hpp"
+#include "err.hpp"
+#include "util.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+namespace sim {
+
+#ifdef MSG_NOSIGNAL
+static const int SendFlags = MSG_NOSIGNAL;
+#else
+static const int SendFlags = 0;
+#endif
+
+SimDevice::SimDevice(Config config, platform::Socket &&socket) :
+	config(config),
+	nickname(config.nickname),
+	serial_number(config.serial_number),
+	socket(std::move(socket)),
+	in_pacer(config.bandwidth),
+	out_pacer(config.bandwidth) {
+	LoadScript();
+	objects[0] = CreateDeviceInterface(*this);
+	read_thread = std::thread(&SimDevice::ReadThread, this);
+	write_thread = std::thread(&SimDevice::WriteThread, this);
+}
+
+SimDevice::~SimDevice() {
+	{
+		std::unique_lock<std::mutex> lock(out_mutex);
+		stopping = true;
+	}
+	out_condvar.notify_all();
+	shutdown(socket.fd, SHUT_RDWR); // kicks the read thread out of recv()
+	read_thread.join();
+	write_thread.join();
+}
+
+SimDevice::Object::~Object() {
+}
+
+uint32_t SimDevice::Response::AddObject(std::shared_ptr<Object> object) {
+	objects.push_back(object);
+	return objects.size() - 1;
+}
+
+void SimDevice::LoadScript() {
+	std::string path = config.root + "/script";
+	std::ifstream script(path);
+	if(!script) {
+		LogMessage(Info, "no script for simulated device at %s", path.c_str());
+		return;
+	}
+
+	std::string line;
+	for(int line_number = 1; std::getline(script, line); line_number++) {
+		std::istringstream words(line);
+		std::string command;
+		if(!(words >> command) || command[0] == '#') {
+			continue;
+		}
+
+		auto number =
+			[&words](uint64_t &out) {
+				std::string word;
+				if(!(words >> word)) {
+					return false;
+				}
+				char *end;
+				out = strtoull(word.c_str(), &end, 0);
+				return *end == 0;
+			};
+		auto rest =
+			[&words]() {
+				std::string str;
+				std::getline(words >> std::ws, str);
+				return str;
+			};
+
+		uint64_t pid;
+		bool ok = true;
+		if(command == "serial") {
+			serial_number = rest();
+		} else if(command == "nickname") {
+			nickname = rest();
+		} else if(command == "process") {
+			Process proc;
+			ok = number(proc.process_id) && number(proc.title_id);
+			proc.name = rest();
+			if(ok) {
+				processes[proc.process_id] = proc;
+			}
+		} else if(command != "region" && command != "module" && command != "thread" &&
+				command != "exception" && command != "exit-thread" && command != "exit-process") {
+			LogMessage(Warning, "%s:%d: unknown command '%s'", path.c_str(), line_number, command.c_str());
+			continue;
+		} else if(!number(pid) || processes.find(pid) == processes.end()) {
+			LogMessage(Warning, "%s:%d: no such process", path.c_str(), line_number);
+			continue;
+		} else if(command == "region" || command == "module") {
+			Process::Region region;
+			uint64_t memory_type = 3, permission = 5; // CODE_STATIC, RX
+			ok = number(region.base) && number(region.size) &&
+				(command == "module" || (number(memory_type) && number(permission)));
+			region.memory_type = memory_type;
+			region.permission = permission;
+			std::string file = rest();
+			if(ok && !file.empty()) {
+				std::optional<std::vector<uint8_t>> data = util::ReadFile((config.root + "/" + file).c_str());
+				if(data) {
+					region.data = std::move(*data);
+				} else {
+					LogMessage(Warning, "%s:%d: couldn't read %s", path.c_str(), line_number, file.c_str());
+				}
+			}
+			region.data.resize(region.size);
+			if(ok) {
+				processes[pid].regions[region.base] = std::move(region);
+			}
+		} else if(command == "thread") {
+			Process::Thread thread = {};
+			ok = number(thread.thread_id) && number(thread.context.pc) && number(thread.context.sp);
+			if(ok) {
+				processes[pid].threads.push_back(thread);
+			}
+		} else if(command == "exception") {
+			Process::Event event;
+			uint64_t type;
+			event.type = Process::Event::Type::Exception;
+			ok = number(event.thread_id) && number(type) && number(event.address);
+			event.exception_type = type;
+			if(ok) {
+				processes[pid].events.push_back(event);
+			}
+		} else if(command == "exit-thread") {
+			Process::Event event;
+			event.type = Process::Event::Type::ExitThread;
+			ok = number(event.thread_id);
+			if(ok) {
+				processes[pid].events.push_back(event);
+			}
+		} else { // exit-process
+			Process::Event event;
+			event.type = Process::Event::Type::ExitProcess;
+			processes[pid].events.push_back(event);
+		}
+
+		if(!ok) {
+			LogMessage(Warning, "%s:%d: bad arguments for '%s'", path.c_str(), line_number, command.c_str());
+		}
+	}
+}
+
+void SimDevice::ReadThread() {
+	while(true) {
+		protocol::MessageHeader mh;
+		if(!RecvAll(&mh, sizeof(mh))) {
+			break;
+		}
+		std::vector<uint8_t> payload(mh.payload_size);
+		std::vector<uint32_t> object_ids(mh.object_count);
+		if(!RecvAll(payload.data(), payload.size()) ||
+			 !RecvAll(object_ids.data(), object_ids.size() * sizeof(uint32_t))) {
+			break;
+		}
+		if(!WaitUntil(in_pacer.Reserve(sizeof(mh) + payload.size() + object_ids.size() * sizeof(uint32_t)))) {
+			break;
+		}
+		if(compression && (mh.flags & protocol::FLAG_COMPRESSED) && !protocol::DecompressPayload(mh, payload)) {
+			LogMessage(Error, "simulated device got a bad compressed payload");
+			break;
+		}
+		Dispatch(mh, std::move(payload));
+	}
+
+	// drop objects here so that they go away on the thread that used them
+	objects.clear();
+	LogMessage(Debug, "simulated device %s disconnected", serial_number.c_str());
+}
+
+void SimDevice::WriteThread() {
+	std::unique_lock<std::mutex> lock(out_mutex);
+	while(true) {
+		out_condvar.wait(lock, [this]() { return stopping || !out_queue.empty(); });
+		if(stopping) {
+			return;
+		}
+
+		std::chrono::steady_clock::time_point due = out_queue.front().due;
+		lock.unlock();
+		if(!WaitUntil(due)) {
+			return;
+		}
+		lock.lock();
+		OutgoingMessage message = std::move(out_queue.front());
+		out_queue.pop_front();
+		lock.unlock();
+
+		size_t object_ids_size = message.object_ids.size() * sizeof(uint32_t);
+		if(!WaitUntil(out_pacer.Reserve(sizeof(message.mh) + message.payload.size() + object_ids_size)) ||
+			 !SendAll(&message.mh, sizeof(message.mh)) ||
+			 !SendAll(message.payload.data(), message.payload.size()) ||
+			 !SendAll(message.object_ids.data(), object_ids_size)) {
+			return;
+		}
+		lock.lock();
+	}
+}
+
+void SimDevice::Dispatch(protocol::MessageHeader &mh, std::vector<uint8_t> &&payload) {
+	Call call;
+	call.client_id = mh.client_id;
+	call.object_id = mh.object_id;
+	call.command_id = mh.command_id;
+	call.tag = mh.tag;
+	call.compress = compression;
+
+	// like Twili, the identify response itself goes out uncompressed
+	if(mh.object_id == 0 && mh.command_id == (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY) {
+		compression = mh.flags == protocol::COMPRESSION_OFFER;
+	}
+
+	Response response;
+	auto i = objects.find(mh.object_id);
+	if(i == objects.end()) {
+		response.result_code = TWILI_ERR_PROTOCOL_UNRECOGNIZED_OBJECT;
+		Respond(call, std::move(response));
+		return;
+	}
+
+	if(mh.command_id == 0xffffffff) {
+		if(mh.object_id == 0) {
+			// closing object 0 closes everything except object 0
+			for(auto j = objects.begin(); j != objects.end(); ) {
+				j = j->first == 0 ? std::next(j) : objects.erase(j);
+			}
+		} else {
+			objects.erase(i);
+		}
+		Respond(call, std::move(response));
+		return;
+	}
+
+	std::shared_ptr<Object> object = i->second; // in case it closes itself
+	util::Buffer in(std::move(payload));
+	if(object->Handle(call, in, response)) {
+		Respond(call, std::move(response));
+	}
+}
+
+void SimDevice::Respond(const Call &call, Response &&response) {
+	OutgoingMessage message;
+	message.due = std::chrono::steady_clock::now() + config.latency;
+	message.mh.client_id = call.client_id;
+	message.mh.object_id = call.object_id;
+	message.mh.result_code = response.result_code;
+	message.mh.tag = call.tag;
+	message.mh.flags = 0;
+	message.payload = response.payload.TakeData();
+	for(std::shared_ptr<Object> &object : response.objects) {
+		uint32_t id = next_object_id++;
+		objects[id] = std::move(object);
+		message.object_ids.push_back(id);
+	}
+	message.mh.payload_size = message.payload.size();
+	message.mh.object_count = message.object_ids.size();
+	if(call.compress) {
+		protocol::CompressPayload(message.mh, message.payload);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(out_mutex);
+		out_queue.push_back(std::move(message));
+	}
+	out_condvar.notify_all();
+}
+
+bool SimDevice::RecvAll(void *data, size_t size) {
+	uint8_t *ptr = (uint8_t*) data;
+	while(size > 0) {
+		ssize_t r = socket.Recv(ptr, size, 0);
+		if(r <= 0) {
+			if(r < 0 && errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		ptr+= r;
+		size-= r;
+	}
+	return true;
+}
+
+bool SimDevice::SendAll(const void *data, size_t size) {
+	const uint8_t *ptr = (const uint8_t*) data;
+	while(size > 0) {
+		ssize_t r = socket.Send(ptr, size, SendFlags);
+		if(r <= 0) {
+			if(r < 0 && errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		ptr+= r;
+		size-= r;
+	}
+	return true;
+}
+
+bool SimDevice::WaitUntil(std::chrono::steady_clock::time_point time) {
+	std::unique_lock<std::mutex> lock(out_mutex);
+	return !out_condvar.wait_until(lock, time, [this]() { return stopping; });
+}
+
+SimDevice::Pacer::Pacer(uint64_t bandwidth) :
+	bandwidth(bandwidth),
+	next(std::chrono::steady_clock::now()) {
+}
+
+std::chrono::steady_clock::time_point SimDevice::Pacer::Reserve(size_t size) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(bandwidth == 0) {
+		return now;
+	}
+	next = std::max(next, now) + std::chrono::nanoseconds(size * UINT64_C(1000000000) / bandwidth);
+	return next;
+}
+
+} // namespace sim
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
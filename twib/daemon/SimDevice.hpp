@@ -0,0 +1,198 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "platform/platform.hpp"
+
+#include<chrono>
+#include<condition_variable>
+#include<deque>
+#include<map>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include "Buffer.hpp"
+#include "Protocol.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+namespace sim {
+
+// Same layout as thread_context_t on the device.
+struct ThreadContext {
+	uint64_t x[31];
+	uint64_t sp, pc;
+	uint32_t psr;
+	uint32_t _pad;
+	uint64_t fpr[32][2];
+	uint32_t fpcr, fpsr;
+	uint64_t tpidr;
+};
+static_assert(sizeof(ThreadContext) == 800, "sizeof(ThreadContext)");
+
+// A process on the simulated device, as described by the device's script.
+// Debuggers work on their own copy, so memory writes and thread context
+// changes only last as long as the debugger does.
+struct Process {
+	struct Region {
+		uint64_t base;
+		uint64_t size;
+		uint32_t memory_type;
+		uint32_t permission;
+		std::vector<uint8_t> data;
+	};
+
+	struct Thread {
+		uint64_t thread_id;
+		ThreadContext context;
+	};
+
+	// Debug events after the initial attach events. One is let out each
+	// time the debugger continues the process.
+	struct Event {
+		enum class Type {
+			ExitThread,
+			Exception,
+			ExitProcess,
+		} type;
+		uint64_t thread_id = 0;
+		uint32_t exception_type = 0;
+		uint64_t address = 0; // new pc and fault register, for exceptions
+	};
+
+	uint64_t process_id;
+	uint64_t title_id = 0;
+	std::string name;
+	std::map<uint64_t, Region> regions; // keyed by base address
+	std::vector<Thread> threads;
+	std::vector<Event> events;
+};
+
+// Stands in for a console running Twili, on the device end of a bridge
+// connection. Requests are read and answered on one thread; responses are
+// written out from another after the configured latency, paced to the
+// configured bandwidth.
+class SimDevice {
+ public:
+	struct Config {
+		std::string root; // holds the script, fs/, and pipes/
+		std::string serial_number;
+		std::string nickname;
+		std::chrono::milliseconds latency = std::chrono::milliseconds(0);
+		uint64_t bandwidth = 0; // bytes per second each way, 0 for unlimited
+	};
+
+	SimDevice(Config config, platform::Socket &&socket);
+	~SimDevice();
+
+	class Object;
+
+	class Call {
+	 public:
+		uint32_t client_id;
+		uint32_t object_id;
+		uint32_t command_id;
+		uint32_t tag;
+		bool compress;
+	};
+
+	class Response {
+	 public:
+		uint32_t result_code = 0;
+		util::Buffer payload;
+		std::vector<std::shared_ptr<Object>> objects;
+
+		// Returns the index to write into the payload.
+		uint32_t AddObject(std::shared_ptr<Object> object);
+	};
+
+	class Object {
+	 public:
+		virtual ~Object();
+		// Returns false if the response will be sent later through Respond().
+		virtual bool Handle(const Call &call, util::Buffer &in, Response &out) = 0;
+	};
+
+	// Only call this from request handlers.
+	void Respond(const Call &call, Response &&response);
+
+	const Config config;
+	std::string nickname;
+	std::string serial_number;
+	std::map<uint64_t, Process> processes;
+ private:
+	class Pacer {
+	 public:
+		Pacer(uint64_t bandwidth);
+		// Returns when a transfer of this size started now would be done.
+		std::chrono::steady_clock::time_point Reserve(size_t size);
+	 private:
+		const uint64_t bandwidth;
+		std::chrono::steady_clock::time_point next;
+	};
+
+	class OutgoingMessage {
+	 public:
+		std::chrono::steady_clock::time_point due;
+		protocol::MessageHeader mh;
+		std::vector<uint8_t> payload;
+		std::vector<uint32_t> object_ids;
+	};
+
+	void LoadScript();
+	void ReadThread();
+	void WriteThread();
+	void Dispatch(protocol::MessageHeader &mh, std::vector<uint8_t> &&payload);
+	bool RecvAll(void *data, size_t size);
+	bool SendAll(const void *data, size_t size);
+	// Returns false if we're shutting down.
+	bool WaitUntil(std::chrono::steady_clock::time_point time);
+
+	platform::Socket socket;
+
+	// only touched by the read thread
+	std::map<uint32_t, std::shared_ptr<Object>> objects;
+	uint32_t next_object_id = 1;
+	bool compression = false;
+	Pacer in_pacer;
+
+	std::mutex out_mutex;
+	std::condition_variable out_condvar;
+	std::deque<OutgoingMessage> out_queue;
+	bool stopping = false;
+	Pacer out_pacer;
+
+	std::thread read_thread;
+	std::thread write_thread;
+};
+
+std::shared_ptr<SimDevice::Object> CreateDeviceInterface(SimDevice &device);
+
+} // namespace sim
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,945 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "SimDevice.hpp"
+
+#include<algorithm>
+#include<deque>
+#include<optional>
+#include<sstream>
+
+#include<dirent.h>
+#include<fcntl.h>
+#include<string.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include<msgpack11.hpp>
+
+#include "common/Logger.hpp"
+#include "err.hpp"
+#include "util.hpp"
+
+// The objects a simulated device hands out. They mirror the interfaces in
+// twili/bridge/interfaces closely enough for twib, backed by the host
+// filesystem and the device's script instead of a console.
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+namespace sim {
+
+namespace {
+
+// result codes that the console's services would give us
+const uint32_t FsPathNotFound = 0x202;
+const uint32_t FsPathAlreadyExists = 0x402;
+const uint32_t KernelNoDebugEvent = 0x8c01;
+const uint32_t KernelInvalidMemoryState = 0xd401;
+
+const size_t DirectoryReadLimit = 32;
+const size_t PipeReadLimit = 0x4000;
+
+using Call = SimDevice::Call;
+using Response = SimDevice::Response;
+
+bool ReadString(util::Buffer &in, std::string &str) {
+	uint64_t size;
+	return in.Read<uint64_t>(size) && size <= in.ReadAvailable() && in.Read(str, size);
+}
+
+template<typename T>
+bool ReadVector(util::Buffer &in, std::vector<T> &vec) {
+	uint64_t count;
+	if(!in.Read<uint64_t>(count) || count > in.ReadAvailable() / sizeof(T)) {
+		return false;
+	}
+	vec.resize(count);
+	return in.Read(vec);
+}
+
+void WriteString(util::Buffer &out, std::string str) {
+	out.Write<uint64_t>(str.size());
+	out.Write(str);
+}
+
+template<typename T>
+void WriteVector(util::Buffer &out, std::vector<T> vec) {
+	out.Write<uint64_t>(vec.size());
+	out.Write(vec);
+}
+
+void WriteMsgPack(util::Buffer &out, const msgpack11::MsgPack &pack) {
+	WriteString(out, pack.dump());
+}
+
+bool BadRequest(Response &out) {
+	out.result_code = TWILI_ERR_PROTOCOL_BAD_REQUEST;
+	return true;
+}
+
+uint32_t ResultFromErrno(int en) {
+	switch(en) {
+	case ENOENT:
+	case ENOTDIR:
+		return FsPathNotFound;
+	case EEXIST:
+		return FsPathAlreadyExists;
+	default:
+		return TWILI_ERR_IO_ERROR;
+	}
+}
+
+// Maps a path on a simulated filesystem onto the host, without letting it
+// climb out of the filesystem's root.
+bool ResolvePath(const std::string &root, const std::string &path, std::string &out) {
+	std::istringstream parts(path);
+	std::string part;
+	out = root;
+	while(std::getline(parts, part, '/')) {
+		if(part.empty() || part == ".") {
+			continue;
+		}
+		if(part == "..") {
+			return false;
+		}
+		out+= "/" + part;
+	}
+	return true;
+}
+
+int RemoveTree(const std::string &path) {
+	struct stat st;
+	if(lstat(path.c_str(), &st) != 0) {
+		return errno;
+	}
+	if(!S_ISDIR(st.st_mode)) {
+		return unlink(path.c_str()) == 0 ? 0 : errno;
+	}
+	DIR *dir = opendir(path.c_str());
+	if(dir == nullptr) {
+		return errno;
+	}
+	std::vector<std::string> names;
+	struct dirent *ent;
+	while((ent = readdir(dir)) != nullptr) {
+		if(strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+			names.push_back(ent->d_name);
+		}
+	}
+	closedir(dir);
+	for(std::string &name : names) {
+		int en = RemoveTree(path + "/" + name);
+		if(en != 0) {
+			return en;
+		}
+	}
+	return rmdir(path.c_str()) == 0 ? 0 : errno;
+}
+
+class FileAccessor : public SimDevice::Object {
+ public:
+	FileAccessor(int fd) : fd(fd) {
+	}
+
+	virtual ~FileAccessor() override {
+		close(fd);
+	}
+
+	virtual bool Handle(const Call &call, util::Buffer &in, Response &out) override {
+		using Command = protocol::ITwibFileAccessor::Command;
+		switch((Command) call.command_id) {
+		case Command::READ: {
+			uint64_t offset, size;
+			if(!in.Read(offset) || !in.Read(size)) {
+				return BadRequest(out);
+			}
+			std::vector<uint8_t> buffer(std::min(size, protocol::ITwibFileAccessor::READ_MAX_SIZE));
+			ssize_t r = pread(fd, buffer.data(), buffer.size(), offset);
+			if(r < 0) {
+				out.result_code = ResultFromErrno(errno);
+				return true;
+			}
+			buffer.resize(r);
+			WriteVector(out.payload, std::move(buffer));
+			return true; }
+		case Command::WRITE: {
+			uint64_t offset;
+			std::vector<uint8_t> data;
+			if(!in.Read(offset) || !ReadVector(in, data)) {
+				return BadRequest(out);
+			}
+			if(pwrite(fd, data.data(), data.size(), offset) != (ssize_t) data.size()) {
+				out.result_code = TWILI_ERR_IO_ERROR;
+			}
+			return true; }
+		case Command::FLUSH:
+			if(fsync(fd) != 0) {
+				out.result_code = TWILI_ERR_IO_ERROR;
+			}
+			return true;
+		case Command::SET_SIZE: {
+			uint64_t size;
+			if(!in.Read(size)) {
+				return BadRequest(out);
+			}
+			if(ftruncate(fd, size) != 0) {
+				out.result_code = ResultFromErrno(errno);
+			}
+			return true; }
+		case Command::GET_SIZE: {
+			struct stat st;
+			if(fstat(fd, &st) != 0) {
+				out.result_code = ResultFromErrno(errno);
+				return true;
+			}
+			out.payload.Write<uint64_t>(st.st_size);
+			return true; }
+		case Command::HASH_BLOCKS: {
+			uint64_t offset, block_size, block_count;
+			if(!in.Read(offset) || !in.Read(block_size) || !in.Read(block_count)) {
+				return BadRequest(out);
+			}
+			using Limits = protocol::ITwibFileAccessor;
+			if(block_size < Limits::HASH_MIN_BLOCK_SIZE || block_size > Limits::HASH_MAX_BLOCK_SIZE ||
+				 block_count > Limits::HASH_MAX_BLOCK_COUNT || block_size * block_count > Limits::HASH_MAX_BYTES) {
+				return BadRequest(out);
+			}
+			struct stat st;
+			if(fstat(fd, &st) != 0) {
+				out.result_code = ResultFromErrno(errno);
+				return true;
+			}
+			uint64_t file_size = st.st_size;
+			std::vector<uint8_t> buffer(block_size);
+			std::vector<uint64_t> hashes;
+			for(uint64_t i = 0; i < block_count && offset < file_size; i++) {
+				size_t size = std::min(block_size, file_size - offset);
+				if(pread(fd, buffer.data(), size, offset) != (ssize_t) size) {
+					out.result_code = TWILI_ERR_IO_ERROR;
+					return true;
+				}
+				hashes.push_back(util::HashBlock(buffer.data(), size));
+				offset+= size;
+			}
+			WriteVector(out.payload, std::move(hashes));
+			return true; }
+		default:
+			out.result_code = TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+			return true;
+		}
+	}
+ private:
+	int fd;
+};
+
+class DirectoryAccessor : public SimDevice::Object {
+ public:
+	// Same layout as idirectoryentry_t on the device.
+	struct DirectoryEntry {
+		char path[0x301];
+		uint8_t attributes;
+		uint32_t entry_type;
+		uint64_t file_size;
+	};
+
+	DirectoryAccessor(std::vector<DirectoryEntry> entries) : entries(std::move(entries)) {
+	}
+
+	virtual bool Handle(const Call &call, util::Buffer &, Response &out) override {
+		using Command = protocol::ITwibDirectoryAccessor::Command;
+		switch((Command) call.command_id) {
+		case Command::READ: {
+			size_t count = std::min(DirectoryReadLimit, entries.size() - position);
+			WriteVector(out.payload, std::vector<DirectoryEntry>(entries.begin() + position, entries.begin() + position + count));
+			position+= count;
+			return true; }
+		case Command::GET_ENTRY_COUNT:
+			out.payload.Write<uint64_t>(entries.size());
+			return true;
+		default:
+			out.result_code = TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+			return true;
+		}
+	}
+ private:
+	std::vector<DirectoryEntry> entries;
+	size_t position = 0;
+};
+
+class FilesystemAccessor : public SimDevice::Object {
+ public:
+	FilesystemAccessor(std::string root) : root(std::move(root)) {
+	}
+
+	virtual bool Handle(const Call &call, util::Buffer &in, Response &out) override {
+		using Command = protocol::ITwibFilesystemAccessor::Command;
+		std::string path, dst;
+		switch((Command) call.command_id) {
+		case Command::CREATE_FILE: {
+			uint32_t mode;
+			uint64_t size;
+			if(!in.Read(mode) || !in.Read(size) || !ReadPath(in, path)) {
+				return BadRequest(out);
+			}
+			int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+			if(fd < 0) {
+				out.result_code = ResultFromErrno(errno);
+				return true;
+			}
+			if(ftruncate(fd, size) != 0) {
+				out.result_code = TWILI_ERR_IO_ERROR;
+			}
+			close(fd);
+			return true; }
+		case Command::DELETE_FILE:
+			if(!ReadPath(in, path)) {
+				return BadRequest(out);
+			}
+			return Check(unlink(path.c_str()), out);
+		case Command::CREATE_DIRECTORY:
+			if(!ReadPath(in, path)) {
+				return BadRequest(out);
+			}
+			return Check(mkdir(path.c_str(), 0755), out);
+		case Command::DELETE_DIRECTORY:
+			if(!ReadPath(in, path)) {
+				return BadRequest(out);
+			}
+			return Check(rmdir(path.c_str()), out);
+		case Command::DELETE_DIRECTORY_RECURSIVELY:
+			if(!ReadPath(in, path)) {
+				return BadRequest(out);
+			}
+			if(int en = RemoveTree(path)) {
+				out.result_code = ResultFromErrno(en);
+			}
+			return true;
+		case Command::RENAME_FILE:
+		case Command::RENAME_DIRECTORY:
+			if(!ReadPath(in, path) || !ReadPath(in, dst)) {
+				return BadRequest(out);
+			}
+			return Check(rename(path.c_str(), dst.c_str()), out);
+		case Command::GET_ENTRY_TYPE: {
+			struct stat st;
+			if(!ReadPath(in, path)) {
+				return BadRequest(out);
+			}
+			if(stat(path.c_str(), &st) != 0) {
+				return Check(-1, out);
+			}
+			out.payload.Write<uint32_t>(S_ISDIR(st.st_mode) ? 0 : 1);
+			return true; }
+		case Command::OPEN_FILE: {
+			uint32_t mode;
+			if(!in.Read(mode) || !ReadPath(in, path)) {
+				return BadRequest(out);
+			}
+			int fd = open(path.c_str(), (mode & 2) ? O_RDWR : O_RDONLY); // OpenMode_Write
+			if(fd < 0) {
+				return Check(-1, out);
+			}
+			out.payload.Write<uint32_t>(out.AddObject(std::make_shared<FileAccessor>(fd)));
+			return true; }
+		case Command::OPEN_DIRECTORY: {
+			if(!ReadPath(in, path)) {
+				return BadRequest(out);
+			}
+			DIR *dir = opendir(path.c_str());
+			if(dir == nullptr) {
+				return Check(-1, out);
+			}
+			std::vector<DirectoryAccessor::DirectoryEntry> entries;
+			struct dirent *ent;
+			while((ent = readdir(dir)) != nullptr) {
+				struct stat st;
+				if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0 ||
+					 stat((path + "/" + ent->d_name).c_str(), &st) != 0) {
+					continue;
+				}
+				DirectoryAccessor::DirectoryEntry entry = {};
+				strncpy(entry.path, ent->d_name, sizeof(entry.path) - 1);
+				entry.entry_type = S_ISDIR(st.st_mode) ? 0 : 1;
+				entry.file_size = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+				entries.push_back(entry);
+			}
+			closedir(dir);
+			out.payload.Write<uint32_t>(out.AddObject(std::make_shared<DirectoryAccessor>(std::move(entries))));
+			return true; }
+		default:
+			out.result_code = TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+			return true;
+		}
+	}
+ private:
+	std::string root;
+
+	bool ReadPath(util::Buffer &in, std::string &path) {
+		std::string device_path;
+		return ReadString(in, device_path) && ResolvePath(root, device_path, path);
+	}
+
+	bool Check(int r, Response &out) {
+		if(r != 0) {
+			out.result_code = ResultFromErrno(errno);
+		}
+		return true;
+	}
+};
+
+// Plays back the contents of a file under pipes/. Each reader gets the
+// whole file to itself.
+class PipeReader : public SimDevice::Object {
+ public:
+	PipeReader(std::vector<uint8_t> data) : data(std::move(data)) {
+	}
+
+	virtual bool Handle(const Call &call, util::Buffer &, Response &out) override {
+		if(call.command_id != (uint32_t) protocol::ITwibPipeReader::Command::READ) {
+			out.result_code = TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+			return true;
+		}
+		if(position == data.size()) {
+			out.result_code = TWILI_ERR_EOF;
+			return true;
+		}
+		size_t size = std::min(PipeReadLimit, data.size() - position);
+		WriteVector(out.payload, std::vector<uint8_t>(data.begin() + position, data.begin() + position + size));
+		position+= size;
+		return true;
+	}
+ private:
+	std::vector<uint8_t> data;
+	size_t position = 0;
+};
+
+// Same layout as memory_info_t on the device.
+struct MemoryInfo {
+	uint64_t base_addr;
+	uint64_t size;
+	uint32_t memory_type;
+	uint32_t memory_attribute;
+	uint32_t permission;
+	uint32_t device_ref_count;
+	uint32_t ipc_ref_count;
+	uint32_t padding;
+};
+
+// Same layout as debug_event_info_t on the device.
+struct DebugEventInfo {
+	enum : uint32_t {
+		AttachProcess = 0,
+		AttachThread = 1,
+		ExitProcess = 2,
+		ExitThread = 3,
+		Exception = 4,
+	};
+	enum : uint32_t {
+		DebuggerAttached = 4,
+		DebuggerBreak = 7,
+	};
+
+	uint32_t event_type;
+	uint32_t flags;
+	uint64_t thread_id;
+	union {
+		struct {
+			uint64_t title_id;
+			uint64_t process_id;
+			char process_name[12];
+			uint32_t mmu_flags;
+			uint64_t user_exception_context_addr;
+		} attach_process;
+		struct {
+			uint64_t thread_id;
+			uint64_t tls_pointer;
+			uint64_t entrypoint;
+		} attach_thread;
+		struct {
+			uint64_t type;
+		} exit;
+		struct {
+			uint32_t exception_type;
+			uint64_t fault_register;
+		} exception;
+		uint8_t padding[0x80];
+	};
+};
+
+struct LoadedModuleInfo {
+	uint8_t build_id[0x20];
+	uint64_t base_addr;
+	uint64_t size;
+};
+
+// Debugs a copy of a scripted process. Attaching queues up the usual attach
+// events, and after that each continue lets out the next event from the
+// script.
+class Debugger : public SimDevice::Object {
+ public:
+	Debugger(SimDevice &device, Process process) : device(device), process(std::move(process)) {
+		DebugEventInfo attach_process = {};
+		attach_process.event_type = DebugEventInfo::AttachProcess;
+		attach_process.attach_process.title_id = this->process.title_id;
+		attach_process.attach_process.process_id = this->process.process_id;
+		strncpy(attach_process.attach_process.process_name, this->process.name.c_str(), sizeof(attach_process.attach_process.process_name));
+		events.push_back(attach_process);
+
+		for(Process::Thread &thread : this->process.threads) {
+			DebugEventInfo attach_thread = {};
+			attach_thread.event_type = DebugEventInfo::AttachThread;
+			attach_thread.thread_id = thread.thread_id;
+			attach_thread.attach_thread.thread_id = thread.thread_id;
+			attach_thread.attach_thread.entrypoint = thread.context.pc;
+			events.push_back(attach_thread);
+		}
+
+		DebugEventInfo attached = {};
+		attached.event_type = DebugEventInfo::Exception;
+		attached.flags = 1;
+		attached.exception.exception_type = DebugEventInfo::DebuggerAttached;
+		events.push_back(attached);
+	}
+
+	virtual bool Handle(const Call &call, util::Buffer &in, Response &out) override {
+		using Command = protocol::ITwibDebugger::Command;
+		switch((Command) call.command_id) {
+		case Command::QUERY_MEMORY: {
+			uint64_t addr;
+			if(!in.Read(addr)) {
+				return BadRequest(out);
+			}
+			MemoryInfo mi = {};
+			auto i = process.regions.upper_bound(addr);
+			if(i != process.regions.begin() && addr - std::prev(i)->first < std::prev(i)->second.size) {
+				Process::Region &region = std::prev(i)->second;
+				mi.base_addr = region.base;
+				mi.size = region.size;
+				mi.memory_type = region.memory_type;
+				mi.permission = region.permission;
+			} else {
+				// unmapped space up to the next region, wrapping at the end
+				mi.base_addr = i == process.regions.begin() ? 0 : std::prev(i)->first + std::prev(i)->second.size;
+				mi.size = (i == process.regions.end() ? 0 : i->first) - mi.base_addr;
+			}
+			out.payload.Write(mi);
+			out.payload.Write<uint32_t>(0); // page info
+			return true; }
+		case Command::READ_MEMORY: {
+			uint64_t addr, size;
+			if(!in.Read(addr) || !in.Read(size)) {
+				return BadRequest(out);
+			}
+			if(!IsMapped(addr, size)) {
+				out.result_code = KernelInvalidMemoryState;
+				return true;
+			}
+			std::vector<uint8_t> data(size);
+			Access(addr, data.data(), size, false);
+			WriteVector(out.payload, std::move(data));
+			return true; }
+		case Command::READ_MEMORY_V: {
+			std::vector<protocol::MemoryRange> ranges;
+			if(!ReadVector(in, ranges)) {
+				return BadRequest(out);
+			}
+			uint64_t total_size = 0;
+			for(protocol::MemoryRange &range : ranges) {
+				if(range.size > protocol::ITwibDebugger::READ_MEMORY_V_MAX_SIZE - total_size) {
+					return BadRequest(out);
+				}
+				total_size+= range.size;
+			}
+			std::vector<uint32_t> results;
+			std::vector<uint8_t> data(total_size);
+			size_t offset = 0;
+			for(protocol::MemoryRange &range : ranges) {
+				if(IsMapped(range.address, range.size)) {
+					Access(range.address, data.data() + offset, range.size, false);
+					offset+= range.size;
+					results.push_back(0);
+				} else {
+					results.push_back(KernelInvalidMemoryState);
+				}
+			}
+			data.resize(offset);
+			WriteVector(out.payload, std::move(results));
+			WriteVector(out.payload, std::move(data));
+			return true; }
+		case Command::WRITE_MEMORY: {
+			uint64_t addr;
+			std::vector<uint8_t> data;
+			if(!in.Read(addr) || !ReadVector(in, data)) {
+				return BadRequest(out);
+			}
+			if(!IsMapped(addr, data.size())) {
+				out.result_code = KernelInvalidMemoryState;
+				return true;
+			}
+			Access(addr, data.data(), data.size(), true);
+			return true; }
+		case Command::GET_DEBUG_EVENT:
+			if(events.empty()) {
+				out.result_code = KernelNoDebugEvent;
+				return true;
+			}
+			out.payload.Write(events.front());
+			events.pop_front();
+			return true;
+		case Command::GET_THREAD_CONTEXT: {
+			uint64_t thread_id;
+			if(!in.Read(thread_id)) {
+				return BadRequest(out);
+			}
+			Process::Thread *thread = FindThread(thread_id);
+			if(!thread) {
+				return BadRequest(out);
+			}
+			out.payload.Write(thread->context);
+			return true; }
+		case Command::SET_THREAD_CONTEXT: {
+			uint64_t thread_id;
+			uint32_t flags;
+			ThreadContext context;
+			if(!in.Read(thread_id) || !in.Read(flags) || !in.Read(context)) {
+				return BadRequest(out);
+			}
+			Process::Thread *thread = FindThread(thread_id);
+			if(!thread) {
+				return BadRequest(out);
+			}
+			thread->context = context;
+			return true; }
+		case Command::BREAK_PROCESS: {
+			DebugEventInfo event = {};
+			event.event_type = DebugEventInfo::Exception;
+			event.flags = 1;
+			event.thread_id = process.threads.empty() ? 0 : process.threads[0].thread_id;
+			event.exception.exception_type = DebugEventInfo::DebuggerBreak;
+			events.push_back(event);
+			device.Respond(call, std::move(out));
+			Wake();
+			return false; }
+		case Command::CONTINUE_DEBUG_EVENT: {
+			uint32_t flags;
+			std::vector<uint64_t> thread_ids;
+			if(!in.Read(flags) || !ReadVector(in, thread_ids)) {
+				return BadRequest(out);
+			}
+			if(events.empty() && next_event < process.events.size()) {
+				Release(process.events[next_event++]);
+			}
+			device.Respond(call, std::move(out));
+			Wake();
+			return false; }
+		case Command::WAIT_EVENT:
+			if(waiter) {
+				out.result_code = TWILI_ERR_ALREADY_WAITING;
+				return true;
+			}
+			if(!events.empty()) {
+				return true;
+			}
+			waiter = call;
+			return false;
+		case Command::GET_TARGET_ENTRY: {
+			// same guess Twili makes for processes it didn't launch
+			std::vector<uint64_t> candidates = ModuleBases();
+			out.payload.Write<uint64_t>(candidates.size() > 1 ? candidates[1] : candidates.size() == 1 ? candidates[0] : 0);
+			return true; }
+		case Command::LAUNCH_DEBUG_PROCESS:
+			return true;
+		case Command::GET_NSO_INFOS: {
+			std::vector<LoadedModuleInfo> infos;
+			for(uint64_t base : ModuleBases()) {
+				LoadedModuleInfo info = {};
+				info.base_addr = base;
+				info.size = process.regions[base].size;
+				infos.push_back(info);
+			}
+			WriteVector(out.payload, std::move(infos));
+			return true; }
+		case Command::GET_NRO_INFOS:
+			WriteVector(out.payload, std::vector<LoadedModuleInfo>());
+			return true;
+		default:
+			out.result_code = TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+			return true;
+		}
+	}
+ private:
+	SimDevice &device;
+	Process process;
+	std::deque<DebugEventInfo> events;
+	size_t next_event = 0;
+	std::optional<Call> waiter;
+
+	bool IsMapped(uint64_t addr, uint64_t size) {
+		while(size > 0) {
+			auto i = process.regions.upper_bound(addr);
+			if(i == process.regions.begin() || addr - std::prev(i)->first >= std::prev(i)->second.size) {
+				return false;
+			}
+			Process::Region &region = std::prev(i)->second;
+			uint64_t available = region.base + region.size - addr;
+			if(size <= available) {
+				return true;
+			}
+			addr+= available;
+			size-= available;
+		}
+		return true;
+	}
+
+	// Only call this on memory that IsMapped().
+	void Access(uint64_t addr, uint8_t *data, uint64_t size, bool write) {
+		while(size > 0) {
+			Process::Region &region = std::prev(process.regions.upper_bound(addr))->second;
+			uint64_t offset = addr - region.base;
+			uint64_t chunk = std::min(size, region.size - offset);
+			if(write) {
+				std::copy(data, data + chunk, region.data.begin() + offset);
+			} else {
+				std::copy(region.data.begin() + offset, region.data.begin() + offset + chunk, data);
+			}
+			addr+= chunk;
+			data+= chunk;
+			size-= chunk;
+		}
+	}
+
+	Process::Thread *FindThread(uint64_t thread_id) {
+		for(Process::Thread &thread : process.threads) {
+			if(thread.thread_id == thread_id) {
+				return &thread;
+			}
+		}
+		return nullptr;
+	}
+
+	std::vector<uint64_t> ModuleBases() {
+		std::vector<uint64_t> bases;
+		for(auto &i : process.regions) {
+			if(i.second.memory_type == 3 && i.second.permission == 5) { // CODE_STATIC RX
+				bases.push_back(i.first);
+			}
+		}
+		return bases;
+	}
+
+	void Release(const Process::Event &scripted) {
+		DebugEventInfo event = {};
+		event.thread_id = scripted.thread_id;
+		switch(scripted.type) {
+		case Process::Event::Type::ExitThread:
+			event.event_type = DebugEventInfo::ExitThread;
+			event.exit.type = 1; // RunningThread
+			process.threads.erase(
+				std::remove_if(
+					process.threads.begin(), process.threads.end(),
+					[&scripted](const Process::Thread &thread) {
+						return thread.thread_id == scripted.thread_id;
+					}), process.threads.end());
+			break;
+		case Process::Event::Type::Exception:
+			event.event_type = DebugEventInfo::Exception;
+			event.flags = 1;
+			event.exception.exception_type = scripted.exception_type;
+			event.exception.fault_register = scripted.address;
+			if(Process::Thread *thread = FindThread(scripted.thread_id)) {
+				thread->context.pc = scripted.address;
+			}
+			break;
+		case Process::Event::Type::ExitProcess:
+			event.event_type = DebugEventInfo::ExitProcess;
+			event.exit.type = 2; // ExitedProcess
+			next_event = process.events.size(); // nothing happens after this
+			break;
+		}
+		events.push_back(event);
+	}
+
+	void Wake() {
+		if(waiter && !events.empty()) {
+			device.Respond(*waiter, Response());
+			waiter.reset();
+		}
+	}
+};
+
+class DeviceInterface : public SimDevice::Object {
+ public:
+	DeviceInterface(SimDevice &device) : device(device) {
+	}
+
+	virtual bool Handle(const Call &call, util::Buffer &in, Response &out) override {
+		using Command = protocol::ITwibDeviceInterface::Command;
+		switch((Command) call.command_id) {
+		case Command::IDENTIFY: {
+			std::vector<uint8_t> firmware_version(0x100);
+			strcpy((char*) firmware_version.data() + 0x68, "sim"); // display version
+			WriteMsgPack(
+				out.payload,
+				msgpack11::MsgPack::object {
+					{"service", "twili"},
+					{"protocol", protocol::VERSION},
+					{"firmware_version", firmware_version},
+					{"serial_number", device.serial_number},
+					{"bluetooth_bd_address", std::vector<uint8_t>(6)},
+					{"wireless_lan_mac_address", std::vector<uint8_t>(6)},
+					{"device_nickname", device.nickname},
+					{"mii_author_id", std::vector<uint8_t>(16)},
+				});
+			return true; }
+		case Command::LIST_PROCESSES: {
+			struct ProcessReport {
+				uint64_t process_id;
+				uint32_t result;
+				uint64_t title_id;
+				char process_name[12];
+				uint32_t mmu_flags;
+			};
+			std::vector<ProcessReport> reports;
+			for(auto &i : device.processes) {
+				ProcessReport report = {};
+				report.process_id = i.first;
+				report.title_id = i.second.title_id;
+				strncpy(report.process_name, i.second.name.c_str(), sizeof(report.process_name));
+				reports.push_back(report);
+			}
+			WriteVector(out.payload, std::move(reports));
+			return true; }
+		case Command::TERMINATE: {
+			uint64_t pid;
+			if(!in.Read(pid)) {
+				return BadRequest(out);
+			}
+			if(device.processes.erase(pid) == 0) {
+				out.result_code = TWILI_ERR_UNRECOGNIZED_PID;
+			}
+			return true; }
+		case Command::LIST_NAMED_PIPES: {
+			std::vector<std::string> names;
+			std::string dir_path = device.config.root + "/pipes";
+			if(DIR *dir = opendir(dir_path.c_str())) {
+				struct dirent *ent;
+				while((ent = readdir(dir)) != nullptr) {
+					if(ent->d_name[0] != '.') {
+						names.push_back(ent->d_name);
+					}
+				}
+				closedir(dir);
+			}
+			out.payload.Write<uint64_t>(names.size());
+			for(std::string &name : names) {
+				WriteString(out.payload, name);
+			}
+			return true; }
+		case Command::OPEN_NAMED_PIPE: {
+			std::string name;
+			if(!ReadString(in, name)) {
+				return BadRequest(out);
+			}
+			std::optional<std::vector<uint8_t>> data;
+			if(!name.empty() && name.find('/') == std::string::npos && name[0] != '.') {
+				data = util::ReadFile((device.config.root + "/pipes/" + name).c_str());
+			}
+			if(!data) {
+				out.result_code = TWILI_ERR_NO_SUCH_PIPE;
+				return true;
+			}
+			out.payload.Write<uint32_t>(out.AddObject(std::make_shared<PipeReader>(std::move(*data))));
+			return true; }
+		case Command::OPEN_ACTIVE_DEBUGGER: {
+			uint64_t pid;
+			if(!in.Read(pid)) {
+				return BadRequest(out);
+			}
+			auto i = device.processes.find(pid);
+			if(i == device.processes.end()) {
+				out.result_code = TWILI_ERR_UNRECOGNIZED_PID;
+				return true;
+			}
+			out.payload.Write<uint32_t>(out.AddObject(std::make_shared<Debugger>(device, i->second)));
+			return true; }
+		case Command::GET_MEMORY_INFO: {
+			const uint64_t total_memory = 0x100000000;
+			uint64_t usage = 0;
+			for(auto &i : device.processes) {
+				for(auto &j : i.second.regions) {
+					usage+= j.second.size;
+				}
+			}
+			msgpack11::MsgPack::array limits;
+			for(size_t i = 0; i < 3; i++) {
+				limits.push_back(
+					msgpack11::MsgPack::object {
+						{"category", i},
+						{"current_value", i == 0 ? usage : 0},
+						{"limit_value", total_memory},
+					});
+			}
+			WriteMsgPack(
+				out.payload,
+				msgpack11::MsgPack::object {
+					{"total_memory_available", total_memory},
+					{"total_memory_usage", usage},
+					{"limits", limits},
+				});
+			return true; }
+		case Command::PRINT_DEBUG_INFO:
+			LogMessage(Info, "simulated device %s: %zu processes", device.serial_number.c_str(), device.processes.size());
+			return true;
+		case Command::OPEN_FILESYSTEM_ACCESSOR: {
+			std::string name;
+			if(!ReadString(in, name)) {
+				return BadRequest(out);
+			}
+			std::string root = device.config.root + "/fs/" + name;
+			struct stat st;
+			if(name.empty() || name.find('/') != std::string::npos || name[0] == '.' ||
+				 stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+				out.result_code = TWILI_ERR_UNKNOWN_FILESYSTEM;
+				return true;
+			}
+			out.payload.Write<uint32_t>(out.AddObject(std::make_shared<FilesystemAccessor>(root)));
+			return true; }
+		default:
+			out.result_code = TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+			return true;
+		}
+	}
+ private:
+	SimDevice &device;
+};
+
+} // anonymous namespace
+
+std::shared_ptr<SimDevice::Object> CreateDeviceInterface(SimDevice &device) {
+	return std::make_shared<DeviceInterface>(device);
+}
+
+} // namespace sim
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
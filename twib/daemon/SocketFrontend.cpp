@@ -36,6 +36,11 @@ namespace twib {
 namespace daemon {
 namespace frontend {
 
+// how much output a client may leave unread before we stop taking its
+// requests, and how far it has to catch up before we start again
+static const size_t OutputBudget = 8 * 1024 * 1024;
+static const size_t OutputResume = OutputBudget / 2;
+
 SocketFrontend::SocketFrontend(Daemon &daemon, int address_family, int socktype, struct sockaddr *bind_addr, size_t bind_addrlen) :
 	daemon(daemon),
 	address_family(address_family),
@@ -60,6 +65,7 @@ SocketFrontend::SocketFrontend(Daemon &daemon, int address_family, int socktype,
 
 	server_member.socket.Bind(bind_addr, bind_addrlen);
 	server_member.socket.Listen(20);
+	event_loop.AddMember(server_member);
 	event_loop.Begin();
 }
 
@@ -70,11 +76,13 @@ SocketFrontend::SocketFrontend(Daemon &daemon, platform::Socket &&socket) :
 	socktype(SOCK_STREAM),
 	server_logic(*this),
 	event_loop(server_logic) {
+	event_loop.AddMember(server_member);
 	event_loop.Begin();
 }
 
 SocketFrontend::~SocketFrontend() {
 	event_loop.Destroy();
+	event_loop.Clear(); // clients may outlive us
 	server_member.socket.Close();
 }
 
@@ -102,6 +110,7 @@ void SocketFrontend::ServerMember::SignalRead() {
 	platform::Socket client_socket = socket.Accept(nullptr, nullptr);
 	std::shared_ptr<Client> c = std::make_shared<Client>(std::move(client_socket), frontend);
 	frontend.clients.push_back(c);
+	frontend.event_loop.AddMember(c->connection.member);
 	frontend.daemon.AddClient(c);
 }
 
@@ -114,11 +123,9 @@ SocketFrontend::ServerLogic::ServerLogic(SocketFrontend &frontend) : frontend(fr
 }
 
 void SocketFrontend::ServerLogic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
-	loop.AddMember(frontend.server_member);
 	for(auto i = frontend.clients.begin(); i != frontend.clients.end(); ) {
 		common::MessageConnection::Request *rq;
-		while((rq = (*i)->connection.Process()) != nullptr) {
+		while((*i)->UpdateOutputCredit() && (rq = (*i)->connection.Process()) != nullptr) {
 			LogMessage(Debug, "posting request");
 			frontend.daemon.PostRequest(
 				Request(
@@ -127,7 +134,7 @@ void SocketFrontend::ServerLogic::Prepare(platform::EventLoop &loop) {
 					rq->mh.object_id,
 					rq->mh.command_id,
 					rq->mh.tag,
-					std::vector<uint8_t>(rq->payload.Read(), rq->payload.Read() + rq->payload.ReadAvailable())));
+					std::move(rq->payload)));
 			LogMessage(Debug, "posted request");
 		}
 
@@ -136,12 +143,11 @@ void SocketFrontend::ServerLogic::Prepare(platform::EventLoop &loop) {
 		}
 		
 		if((*i)->deletion_flag) {
+			loop.RemoveMember((*i)->connection.member);
 			frontend.daemon.RemoveClient(*i);
 			i = frontend.clients.erase(i);
 			continue;
 		}
-
-		loop.AddMember((*i)->connection.member);
 		
 		i++;
 	}
@@ -157,6 +163,26 @@ SocketFrontend::Client::~Client() {
 	LogMessage(Debug, "destroying client 0x%x", client_id);
 }
 
+bool SocketFrontend::Client::UpdateOutputCredit() {
+	size_t queued = connection.GetOutputSize();
+	output_queued = queued;
+	if(queued > output_high_water) {
+		output_high_water = queued;
+	}
+
+	if(!connection.input_paused && queued >= OutputBudget) {
+		LogMessage(Warning, "client 0x%x isn't reading its responses (%zu bytes queued), holding back its requests", client_id, queued);
+		connection.input_paused = true;
+		connection.member.RequestInterestUpdate();
+		output_throttle_count++;
+	} else if(connection.input_paused && queued <= OutputResume) {
+		LogMessage(Info, "client 0x%x caught up (peaked at %zu bytes queued)", client_id, (size_t) output_high_water.load());
+		connection.input_paused = false;
+		connection.member.RequestInterestUpdate();
+	}
+	return !connection.input_paused;
+}
+
 void SocketFrontend::Client::PostResponse(Response &r) {
 	protocol::MessageHeader mh;
 	mh.device_id = r.device_id;
@@ -165,6 +191,7 @@ void SocketFrontend::Client::PostResponse(Response &r) {
 	mh.tag = r.tag;
 	mh.payload_size = r.payload.size();
 	mh.object_count = r.objects.size();
+	mh.flags = 0;
 	
 	std::vector<uint32_t> object_ids(r.objects.size(), 0);
 	std::transform(
@@ -173,7 +200,7 @@ void SocketFrontend::Client::PostResponse(Response &r) {
 			return object->object_id;
 		});
 
-	connection.SendMessage(mh, r.payload, object_ids);
+	connection.SendMessage(mh, std::move(r.payload), std::move(object_ids));
 }
 
 } // namespace frontend
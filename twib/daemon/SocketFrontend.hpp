@@ -57,6 +57,12 @@ class SocketFrontend : public Frontend {
 
 		virtual void PostResponse(Response &r) override;
 
+		// Called on the event thread. Stops taking requests from a client that
+		// has left too much output unread, so that whatever it has asked for
+		// (pipe reads, say) stops flowing in from devices, and resumes once
+		// it catches up. Returns true if the client may send requests.
+		bool UpdateOutputCredit();
+
 		common::SocketMessageConnection connection;
 		SocketFrontend &frontend;
 		Daemon &daemon;
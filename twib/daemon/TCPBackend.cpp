@@ -23,6 +23,7 @@
 #include "platform/platform.hpp"
 
 #include "Daemon.hpp"
+#include "err.hpp"
 
 namespace twili {
 namespace twib {
@@ -48,11 +49,13 @@ TCPBackend::TCPBackend(Daemon &daemon) :
 		exit(1);
 	}
 
+	event_loop.AddMember(listen_member);
 	event_loop.Begin();
 }
 
 TCPBackend::~TCPBackend() {
 	event_loop.Destroy();
+	event_loop.Clear(); // devices may outlive us
 	listen_member.socket.Close();
 }
 
@@ -109,19 +112,25 @@ TCPBackend::Device::Device(platform::Socket &&socket, TCPBackend &backend) :
 }
 
 TCPBackend::Device::~Device() {
+	for(auto r : pending_requests.TakeAll()) {
+		if(r.client_id != 0xffffffff) {
+			backend.daemon.PostResponse(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
+		}
+	}
 }
 
 void TCPBackend::Device::Begin() {
 	SendRequest(Request(std::shared_ptr<Client>(), 0x0, 0x0, (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY, 0xFFFFFFFF, std::vector<uint8_t>()));
 }
 
-void TCPBackend::Device::IncomingMessage(protocol::MessageHeader &mh, util::Buffer &payload, util::Buffer &object_ids) {
+void TCPBackend::Device::IncomingMessage(protocol::MessageHeader &mh, std::vector<uint8_t> &&payload, util::Buffer &object_ids) {
 	response_in.device_id = device_id;
 	response_in.client_id = mh.client_id;
 	response_in.object_id = mh.object_id;
 	response_in.result_code = mh.result_code;
 	response_in.tag = mh.tag;
-	response_in.payload = std::vector<uint8_t>(payload.Read(), payload.Read() + payload.ReadAvailable());
+	response_in.payload = std::move(payload);
+	RecordReceived(sizeof(mh) + response_in.payload.size() + mh.object_count * sizeof(uint32_t));
 	
 	// create BridgeObjects
 	response_in.objects.resize(mh.object_count);
@@ -131,13 +140,14 @@ void TCPBackend::Device::IncomingMessage(protocol::MessageHeader &mh, util::Buff
 			LogMessage(Error, "not enough object IDs");
 			return;
 		}
-		response_in.objects[i] = std::make_shared<BridgeObject>(backend.daemon, mh.device_id, id);
+		response_in.objects[i] = std::make_shared<BridgeObject>(backend.daemon, device_id, id);
 	}
 
 	// remove from pending requests
-	pending_requests.remove_if([this](WeakRequest &r) {
-			return r.tag == response_in.tag;
-		});
+	if(!pending_requests.Complete(response_in.client_id, response_in.tag, response_in.objects)) {
+		LogMessage(Info, "dropping response to request that already timed out");
+		return;
+	}
 	
 	if(response_in.client_id == 0xFFFFFFFF) { // identification meta-client
 		Identified(response_in);
@@ -165,10 +175,15 @@ void TCPBackend::Device::Identified(Response &r) {
 	
 	device_id = std::hash<std::string>()(serial_number);
 	LogMessage(Info, "assigned device id: %08x", device_id);
+
+	if(obj["protocol"].int_value() >= 4) {
+		LogMessage(Debug, "payload compression enabled");
+		connection.EnableCompression();
+	}
 	ready_flag = true;
 }
 
-void TCPBackend::Device::SendRequest(const Request &&r) {
+void TCPBackend::Device::SendRequest(Request &&r) {
 	protocol::MessageHeader mhdr;
 	mhdr.client_id = r.client ? r.client->client_id : 0xffffffff;
 	mhdr.object_id = r.object_id;
@@ -176,8 +191,11 @@ void TCPBackend::Device::SendRequest(const Request &&r) {
 	mhdr.tag = r.tag;
 	mhdr.payload_size = r.payload.size();
 	mhdr.object_count = 0;
+	// devices that understand the offer will compress from here on
+	mhdr.flags = protocol::RequestFlags(r.object_id, r.command_id);
 
-	pending_requests.push_back(r.Weak());
+	pending_requests.Add(r);
+	RecordSent(sizeof(mhdr) + r.payload.size());
 
 	/* TODO: request objects
 	std::vector<uint32_t> object_ids(r.objects.size(), 0);
@@ -187,7 +205,7 @@ void TCPBackend::Device::SendRequest(const Request &&r) {
 			return object->object_id;
 		});
 	connection.out_buffer.Write(object_ids); */
-	connection.SendMessage(mhdr, r.payload, std::vector<uint32_t>());
+	connection.SendMessage(mhdr, std::move(r.payload), std::vector<uint32_t>());
 }
 
 int TCPBackend::Device::GetPriority() {
@@ -233,12 +251,17 @@ TCPBackend::ServerLogic::ServerLogic(TCPBackend &backend) : backend(backend) {
 }
 
 void TCPBackend::ServerLogic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
-	loop.AddMember(backend.listen_member);
 	for(auto i = backend.devices.begin(); i != backend.devices.end(); ) {
+		if(!(*i)->member_added_flag) {
+			// devices are created on whichever thread connected them, so
+			// they get added to the event loop here.
+			loop.AddMember((*i)->connection.member);
+			(*i)->member_added_flag = true;
+		}
+		
 		common::MessageConnection::Request *rq;
 		while((rq = (*i)->connection.Process()) != nullptr) {
-			(*i)->IncomingMessage(rq->mh, rq->payload, rq->object_ids);
+			(*i)->IncomingMessage(rq->mh, std::move(rq->payload), rq->object_ids);
 		}
 
 		if((*i)->connection.error_flag) {
@@ -249,6 +272,7 @@ void TCPBackend::ServerLogic::Prepare(platform::EventLoop &loop) {
 			if((*i)->added_flag) {
 				backend.daemon.RemoveDevice(*i);
 			}
+			loop.RemoveMember((*i)->connection.member);
 			i = backend.devices.erase(i);
 			continue;
 		} else {
@@ -257,8 +281,6 @@ void TCPBackend::ServerLogic::Prepare(platform::EventLoop &loop) {
 				(*i)->added_flag = true;
 			}
 		}
-
-		loop.AddMember((*i)->connection.member);
 		
 		i++;
 	}
@@ -58,17 +58,17 @@ class TCPBackend {
 
 		void Begin();
 		void Identified(Response &r);
-		void IncomingMessage(protocol::MessageHeader &mh, util::Buffer &payload, util::Buffer &object_ids);
-		virtual void SendRequest(const Request &&r) override;
+		void IncomingMessage(protocol::MessageHeader &mh, std::vector<uint8_t> &&payload, util::Buffer &object_ids);
+		virtual void SendRequest(Request &&r) override;
 		virtual int GetPriority() override;
 		virtual std::string GetBridgeType() override;
 		
 		TCPBackend &backend;
 		common::SocketMessageConnection connection;
-		std::list<WeakRequest> pending_requests;
 		Response response_in;
 		bool ready_flag = false;
 		bool added_flag = false;
+		bool member_added_flag = false;
 	};
 
  private:
@@ -22,9 +22,12 @@
 
 #include "common/config.hpp"
 
+#include<algorithm>
+
 #include<msgpack11.hpp>
 
 #include "Daemon.hpp"
+#include "Compression.hpp"
 #include "err.hpp"
 
 void show(msgpack11::MsgPack const& blob);
@@ -82,23 +85,28 @@ USBBackend::Device::Device(USBBackend *backend, libusb_device_handle *handle, ui
 	endp_meta_out(endp_addrs[0]), endp_meta_in(endp_addrs[2]),
 	endp_data_out(endp_addrs[1]), endp_data_in(endp_addrs[3]),
 	interface_number(interface_number),
+	output(*this),
 	isl_lock(backend->daemon.initial_scan_lock) {
 	
-	tfer_meta_out = libusb_alloc_transfer(0);
-	tfer_data_out = libusb_alloc_transfer(0);
+	for(size_t i = 0; i < USBOutputScheduler::PoolSize; i++) {
+		meta_out_tfers[i] = libusb_alloc_transfer(0);
+		data_out_tfers[i] = libusb_alloc_transfer(0);
+	}
 	tfer_meta_in = libusb_alloc_transfer(0);
 	tfer_data_in = libusb_alloc_transfer(0);
 }
 
 USBBackend::Device::~Device() {
-	for(auto r : pending_requests) {
+	for(auto r : pending_requests.TakeAll()) {
 		if(r.client_id != 0xffffffff) {
 			backend->daemon.PostResponse(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
 		}
 	}
 	Destroy();
-	libusb_free_transfer(tfer_meta_out);
-	libusb_free_transfer(tfer_data_out);
+	for(size_t i = 0; i < USBOutputScheduler::PoolSize; i++) {
+		libusb_free_transfer(meta_out_tfers[i]);
+		libusb_free_transfer(data_out_tfers[i]);
+	}
 	libusb_free_transfer(tfer_meta_in);
 	libusb_free_transfer(tfer_data_in);
 	libusb_release_interface(handle, interface_number);
@@ -113,8 +121,10 @@ void USBBackend::Device::Begin() {
 }
 
 void USBBackend::Device::Destroy() {
-	libusb_cancel_transfer(tfer_meta_out);
-	libusb_cancel_transfer(tfer_data_out);
+	for(size_t i = 0; i < USBOutputScheduler::PoolSize; i++) {
+		libusb_cancel_transfer(meta_out_tfers[i]);
+		libusb_cancel_transfer(data_out_tfers[i]);
+	}
 	libusb_cancel_transfer(tfer_meta_in);
 	libusb_cancel_transfer(tfer_data_in);
 	if(isl_lock) { isl_lock.unlock(); }
@@ -127,13 +137,14 @@ void USBBackend::Device::MarkAdded() {
 	added_flag = true;
 }
 
-void USBBackend::Device::SendRequest(const Request &&request) {
+void USBBackend::Device::SendRequest(Request &&request) {
 	std::unique_lock<std::mutex> lock(state_mutex);
-	while(state != State::AVAILABLE && !deletion_flag) {
-		state_cv.wait(lock);
+	if(deletion_flag) {
+		if(request.client) {
+			backend->daemon.PostResponse(request.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
+		}
+		return;
 	}
-	if(deletion_flag) { return; }
-	state = State::BUSY;
 	
 	/*
 	LogMessage(Debug, "sending request");
@@ -143,25 +154,61 @@ void USBBackend::Device::SendRequest(const Request &&request) {
 	LogMessage(Debug, "  tag 0x%x", request.tag);
 	LogMessage(Debug, "  payload size 0x%lx", request.payload.size());
 	*/
-	
+
+	protocol::MessageHeader mhdr;
 	mhdr.client_id = request.client ? request.client->client_id : 0xffffffff;
 	mhdr.object_id = request.object_id;
 	mhdr.command_id = request.command_id;
 	mhdr.tag = request.tag;
 	mhdr.payload_size = request.payload.size();
 	mhdr.object_count = 0;
+	mhdr.flags = protocol::RequestFlags(request.object_id, request.command_id);
+	std::vector<uint8_t> payload = std::move(request.payload);
+	RecordSent(sizeof(mhdr) + payload.size());
+	if(compression) {
+		protocol::CompressPayload(mhdr, payload);
+	}
+
+	pending_requests.Add(request);
+	output.Queue(mhdr, std::move(payload));
+
+	PumpOutput();
+}
 
-	request_out = request.Weak();
-	pending_requests.push_back(request_out);
+void USBBackend::Device::PumpOutput() {
+	if(deletion_flag) {
+		return;
+	}
+
+	if(!output.Pump()) {
+		Kill();
+	}
+}
 
-	libusb_fill_bulk_transfer(tfer_meta_out, handle, endp_meta_out, (uint8_t*) &mhdr, sizeof(mhdr), &Device::MetaOutTransferShim, SharedPtrForTransfer(), 5000);
-	transferring_meta = true;
-	int r = libusb_submit_transfer(tfer_meta_out);
+bool USBBackend::Device::SubmitTransfer(USBOutputScheduler::Endpoint endpoint, size_t slot, uint8_t *buffer, size_t size) {
+	if(endpoint == USBOutputScheduler::Endpoint::Meta) {
+		libusb_fill_bulk_transfer(meta_out_tfers[slot], handle, endp_meta_out, buffer, size, &Device::MetaOutTransferShim, SharedPtrForTransfer(), 15000);
+	} else {
+		libusb_fill_bulk_transfer(data_out_tfers[slot], handle, endp_data_out, buffer, size, &Device::DataOutTransferShim, SharedPtrForTransfer(), 15000);
+	}
+	libusb_transfer *tfer = endpoint == USBOutputScheduler::Endpoint::Meta ? meta_out_tfers[slot] : data_out_tfers[slot];
+	int r = libusb_submit_transfer(tfer);
 	if(r != 0) {
 		LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-		Kill();
-		return;
+		delete (std::shared_ptr<Device>*) tfer->user_data;
+		return false;
 	}
+	return true;
+}
+
+size_t USBBackend::Device::FindTransfer(std::array<libusb_transfer*, USBOutputScheduler::PoolSize> &pool, libusb_transfer *tfer) {
+	for(size_t i = 0; i < pool.size(); i++) {
+		if(pool[i] == tfer) {
+			return i;
+		}
+	}
+	LogMessage(Fatal, "completed transfer doesn't belong to this device");
+	exit(1);
 }
 
 int USBBackend::Device::GetPriority() {
@@ -175,67 +222,33 @@ std::string USBBackend::Device::GetBridgeType() {
 void USBBackend::Device::Kill() {
 	deletion_flag = true;
 	if(isl_lock) { isl_lock.unlock(); }
-	state_cv.notify_all();
 }
 
 std::shared_ptr<USBBackend::Device> *USBBackend::Device::SharedPtrForTransfer() {
 	return new std::shared_ptr<Device>(shared_from_this());
 }
 
-void USBBackend::Device::MetaOutTransferCompleted() {
+void USBBackend::Device::MetaOutTransferCompleted(libusb_transfer *tfer) {
 	LogMessage(Debug, "finished transferring meta");
 	std::unique_lock<std::mutex> lock(state_mutex);
-
-	if(request_out.payload.size() > 0) {
-		LogMessage(Debug, "transferring data");
-		libusb_fill_bulk_transfer(tfer_data_out, handle, endp_data_out, (uint8_t*) request_out.payload.data(), LimitTransferSize(request_out.payload.size()), &Device::DataOutTransferShim, SharedPtrForTransfer(), 5000);
-		transferring_data = true;
-		int r = libusb_submit_transfer(tfer_data_out);
-		if(r != 0) {
-			LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-			Kill();
-			return;
-		}
-	}
-
-	transferring_meta = false;
-	if(!transferring_meta && !transferring_data) {
-		LogMessage(Debug, "entering AVAILABLE state");
-		state = State::AVAILABLE;
-		state_cv.notify_one();
+	size_t slot = FindTransfer(meta_out_tfers, tfer);
+	if(!output.TransferCompleted(USBOutputScheduler::Endpoint::Meta, slot, tfer->actual_length)) {
+		LogMessage(Debug, "short meta transfer");
+		Kill();
+		return;
 	}
+	PumpOutput();
 }
 
-void USBBackend::Device::DataOutTransferCompleted() {
-	size_t beg_off = (tfer_data_out->buffer - request_out.payload.data());
-	size_t read = beg_off + tfer_data_out->actual_length;
-	size_t remaining = mhdr.payload_size - read;
-	LogMessage(Debug, "send request data 0x%x/0x%x. 0x%x remaining", read, request_out.payload.size(), remaining);
-
-	if(remaining > 0) {
-		// continue transferring
-		libusb_fill_bulk_transfer(tfer_data_out, handle, endp_data_out,
-															request_out.payload.data() + read,
-															LimitTransferSize(remaining),
-															&Device::DataOutTransferShim, SharedPtrForTransfer(), 15000);
-		int r = libusb_submit_transfer(tfer_data_out);
-		if(r != 0) {
-			LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-			Kill();
-			return;
-		}
+void USBBackend::Device::DataOutTransferCompleted(libusb_transfer *tfer) {
+	std::unique_lock<std::mutex> lock(state_mutex);
+	size_t slot = FindTransfer(data_out_tfers, tfer);
+	if(!output.TransferCompleted(USBOutputScheduler::Endpoint::Data, slot, tfer->actual_length)) {
+		LogMessage(Debug, "short data transfer (0x%x/0x%x)", tfer->actual_length, tfer->length);
+		Kill();
 		return;
-	} else {
-		LogMessage(Debug, "finished transferring data");
-		std::unique_lock<std::mutex> lock(state_mutex);
-		
-		transferring_data = false;
-		if(!transferring_meta && !transferring_data) {
-			LogMessage(Debug, "entering AVAILABLE state");
-			state = State::AVAILABLE;
-			state_cv.notify_one();
-		}
 	}
+	PumpOutput();
 }
 
 void USBBackend::Device::MetaInTransferCompleted() {
@@ -322,6 +335,13 @@ void USBBackend::Device::ObjectInTransferCompleted() {
 }
 
 void USBBackend::Device::DispatchResponse() {
+	if(compression && !protocol::DecompressPayload(mhdr_in, response_in.payload)) {
+		LogMessage(Error, "failed to decompress response payload");
+		Kill();
+		return;
+	}
+	RecordReceived(sizeof(mhdr_in) + response_in.payload.size() + object_ids_in.size() * sizeof(uint32_t));
+
 	// create BridgeObjects
 	response_in.objects.resize(object_ids_in.size());
 	std::transform(
@@ -331,9 +351,11 @@ void USBBackend::Device::DispatchResponse() {
 		});
 
 	// remove from pending requests
-	pending_requests.remove_if([this](WeakRequest &r) {
-			return r.tag == response_in.tag;
-		});
+	if(!pending_requests.Complete(response_in.client_id, response_in.tag, response_in.objects)) {
+		LogMessage(Info, "dropping response to request that already timed out");
+		ResubmitMetaInTransfer();
+		return;
+	}
 	
 	if(response_in.client_id == 0xFFFFFFFF) { // identification meta-client
 		Identified(response_in);
@@ -362,6 +384,17 @@ void USBBackend::Device::Identified(Response &r) {
 	
 	device_id = std::hash<std::string>()(serial_number);
 	LogMessage(Info, "assigned device id: %08x", device_id);
+
+	{
+		std::unique_lock<std::mutex> lock(state_mutex);
+		bool pipelining = obj["protocol"].int_value() >= 3;
+		output.SetPipelining(pipelining);
+		LogMessage(Debug, "request pipelining %s", pipelining ? "enabled" : "disabled");
+		compression = obj["protocol"].int_value() >= 4;
+		LogMessage(Debug, "payload compression %s", compression ? "enabled" : "disabled");
+		PumpOutput();
+	}
+	
 	ready_flag = true;
 }
 
@@ -386,7 +419,7 @@ bool USBBackend::Device::CheckTransfer(libusb_transfer *tfer) {
 }
 
 size_t USBBackend::Device::LimitTransferSize(size_t sz) {
-	const size_t max_size = 0x10000;
+	const size_t max_size = 0x100000;
 	if(sz > max_size) {
 		return max_size;
 	} else {
@@ -398,7 +431,7 @@ void USBBackend::Device::MetaOutTransferShim(libusb_transfer *tfer) {
 	LogMessage(Debug, "meta out transfer shim, status = %d", tfer->status);
 	std::shared_ptr<Device> *d = (std::shared_ptr<Device> *) tfer->user_data;
 	if(!(*d)->CheckTransfer(tfer)) {
-		(*d)->MetaOutTransferCompleted();
+		(*d)->MetaOutTransferCompleted(tfer);
 	}
 	delete d;
 }
@@ -406,7 +439,7 @@ void USBBackend::Device::MetaOutTransferShim(libusb_transfer *tfer) {
 void USBBackend::Device::DataOutTransferShim(libusb_transfer *tfer) {
 	std::shared_ptr<Device> *d = (std::shared_ptr<Device> *) tfer->user_data;
 	if(!(*d)->CheckTransfer(tfer)) {
-		(*d)->DataOutTransferCompleted();
+		(*d)->DataOutTransferCompleted(tfer);
 	}
 	delete d;
 }
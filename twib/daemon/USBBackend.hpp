@@ -22,9 +22,12 @@
 
 #include "platform/platform.hpp"
 
+#include<atomic>
 #include<thread>
 #include<list>
 #include<queue>
+#include<deque>
+#include<array>
 #include<mutex>
 #include<condition_variable>
 
@@ -35,6 +38,7 @@
 #include "Messages.hpp"
 #include "Protocol.hpp"
 #include "InitialScanLock.hpp"
+#include "USBOutputScheduler.hpp"
 
 namespace twili {
 namespace twib {
@@ -57,21 +61,17 @@ class USBBackend {
 		libusb_context *ctx;
 	};
 	
-	class Device : public daemon::Device, public std::enable_shared_from_this<Device> {
+	class Device : public daemon::Device, public std::enable_shared_from_this<Device>, private USBOutputScheduler::Submitter {
 	 public:
 		Device(USBBackend *backend, libusb_device_handle *device, uint8_t endp_addrs[4], uint8_t interface_number);
 		~Device();
 
-		enum class State {
-			AVAILABLE, BUSY
-		};
-
 		void Begin();
 		void Destroy();
 		void MarkAdded();
 		
-		// thread-agnostic
-		virtual void SendRequest(const Request &&r) override;
+		// thread-agnostic, doesn't block
+		virtual void SendRequest(Request &&r) override;
 
 		virtual int GetPriority() override;
 		virtual std::string GetBridgeType() override;
@@ -87,28 +87,32 @@ class USBBackend {
 		uint8_t endp_data_out;
 		uint8_t endp_meta_in;
 		uint8_t endp_data_in;
-		libusb_transfer *tfer_meta_out = NULL;
-		libusb_transfer *tfer_data_out = NULL;
+		// indexed by the scheduler's pool slots
+		std::array<libusb_transfer*, USBOutputScheduler::PoolSize> meta_out_tfers;
+		std::array<libusb_transfer*, USBOutputScheduler::PoolSize> data_out_tfers;
 		libusb_transfer *tfer_meta_in = NULL;
 		libusb_transfer *tfer_data_in = NULL;
-		State state = State::AVAILABLE;
-		bool transferring_meta = false;
-		bool transferring_data = false;
+
+		// protected by state_mutex
 		std::mutex state_mutex;
-		std::condition_variable state_cv;
-		protocol::MessageHeader mhdr;
+		USBOutputScheduler output;
+		// Set once the device has accepted our compression offer. Read
+		// without the lock when requests are built.
+		std::atomic<bool> compression = false;
+		
 		protocol::MessageHeader mhdr_in;
-		WeakRequest request_out;
 		Response response_in;
 		std::vector<uint32_t> object_ids_in;
-		std::list<WeakRequest> pending_requests;
 
 		std::unique_lock<InitialScanLock> isl_lock;
 
 		void Kill();
 		std::shared_ptr<Device> *SharedPtrForTransfer();
-		void MetaOutTransferCompleted();
-		void DataOutTransferCompleted();
+		void PumpOutput(); // must hold state_mutex
+		virtual bool SubmitTransfer(USBOutputScheduler::Endpoint endpoint, size_t slot, uint8_t *buffer, size_t size) override;
+		size_t FindTransfer(std::array<libusb_transfer*, USBOutputScheduler::PoolSize> &pool, libusb_transfer *tfer);
+		void MetaOutTransferCompleted(libusb_transfer *tfer);
+		void DataOutTransferCompleted(libusb_transfer *tfer);
 		void MetaInTransferCompleted();
 		void DataInTransferCompleted();
 		void ObjectInTransferCompleted();
@@ -24,6 +24,7 @@
 #include "err.hpp"
 
 #include "Daemon.hpp"
+#include "Compression.hpp"
 
 namespace twili {
 namespace twib {
@@ -177,7 +178,7 @@ USBKBackend::Device::Device(USBKBackend &backend, KUSB_DRIVER_API Usb, UsbHandle
 }
 
 USBKBackend::Device::~Device() {
-	for(auto r : pending_requests) {
+	for(auto r : pending_requests.TakeAll()) {
 		if(r.client_id != 0xffffffff) {
 			backend.daemon.PostResponse(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
 		}
@@ -206,7 +207,7 @@ void USBKBackend::Device::MarkAdded() {
 	added_flag = true;
 }
 
-void USBKBackend::Device::SendRequest(const Request &&request) {
+void USBKBackend::Device::SendRequest(Request &&request) {
 	std::unique_lock<std::mutex> lock(state_mutex);
 	while(state != State::AVAILABLE && !deletion_flag) {
 		state_cv.wait(lock);
@@ -220,9 +221,15 @@ void USBKBackend::Device::SendRequest(const Request &&request) {
 	mhdr.tag = request.tag;
 	mhdr.payload_size = request.payload.size();
 	mhdr.object_count = 0;
+	mhdr.flags = protocol::RequestFlags(request.object_id, request.command_id);
 
+	pending_requests.Add(request);
 	request_out = request.Weak();
-	pending_requests.push_back(request_out);
+	request_out.payload = std::move(request.payload);
+	RecordSent(sizeof(mhdr) + request_out.payload.size());
+	if(compression) {
+		protocol::CompressPayload(mhdr, request_out.payload);
+	}
 
 	member_meta_out.Submit((uint8_t*)&mhdr, sizeof(mhdr));
 	transferring_data = false;
@@ -321,6 +328,13 @@ void USBKBackend::Device::DataInTransferCompleted(size_t size) {
 }
 
 void USBKBackend::Device::DispatchResponse() {
+	if(compression && !protocol::DecompressPayload(mhdr_in, response_in.payload)) {
+		LogMessage(Error, "failed to decompress response payload");
+		Kill();
+		return;
+	}
+	RecordReceived(sizeof(mhdr_in) + response_in.payload.size() + object_ids_in.size() * sizeof(uint32_t));
+
 	// create BridgeObjects
 	response_in.objects.resize(object_ids_in.size());
 	std::transform(
@@ -330,9 +344,11 @@ void USBKBackend::Device::DispatchResponse() {
 		});
 
 	// remove from pending requests
-	pending_requests.remove_if([this](WeakRequest &r) {
-			return r.tag == response_in.tag;
-		});
+	if(!pending_requests.Complete(response_in.client_id, response_in.tag, response_in.objects)) {
+		LogMessage(Info, "dropping response to request that already timed out");
+		ResubmitMetaInTransfer();
+		return;
+	}
 	
 	if(response_in.client_id == 0xFFFFFFFF) { // identification meta-client
 		Identified(response_in);
@@ -361,6 +377,9 @@ void USBKBackend::Device::Identified(Response &r) {
 	
 	device_id = std::hash<std::string>()(serial_number);
 	LogMessage(Info, "assigned device id: %08x", device_id);
+
+	compression = obj["protocol"].int_value() >= 4;
+	LogMessage(Debug, "payload compression %s", compression ? "enabled" : "disabled");
 	ready_flag = true;
 }
 
@@ -103,7 +103,7 @@ class USBKBackend {
 		void MarkAdded();
 		
 		// thread-agnostic
-		virtual void SendRequest(const Request &&r) override;
+		virtual void SendRequest(Request &&r) override;
 
 		virtual int GetPriority() override;
 		virtual std::string GetBridgeType() override;
@@ -151,8 +151,8 @@ class USBKBackend {
 		protocol::MessageHeader mhdr;
 		WeakRequest request_out;
 		Response response_in;
-		std::list<WeakRequest> pending_requests;
 		std::vector<uint32_t> object_ids_in;
+		bool compression = false; // set once the device accepts our offer
 
 		std::unique_lock<InitialScanLock> isl_lock;
 		
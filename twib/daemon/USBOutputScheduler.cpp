@@ -0,0 +1,130 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "USBOutputScheduler.hpp"
+
+#include<algorithm>
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+
+USBOutputScheduler::USBOutputScheduler(Submitter &submitter) :
+	submitter(submitter) {
+}
+
+void USBOutputScheduler::SetPipelining(bool pipelining) {
+	this->pipelining = pipelining;
+}
+
+void USBOutputScheduler::Queue(const protocol::MessageHeader &mhdr, std::vector<uint8_t> &&payload) {
+	std::shared_ptr<OutgoingRequest> out = std::make_shared<OutgoingRequest>();
+	out->mhdr = mhdr;
+	out->payload = std::move(payload);
+	meta_queue.push_back(out);
+	if(out->payload.size() > 0) {
+		data_queue.push_back(out);
+	}
+}
+
+bool USBOutputScheduler::Pump() {
+	// Payloads go out back-to-back on the data endpoint, so they can be
+	// queued as soon as a transfer is free. The device reads them in the
+	// same order it reads headers.
+	while(!data_queue.empty()) {
+		Slot *slot = FindIdleSlot(data_pool);
+		if(slot == nullptr) {
+			break;
+		}
+		std::shared_ptr<OutgoingRequest> out = data_queue.front();
+		size_t size = ChooseTransferSize(out->payload.size() - out->data_submitted);
+		if(!submitter.SubmitTransfer(Endpoint::Data, slot - data_pool.data(), out->payload.data() + out->data_submitted, size)) {
+			return false;
+		}
+		slot->request = out;
+		slot->size = size;
+		out->data_submitted+= size;
+		if(out->data_submitted == out->payload.size()) {
+			data_queue.pop_front();
+		}
+	}
+
+	while(!meta_queue.empty()) {
+		if(!pipelining && last_meta && last_meta->data_completed < last_meta->payload.size()) {
+			// older devices start reading a new header as soon as they've
+			// read the previous one, so hold off until its payload is through
+			break;
+		}
+		Slot *slot = FindIdleSlot(meta_pool);
+		if(slot == nullptr || (!pipelining && slot != &meta_pool[0])) { // only one header at a time
+			break;
+		}
+		std::shared_ptr<OutgoingRequest> out = meta_queue.front();
+		if(!submitter.SubmitTransfer(Endpoint::Meta, slot - meta_pool.data(), (uint8_t*) &out->mhdr, sizeof(out->mhdr))) {
+			return false;
+		}
+		slot->request = out;
+		slot->size = sizeof(out->mhdr);
+		last_meta = out;
+		meta_queue.pop_front();
+	}
+
+	return true;
+}
+
+bool USBOutputScheduler::TransferCompleted(Endpoint endpoint, size_t slot_index, size_t actual_length) {
+	Slot &slot = (endpoint == Endpoint::Meta ? meta_pool : data_pool)[slot_index];
+	std::shared_ptr<OutgoingRequest> out = std::move(slot.request);
+	if(actual_length != slot.size) {
+		// anything queued behind this would land in the wrong place
+		return false;
+	}
+	if(endpoint == Endpoint::Data) {
+		out->data_completed+= actual_length;
+	}
+	return true;
+}
+
+size_t USBOutputScheduler::ChooseTransferSize(size_t remaining) {
+	// Spread large payloads over the whole transfer pool so that several
+	// chunks can be queued at once, but keep chunks big enough to amortize
+	// the per-transfer overhead. Chunks stay page-aligned so that only the
+	// last one can end in a short packet.
+	const size_t min_size = 0x10000;
+	size_t size = (remaining / PoolSize + 0xfff) & ~(size_t) 0xfff;
+	size = std::max(size, min_size);
+	size = std::min(size, MaxTransferSize);
+	return std::min(size, remaining);
+}
+
+USBOutputScheduler::Slot *USBOutputScheduler::FindIdleSlot(Pool &pool) {
+	for(Slot &s : pool) {
+		if(!s.request) {
+			return &s;
+		}
+	}
+	return nullptr;
+}
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,111 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<array>
+#include<deque>
+#include<memory>
+#include<vector>
+
+#include<stdint.h>
+
+#include "Protocol.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+
+// Decides what goes out on a USB device's outbound meta and data endpoints,
+// and in what order. It doesn't know anything about libusb: the backend
+// submits the transfers it's asked for and reports back when they finish.
+// Not thread-safe; the backend's state lock covers it.
+class USBOutputScheduler {
+ public:
+	enum class Endpoint {
+		Meta,
+		Data,
+	};
+
+	class Submitter {
+	 public:
+		virtual ~Submitter() = default;
+		// Starts a transfer on the given pool slot of an endpoint. The buffer
+		// stays alive until the transfer is reported as completed. Returns
+		// false if the transfer couldn't be submitted.
+		virtual bool SubmitTransfer(Endpoint endpoint, size_t slot, uint8_t *buffer, size_t size) = 0;
+	};
+
+	// Picked to cover the gap between a transfer completing and the next
+	// one being submitted. Neither this nor the chunk sizes in
+	// ChooseTransferSize have been measured against real hardware.
+	static constexpr size_t PoolSize = 4;
+	static constexpr size_t MaxTransferSize = 0x100000;
+
+	USBOutputScheduler(Submitter &submitter);
+
+	// Until we know the device can take a header while the previous
+	// request's payload is still arriving, we only put one request on the
+	// wire at a time.
+	void SetPipelining(bool pipelining);
+	void Queue(const protocol::MessageHeader &mhdr, std::vector<uint8_t> &&payload);
+	// Submits queued output on whichever transfers are idle. Returns false
+	// if a submission failed, in which case the device should be dropped.
+	bool Pump();
+	// Frees up a slot. Returns false if the transfer came up short, which
+	// leaves the device out of sync with us.
+	bool TransferCompleted(Endpoint endpoint, size_t slot, size_t actual_length);
+
+	static size_t ChooseTransferSize(size_t remaining);
+
+ private:
+	class OutgoingRequest {
+	 public:
+		protocol::MessageHeader mhdr;
+		std::vector<uint8_t> payload;
+		size_t data_submitted = 0;
+		size_t data_completed = 0;
+	};
+
+	class Slot {
+	 public:
+		// keeps the buffer alive while the transfer is in flight; null when idle
+		std::shared_ptr<OutgoingRequest> request;
+		size_t size = 0;
+	};
+
+	using Pool = std::array<Slot, PoolSize>;
+
+	static Slot *FindIdleSlot(Pool &pool);
+
+	Submitter &submitter;
+	Pool meta_pool;
+	Pool data_pool;
+	std::deque<std::shared_ptr<OutgoingRequest>> meta_queue;
+	std::deque<std::shared_ptr<OutgoingRequest>> data_queue;
+	std::shared_ptr<OutgoingRequest> last_meta;
+	bool pipelining = false;
+};
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
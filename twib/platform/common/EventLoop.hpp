@@ -22,6 +22,8 @@
 
 #include "platform/common/EventLoop.hpp"
 
+#include<algorithm>
+#include<functional>
 #include<list>
 #include<vector>
 #include<thread>
@@ -66,12 +68,32 @@ class EventLoopBase {
 		}
 	}
 	
+	// Membership is persistent: a member stays registered until it is
+	// removed, so there is no need to re-add members from Prepare(). These
+	// should only be called from the event thread (i.e. from Prepare() or a
+	// member's signal handlers) or before Begin().
 	void Clear() {
+		for(auto &member : members) {
+			MemberRemoved(member.get());
+		}
 		members.clear();
 	}
 	
 	void AddMember(Member &member) {
 		members.push_back(member);
+		MemberAdded(member);
+	}
+
+	void RemoveMember(Member &member) {
+		auto i = std::find_if(
+			members.begin(), members.end(),
+			[&member](auto const &m) {
+				return &m.get() == &member;
+			});
+		if(i != members.end()) {
+			members.erase(i);
+			MemberRemoved(member);
+		}
 	}
 
 	virtual const Notifier &GetNotifier() = 0;
@@ -79,6 +101,12 @@ class EventLoopBase {
 	std::vector<std::reference_wrapper<Member>> members;
 	Logic &logic;
 
+	// hooks for implementations that keep kernel-side registrations
+	virtual void MemberAdded(Member &) {
+	}
+	virtual void MemberRemoved(Member &) {
+	}
+
 	bool event_thread_destroy = false;
 	bool event_thread_running = false;
 	std::thread event_thread;
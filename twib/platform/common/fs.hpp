@@ -22,6 +22,9 @@
 
 #include<optional>
 #include<string>
+#include<vector>
+
+#include<stdint.h>
 
 namespace twili {
 namespace platform {
@@ -29,10 +32,14 @@ namespace fs {
 
 struct Stat {
 	bool is_directory;
+	uint64_t size;
+	int64_t mtime; // opaque; only good for comparing against itself
 };
 
 std::optional<Stat> StatFile(const char *path);
 std::string BaseName(const char *path);
+// Names of the entries in a directory, excluding "." and "..".
+std::vector<std::string> ListDirectory(const char *path);
 
 } // namespace fs
 } // namespace platform
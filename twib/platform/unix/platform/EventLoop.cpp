@@ -22,6 +22,17 @@
 
 #include<algorithm>
 
+#include<fcntl.h>
+#include<sys/stat.h>
+
+#if defined(__linux__)
+#include<sys/epoll.h>
+#else
+#include<sys/types.h>
+#include<sys/event.h>
+#include<sys/time.h>
+#endif
+
 #include "common/Logger.hpp"
 
 namespace twili {
@@ -29,12 +40,18 @@ namespace platform {
 namespace unix {
 namespace detail {
 
+static const size_t MaxEventsPerWait = 64;
+
 EventLoop::EventThreadNotifier::EventThreadNotifier(EventLoop &loop) : loop(loop) {
 }
 
 void EventLoop::EventThreadNotifier::Notify() const {
 	char buf[] = ".";
 	if(write(loop.notification_pipe[1], buf, sizeof(buf)) != sizeof(buf)) {
+		if(errno == EAGAIN || errno == EWOULDBLOCK) {
+			// pipe is full, so the event thread already has a wakeup pending
+			return;
+		}
 		LogMessage(Fatal, "failed to write to event thread notification pipe: %s", strerror(errno));
 		exit(1);
 	}
@@ -47,10 +64,46 @@ EventLoop::EventLoop(Logic &logic) :
 		LogMessage(Fatal, "failed to create pipe for event thread notifications: %s", strerror(errno));
 		exit(1);
 	}
+	for(int fd : notification_pipe) {
+		if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+			LogMessage(Fatal, "failed to make event thread notification pipe non-blocking: %s", strerror(errno));
+			exit(1);
+		}
+	}
+
+#if defined(__linux__)
+	poll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(poll_fd < 0) {
+		LogMessage(Fatal, "failed to create epoll instance: %s", strerror(errno));
+		exit(1);
+	}
+
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr; // identifies the notification pipe
+	if(epoll_ctl(poll_fd, EPOLL_CTL_ADD, notification_pipe[0], &ev) < 0) {
+		LogMessage(Fatal, "failed to add notification pipe to epoll instance: %s", strerror(errno));
+		exit(1);
+	}
+#else
+	poll_fd = kqueue();
+	if(poll_fd < 0) {
+		LogMessage(Fatal, "failed to create kqueue: %s", strerror(errno));
+		exit(1);
+	}
+
+	struct kevent kev;
+	EV_SET(&kev, notification_pipe[0], EVFILT_READ, EV_ADD, 0, 0, nullptr); // null udata identifies the notification pipe
+	if(kevent(poll_fd, &kev, 1, nullptr, 0, nullptr) < 0) {
+		LogMessage(Fatal, "failed to add notification pipe to kqueue: %s", strerror(errno));
+		exit(1);
+	}
+#endif
 }
 
 EventLoop::~EventLoop() {
 	Destroy();
+	close(poll_fd);
 	close(notification_pipe[0]);
 	close(notification_pipe[1]);
 }
@@ -59,65 +112,259 @@ EventLoop::Notifier &EventLoop::GetNotifier() {
 	return notifier;
 }
 
+void EventLoop::MemberAdded(FileMember &member) {
+	int fd = member.GetFile().fd;
+	
+	member.loop = this;
+	member.registered_read = false;
+	member.registered_write = false;
+
+	// select() treated regular files as always ready, but epoll refuses
+	// them and kqueue doesn't report EOF on them, so keep that behaviour by
+	// signalling them on every iteration instead.
+	struct stat st;
+	member.polled = !(fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+
+#if defined(__linux__)
+	if(member.polled) {
+		struct epoll_event ev = {};
+		ev.events = 0; // UpdateInterest() fills this in
+		ev.data.ptr = &member;
+		if(epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			if(errno != EPERM) {
+				LogMessage(Fatal, "failed to add fd %d to epoll instance: %s", fd, strerror(errno));
+				exit(1);
+			}
+			member.polled = false;
+		}
+	}
+#endif
+
+	if(!member.polled) {
+		unpolled_members.push_back(&member);
+		return;
+	}
+	
+	UpdateInterest(member);
+}
+
+void EventLoop::MemberRemoved(FileMember &member) {
+	{
+		std::lock_guard<std::mutex> lock(interest_update_mutex);
+		member.loop = nullptr;
+		if(member.interest_update_pending) {
+			interest_updates.erase(std::remove(interest_updates.begin(), interest_updates.end(), &member), interest_updates.end());
+			member.interest_update_pending = false;
+		}
+	}
+
+	// don't dispatch anything else to this member if we're in the middle of
+	// dispatching events
+	for(size_t i = ready_index; i < ready_events.size(); i++) {
+		if(ready_events[i].member == &member) {
+			ready_events[i].member = nullptr;
+		}
+	}
+
+	if(!member.polled) {
+		unpolled_members.erase(std::remove(unpolled_members.begin(), unpolled_members.end(), &member), unpolled_members.end());
+		return;
+	}
+
+	// The fd may have already been closed, which would have removed it from
+	// the kernel's interest list for us, so failures are fine here.
+	int fd = member.GetFile().fd;
+#if defined(__linux__)
+	if(epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, nullptr) < 0) {
+		LogMessage(Debug, "failed to remove fd %d from epoll instance: %s", fd, strerror(errno));
+	}
+#else
+	struct kevent changes[2];
+	int count = 0;
+	if(member.registered_read) {
+		EV_SET(&changes[count++], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+	}
+	if(member.registered_write) {
+		EV_SET(&changes[count++], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+	}
+	if(count > 0 && kevent(poll_fd, changes, count, nullptr, 0, nullptr) < 0) {
+		LogMessage(Debug, "failed to remove fd %d from kqueue: %s", fd, strerror(errno));
+	}
+#endif
+	member.registered_read = false;
+	member.registered_write = false;
+}
+
+void EventLoop::UpdateInterest(FileMember &member) {
+	if(!member.polled) {
+		return;
+	}
+	
+	bool read = member.WantsRead();
+	bool write = member.WantsWrite();
+	if(read == member.registered_read && write == member.registered_write) {
+		return;
+	}
+
+	int fd = member.GetFile().fd;
+#if defined(__linux__)
+	struct epoll_event ev = {};
+	ev.events = (read ? (uint32_t) EPOLLIN : 0) | (write ? (uint32_t) EPOLLOUT : 0);
+	ev.data.ptr = &member;
+	if(epoll_ctl(poll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+		LogMessage(Fatal, "failed to modify fd %d in epoll instance: %s", fd, strerror(errno));
+		exit(1);
+	}
+#else
+	struct kevent changes[2];
+	int count = 0;
+	if(read != member.registered_read) {
+		EV_SET(&changes[count++], fd, EVFILT_READ, read ? EV_ADD : EV_DELETE, 0, 0, &member);
+	}
+	if(write != member.registered_write) {
+		EV_SET(&changes[count++], fd, EVFILT_WRITE, write ? EV_ADD : EV_DELETE, 0, 0, &member);
+	}
+	if(kevent(poll_fd, changes, count, nullptr, 0, nullptr) < 0) {
+		LogMessage(Fatal, "failed to modify fd %d in kqueue: %s", fd, strerror(errno));
+		exit(1);
+	}
+#endif
+	
+	member.registered_read = read;
+	member.registered_write = write;
+}
+
+void EventLoop::QueueInterestUpdate(FileMember &member) {
+	std::lock_guard<std::mutex> lock(interest_update_mutex);
+	if(member.loop != this || member.interest_update_pending) {
+		return;
+	}
+	member.interest_update_pending = true;
+	interest_updates.push_back(&member);
+}
+
+void EventLoop::DrainNotifications() {
+	char buf[256];
+	ssize_t r;
+	while((r = read(notification_pipe[0], buf, sizeof(buf))) > 0) {
+	}
+	if(r < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		LogMessage(Fatal, "failed to read from event thread notification pipe: %s", strerror(errno));
+		exit(1);
+	}
+}
+
 void EventLoop::event_thread_func() {
+	std::vector<FileMember*> updates;
+	
 	while(!event_thread_destroy) {
 		logic.Prepare(*this);
 
-		fd_set readfds;
-		fd_set writefds;
-		fd_set errorfds;
-		int max_fd = 0;
+		{
+			std::lock_guard<std::mutex> lock(interest_update_mutex);
+			updates.swap(interest_updates);
+			for(FileMember *member : updates) {
+				member->interest_update_pending = false;
+			}
+		}
+		for(FileMember *member : updates) {
+			UpdateInterest(*member);
+		}
+		updates.clear();
+
+		ready_events.clear();
+		for(FileMember *member : unpolled_members) {
+			bool read = member->WantsRead();
+			bool write = member->WantsWrite();
+			if(read || write) {
+				ready_events.push_back({member, read, write, false});
+			}
+		}
 
-		FD_ZERO(&readfds);
-		FD_ZERO(&writefds);
-		FD_ZERO(&errorfds);
+		// don't block if we already have unpolled members to service
+		bool block = ready_events.empty();
 		
-		for(auto i = members.begin(); i != members.end(); i++) {
-			FileMember &member = i->get();
-			File &f = member.GetFile();
-			if(member.WantsRead()) {
-				FD_SET(f.fd, &readfds);
+#if defined(__linux__)
+		struct epoll_event events[MaxEventsPerWait];
+		int count = epoll_wait(poll_fd, events, MaxEventsPerWait, block ? -1 : 0);
+		if(count < 0) {
+			if(errno == EINTR) {
+				continue;
 			}
-			if(member.WantsWrite()) {
-				FD_SET(f.fd, &writefds);
+			LogMessage(Fatal, "failed to wait on epoll instance: %s", strerror(errno));
+			exit(1);
+		}
+
+		for(int i = 0; i < count; i++) {
+			if(events[i].data.ptr == nullptr) {
+				DrainNotifications();
+				continue;
 			}
-			FD_SET(f.fd, &errorfds);
-			max_fd = std::max(max_fd, f.fd);
+
+			FileMember *member = (FileMember*) events[i].data.ptr;
+			uint32_t e = events[i].events;
+
+			// A hangup with data still pending is reported as EPOLLHUP, so let
+			// members that are reading find the EOF themselves, like they would
+			// have with select().
+			ready_events.push_back({
+					member,
+					(e & EPOLLIN) || ((e & EPOLLHUP) && member->registered_read),
+					(e & EPOLLOUT) != 0,
+					(e & EPOLLERR) || ((e & EPOLLHUP) && !member->registered_read)});
 		}
-		
-		// add event thread notification pipe
-		max_fd = std::max(max_fd, notification_pipe[0]);
-		FD_SET(notification_pipe[0], &readfds);
-		
-		if(select(max_fd + 1, &readfds, &writefds, &errorfds, NULL) < 0) {
-			LogMessage(Fatal, "failed to select file descriptors: %s", NetErrStr());
+#else
+		struct kevent events[MaxEventsPerWait];
+		struct timespec zero = {0, 0};
+		int count = kevent(poll_fd, nullptr, 0, events, MaxEventsPerWait, block ? nullptr : &zero);
+		if(count < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			LogMessage(Fatal, "failed to wait on kqueue: %s", strerror(errno));
 			exit(1);
 		}
 
-		// Check select status on event thread notification pipe
-		if(FD_ISSET(notification_pipe[0], &readfds)) {
-			char buf[64];
-			ssize_t r = read(notification_pipe[0], buf, sizeof(buf));
-			if(r < 0) {
-				LogMessage(Fatal, "failed to read from event thread notification pipe: %s", strerror(errno));
-				exit(1);
+		for(int i = 0; i < count; i++) {
+			if(events[i].udata == nullptr) {
+				DrainNotifications();
+				continue;
 			}
-			LogMessage(Debug, "event thread notified: '%.*s'", r, buf);
+
+			ready_events.push_back({
+					(FileMember*) events[i].udata,
+					events[i].filter == EVFILT_READ,
+					events[i].filter == EVFILT_WRITE,
+					(events[i].flags & EV_ERROR) != 0});
 		}
+#endif
 
-		for(auto i = members.begin(); i != members.end(); i++) {
-			FileMember &member = i->get();
-			File &f = member.GetFile();
-			if(FD_ISSET(f.fd, &readfds)) {
-				member.SignalRead();
+		// Members may be added or removed by signal handlers, which is why
+		// we go through ready_events by index here.
+		for(ready_index = 0; ready_index < ready_events.size(); ready_index++) {
+			ReadyEvent &event = ready_events[ready_index];
+			if(event.member && event.read) {
+				event.member->SignalRead();
+			}
+			if(event.member && event.write) {
+				event.member->SignalWrite();
 			}
-			if(FD_ISSET(f.fd, &writefds)) {
-				member.SignalWrite();
+			if(event.member && event.error) {
+				event.member->SignalError();
 			}
-			if(FD_ISSET(f.fd, &errorfds)) {
-				member.SignalError();
+			if(event.member) {
+				UpdateInterest(*event.member);
 			}
 		}
+		ready_events.clear();
+		ready_index = 0;
+	}
+}
+
+void EventLoopFileMember::RequestInterestUpdate() {
+	EventLoop *l = loop;
+	if(l != nullptr) {
+		l->QueueInterestUpdate(*this);
 	}
 }
 
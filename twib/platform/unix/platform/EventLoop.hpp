@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include<atomic>
 #include<list>
 #include<vector>
 #include<thread>
@@ -39,6 +40,12 @@ class EventLoop;
 
 class EventLoopFileMember {
 	friend class EventLoop;
+ public:
+	// The event loop only re-checks WantsRead()/WantsWrite() for members
+	// that were just signalled. If interest changes for any other reason
+	// (e.g. output was queued from another thread), call this and then
+	// notify the loop.
+	void RequestInterestUpdate();
  protected:
 	virtual bool WantsRead();
 	virtual bool WantsWrite();
@@ -47,7 +54,11 @@ class EventLoopFileMember {
 	virtual void SignalError();
 	virtual File &GetFile() = 0;
  private:
-	size_t last_service = 0;
+	std::atomic<EventLoop*> loop = nullptr;
+	bool polled = false; // false for files that the kernel can't poll (regular files)
+	bool registered_read = false;
+	bool registered_write = false;
+	bool interest_update_pending = false;
 };
 
 // to provide a common interface
@@ -62,6 +73,7 @@ class EventLoopSocketMember : public EventLoopFileMember {
 
 class EventLoop :
 		public platform::common::detail::EventLoopBase<EventLoop, EventLoopFileMember> {
+	friend class EventLoopFileMember;
  public:
 	using FileMember = EventLoopFileMember;
 	using SocketMember = EventLoopSocketMember;
@@ -72,6 +84,28 @@ class EventLoop :
 	virtual Notifier &GetNotifier() override;
 protected:
 	virtual void event_thread_func() override;
+	virtual void MemberAdded(FileMember &member) override;
+	virtual void MemberRemoved(FileMember &member) override;
+
+	void UpdateInterest(FileMember &member);
+	void QueueInterestUpdate(FileMember &member);
+	void DrainNotifications();
+
+	// epoll fd on linux, kqueue fd elsewhere
+	int poll_fd;
+
+	struct ReadyEvent {
+		FileMember *member; // nulled out if the member is removed before it is dispatched
+		bool read;
+		bool write;
+		bool error;
+	};
+	std::vector<ReadyEvent> ready_events;
+	size_t ready_index = 0;
+	std::vector<FileMember*> unpolled_members;
+
+	std::mutex interest_update_mutex;
+	std::vector<FileMember*> interest_updates;
 
 	// TODO: use File to RAII this
 	int notification_pipe[2];
@@ -22,6 +22,9 @@
 
 #include<fcntl.h>
 #include<sys/stat.h>
+#include<sys/uio.h>
+
+#include<algorithm>
 
 namespace twili {
 namespace platform {
@@ -62,7 +65,7 @@ File File::OpenForRead(const char *path) {
 }
 
 File File::OpenForClobberingWrite(const char *path) {
-	int fd = open(path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 	if(fd < 0) {
 		throw NetworkError(errno);
 	}
@@ -97,6 +100,12 @@ size_t File::GetSize() {
 	return statbuf.st_size;
 }
 
+void File::Seek(uint64_t offset) {
+	if(lseek(fd, offset, SEEK_SET) == (off_t) -1) {
+		throw NetworkError(errno);
+	}
+}
+
 size_t File::Read(void *buf, size_t size) {
 	ssize_t r = read(fd, buf, size);
 	if(r == -1) {
@@ -151,6 +160,19 @@ ssize_t Socket::Send(const void *buf, size_t length, int flags) {
 	return send(fd, buf, length, flags);
 }
 
+ssize_t Socket::SendV(const std::tuple<const uint8_t*, size_t> *buffers, size_t count, int flags) {
+	struct iovec iov[MaxSendFragments];
+	count = std::min(count, MaxSendFragments);
+	for(size_t i = 0; i < count; i++) {
+		iov[i].iov_base = (void*) std::get<0>(buffers[i]);
+		iov[i].iov_len = std::get<1>(buffers[i]);
+	}
+	struct msghdr msg = {};
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	return sendmsg(fd, &msg, flags);
+}
+
 int Socket::SetSockOpt(int level, int option_name, const void *option_value, socklen_t option_len) {
 	return setsockopt(fd, level, option_name, option_value, option_len);
 }
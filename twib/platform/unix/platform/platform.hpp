@@ -35,6 +35,7 @@
 #include<stdint.h>
 
 #include<stdexcept>
+#include<tuple>
 
 namespace twili {
 namespace platform {
@@ -68,6 +69,7 @@ public:
 	void Close();
 
 	size_t GetSize();
+	void Seek(uint64_t offset);
 	size_t Read(void *buffer, size_t size);
 	size_t Write(const void *buffer, size_t size);
 };
@@ -79,6 +81,8 @@ class NetworkError : public std::runtime_error {
 
 class Socket : public File {
  public:
+	static constexpr size_t MaxSendFragments = 64;
+	
 	Socket(int domain, int type, int protocol);
 	Socket(File &&f);
 	Socket(Socket &&);
@@ -91,6 +95,8 @@ class Socket : public File {
 	ssize_t Recv(void *buf, size_t length, int flags);
 	ssize_t RecvFrom(void *buf, size_t length, int flags, struct sockaddr *address, socklen_t *address_len);
 	ssize_t Send(const void *buf, size_t length, int flags);
+	// gathers up to MaxSendFragments buffers into one send
+	ssize_t SendV(const std::tuple<const uint8_t*, size_t> *buffers, size_t count, int flags);
 	int SetSockOpt(int level, int option_name, const void *option_value, socklen_t option_len); // no error check
 	
 	// checks errors for you
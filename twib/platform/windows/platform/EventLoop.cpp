@@ -95,6 +95,9 @@ void EventLoop::event_thread_func() {
 }
 
 // default implementations for Native
+void EventLoopNativeMember::RequestInterestUpdate() {
+}
+
 bool EventLoopNativeMember::WantsSignal() {
 	return false;
 }
@@ -41,6 +41,10 @@ class EventLoop;
 
 class EventLoopNativeMember {
 	friend class EventLoop;
+public:
+	// The windows event loop re-evaluates every member on every iteration,
+	// so there is nothing to do here besides notifying the loop.
+	void RequestInterestUpdate();
 protected:
 	virtual bool WantsSignal();
 	virtual void Signal();
@@ -20,13 +20,15 @@
 
 #include "platform.hpp"
 
+#include<string.h>
+
 namespace twili {
 namespace platform {
 namespace fs {
 
 std::optional<Stat> StatFile(const char *path) {
-	DWORD attributes = GetFileAttributes(path);
-	if(attributes == INVALID_FILE_ATTRIBUTES) {
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(!GetFileAttributesEx(path, GetFileExInfoStandard, &data)) {
 		DWORD err = GetLastError();
 		if(err != ERROR_PATH_NOT_FOUND && err != ERROR_FILE_NOT_FOUND) {
 			throw NetworkError(err);
@@ -34,7 +36,10 @@ std::optional<Stat> StatFile(const char *path) {
 		return std::nullopt;
 	} else {
 		Stat out;
-		out.is_directory = attributes & FILE_ATTRIBUTE_DIRECTORY;
+		out.is_directory = data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+		out.size = ((uint64_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		out.mtime = ((int64_t) data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+		return out;
 	}
 }
 
@@ -53,6 +58,36 @@ std::string BaseName(const char *path) {
 	return out;
 }
 
+std::vector<std::string> ListDirectory(const char *path) {
+	std::string pattern(path);
+	pattern+= "\\*";
+
+	WIN32_FIND_DATA data;
+	HANDLE find = FindFirstFile(pattern.c_str(), &data);
+	if(find == INVALID_HANDLE_VALUE) {
+		DWORD err = GetLastError();
+		if(err == ERROR_FILE_NOT_FOUND) {
+			return {};
+		}
+		throw NetworkError(err);
+	}
+
+	std::vector<std::string> names;
+	do {
+		if(strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) {
+			continue;
+		}
+		names.push_back(data.cFileName);
+	} while(FindNextFile(find, &data));
+
+	DWORD err = GetLastError();
+	FindClose(find);
+	if(err != ERROR_NO_MORE_FILES) {
+		throw NetworkError(err);
+	}
+	return names;
+}
+
 } // namespace fs
 } // namespace platform
 } // namespace twili
\ No newline at end of file
@@ -24,6 +24,7 @@
 #include "platform/platform.hpp"
 
 #include<optional>
+#include<algorithm>
 
 #include "common/Logger.hpp"
 
@@ -181,6 +182,19 @@ ssize_t Socket::Send(const void *buffer, size_t length, int flags) {
 	return bytes;
 }
 
+ssize_t Socket::SendV(const std::tuple<const uint8_t*, size_t> *buffers, size_t count, int flags) {
+	DWORD bytes;
+	WSABUF bufs[MaxSendFragments];
+	count = std::min(count, MaxSendFragments);
+	for(size_t i = 0; i < count; i++) {
+		bufs[i] = { (ULONG) std::get<1>(buffers[i]), (CHAR*) std::get<0>(buffers[i]) };
+	}
+	if(WSASend(fd, bufs, (DWORD) count, &bytes, flags, nullptr, nullptr) != 0) {
+		return -1;
+	}
+	return bytes;
+}
+
 int Socket::SetSockOpt(int level, int option_name, const void *option_value, socklen_t option_len) {
 	return setsockopt(fd, level, option_name, (const char*) option_value, option_len);
 }
@@ -250,6 +264,14 @@ size_t File::GetSize() {
 	return size.QuadPart;
 }
 
+void File::Seek(uint64_t offset) {
+	LARGE_INTEGER distance;
+	distance.QuadPart = offset;
+	if(!SetFilePointerEx(handle, distance, nullptr, FILE_BEGIN)) {
+		throw NetworkError(GetLastError());
+	}
+}
+
 size_t File::Read(void *buffer, size_t size) {
 	DWORD actual;
 	if(!ReadFile(handle, buffer, size, &actual, nullptr)) {
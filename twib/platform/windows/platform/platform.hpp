@@ -41,6 +41,7 @@
 #include<stdint.h>
 
 #include<stdexcept>
+#include<tuple>
 
 // pls
 typedef signed long long ssize_t;
@@ -110,6 +111,8 @@ class NetworkError : public std::runtime_error {
 
 class Socket {
  public:
+	static constexpr size_t MaxSendFragments = 64;
+	
 	Socket(int domain, int type, int protocol);
 	Socket(SOCKET fd);
 
@@ -123,6 +126,8 @@ class Socket {
 	ssize_t Recv(void *buf, size_t length, int flags);
 	ssize_t RecvFrom(void *buf, size_t length, int flags, struct sockaddr *address, socklen_t *address_len);
 	ssize_t Send(const void *buf, size_t length, int flags);
+	// gathers up to MaxSendFragments buffers into one send
+	ssize_t SendV(const std::tuple<const uint8_t*, size_t> *buffers, size_t count, int flags);
 	int SetSockOpt(int level, int option_name, const void *option_value, socklen_t option_len);
 
 	void Bind(const struct sockaddr *address, socklen_t address_len);
@@ -145,6 +150,7 @@ public:
 	static File BorrowStdout();
 
 	size_t GetSize();
+	void Seek(uint64_t offset);
 	size_t Read(void *buffer, size_t size);
 	size_t Write(const void *buffer, size_t size);
 };
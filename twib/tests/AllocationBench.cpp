@@ -0,0 +1,90 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+#include "EchoServer.hpp"
+
+#include<atomic>
+#include<chrono>
+#include<new>
+
+#include<stdlib.h>
+
+#include "tool/RemoteObject.hpp"
+#include "tool/SocketClient.hpp"
+
+// Every allocation in twib-bench goes through here, so the request path
+// can be checked for heap traffic.
+static std::atomic<size_t> allocations = 0;
+
+void *operator new(size_t size) {
+	allocations++;
+	void *ptr = malloc(size == 0 ? 1 : size);
+	if(ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t WarmupRequests = 1000;
+const size_t Requests = 100000;
+
+} // namespace
+
+// A steady-state small request, as issued by memory polling or ps: pack an
+// argument, send it, wait for the response and unpack the result. Counts
+// allocations on both ends of the socket, so the echo server is included.
+TWIB_BENCHMARK(AllocationsPerRequest) {
+	EchoServer server;
+	tool::client::SocketClient client {platform::Socket(platform::File(server.client_fd))};
+	tool::RemoteObject obj(client, 0, 0);
+
+	uint64_t result = 0;
+	for(uint64_t i = 0; i < WarmupRequests; i++) {
+		obj.SendSmartSyncRequest(0, tool::in<uint64_t>(i), tool::out<uint64_t>(result));
+		TWIB_CHECK(result == i);
+	}
+
+	size_t before = allocations;
+	auto start = std::chrono::steady_clock::now();
+	for(uint64_t i = 0; i < Requests; i++) {
+		obj.SendSmartSyncRequest(0, tool::in<uint64_t>(i), tool::out<uint64_t>(result));
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	size_t after = allocations;
+	TWIB_CHECK(result == Requests - 1);
+
+	Report("small_request", "in<u64>, out<u64>", (double) (after - before) / Requests, "allocs/request");
+	Report("small_request", "in<u64>, out<u64>", seconds * 1e6 / Requests, "us/request");
+}
@@ -0,0 +1,97 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<chrono>
+#include<vector>
+
+#include "Compression.hpp"
+
+using namespace twili;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t BytesPerRun = 256 << 20;
+
+class Input {
+ public:
+	const char *name;
+	std::vector<uint8_t> data;
+};
+
+std::vector<Input> MakeInputs(size_t size) {
+	std::vector<Input> inputs;
+
+	Input random {"random", {}};
+	random.data.resize(size);
+	FillRandom(random.data.data(), size, 1);
+	inputs.push_back(std::move(random));
+
+	inputs.push_back(Input {"zeroes", std::vector<uint8_t>(size, 0)});
+
+	// a few distinct 8-byte words in random order, about as compressible
+	// as typical heap contents
+	Input mixed {"mixed", {}};
+	std::vector<uint8_t> words(256), picks(size / 8 + 1);
+	FillRandom(words.data(), words.size(), 2);
+	FillRandom(picks.data(), picks.size(), 3);
+	mixed.data.resize(size);
+	for(size_t i = 0; i < size; i++) {
+		mixed.data[i] = words[(picks[i / 8] & 0x1f) * 8 + (i % 8)];
+	}
+	inputs.push_back(std::move(mixed));
+
+	return inputs;
+}
+
+std::string Describe(const Input &input) {
+	return std::string(input.name) + ", " + std::to_string(input.data.size() >> 10) + " KiB";
+}
+
+} // namespace
+
+TWIB_BENCHMARK(CompressionThroughput) {
+	for(size_t size : {(size_t) 0x10000, (size_t) protocol::COMPRESSION_MAX_SIZE}) {
+		for(Input &input : MakeInputs(size)) {
+			size_t iterations = BytesPerRun / size;
+
+			std::vector<uint8_t> block;
+			auto start = std::chrono::steady_clock::now();
+			for(size_t i = 0; i < iterations; i++) {
+				block = util::CompressLZ4(input.data.data(), input.data.size());
+			}
+			double compress_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			std::vector<uint8_t> out(size);
+			start = std::chrono::steady_clock::now();
+			for(size_t i = 0; i < iterations; i++) {
+				TWIB_CHECK(util::DecompressLZ4(block.data(), block.size(), out.data(), out.size()));
+			}
+			double decompress_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			TWIB_CHECK(out == input.data);
+
+			Report("lz4_compress", Describe(input), (double) size * iterations / compress_seconds / (1 << 20), "MiB/s");
+			Report("lz4_decompress", Describe(input), (double) size * iterations / decompress_seconds / (1 << 20), "MiB/s");
+			Report("lz4_ratio", Describe(input), (double) block.size() / size * 100.0, "% of input");
+		}
+	}
+}
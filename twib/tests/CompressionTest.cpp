@@ -0,0 +1,206 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<vector>
+
+#include<string.h>
+
+#include "Compression.hpp"
+
+using namespace twili;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t Sizes[] = {0, 1, 4, 5, 12, 13, 16, 255, 256, 4095, 4096, 65535, 65536, 70000, 0x80000};
+
+// Repetitive but not trivially so, a bit like code or structured data.
+std::vector<uint8_t> MakeMixed(size_t size, uint32_t seed) {
+	std::vector<uint8_t> words(256);
+	FillRandom(words.data(), words.size(), seed);
+	std::vector<uint8_t> picks(size / 8 + 1);
+	FillRandom(picks.data(), picks.size(), seed + 1);
+	std::vector<uint8_t> data(size);
+	for(size_t i = 0; i < size; i++) {
+		data[i] = words[(picks[i / 8] & 0x1f) * 8 + (i % 8)];
+	}
+	return data;
+}
+
+std::vector<uint8_t> MakeRandom(size_t size, uint32_t seed) {
+	std::vector<uint8_t> data(size);
+	FillRandom(data.data(), data.size(), seed);
+	return data;
+}
+
+bool RoundTrips(const std::vector<uint8_t> &data) {
+	std::vector<uint8_t> block = util::CompressLZ4(data.data(), data.size());
+	std::vector<uint8_t> out(data.size());
+	return util::DecompressLZ4(block.data(), block.size(), out.data(), out.size()) && out == data;
+}
+
+protocol::MessageHeader HeaderFor(const std::vector<uint8_t> &payload) {
+	protocol::MessageHeader mh = {};
+	mh.payload_size = payload.size();
+	return mh;
+}
+
+} // namespace
+
+TWIB_TEST(CompressionRoundTripsRandomData) {
+	for(size_t size : Sizes) {
+		TWIB_CHECK(RoundTrips(MakeRandom(size, size + 1)));
+	}
+}
+
+TWIB_TEST(CompressionRoundTripsZeroes) {
+	for(size_t size : Sizes) {
+		std::vector<uint8_t> data(size, 0);
+		TWIB_CHECK(RoundTrips(data));
+	}
+
+	// one long overlapping match, so it should shrink to almost nothing
+	std::vector<uint8_t> zeroes(0x80000, 0);
+	TWIB_CHECK(util::CompressLZ4(zeroes.data(), zeroes.size()).size() < 0x1000);
+}
+
+TWIB_TEST(CompressionRoundTripsMixedData) {
+	for(size_t size : Sizes) {
+		TWIB_CHECK(RoundTrips(MakeMixed(size, size + 1)));
+	}
+	// matches more than 64 KiB back can't be encoded, so this needs the
+	// offset limit to be respected
+	std::vector<uint8_t> data = MakeRandom(0x20000, 7);
+	memcpy(data.data() + 0x18000, data.data(), 0x8000);
+	TWIB_CHECK(RoundTrips(data));
+}
+
+TWIB_TEST(CompressionGrowsIncompressibleDataOnlySlightly) {
+	std::vector<uint8_t> data = MakeRandom(0x80000, 3);
+	std::vector<uint8_t> block = util::CompressLZ4(data.data(), data.size());
+	TWIB_CHECK(block.size() <= data.size() + data.size() / 255 + 16);
+}
+
+TWIB_TEST(CompressionRejectsTruncatedBlocks) {
+	std::vector<uint8_t> data = MakeMixed(0x2000, 5);
+	std::vector<uint8_t> block = util::CompressLZ4(data.data(), data.size());
+	std::vector<uint8_t> out(data.size());
+	for(size_t size = 0; size < block.size(); size++) {
+		TWIB_CHECK(!util::DecompressLZ4(block.data(), size, out.data(), out.size()));
+	}
+}
+
+TWIB_TEST(CompressionRejectsWrongSizes) {
+	std::vector<uint8_t> data = MakeMixed(0x2000, 6);
+	std::vector<uint8_t> block = util::CompressLZ4(data.data(), data.size());
+	std::vector<uint8_t> small(data.size() - 1), large(data.size() + 1);
+	TWIB_CHECK(!util::DecompressLZ4(block.data(), block.size(), small.data(), small.size()));
+	TWIB_CHECK(!util::DecompressLZ4(block.data(), block.size(), large.data(), large.size()));
+}
+
+TWIB_TEST(CompressionSurvivesCorruptBlocks) {
+	std::vector<uint8_t> data = MakeMixed(0x2000, 8);
+	std::vector<uint8_t> block = util::CompressLZ4(data.data(), data.size());
+	std::vector<uint8_t> noise(block.size() * 2);
+	FillRandom(noise.data(), noise.size(), 9);
+	for(size_t i = 0; i < block.size(); i++) {
+		// flip each byte in turn; decoding must either fail or stay in
+		// bounds and produce exactly the expected length
+		std::vector<uint8_t> corrupt = block;
+		corrupt[i]^= noise[i] | 1;
+		std::vector<uint8_t> out(data.size());
+		util::DecompressLZ4(corrupt.data(), corrupt.size(), out.data(), out.size());
+	}
+	for(uint32_t seed = 0; seed < 256; seed++) {
+		std::vector<uint8_t> garbage = MakeRandom(64 + seed, seed);
+		std::vector<uint8_t> out(0x1000);
+		util::DecompressLZ4(garbage.data(), garbage.size(), out.data(), out.size());
+	}
+}
+
+TWIB_TEST(CompressionPayloadRoundTrip) {
+	std::vector<uint8_t> original = MakeMixed(0x10000, 10);
+	std::vector<uint8_t> payload = original;
+	protocol::MessageHeader mh = HeaderFor(payload);
+	protocol::CompressPayload(mh, payload);
+	TWIB_CHECK(mh.flags & protocol::FLAG_COMPRESSED);
+	TWIB_CHECK(mh.payload_size == payload.size());
+	TWIB_CHECK(payload.size() < original.size());
+
+	TWIB_CHECK(protocol::DecompressPayload(mh, payload));
+	TWIB_CHECK(!(mh.flags & protocol::FLAG_COMPRESSED));
+	TWIB_CHECK(mh.payload_size == original.size());
+	TWIB_CHECK(payload == original);
+}
+
+TWIB_TEST(CompressionPayloadLeavesUnsuitablePayloadsAlone) {
+	for(std::vector<uint8_t> original : {
+			std::vector<uint8_t>(protocol::COMPRESSION_THRESHOLD - 1, 0), // too small
+			std::vector<uint8_t>(protocol::COMPRESSION_MAX_SIZE + 1, 0), // too big
+			MakeRandom(0x10000, 11)}) { // wouldn't shrink
+		std::vector<uint8_t> payload = original;
+		protocol::MessageHeader mh = HeaderFor(payload);
+		protocol::CompressPayload(mh, payload);
+		TWIB_CHECK(!(mh.flags & protocol::FLAG_COMPRESSED));
+		TWIB_CHECK(payload == original);
+	}
+}
+
+TWIB_TEST(CompressionPayloadRejectsMalformedPayloads) {
+	std::vector<uint8_t> original = MakeMixed(0x10000, 12);
+	std::vector<uint8_t> compressed = original;
+	protocol::MessageHeader compressed_mh = HeaderFor(compressed);
+	protocol::CompressPayload(compressed_mh, compressed);
+	TWIB_CHECK(compressed_mh.flags & protocol::FLAG_COMPRESSED);
+
+	// shorter than the size prefix
+	std::vector<uint8_t> payload(compressed.begin(), compressed.begin() + 4);
+	protocol::MessageHeader mh = compressed_mh;
+	TWIB_CHECK(!protocol::DecompressPayload(mh, payload));
+
+	// claims to expand past the limit
+	payload = compressed;
+	uint64_t huge = protocol::COMPRESSION_MAX_SIZE + 1;
+	memcpy(payload.data(), &huge, sizeof(huge));
+	mh = compressed_mh;
+	TWIB_CHECK(!protocol::DecompressPayload(mh, payload));
+
+	// claims a different size than the block expands to
+	payload = compressed;
+	uint64_t wrong = original.size() - 1;
+	memcpy(payload.data(), &wrong, sizeof(wrong));
+	mh = compressed_mh;
+	TWIB_CHECK(!protocol::DecompressPayload(mh, payload));
+
+	// truncated block, through the util::Buffer overload
+	util::Buffer buffer;
+	buffer.Write(compressed.data(), compressed.size() - 1);
+	mh = compressed_mh;
+	TWIB_CHECK(!protocol::DecompressPayload(mh, buffer));
+
+	// and the whole thing, through the same overload
+	buffer.Clear();
+	buffer.Write(compressed.data(), compressed.size());
+	mh = compressed_mh;
+	TWIB_CHECK(protocol::DecompressPayload(mh, buffer));
+	TWIB_CHECK(buffer.GetData() == original);
+}
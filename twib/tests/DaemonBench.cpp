@@ -0,0 +1,180 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<atomic>
+#include<chrono>
+#include<memory>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include<stdlib.h>
+#include<unistd.h>
+
+#include "daemon/Daemon.hpp"
+#include "Protocol.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t ClientCounts[] = {4, 16};
+const size_t DeviceCounts[] = {1, 8};
+const size_t DispatchThreads[] = {1, 4};
+const size_t RequestsPerClient = 4000;
+const size_t Window = 8; // requests each client keeps in flight
+
+// Stands in for a twib connected to a frontend. Keeps Window requests
+// going to one device, sending another each time a response comes back.
+// Responses arrive on dispatch threads, so nothing here can fail a check.
+class LoadClient : public daemon::Client {
+ public:
+	LoadClient(daemon::Daemon &daemon, uint32_t device_id) : daemon(daemon), device_id(device_id) {
+	}
+
+	void Start() {
+		for(size_t i = 0; i < Window; i++) {
+			Issue();
+		}
+	}
+
+	virtual void PostResponse(daemon::Response &r) override {
+		if(r.result_code != 0) {
+			errors++;
+		}
+		completed++;
+		Issue();
+	}
+
+	bool Done() {
+		return completed == RequestsPerClient;
+	}
+
+	std::atomic<size_t> completed = 0;
+	std::atomic<size_t> errors = 0;
+
+ private:
+	void Issue() {
+		size_t n = issued++;
+		if(n < RequestsPerClient) {
+			daemon.PostRequest(daemon::Request(shared_from_this(), device_id, 0, (uint32_t) protocol::ITwibDeviceInterface::Command::LIST_PROCESSES, n, {}));
+		}
+	}
+
+	daemon::Daemon &daemon;
+	const uint32_t device_id;
+	std::atomic<size_t> issued = 0;
+};
+
+// Runs a daemon in-process, with simulated devices attached through its
+// own sim backend. Whatever other backends twibd was built with come up
+// too, the same as they would in twibd.
+class DaemonRig {
+ public:
+	DaemonRig(size_t dispatch_threads, size_t devices) : daemon(std::chrono::milliseconds(0), dispatch_threads) {
+		char tmpl[] = "/tmp/twib-sim-XXXXXX";
+		TWIB_CHECK(mkdtemp(tmpl) != nullptr);
+		root = tmpl;
+
+		main_thread = std::thread([this]() {
+			while(running) {
+				daemon.Process();
+			}
+		});
+
+		for(size_t i = 0; i < devices; i++) {
+			daemon::backend::sim::SimDevice::Config config;
+			config.root = root;
+			config.serial_number = "bench-" + std::to_string(i);
+			config.nickname = config.serial_number;
+			TWIB_CHECK(daemon.AttachSimulatedDevice(config) == "Ok");
+			// the same ID the backend assigns once the device identifies
+			device_ids.push_back(std::hash<std::string>()(config.serial_number));
+		}
+		for(uint32_t id : device_ids) {
+			TWIB_CHECK(WaitFor([&]() {
+				daemon::Request rq(nullptr, id, 0, (uint32_t) protocol::ITwibDeviceInterface::Command::LIST_PROCESSES, 0);
+				return daemon.local_client->SendRequest(std::move(rq)).get().result_code == 0;
+			}));
+		}
+	}
+
+	~DaemonRig() {
+		running = false;
+		daemon.Awaken();
+		main_thread.join();
+		rmdir(root.c_str());
+	}
+
+	daemon::Daemon daemon;
+	std::vector<uint32_t> device_ids;
+
+ private:
+	std::string root;
+	std::atomic<bool> running = true;
+	std::thread main_thread;
+};
+
+} // namespace
+
+// Clients spread evenly over the devices, each keeping a window of small
+// requests in flight. Messages for different devices can only be
+// dispatched in parallel when there's more than one dispatch thread, and
+// only when the devices' IDs land on different shards.
+TWIB_BENCHMARK(DaemonDispatchScaling) {
+	for(size_t devices : DeviceCounts) {
+		for(size_t threads : DispatchThreads) {
+			DaemonRig rig(threads, devices);
+			for(size_t client_count : ClientCounts) {
+				std::vector<std::shared_ptr<LoadClient>> clients;
+				for(size_t i = 0; i < client_count; i++) {
+					clients.push_back(std::make_shared<LoadClient>(rig.daemon, rig.device_ids[i % devices]));
+					rig.daemon.AddClient(clients.back());
+				}
+
+				auto start = std::chrono::steady_clock::now();
+				for(auto &client : clients) {
+					client->Start();
+				}
+				TWIB_CHECK(WaitFor([&]() {
+					for(auto &client : clients) {
+						if(!client->Done()) {
+							return false;
+						}
+					}
+					return true;
+				}, std::chrono::seconds(60)));
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				for(auto &client : clients) {
+					TWIB_CHECK(client->errors == 0);
+					rig.daemon.RemoveClient(client);
+				}
+				Report("twibd_dispatch",
+					std::to_string(client_count) + " clients, " + std::to_string(devices) + " devices, -j " + std::to_string(threads),
+					client_count * RequestsPerClient / seconds, "req/s");
+			}
+		}
+	}
+}
@@ -0,0 +1,93 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<utility>
+
+#include<sys/socket.h>
+
+#include "platform/platform.hpp"
+#include "platform/EventLoop.hpp"
+
+#include "common/SocketMessageConnection.hpp"
+
+namespace twili {
+namespace twib {
+namespace tests {
+
+// Stands in for twibd on the other end of a socketpair: answers every
+// request with its own payload and a result code of zero. Take client_fd
+// for the client side.
+class EchoServer {
+ public:
+	EchoServer() :
+		logic(*this),
+		loop(logic),
+		fds(MakeSocketPair()),
+		client_fd(fds.first),
+		connection(platform::Socket(platform::File(fds.second)), loop.GetNotifier()) {
+		loop.AddMember(connection.member);
+		loop.Begin();
+	}
+
+	~EchoServer() {
+		loop.Destroy();
+		loop.Clear();
+	}
+
+ private:
+	class Logic : public platform::EventLoop::Logic {
+	 public:
+		Logic(EchoServer &server) : server(server) {
+		}
+
+		virtual void Prepare(platform::EventLoop &) override {
+			common::MessageConnection::Request *rq;
+			while((rq = server.connection.Process()) != nullptr) {
+				protocol::MessageHeader mh = rq->mh;
+				mh.result_code = 0;
+				mh.object_count = 0;
+				server.connection.SendMessage(mh, std::move(rq->payload), {});
+			}
+		}
+	 private:
+		EchoServer &server;
+	};
+
+	static std::pair<int, int> MakeSocketPair() {
+		int pair[2] = {-1, -1};
+		socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+		return std::make_pair(pair[0], pair[1]);
+	}
+
+	// declared in construction order
+	Logic logic;
+	platform::EventLoop loop;
+	std::pair<int, int> fds;
+ public:
+	int client_fd;
+ private:
+	common::SocketMessageConnection connection;
+};
+
+} // namespace tests
+} // namespace twib
+} // namespace twili
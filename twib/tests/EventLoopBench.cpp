@@ -0,0 +1,126 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include "platform/platform.hpp"
+#include "platform/EventLoop.hpp"
+
+#include<atomic>
+#include<chrono>
+#include<list>
+#include<memory>
+#include<thread>
+#include<vector>
+
+#include<sys/resource.h>
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+class Sink : public platform::EventLoop::SocketMember {
+ public:
+	Sink(platform::Socket &&socket, std::atomic<uint64_t> &received) :
+		platform::EventLoop::SocketMember(std::move(socket)),
+		received(received) {
+	}
+
+ protected:
+	virtual bool WantsRead() override {
+		return true;
+	}
+
+	virtual void SignalRead() override {
+		uint8_t buffer[4096];
+		ssize_t r = socket.Recv(buffer, sizeof(buffer), 0);
+		if(r > 0) {
+			received+= r;
+		}
+	}
+
+ private:
+	std::atomic<uint64_t> &received;
+};
+
+class NullLogic : public platform::EventLoop::Logic {
+ public:
+	virtual void Prepare(platform::EventLoop &) override {
+	}
+};
+
+// Pushes `messages` small writes round-robin through the busy connections
+// while `idle` other connections sit registered with the loop, and reports
+// how many the loop got through per second.
+void Run(size_t idle, size_t busy, size_t messages) {
+	std::atomic<uint64_t> received = 0;
+	std::list<Sink> sinks;
+	std::vector<platform::Socket> peers;
+
+	NullLogic logic;
+	platform::EventLoop loop(logic);
+	for(size_t i = 0; i < idle + busy; i++) {
+		int fds[2];
+		TWIB_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+		sinks.emplace_back(platform::Socket(platform::File(fds[0])), received);
+		peers.emplace_back(platform::File(fds[1]));
+		loop.AddMember(sinks.back());
+	}
+	loop.Begin();
+
+	const uint8_t message[16] = {0};
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < messages; i++) {
+		// the busy connections are the last ones registered
+		peers[idle + (i % busy)].Send(message, sizeof(message), 0);
+	}
+	while(received < messages * sizeof(message)) {
+		std::this_thread::yield();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	loop.Destroy();
+	loop.Clear();
+
+	Report("event_loop", std::to_string(idle) + " idle, " + std::to_string(busy) + " busy", messages / seconds, "msg/s");
+}
+
+} // namespace
+
+TWIB_BENCHMARK(EventLoopScaling) {
+	// two descriptors per connection
+	struct rlimit limit;
+	if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+	size_t max_connections = getrlimit(RLIMIT_NOFILE, &limit) == 0 ? (limit.rlim_cur - 64) / 2 : 256;
+
+	for(size_t idle : {0, 100, 1000, 4000}) {
+		for(size_t busy : {1, 16, 64}) {
+			if(idle + busy > max_connections) {
+				continue;
+			}
+			Run(idle, busy, 200000);
+		}
+	}
+}
@@ -0,0 +1,130 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include "platform/platform.hpp"
+#include "platform/EventLoop.hpp"
+
+#include<atomic>
+#include<chrono>
+#include<thread>
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+class Member : public platform::EventLoop::SocketMember {
+ public:
+	Member(platform::Socket &&socket) : platform::EventLoop::SocketMember(std::move(socket)) {
+	}
+
+	std::atomic<size_t> bytes_read = 0;
+	std::atomic<size_t> writes_signalled = 0;
+	std::atomic<bool> want_write = false;
+
+ protected:
+	virtual bool WantsRead() override {
+		return true;
+	}
+
+	virtual bool WantsWrite() override {
+		return want_write;
+	}
+
+	virtual void SignalRead() override {
+		uint8_t buffer[256];
+		ssize_t r = socket.Recv(buffer, sizeof(buffer), 0);
+		if(r > 0) {
+			bytes_read+= r;
+		}
+	}
+
+	virtual void SignalWrite() override {
+		writes_signalled++;
+		want_write = false;
+	}
+};
+
+class CountingLogic : public platform::EventLoop::Logic {
+ public:
+	virtual void Prepare(platform::EventLoop &) override {
+		prepares++;
+	}
+
+	std::atomic<size_t> prepares = 0;
+};
+
+} // namespace
+
+TWIB_TEST(EventLoopDeliversReads) {
+	int fds[2];
+	TWIB_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	Member member {platform::Socket(platform::File(fds[0]))};
+	platform::Socket peer {platform::File(fds[1])};
+
+	CountingLogic logic;
+	platform::EventLoop loop(logic);
+	loop.AddMember(member);
+	loop.Begin();
+
+	const uint8_t data[100] = {0};
+	for(int i = 0; i < 10; i++) {
+		TWIB_CHECK(peer.Send(data, sizeof(data), 0) == sizeof(data));
+	}
+	bool delivered = WaitFor([&]() { return member.bytes_read == sizeof(data) * 10; });
+
+	loop.Destroy();
+	loop.Clear();
+	TWIB_CHECK(delivered);
+}
+
+TWIB_TEST(EventLoopPicksUpInterestChanges) {
+	int fds[2];
+	TWIB_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	Member member {platform::Socket(platform::File(fds[0]))};
+	platform::Socket peer {platform::File(fds[1])};
+
+	CountingLogic logic;
+	platform::EventLoop loop(logic);
+	loop.AddMember(member);
+	loop.Begin();
+
+	// a writable socket is only signalled once we say we want to write
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	bool quiet = member.writes_signalled == 0;
+
+	member.want_write = true;
+	member.RequestInterestUpdate();
+	loop.GetNotifier().Notify();
+	bool signalled = WaitFor([&]() { return member.writes_signalled > 0; });
+
+	// and it stops once we've lost interest again
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	size_t after = member.writes_signalled;
+
+	loop.Destroy();
+	loop.Clear();
+	TWIB_CHECK(quiet);
+	TWIB_CHECK(signalled);
+	TWIB_CHECK(after == 1);
+}
@@ -0,0 +1,319 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<map>
+#include<optional>
+#include<vector>
+
+#include<stdint.h>
+#include<string.h>
+
+#include "common/ResultError.hpp"
+#include "tool/GdbBreakpoints.hpp"
+#include "tool/Client.hpp"
+
+#include "err.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+using namespace twili::twib::tool;
+using namespace twili::twib::tool::gdb;
+
+namespace {
+
+// A debuggee with one mapped range of memory. Answers the debugger
+// requests BreakpointManager makes synchronously, and doesn't support
+// READ_MEMORY_V, so breakpoints go in through the per-range fallback.
+class FakeProcess : public client::Client {
+ public:
+	static const uint64_t Base = 0x1000;
+
+	FakeProcess() : memory(0x40) {
+		FillRandom(memory.data(), memory.size(), 14);
+	}
+
+	std::vector<uint8_t> Read(uint64_t address, size_t size) {
+		TWIB_CHECK(address >= Base && address + size <= Base + memory.size());
+		return std::vector<uint8_t>(memory.begin() + (address - Base), memory.begin() + (address - Base) + size);
+	}
+
+	void Write(uint64_t address, const std::vector<uint8_t> &bytes) {
+		TWIB_CHECK(address >= Base && address + bytes.size() <= Base + memory.size());
+		std::copy(bytes.begin(), bytes.end(), memory.begin() + (address - Base));
+	}
+
+	std::vector<uint8_t> memory;
+ protected:
+	virtual void SendRequestImpl(Request &&rq) override {
+		using Command = protocol::ITwibDebugger::Command;
+		util::Buffer in(std::move(rq.payload));
+		util::Buffer out;
+		uint32_t result = 0;
+		uint64_t address, size;
+		switch(rq.command_id) {
+		case (uint32_t) Command::READ_MEMORY:
+			if(!in.Read(address) || !in.Read(size) || address < Base || address + size > Base + memory.size()) {
+				result = TWILI_ERR_PROTOCOL_BAD_REQUEST;
+				break;
+			}
+			out.Write<uint64_t>(size);
+			out.Write(Read(address, size));
+			break;
+		case (uint32_t) Command::WRITE_MEMORY: {
+			std::vector<uint8_t> bytes;
+			if(!in.Read(address) || !in.Read(size) || (bytes.resize(size), !in.Read(bytes)) ||
+				 address < Base || address + size > Base + memory.size()) {
+				result = TWILI_ERR_PROTOCOL_BAD_REQUEST;
+				break;
+			}
+			Write(address, bytes);
+			break; }
+		case 0xffffffff: // close
+			break;
+		default:
+			result = TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+			break;
+		}
+
+		protocol::MessageHeader mh = {};
+		mh.device_id = rq.device_id;
+		mh.object_id = rq.object_id;
+		mh.result_code = result;
+		mh.tag = rq.tag;
+		mh.payload_size = out.ReadAvailable();
+		util::Buffer object_ids;
+		PostResponse(mh, out.TakeData(), object_ids);
+	}
+};
+
+std::vector<uint8_t> Brk() {
+	std::vector<uint8_t> bytes(sizeof(BreakpointManager::BrkInstruction));
+	memcpy(bytes.data(), &BreakpointManager::BrkInstruction, bytes.size());
+	return bytes;
+}
+
+// A process with breakpoints inserted at 0x1008 and 0x100c, back to back,
+// so that ranges can overlap either one or both of them partially.
+class BreakpointRig {
+ public:
+	BreakpointRig() :
+		debugger(std::make_shared<RemoteObject>(process, 0, 1)),
+		original(process.memory) {
+		breakpoints.Add(0x1008, {});
+		breakpoints.Add(0x100c, {});
+		breakpoints.Sync(debugger);
+		TWIB_CHECK(process.Read(0x1008, 4) == Brk());
+		TWIB_CHECK(process.Read(0x100c, 4) == Brk());
+	}
+
+	// what gdb should see between base and base + size
+	std::vector<uint8_t> Logical(uint64_t address, size_t size) {
+		return std::vector<uint8_t>(original.begin() + (address - FakeProcess::Base), original.begin() + (address - FakeProcess::Base) + size);
+	}
+
+	FakeProcess process;
+	ITwibDebugger debugger;
+	BreakpointManager breakpoints;
+	std::vector<uint8_t> original;
+};
+
+ThreadContext MakeContext() {
+	ThreadContext tc = {};
+	for(int i = 0; i < 31; i++) {
+		tc.x[i] = 0x1000 * (i + 1);
+	}
+	tc.x[1] = (uint64_t) -2;
+	tc.sp = 0x7000;
+	tc.pc = 0x8000;
+	tc.psr = 0x60000000;
+	return tc;
+}
+
+} // anonymous namespace
+
+TWIB_TEST(GdbSuccessors) {
+	const uint64_t pc = 0x10000;
+	struct {
+		const char *name;
+		uint32_t instruction;
+		std::vector<uint64_t> expected;
+	} cases[] = {
+		{"nop", 0xd503201f, {pc + 4}},
+		{"add x0, x1, x2", 0x8b020020, {pc + 4}},
+		{"b +8", 0x14000002, {pc + 8}},
+		{"b -4", 0x17ffffff, {pc - 4}},
+		{"bl +0x100", 0x94000040, {pc + 0x100}},
+		{"b.eq +8", 0x54000040, {pc + 4, pc + 8}},
+		{"b.ne -8", 0x54ffffc1, {pc + 4, pc - 8}},
+		{"cbz x0, +0x10", 0xb4000080, {pc + 4, pc + 0x10}},
+		{"cbnz w1, -4", 0x35ffffe1, {pc + 4, pc - 4}},
+		{"tbz w0, #3, +8", 0x36180040, {pc + 4, pc + 8}},
+		{"tbnz x5, #63, -0x10", 0xb7f7ff85, {pc + 4, pc - 0x10}},
+		{"br x16", 0xd61f0200, {0x11000}},
+		{"blr x8", 0xd63f0100, {0x9000}},
+		{"ret", 0xd65f03c0, {0x1f000}},
+	};
+
+	ThreadContext tc = MakeContext();
+	for(auto &c : cases) {
+		if(BreakpointManager::Successors(pc, c.instruction, tc) != c.expected) {
+			Fail(__FILE__, __LINE__, c.name);
+		}
+	}
+}
+
+TWIB_TEST(GdbAgentExpressions) {
+	std::map<uint64_t, uint8_t> memory = {{0x2000, 0xef}, {0x2001, 0xbe}, {0x2002, 0xad}, {0x2003, 0xde}};
+	MemoryReader read = [&memory](uint64_t address, uint64_t size) {
+		std::vector<uint8_t> bytes;
+		for(uint64_t i = 0; i < size; i++) {
+			auto b = memory.find(address + i);
+			if(b == memory.end()) {
+				throw ResultError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+			}
+			bytes.push_back(b->second);
+		}
+		return bytes;
+	};
+
+	struct {
+		const char *name;
+		std::vector<uint8_t> bytecode;
+		std::optional<uint64_t> expected;
+	} cases[] = {
+		{"2 + 3", {0x22, 2, 0x22, 3, 0x02, 0x27}, 5},
+		{"3 - 5", {0x22, 3, 0x22, 5, 0x03, 0x27}, (uint64_t) -2},
+		{"x0 == 0x1000", {0x26, 0, 0, 0x23, 0x10, 0x00, 0x13, 0x27}, 1},
+		{"x1 < 0 signed", {0x26, 0, 1, 0x22, 0, 0x14, 0x27}, 1},
+		{"x1 < 0 unsigned", {0x26, 0, 1, 0x22, 0, 0x15, 0x27}, 0},
+		{"sp", {0x26, 0, 31, 0x27}, 0x7000},
+		{"pc", {0x26, 0, 32, 0x27}, 0x8000},
+		{"unsupported register", {0x26, 0, 34, 0x27}, std::nullopt},
+		{"-7 / 2", {0x22, 0xf9, 0x16, 8, 0x22, 2, 0x05, 0x27}, (uint64_t) -3},
+		{"divide by zero", {0x22, 1, 0x22, 0, 0x06, 0x27}, std::nullopt},
+		{"remainder by zero", {0x22, 1, 0x22, 0, 0x08, 0x27}, std::nullopt},
+		{"sign extend", {0x22, 0xff, 0x16, 8, 0x27}, (uint64_t) -1},
+		{"zero extend", {0x23, 0xff, 0xff, 0x2a, 8, 0x27}, 0xff},
+		{"shift past width", {0x22, 1, 0x22, 64, 0x09, 0x27}, 0},
+		{"log not", {0x22, 5, 0x0e, 0x27}, 0},
+		{"ref32", {0x23, 0x20, 0x00, 0x19, 0x27}, 0xdeadbeef},
+		{"ref16", {0x23, 0x20, 0x02, 0x18, 0x27}, 0xdead},
+		{"ref past mapping", {0x23, 0x20, 0x02, 0x19, 0x27}, std::nullopt},
+		{"if_goto taken", {0x22, 1, 0x20, 0, 8, 0x22, 0, 0x27, 0x22, 9, 0x27}, 9},
+		{"if_goto not taken", {0x22, 0, 0x20, 0, 8, 0x22, 4, 0x27, 0x22, 9, 0x27}, 4},
+		{"goto forever", {0x21, 0, 0}, std::nullopt},
+		{"dup", {0x22, 3, 0x28, 0x04, 0x27}, 9},
+		{"swap", {0x22, 1, 0x22, 2, 0x2b, 0x03, 0x27}, 1},
+		{"pick", {0x22, 7, 0x22, 8, 0x32, 1, 0x27}, 7},
+		{"rot", {0x22, 1, 0x22, 2, 0x22, 3, 0x33, 0x27}, 2},
+		{"pop", {0x22, 1, 0x22, 2, 0x29, 0x27}, 1},
+		{"stack underflow", {0x02, 0x27}, std::nullopt},
+		{"end on empty stack", {0x27}, std::nullopt},
+		{"truncated operand", {0x23, 0x10}, std::nullopt},
+		{"no end", {0x22, 1}, std::nullopt},
+		{"float opcode", {0x01, 0x27}, std::nullopt},
+	};
+
+	ThreadContext tc = MakeContext();
+	for(auto &c : cases) {
+		if(AgentExpression(c.bytecode).Evaluate(tc, read) != c.expected) {
+			Fail(__FILE__, __LINE__, c.name);
+		}
+	}
+}
+
+// Reads that cover inserted breakpoints have to show gdb the original
+// instructions, however the read lines up with them.
+TWIB_TEST(GdbShadowPartialOverlaps) {
+	struct {
+		const char *name;
+		uint64_t address;
+		size_t size;
+	} cases[] = {
+		{"everything", 0x1000, 0x40},
+		{"both breakpoints exactly", 0x1008, 8},
+		{"tail of one, head of the next", 0x100a, 4},
+		{"ends inside the first", 0x1004, 6},
+		{"starts inside the second", 0x100f, 5},
+		{"middle of one", 0x1009, 2},
+		{"single byte", 0x100d, 1},
+		{"just before", 0x1004, 4},
+		{"just after", 0x1010, 4},
+	};
+
+	BreakpointRig rig;
+	for(auto &c : cases) {
+		std::vector<uint8_t> bytes = rig.process.Read(c.address, c.size);
+		rig.breakpoints.Shadow(c.address, bytes);
+		if(bytes != rig.Logical(c.address, c.size)) {
+			Fail(__FILE__, __LINE__, c.name);
+		}
+	}
+}
+
+// Writes over inserted breakpoints become the new original instructions,
+// and the breakpoints stay in memory until they're removed.
+TWIB_TEST(GdbUnshadowPartialOverlaps) {
+	struct {
+		const char *name;
+		uint64_t address;
+		size_t size;
+	} cases[] = {
+		{"both breakpoints exactly", 0x1008, 8},
+		{"tail of one, head of the next", 0x100a, 4},
+		{"ends inside the first", 0x1004, 6},
+		{"starts inside the second", 0x100f, 5},
+		{"middle of one", 0x1009, 2},
+		{"just after", 0x1010, 4},
+	};
+
+	for(auto &c : cases) {
+		BreakpointRig rig;
+		std::vector<uint8_t> written(c.size);
+		FillRandom(written.data(), written.size(), (uint32_t) c.address);
+		std::copy(written.begin(), written.end(), rig.original.begin() + (c.address - FakeProcess::Base));
+
+		std::vector<uint8_t> bytes = written;
+		rig.breakpoints.Unshadow(c.address, bytes);
+		rig.process.Write(c.address, bytes);
+
+		// still trapping
+		if(rig.process.Read(0x1008, 4) != Brk() || rig.process.Read(0x100c, 4) != Brk()) {
+			Fail(__FILE__, __LINE__, c.name);
+		}
+
+		// but gdb reads back what it wrote
+		std::vector<uint8_t> all = rig.process.Read(FakeProcess::Base, rig.process.memory.size());
+		rig.breakpoints.Shadow(FakeProcess::Base, all);
+		if(all != rig.original) {
+			Fail(__FILE__, __LINE__, c.name);
+		}
+
+		// and taking the breakpoints out leaves it there for real
+		rig.breakpoints.RemoveAll();
+		rig.breakpoints.Sync(rig.debugger);
+		if(rig.process.memory != rig.original) {
+			Fail(__FILE__, __LINE__, c.name);
+		}
+	}
+}
@@ -0,0 +1,127 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<exception>
+#include<memory>
+#include<thread>
+#include<vector>
+
+#include<stdio.h>
+#include<string.h>
+
+#include "common/Logger.hpp"
+#include "common/ResultError.hpp"
+
+namespace twili {
+namespace twib {
+namespace tests {
+
+static std::vector<Case*> &Registry() {
+	static std::vector<Case*> cases;
+	return cases;
+}
+
+Case::Case(const char *name, std::function<void()> func) : name(name), func(func) {
+	Registry().push_back(this);
+}
+
+void Fail(const char *file, int line, const char *expr) {
+	char message[512];
+	snprintf(message, sizeof(message), "%s:%d: check failed: %s", file, line, expr);
+	throw CheckFailure {message};
+}
+
+void Report(const char *bench, const std::string &config, double value, const char *unit) {
+	printf("  %-24s %-32s %14.2f %s\n", bench, config.c_str(), value, unit);
+	fflush(stdout);
+}
+
+void FillRandom(uint8_t *data, size_t size, uint32_t seed) {
+	// xorshift32
+	uint32_t x = seed ? seed : 1;
+	for(size_t i = 0; i < size; i++) {
+		x^= x << 13;
+		x^= x >> 17;
+		x^= x << 5;
+		data[i] = x;
+	}
+}
+
+bool WaitFor(std::function<bool()> condition, std::chrono::milliseconds timeout) {
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	while(!condition()) {
+		if(std::chrono::steady_clock::now() > deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+} // namespace tests
+} // namespace twib
+} // namespace twili
+
+using namespace twili;
+using namespace twili::twib;
+
+int main(int argc, char *argv[]) {
+	log::add_log(std::make_shared<log::PrettyFileLogger>(stderr, log::Level::Error));
+
+	size_t run = 0;
+	size_t failed = 0;
+	for(tests::Case *c : tests::Registry()) {
+		bool selected = argc < 2;
+		for(int i = 1; i < argc; i++) {
+			if(strcmp(argv[i], c->name) == 0) {
+				selected = true;
+			}
+		}
+		if(!selected) {
+			continue;
+		}
+
+		run++;
+		printf("[ RUN      ] %s\n", c->name);
+		fflush(stdout);
+		std::string failure;
+		try {
+			c->func();
+		} catch(tests::CheckFailure &e) {
+			failure = e.message;
+		} catch(twili::twib::ResultError &e) {
+			failure = std::string("caught ResultError: ") + e.what();
+		} catch(std::exception &e) {
+			failure = std::string("caught exception: ") + e.what();
+		}
+		if(failure.empty()) {
+			printf("[       OK ] %s\n", c->name);
+		} else {
+			printf("%s\n[  FAILED  ] %s\n", failure.c_str(), c->name);
+			failed++;
+		}
+		fflush(stdout);
+	}
+
+	printf("%zu of %zu passed\n", run - failed, run);
+	return failed ? 1 : 0;
+}
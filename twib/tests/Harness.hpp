@@ -0,0 +1,74 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<chrono>
+#include<functional>
+#include<string>
+
+#include<stdint.h>
+
+namespace twili {
+namespace twib {
+namespace tests {
+
+// Tests and benchmarks register themselves as cases. twib-tests and
+// twib-bench both run every case they were linked with, or only the ones
+// named on the command line.
+class Case {
+ public:
+	Case(const char *name, std::function<void()> func);
+
+	const char *name;
+	std::function<void()> func;
+};
+
+// Thrown when a check fails, to abandon the rest of the case.
+class CheckFailure {
+ public:
+	std::string message;
+};
+
+[[noreturn]] void Fail(const char *file, int line, const char *expr);
+
+// Prints a line of benchmark results.
+void Report(const char *bench, const std::string &config, double value, const char *unit);
+
+// Deterministic filler data, so that failures can be reproduced.
+void FillRandom(uint8_t *data, size_t size, uint32_t seed);
+
+// Polls condition until it holds. Returns false if it didn't before the
+// timeout ran out.
+bool WaitFor(std::function<bool()> condition, std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+} // namespace tests
+} // namespace twib
+} // namespace twili
+
+#define TWIB_CASE(name) \
+	static void name(); \
+	static twili::twib::tests::Case name##_case(#name, name); \
+	static void name()
+
+#define TWIB_TEST(name) TWIB_CASE(name)
+#define TWIB_BENCHMARK(name) TWIB_CASE(name)
+
+#define TWIB_CHECK(expr) do { if(!(expr)) { twili::twib::tests::Fail(__FILE__, __LINE__, #expr); } } while(0)
@@ -0,0 +1,93 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<chrono>
+#include<memory>
+
+#include<stdio.h>
+
+#include "common/Logger.hpp"
+
+using namespace twili;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t Messages = 200000;
+
+// Logs Messages lines at the given level and returns the nanoseconds each
+// one took, including whatever the loggers do with it.
+double TimeMessages(bool debug) {
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < Messages; i++) {
+		if(debug) {
+			LogMessage(Debug, "pumping out %zu fragments for 0x%x", i, 0x1234);
+		} else {
+			LogMessage(Message, "pumping out %zu fragments for 0x%x", i, 0x1234);
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return seconds * 1e9 / Messages;
+}
+
+// FileLoggers close their file when they're destroyed, so each one gets
+// its own.
+FILE *OpenNull() {
+	FILE *null = fopen("/dev/null", "w");
+	TWIB_CHECK(null != nullptr);
+	return null;
+}
+
+} // namespace
+
+TWIB_BENCHMARK(LoggerCostPerMessage) {
+	// the harness only logs errors, so this never gets past the level check
+	Report("log", "suppressed", TimeMessages(true), "ns/msg");
+
+	// Debug is wanted by nobody but this logger, so suppressed messages go
+	// through the whole logger list too
+	std::shared_ptr<log::Logger> filtering = std::make_shared<log::FileLogger>(OpenNull(), log::Level::Debug, log::Level::Debug);
+	log::add_log(filtering);
+	Report("log", "formatted, filtered by logger", TimeMessages(false), "ns/msg");
+	log::remove_log(filtering);
+
+	std::shared_ptr<log::Logger> plain = std::make_shared<log::FileLogger>(OpenNull(), log::Level::Debug);
+	log::add_log(plain);
+	Report("log", "emitted, plain", TimeMessages(true), "ns/msg");
+	log::remove_log(plain);
+
+	std::shared_ptr<log::Logger> pretty = std::make_shared<log::PrettyFileLogger>(OpenNull(), log::Level::Debug);
+	log::add_log(pretty);
+	Report("log", "emitted, pretty", TimeMessages(true), "ns/msg");
+	log::remove_log(pretty);
+
+	{
+		// only counts the time to hand messages off; the background thread
+		// catches up when the logger is destroyed
+		std::shared_ptr<log::Logger> async = std::make_shared<log::AsyncLogger>(std::make_shared<log::PrettyFileLogger>(OpenNull(), log::Level::Debug), 0x4000000);
+		log::add_log(async);
+		Report("log", "emitted, async", TimeMessages(true), "ns/msg");
+		log::remove_log(async);
+	}
+
+	TWIB_CHECK(log::min_level == log::Level::Error);
+}
@@ -0,0 +1,108 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+#include "MessagePair.hpp"
+
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<thread>
+#include<vector>
+
+#include<string.h>
+
+#include "common/BufferPool.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t PayloadSizes[] = {64, 4096, 65536, 1 << 20, 16 << 20};
+const size_t BytesPerRun = 512 << 20;
+const size_t MaxQueued = 8 << 20;
+
+std::string Describe(size_t size) {
+	if(size >= (1 << 20)) {
+		return std::to_string(size >> 20) + " MiB payloads";
+	} else if(size >= (1 << 10)) {
+		return std::to_string(size >> 10) + " KiB payloads";
+	} else {
+		return std::to_string(size) + " B payloads";
+	}
+}
+
+} // namespace
+
+TWIB_BENCHMARK(MessageConnectionThroughput) {
+	for(size_t size : PayloadSizes) {
+		size_t messages = std::max(BytesPerRun / size, (size_t) 64);
+		std::atomic<size_t> received = 0;
+		MessagePair pair([&](common::MessageConnection::Request &rq) {
+			common::BufferPool::Release(std::move(rq.payload));
+			received++;
+		});
+
+		std::vector<uint8_t> payload(size);
+		FillRandom(payload.data(), payload.size(), 1);
+		protocol::MessageHeader mh = {};
+		mh.payload_size = size;
+
+		auto start = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < messages; i++) {
+			while(pair.sender.GetOutputSize() > MaxQueued) {
+				std::this_thread::yield();
+			}
+			// the copy here stands in for the caller producing its payload
+			pair.sender.SendMessage(mh, payload, {});
+		}
+		TWIB_CHECK(WaitFor([&]() { return received == messages || pair.HasError(); }, std::chrono::seconds(60)));
+		TWIB_CHECK(!pair.HasError());
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		Report("message_connection", Describe(size), (double) size * messages / seconds / (1 << 20), "MiB/s");
+		Report("message_connection", Describe(size), messages / seconds, "msg/s");
+	}
+}
+
+// What the receive and send paths used to do on top of the socket I/O:
+// in_buffer -> Request::payload -> caller's vector, and payload -> out_buffer.
+// Compare against MessageConnectionThroughput to see what those copies cost.
+TWIB_BENCHMARK(MessageConnectionLegacyCopies) {
+	for(size_t size : PayloadSizes) {
+		size_t messages = std::max(BytesPerRun / size, (size_t) 64);
+		std::vector<uint8_t> in_buffer(size), request(size), out_buffer(size);
+		FillRandom(in_buffer.data(), in_buffer.size(), 1);
+
+		auto start = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < messages; i++) {
+			memcpy(request.data(), in_buffer.data(), size);
+			std::vector<uint8_t> handed_off(request.begin(), request.end());
+			memcpy(out_buffer.data(), handed_off.data(), size);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		TWIB_CHECK(out_buffer == in_buffer);
+
+		Report("legacy_copies", Describe(size), (double) size * messages / seconds / (1 << 20), "MiB/s");
+		Report("legacy_copies", Describe(size), 3.0 * size, "bytes copied/msg");
+	}
+}
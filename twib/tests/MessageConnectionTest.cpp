@@ -0,0 +1,133 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+#include "MessagePair.hpp"
+
+#include<mutex>
+#include<vector>
+
+#include "common/BufferPool.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+class Message {
+ public:
+	protocol::MessageHeader mh;
+	std::vector<uint8_t> payload;
+	std::vector<uint32_t> object_ids;
+};
+
+Message MakeMessage(uint32_t tag, size_t size, size_t object_count, bool compressible) {
+	Message msg;
+	msg.mh = {};
+	msg.mh.device_id = 1;
+	msg.mh.object_id = 2;
+	msg.mh.command_id = 3;
+	msg.mh.tag = tag;
+	msg.payload.resize(size);
+	if(compressible) {
+		for(size_t i = 0; i < size; i++) {
+			msg.payload[i] = (i / 64) & 0xff;
+		}
+	} else {
+		FillRandom(msg.payload.data(), size, tag + 1);
+	}
+	for(size_t i = 0; i < object_count; i++) {
+		msg.object_ids.push_back(tag * 100 + i);
+	}
+	msg.mh.payload_size = msg.payload.size();
+	msg.mh.object_count = msg.object_ids.size();
+	return msg;
+}
+
+void RoundTrip(bool compression) {
+	std::mutex mutex;
+	std::vector<Message> received;
+	MessagePair pair([&](common::MessageConnection::Request &rq) {
+		Message msg;
+		msg.mh = rq.mh;
+		msg.payload = std::move(rq.payload);
+		msg.object_ids.resize(rq.mh.object_count);
+		rq.object_ids.Read(msg.object_ids);
+		std::lock_guard<std::mutex> lock(mutex);
+		received.push_back(std::move(msg));
+	});
+	if(compression) {
+		pair.sender.EnableCompression();
+		pair.receiver.EnableCompression();
+	}
+
+	// straddle the size where payloads start being read directly into
+	// their final storage
+	const size_t sizes[] = {0, 1, 100, 4095, 8191, 8192, 8193, 65536, 100000, 1 << 20, 3};
+	std::vector<Message> sent;
+	uint32_t tag = 0;
+	for(size_t size : sizes) {
+		for(bool compressible : {false, true}) {
+			Message msg = MakeMessage(tag, size, tag % 4, compressible);
+			tag++;
+			pair.sender.SendMessage(msg.mh, msg.payload, msg.object_ids);
+			sent.push_back(std::move(msg));
+		}
+	}
+
+	bool done = WaitFor([&]() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return received.size() >= sent.size() || pair.HasError();
+	});
+	TWIB_CHECK(done);
+	TWIB_CHECK(!pair.HasError());
+
+	std::lock_guard<std::mutex> lock(mutex);
+	TWIB_CHECK(received.size() == sent.size());
+	for(size_t i = 0; i < sent.size(); i++) {
+		TWIB_CHECK(received[i].mh.tag == sent[i].mh.tag);
+		TWIB_CHECK(received[i].mh.device_id == 1);
+		TWIB_CHECK(received[i].mh.object_id == 2);
+		TWIB_CHECK(received[i].mh.command_id == 3);
+		TWIB_CHECK(received[i].payload == sent[i].payload);
+		TWIB_CHECK(received[i].object_ids == sent[i].object_ids);
+	}
+}
+
+} // namespace
+
+TWIB_TEST(MessageConnectionRoundTrip) {
+	RoundTrip(false);
+}
+
+TWIB_TEST(MessageConnectionRoundTripCompressed) {
+	RoundTrip(true);
+}
+
+TWIB_TEST(MessageConnectionReportsQueuedOutput) {
+	MessagePair pair([](common::MessageConnection::Request &rq) {
+		common::BufferPool::Release(std::move(rq.payload));
+	});
+	Message msg = MakeMessage(0, 1 << 20, 0, false);
+	pair.sender.SendMessage(msg.mh, msg.payload, msg.object_ids);
+	TWIB_CHECK(pair.sender.GetOutputSize() <= sizeof(protocol::MessageHeader) + msg.payload.size());
+	TWIB_CHECK(WaitFor([&]() { return pair.sender.GetOutputSize() == 0; }));
+}
@@ -0,0 +1,101 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<functional>
+
+#include<sys/socket.h>
+
+#include "platform/platform.hpp"
+#include "platform/EventLoop.hpp"
+
+#include "common/SocketMessageConnection.hpp"
+
+namespace twili {
+namespace twib {
+namespace tests {
+
+// Two SocketMessageConnections on either end of a socketpair, serviced by
+// their own event loop. Messages arriving at the receiver are handed to the
+// handler on the event thread.
+class MessagePair {
+ public:
+	using Handler = std::function<void(common::MessageConnection::Request &rq)>;
+
+	MessagePair(Handler handler) :
+		logic(*this),
+		loop(logic),
+		fds(MakeSocketPair()),
+		sender(platform::Socket(platform::File(fds.first)), loop.GetNotifier()),
+		receiver(platform::Socket(platform::File(fds.second)), loop.GetNotifier()),
+		handler(handler) {
+		loop.AddMember(sender.member);
+		loop.AddMember(receiver.member);
+		loop.Begin();
+	}
+
+	~MessagePair() {
+		loop.Destroy();
+		loop.Clear();
+	}
+
+	bool HasError() {
+		return sender.error_flag || receiver.error_flag;
+	}
+
+ private:
+	class Logic : public platform::EventLoop::Logic {
+	 public:
+		Logic(MessagePair &pair) : pair(pair) {
+		}
+
+		virtual void Prepare(platform::EventLoop &) override {
+			common::MessageConnection::Request *rq;
+			while((rq = pair.receiver.Process()) != nullptr) {
+				pair.handler(*rq);
+			}
+		}
+	 private:
+		MessagePair &pair;
+	};
+
+	static std::pair<int, int> MakeSocketPair() {
+		int pair[2] = {-1, -1};
+		socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+		return std::make_pair(pair[0], pair[1]);
+	}
+
+	// declared in construction order
+	Logic logic;
+ public:
+	platform::EventLoop loop;
+ private:
+	std::pair<int, int> fds;
+ public:
+	common::SocketMessageConnection sender;
+	common::SocketMessageConnection receiver;
+ private:
+	Handler handler;
+};
+
+} // namespace tests
+} // namespace twib
+} // namespace twili
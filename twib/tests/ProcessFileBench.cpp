@@ -0,0 +1,107 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<chrono>
+#include<memory>
+#include<string>
+#include<vector>
+
+#include<stdint.h>
+
+#include "process/fs/PFS0BuilderFile.hpp"
+#include "process/fs/TransmutationFile.hpp"
+#include "process/fs/VectorFile.hpp"
+
+using namespace twili::process::fs;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t FileSize = 64 << 20;
+const size_t ChunkSizes[] = {0x1000, 0x10000, 0x100000};
+const size_t SegmentSize = 0x1000;
+
+class TestTransmutationFile : public TransmutationFile {
+ public:
+	using TransmutationFile::SetSegments;
+};
+
+// Reads the whole file in chunks of the given size and returns MiB/s.
+double ReadThrough(ProcessFile &file, size_t chunk) {
+	size_t size = 0;
+	TWIB_CHECK(file.GetSize(&size) == RESULT_OK);
+	std::vector<uint8_t> buffer(chunk);
+	auto start = std::chrono::steady_clock::now();
+	for(size_t offset = 0; offset < size; offset+= chunk) {
+		size_t actual = 0;
+		TWIB_CHECK(file.Read(offset, chunk, buffer.data(), &actual) == RESULT_OK);
+		TWIB_CHECK(actual == std::min(chunk, size - offset));
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return size / seconds / (1 << 20);
+}
+
+std::string Describe(const char *layout, size_t chunk) {
+	return std::string(layout) + ", " + std::to_string(chunk >> 10) + " KiB reads";
+}
+
+} // namespace
+
+// A file stitched together from page-sized pieces of another file, as NSO
+// transmutation produces. Contiguous pieces get merged into one segment;
+// interleaving small header segments keeps them apart.
+TWIB_BENCHMARK(TransmutationFileRead) {
+	std::vector<uint8_t> data(FileSize);
+	FillRandom(data.data(), data.size(), 1);
+	std::shared_ptr<VectorFile> backing = std::make_shared<VectorFile>(data);
+	std::vector<uint8_t> header(0x10);
+
+	for(bool interleaved : {false, true}) {
+		TestTransmutationFile tf;
+		std::vector<std::unique_ptr<TransmutationFile::Segment>> segments;
+		for(size_t offset = 0; offset < FileSize; offset+= SegmentSize) {
+			if(interleaved) {
+				segments.emplace_back(new TransmutationFile::MemorySegment(header.data(), header.size()));
+			}
+			segments.emplace_back(new TransmutationFile::BackedSegment(backing, offset, SegmentSize));
+		}
+		tf.SetSegments(std::move(segments));
+
+		for(size_t chunk : ChunkSizes) {
+			Report("transmutation_file", Describe(interleaved ? "interleaved" : "contiguous", chunk), ReadThrough(tf, chunk), "MiB/s");
+		}
+	}
+}
+
+TWIB_BENCHMARK(PFS0BuilderFileRead) {
+	const size_t files = 64;
+	PFS0BuilderFile pfs0;
+	for(size_t i = 0; i < files; i++) {
+		std::vector<uint8_t> data(FileSize / files);
+		FillRandom(data.data(), data.size(), i);
+		TWIB_CHECK(pfs0.Append("file" + std::to_string(i), std::make_shared<VectorFile>(std::move(data))) == RESULT_OK);
+	}
+
+	for(size_t chunk : ChunkSizes) {
+		Report("pfs0_builder_file", Describe("64 files", chunk), ReadThrough(pfs0, chunk), "MiB/s");
+	}
+}
@@ -0,0 +1,270 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<memory>
+#include<string>
+#include<vector>
+
+#include<stdint.h>
+#include<string.h>
+
+#include "err.hpp"
+
+#include "process/fs/PFS0BuilderFile.hpp"
+#include "process/fs/TransmutationFile.hpp"
+#include "process/fs/VectorFile.hpp"
+
+using namespace twili::process::fs;
+using namespace twili::twib::tests;
+
+namespace {
+
+// Counts the reads that make it to the backing file.
+class CountingFile : public VectorFile {
+ public:
+	CountingFile(std::vector<uint8_t> data) : VectorFile(data) {
+	}
+
+	virtual trn::ResultCode Read(size_t offset, size_t size, uint8_t *out, size_t *size_out) override {
+		reads++;
+		return VectorFile::Read(offset, size, out, size_out);
+	}
+
+	size_t reads = 0;
+};
+
+// Returns less than it was asked for.
+class ShortFile : public VectorFile {
+ public:
+	ShortFile(std::vector<uint8_t> data) : VectorFile(data) {
+	}
+
+	virtual trn::ResultCode Read(size_t offset, size_t size, uint8_t *out, size_t *size_out) override {
+		return VectorFile::Read(offset, size / 2, out, size_out);
+	}
+};
+
+class TestTransmutationFile : public TransmutationFile {
+ public:
+	using TransmutationFile::SetSegments;
+
+	size_t SegmentCount() {
+		return segments.size();
+	}
+};
+
+std::vector<uint8_t> MakeData(size_t size, uint32_t seed) {
+	std::vector<uint8_t> data(size);
+	FillRandom(data.data(), data.size(), seed);
+	return data;
+}
+
+std::vector<uint8_t> ReadAll(ProcessFile &file, size_t offset, size_t size) {
+	std::vector<uint8_t> out(size);
+	size_t actual = 0;
+	TWIB_CHECK(file.Read(offset, size, out.data(), &actual) == RESULT_OK);
+	out.resize(actual);
+	return out;
+}
+
+template<typename T>
+T ReadStruct(const std::vector<uint8_t> &data, size_t offset) {
+	T value;
+	TWIB_CHECK(offset + sizeof(value) <= data.size());
+	memcpy(&value, data.data() + offset, sizeof(value));
+	return value;
+}
+
+} // namespace
+
+TWIB_TEST(TransmutationFileMergesContiguousBackedSegments) {
+	std::vector<uint8_t> data = MakeData(0x3000, 1);
+	std::shared_ptr<CountingFile> file = std::make_shared<CountingFile>(data);
+	std::shared_ptr<CountingFile> other = std::make_shared<CountingFile>(data);
+
+	TestTransmutationFile tf;
+	std::vector<std::unique_ptr<TransmutationFile::Segment>> segments;
+	segments.emplace_back(new TransmutationFile::BackedSegment(file, 0, 0x1000));
+	segments.emplace_back(new TransmutationFile::BackedSegment(file, 0x1000, 0x800));
+	segments.emplace_back(new TransmutationFile::BackedSegment(file, 0x1800, 0x800));
+	// a gap in the file, then a different file at the right offset
+	segments.emplace_back(new TransmutationFile::BackedSegment(file, 0x2100, 0x100));
+	segments.emplace_back(new TransmutationFile::BackedSegment(other, 0x2200, 0x100));
+	tf.SetSegments(std::move(segments));
+
+	TWIB_CHECK(tf.SegmentCount() == 3);
+	size_t size = 0;
+	TWIB_CHECK(tf.GetSize(&size) == RESULT_OK);
+	TWIB_CHECK(size == 0x2200);
+
+	// the first three segments go to the file in one read
+	TWIB_CHECK(ReadAll(tf, 0x10, 0x1ff0) == std::vector<uint8_t>(data.begin() + 0x10, data.begin() + 0x2000));
+	TWIB_CHECK(file->reads == 1);
+
+	std::vector<uint8_t> expected(data.begin() + 0x1f00, data.begin() + 0x2000);
+	expected.insert(expected.end(), data.begin() + 0x2100, data.begin() + 0x2300);
+	TWIB_CHECK(ReadAll(tf, 0x1f00, 0x300) == expected);
+	TWIB_CHECK(file->reads == 3);
+	TWIB_CHECK(other->reads == 1);
+}
+
+TWIB_TEST(TransmutationFileReadsAcrossSegments) {
+	std::vector<uint8_t> data = MakeData(0x1000, 2);
+	std::vector<uint8_t> header = MakeData(0x40, 3);
+	std::vector<uint8_t> trailer = MakeData(0x20, 4);
+	std::shared_ptr<VectorFile> file = std::make_shared<VectorFile>(data);
+
+	TestTransmutationFile tf;
+	std::vector<std::unique_ptr<TransmutationFile::Segment>> segments;
+	segments.emplace_back(new TransmutationFile::MemorySegment(header.data(), header.size()));
+	segments.emplace_back(new TransmutationFile::MemorySegment(nullptr, 0)); // dropped
+	segments.emplace_back(new TransmutationFile::BackedSegment(file, 0x100, 0x200));
+	segments.emplace_back(new TransmutationFile::MemorySegment(trailer.data(), trailer.size()));
+	tf.SetSegments(std::move(segments));
+	TWIB_CHECK(tf.SegmentCount() == 3);
+
+	std::vector<uint8_t> whole(header);
+	whole.insert(whole.end(), data.begin() + 0x100, data.begin() + 0x300);
+	whole.insert(whole.end(), trailer.begin(), trailer.end());
+
+	size_t size = 0;
+	TWIB_CHECK(tf.GetSize(&size) == RESULT_OK);
+	TWIB_CHECK(size == whole.size());
+
+	// every read that starts and ends on or around a boundary
+	size_t points[] = {0, 1, 0x3f, 0x40, 0x41, 0x23f, 0x240, 0x241, 0x25f, 0x260};
+	for(size_t start : points) {
+		for(size_t end : points) {
+			if(end < start) {
+				continue;
+			}
+			TWIB_CHECK(ReadAll(tf, start, end - start) == std::vector<uint8_t>(whole.begin() + start, whole.begin() + end));
+		}
+	}
+
+	// reads running off the end stop there
+	TWIB_CHECK(ReadAll(tf, 0x250, 0x100) == std::vector<uint8_t>(whole.begin() + 0x250, whole.end()));
+	TWIB_CHECK(ReadAll(tf, 0x260, 0x10).empty());
+	TWIB_CHECK(ReadAll(tf, 0x1000, 0x10).empty());
+}
+
+TWIB_TEST(TransmutationFileFailsShortReads) {
+	std::vector<uint8_t> header = MakeData(0x10, 5);
+	std::shared_ptr<ShortFile> file = std::make_shared<ShortFile>(MakeData(0x100, 6));
+
+	TestTransmutationFile tf;
+	std::vector<std::unique_ptr<TransmutationFile::Segment>> segments;
+	segments.emplace_back(new TransmutationFile::MemorySegment(header.data(), header.size()));
+	segments.emplace_back(new TransmutationFile::BackedSegment(file, 0, 0x100));
+	tf.SetSegments(std::move(segments));
+
+	std::vector<uint8_t> out(0x110);
+	size_t actual = 0;
+	TWIB_CHECK(tf.Read(0, out.size(), out.data(), &actual) == TWILI_ERR_IO_ERROR);
+	TWIB_CHECK(actual == 0x10 + 0x80);
+}
+
+TWIB_TEST(PFS0BuilderFileLayout) {
+	struct Header {
+		uint32_t magic;
+		uint32_t num_files;
+		uint32_t string_table_size;
+		uint32_t padding;
+	};
+	struct Entry {
+		uint64_t file_image_offset;
+		uint64_t size;
+		uint32_t string_table_offset;
+		uint32_t reserved;
+	};
+
+	std::vector<std::string> names = {"main", "main.npdm", "rtld"};
+	std::vector<std::vector<uint8_t>> contents = {MakeData(0x123, 7), MakeData(0x40, 8), MakeData(0x1001, 9)};
+
+	PFS0BuilderFile pfs0;
+	for(size_t i = 0; i < names.size(); i++) {
+		TWIB_CHECK(pfs0.Append(names[i], std::make_shared<VectorFile>(contents[i])) == RESULT_OK);
+	}
+
+	size_t size = 0;
+	TWIB_CHECK(pfs0.GetSize(&size) == RESULT_OK);
+	std::vector<uint8_t> image = ReadAll(pfs0, 0, size);
+	TWIB_CHECK(image.size() == size);
+
+	Header header = ReadStruct<Header>(image, 0);
+	TWIB_CHECK(header.magic == 0x30534650);
+	TWIB_CHECK(header.num_files == names.size());
+	TWIB_CHECK(header.padding == 0);
+
+	// "main\0main.npdm\0rtld\0" is 20 bytes; the table is padded with zeroes
+	// until file images start on a 0x20 boundary
+	size_t strtab_offset = sizeof(Header) + sizeof(Entry) * names.size();
+	size_t metadata_size = strtab_offset + header.string_table_size;
+	TWIB_CHECK(metadata_size % 0x20 == 0);
+	TWIB_CHECK(header.string_table_size >= 20 && header.string_table_size < 20 + 0x20);
+	for(size_t i = strtab_offset + 20; i < metadata_size; i++) {
+		TWIB_CHECK(image[i] == 0);
+	}
+
+	size_t string_offset = 0;
+	size_t image_offset = 0;
+	for(size_t i = 0; i < names.size(); i++) {
+		Entry e = ReadStruct<Entry>(image, sizeof(Header) + sizeof(Entry) * i);
+		TWIB_CHECK(e.string_table_offset == string_offset);
+		TWIB_CHECK(e.file_image_offset == image_offset);
+		TWIB_CHECK(e.size == contents[i].size());
+		TWIB_CHECK(e.reserved == 0);
+		TWIB_CHECK(strcmp((const char*) image.data() + strtab_offset + e.string_table_offset, names[i].c_str()) == 0);
+
+		size_t begin = metadata_size + e.file_image_offset;
+		TWIB_CHECK(std::vector<uint8_t>(image.begin() + begin, image.begin() + begin + e.size) == contents[i]);
+
+		string_offset+= names[i].size() + 1;
+		image_offset+= contents[i].size();
+	}
+	TWIB_CHECK(metadata_size + image_offset == size);
+
+	// piecewise reads, crossing from metadata into images and between files
+	for(size_t chunk : {(size_t) 1, (size_t) 7, (size_t) 0x100, (size_t) 0x1000}) {
+		std::vector<uint8_t> pieced;
+		for(size_t offset = 0; offset < size; offset+= chunk) {
+			std::vector<uint8_t> piece = ReadAll(pfs0, offset, chunk);
+			pieced.insert(pieced.end(), piece.begin(), piece.end());
+		}
+		TWIB_CHECK(pieced == image);
+	}
+	TWIB_CHECK(ReadAll(pfs0, size, 0x10).empty());
+}
+
+TWIB_TEST(PFS0BuilderFileRebuildsAfterAppend) {
+	PFS0BuilderFile pfs0;
+	TWIB_CHECK(pfs0.Append("a", std::make_shared<VectorFile>(MakeData(0x10, 10))) == RESULT_OK);
+	size_t before = 0;
+	TWIB_CHECK(pfs0.GetSize(&before) == RESULT_OK);
+
+	std::vector<uint8_t> second = MakeData(0x10, 11);
+	TWIB_CHECK(pfs0.Append("b", std::make_shared<VectorFile>(second)) == RESULT_OK);
+	size_t after = 0;
+	TWIB_CHECK(pfs0.GetSize(&after) == RESULT_OK);
+	TWIB_CHECK(after > before + second.size());
+	TWIB_CHECK(ReadAll(pfs0, after - second.size(), second.size()) == second);
+}
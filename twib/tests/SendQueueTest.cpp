@@ -0,0 +1,168 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<vector>
+
+#include<errno.h>
+#include<sys/socket.h>
+#include<unistd.h>
+
+#include "SendQueue.hpp"
+
+using namespace twili;
+using namespace twili::twib::tests;
+
+namespace {
+
+// The TCP bridge's chunk size, so pushes land across chunk boundaries the
+// same way they do on the console.
+const size_t ChunkSize = 0x10000;
+
+// A socketpair whose sending end never blocks, standing in for the TCP
+// bridge's socket thread and the host.
+class SocketPair {
+ public:
+	SocketPair() {
+		TWIB_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	}
+
+	~SocketPair() {
+		CloseReceiver();
+		close(fds[0]);
+	}
+
+	// Same contract as the bridge's send callback.
+	ssize_t Send(const uint8_t *data, size_t size) {
+		ssize_t r = send(fds[0], data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return 0;
+		}
+		return r;
+	}
+
+	// Reads whatever has arrived without waiting for more.
+	void Receive(std::vector<uint8_t> &out) {
+		uint8_t buffer[0x4000];
+		ssize_t r;
+		while((r = recv(fds[1], buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+			out.insert(out.end(), buffer, buffer + r);
+		}
+	}
+
+	void CloseReceiver() {
+		if(fds[1] != -1) {
+			close(fds[1]);
+			fds[1] = -1;
+		}
+	}
+
+ private:
+	int fds[2] = {-1, -1};
+};
+
+std::vector<uint8_t> MakeData(size_t size, uint32_t seed) {
+	std::vector<uint8_t> data(size);
+	FillRandom(data.data(), data.size(), seed);
+	return data;
+}
+
+// Drains queue into the pair until it's empty, reading the other end
+// whenever the socket fills up.
+void DrainAll(util::SendQueue &queue, SocketPair &pair, std::vector<uint8_t> &received) {
+	while(!queue.Empty()) {
+		TWIB_CHECK(queue.Drain([&](const uint8_t *data, size_t size) { return pair.Send(data, size); }));
+		pair.Receive(received);
+	}
+	pair.Receive(received);
+}
+
+} // namespace
+
+TWIB_TEST(SendQueueDeliversInOrder) {
+	SocketPair pair;
+	util::SendQueue queue(ChunkSize);
+
+	std::vector<uint8_t> sent;
+	std::vector<uint8_t> received;
+	// small writes, like headers, between payloads that straddle chunks
+	size_t sizes[] = {0x20, 0x10000, 0x7, 0x18000, 0x20, 0x0, 0x3ffff, 0x20};
+	uint32_t seed = 1;
+	for(size_t size : sizes) {
+		std::vector<uint8_t> data = MakeData(size, seed++);
+		queue.Push(data.data(), data.size());
+		sent.insert(sent.end(), data.begin(), data.end());
+	}
+	TWIB_CHECK(queue.Size() == sent.size());
+
+	DrainAll(queue, pair, received);
+	TWIB_CHECK(queue.Size() == 0);
+	TWIB_CHECK(received == sent);
+
+	// and again, to go through recycled chunks
+	std::vector<uint8_t> more = MakeData(0x30000, seed++);
+	queue.Push(more.data(), more.size());
+	received.clear();
+	DrainAll(queue, pair, received);
+	TWIB_CHECK(received == more);
+}
+
+TWIB_TEST(SendQueueStopsWhenSocketIsFull) {
+	SocketPair pair;
+	util::SendQueue queue(ChunkSize);
+
+	// far more than a socket buffer holds
+	std::vector<uint8_t> data = MakeData(16 << 20, 2);
+	queue.Push(data.data(), data.size());
+
+	size_t taken = 0;
+	TWIB_CHECK(queue.Drain([&](const uint8_t *chunk, size_t size) {
+		ssize_t r = pair.Send(chunk, size);
+		if(r > 0) {
+			taken+= r;
+		}
+		return r;
+	}));
+	TWIB_CHECK(taken > 0);
+	TWIB_CHECK(taken < data.size());
+	TWIB_CHECK(queue.Size() == data.size() - taken);
+
+	// picks up where it left off
+	std::vector<uint8_t> received;
+	DrainAll(queue, pair, received);
+	TWIB_CHECK(received == data);
+}
+
+TWIB_TEST(SendQueueReportsSendErrors) {
+	SocketPair pair;
+	util::SendQueue queue(ChunkSize);
+
+	std::vector<uint8_t> data = MakeData(0x1000, 3);
+	queue.Push(data.data(), data.size());
+	pair.CloseReceiver();
+
+	TWIB_CHECK(!queue.Drain([&](const uint8_t *chunk, size_t size) { return pair.Send(chunk, size); }));
+	TWIB_CHECK(!queue.Empty());
+
+	queue.Clear();
+	TWIB_CHECK(queue.Empty());
+	TWIB_CHECK(queue.Size() == 0);
+}
@@ -0,0 +1,174 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<deque>
+#include<mutex>
+#include<string>
+#include<vector>
+
+#include<string.h>
+#include<sys/socket.h>
+
+#include "platform/platform.hpp"
+#include "platform/EventLoop.hpp"
+
+#include "common/SocketMessageConnection.hpp"
+#include "daemon/SimDevice.hpp"
+
+#include "Harness.hpp"
+
+namespace twili {
+namespace twib {
+namespace tests {
+
+// A simulated device on one end of a socketpair, and a connection on the
+// other that talks to it the way twibd's sim backend does: same header
+// flags, and compression once the device accepts the offer. Calls block
+// until the device answers.
+class SimBridge {
+ public:
+	class Reply {
+	 public:
+		uint32_t result_code;
+		std::vector<uint8_t> payload;
+		std::vector<uint32_t> object_ids;
+	};
+
+	SimBridge(const std::string &root) :
+		logic(*this),
+		loop(logic),
+		fds(MakeSocketPair()),
+		connection(platform::Socket(platform::File(fds.first)), loop.GetNotifier()),
+		device(MakeConfig(root), platform::Socket(platform::File(fds.second))) {
+		loop.AddMember(connection.member);
+		loop.Begin();
+	}
+
+	~SimBridge() {
+		loop.Destroy();
+		loop.Clear();
+	}
+
+	// twibd's own IDENTIFY, after which both ends compress.
+	void Identify() {
+		Reply reply = Call(0xffffffff, 0, (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY, {});
+		TWIB_CHECK(reply.result_code == 0);
+		connection.EnableCompression();
+	}
+
+	Reply Call(uint32_t client_id, uint32_t object_id, uint32_t command_id, std::vector<uint8_t> payload) {
+		protocol::MessageHeader mh = {};
+		mh.client_id = client_id;
+		mh.object_id = object_id;
+		mh.command_id = command_id;
+		mh.tag = next_tag++;
+		mh.payload_size = payload.size();
+		mh.flags = protocol::RequestFlags(object_id, command_id);
+		connection.SendMessage(mh, std::move(payload), {});
+
+		Reply reply;
+		TWIB_CHECK(WaitFor([&]() {
+			std::lock_guard<std::mutex> lock(mutex);
+			if(replies.empty()) {
+				return false;
+			}
+			reply = std::move(replies.front());
+			replies.pop_front();
+			return true;
+		}));
+		return reply;
+	}
+
+	// Object IDs come back as indices into the response's object list.
+	static uint32_t ObjectAt(const Reply &reply, size_t offset) {
+		uint32_t index;
+		TWIB_CHECK(reply.payload.size() >= offset + sizeof(index));
+		memcpy(&index, reply.payload.data() + offset, sizeof(index));
+		TWIB_CHECK(index < reply.object_ids.size());
+		return reply.object_ids[index];
+	}
+
+	template<typename T>
+	static void Put(std::vector<uint8_t> &payload, T value) {
+		const uint8_t *bytes = (const uint8_t*) &value;
+		payload.insert(payload.end(), bytes, bytes + sizeof(value));
+	}
+
+	static void PutString(std::vector<uint8_t> &payload, const std::string &str) {
+		Put<uint64_t>(payload, str.size());
+		payload.insert(payload.end(), str.begin(), str.end());
+	}
+
+ private:
+	class Logic : public platform::EventLoop::Logic {
+	 public:
+		Logic(SimBridge &bridge) : bridge(bridge) {
+		}
+
+		virtual void Prepare(platform::EventLoop &) override {
+			common::MessageConnection::Request *rq;
+			while((rq = bridge.connection.Process()) != nullptr) {
+				Reply reply;
+				reply.result_code = rq->mh.result_code;
+				reply.payload = std::move(rq->payload);
+				reply.object_ids.resize(rq->mh.object_count);
+				for(uint32_t &id : reply.object_ids) {
+					rq->object_ids.Read(id);
+				}
+				std::lock_guard<std::mutex> lock(bridge.mutex);
+				bridge.replies.push_back(std::move(reply));
+			}
+		}
+	 private:
+		SimBridge &bridge;
+	};
+
+	static std::pair<int, int> MakeSocketPair() {
+		int pair[2] = {-1, -1};
+		socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+		return std::make_pair(pair[0], pair[1]);
+	}
+
+	static daemon::backend::sim::SimDevice::Config MakeConfig(const std::string &root) {
+		daemon::backend::sim::SimDevice::Config config;
+		config.root = root;
+		config.serial_number = "sim";
+		config.nickname = "sim";
+		return config;
+	}
+
+	std::mutex mutex;
+	std::deque<Reply> replies;
+	uint32_t next_tag = 0;
+
+	// declared in construction order
+	Logic logic;
+	platform::EventLoop loop;
+	std::pair<int, int> fds;
+	common::SocketMessageConnection connection;
+	// destroyed first, so it hangs up before the connection goes away
+	daemon::backend::sim::SimDevice device;
+};
+
+} // namespace tests
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,188 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+#include "SimBridge.hpp"
+
+#include<string>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+const uint32_t ClientId = 1;
+
+// A root directory for the simulated device with one filesystem, "sd".
+// Files the test creates in it are cleaned up along with it.
+class SimRoot {
+ public:
+	SimRoot() {
+		char tmpl[] = "/tmp/twib-sim-XXXXXX";
+		TWIB_CHECK(mkdtemp(tmpl) != nullptr);
+		path = tmpl;
+		TWIB_CHECK(mkdir((path + "/fs").c_str(), 0700) == 0);
+		TWIB_CHECK(mkdir(SdPath().c_str(), 0700) == 0);
+	}
+
+	~SimRoot() {
+		for(const std::string &name : files) {
+			unlink((SdPath() + "/" + name).c_str());
+		}
+		rmdir(SdPath().c_str());
+		rmdir((path + "/fs").c_str());
+		rmdir(path.c_str());
+	}
+
+	std::string SdPath() {
+		return path + "/fs/sd";
+	}
+
+	void Write(const std::string &name, const std::vector<uint8_t> &contents) {
+		files.push_back(name);
+		FILE *f = fopen((SdPath() + "/" + name).c_str(), "wb");
+		TWIB_CHECK(f != nullptr);
+		TWIB_CHECK(fwrite(contents.data(), 1, contents.size(), f) == contents.size());
+		fclose(f);
+	}
+
+	std::vector<uint8_t> Read(const std::string &name) {
+		std::vector<uint8_t> contents;
+		FILE *f = fopen((SdPath() + "/" + name).c_str(), "rb");
+		TWIB_CHECK(f != nullptr);
+		uint8_t buffer[0x4000];
+		size_t r;
+		while((r = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+			contents.insert(contents.end(), buffer, buffer + r);
+		}
+		fclose(f);
+		return contents;
+	}
+
+	std::string path;
+	std::vector<std::string> files;
+};
+
+// Opens a file on the device's sd filesystem, returning its object ID.
+uint32_t OpenFile(SimBridge &bridge, const std::string &path, uint32_t mode) {
+	std::vector<uint8_t> payload;
+	SimBridge::PutString(payload, "sd");
+	SimBridge::Reply fs = bridge.Call(ClientId, 0, (uint32_t) protocol::ITwibDeviceInterface::Command::OPEN_FILESYSTEM_ACCESSOR, payload);
+	TWIB_CHECK(fs.result_code == 0);
+	uint32_t fs_id = SimBridge::ObjectAt(fs, 0);
+
+	payload.clear();
+	SimBridge::Put<uint32_t>(payload, mode);
+	SimBridge::PutString(payload, path);
+	SimBridge::Reply file = bridge.Call(ClientId, fs_id, (uint32_t) protocol::ITwibFilesystemAccessor::Command::OPEN_FILE, payload);
+	TWIB_CHECK(file.result_code == 0);
+	return SimBridge::ObjectAt(file, 0);
+}
+
+// Reads up to `size` bytes at `offset`, returning what came back.
+std::vector<uint8_t> ReadFile(SimBridge &bridge, uint32_t file, uint64_t offset, uint64_t size) {
+	std::vector<uint8_t> payload;
+	SimBridge::Put<uint64_t>(payload, offset);
+	SimBridge::Put<uint64_t>(payload, size);
+	SimBridge::Reply read = bridge.Call(ClientId, file, (uint32_t) protocol::ITwibFileAccessor::Command::READ, payload);
+	TWIB_CHECK(read.result_code == 0);
+
+	uint64_t count;
+	TWIB_CHECK(read.payload.size() >= sizeof(count));
+	memcpy(&count, read.payload.data(), sizeof(count));
+	TWIB_CHECK(read.payload.size() == sizeof(count) + count);
+	return std::vector<uint8_t>(read.payload.begin() + sizeof(count), read.payload.end());
+}
+
+} // namespace
+
+// A client identifying the device goes through twibd after twibd has
+// turned compression on. If the client's IDENTIFY went out without the
+// offer, the device would stop decompressing while twibd kept compressing,
+// and large pushes would arrive garbled.
+TWIB_TEST(SimClientIdentifyKeepsCompression) {
+	SimRoot root;
+	root.Write("pushed", {});
+	SimBridge bridge(root.path);
+	bridge.Identify();
+
+	SimBridge::Reply identify = bridge.Call(ClientId, 0, (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY, {});
+	TWIB_CHECK(identify.result_code == 0);
+
+	// compressible and over the threshold, so it goes out compressed
+	std::vector<uint8_t> data;
+	while(data.size() < 0x10000) {
+		std::string line = "line " + std::to_string(data.size()) + " of a log file\n";
+		data.insert(data.end(), line.begin(), line.end());
+	}
+	uint32_t file = OpenFile(bridge, "/pushed", 2 | 4); // OpenMode_Write | OpenMode_Append
+	std::vector<uint8_t> payload;
+	SimBridge::Put<uint64_t>(payload, 0);
+	SimBridge::Put<uint64_t>(payload, data.size());
+	payload.insert(payload.end(), data.begin(), data.end());
+	SimBridge::Reply write = bridge.Call(ClientId, file, (uint32_t) protocol::ITwibFileAccessor::Command::WRITE, payload);
+	TWIB_CHECK(write.result_code == 0);
+
+	TWIB_CHECK(root.Read("pushed") == data);
+}
+
+// Pulls a file the way twib does, asking for READ_MAX_SIZE at a time until
+// a read comes back empty, with compression on as it is behind twibd.
+TWIB_TEST(SimFileAccessorReads) {
+	const uint64_t chunk_size = protocol::ITwibFileAccessor::READ_MAX_SIZE;
+	std::vector<uint8_t> data(0x100000);
+	FillRandom(data.data(), data.size(), 21);
+	
+	SimRoot root;
+	root.Write("big", data);
+	SimBridge bridge(root.path);
+	bridge.Identify();
+	uint32_t file = OpenFile(bridge, "/big", 1); // OpenMode_Read
+
+	// asking for more than READ_MAX_SIZE gets READ_MAX_SIZE
+	std::vector<uint8_t> pulled;
+	size_t chunks = 0;
+	while(true) {
+		std::vector<uint8_t> chunk = ReadFile(bridge, file, pulled.size(), chunk_size * 2);
+		if(chunk.empty()) {
+			break;
+		}
+		TWIB_CHECK(chunk.size() <= chunk_size);
+		pulled.insert(pulled.end(), chunk.begin(), chunk.end());
+		chunks++;
+	}
+	TWIB_CHECK(pulled == data);
+	TWIB_CHECK(chunks == data.size() / chunk_size);
+
+	// a read that runs off the end is cut short
+	std::vector<uint8_t> tail = ReadFile(bridge, file, data.size() - 100, chunk_size);
+	TWIB_CHECK(tail == std::vector<uint8_t>(data.end() - 100, data.end()));
+
+	// and one that starts past it is empty, not an error
+	TWIB_CHECK(ReadFile(bridge, file, data.size() + 0x1000, chunk_size).empty());
+}
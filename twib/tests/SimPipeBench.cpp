@@ -0,0 +1,139 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<chrono>
+#include<optional>
+#include<string>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<sys/socket.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include "platform/platform.hpp"
+
+#include "daemon/SimDevice.hpp"
+#include "tool/PipePump.hpp"
+#include "tool/SocketClient.hpp"
+#include "tool/interfaces/ITwibPipeReader.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t PipeSize = 4 << 20;
+const std::chrono::milliseconds Latencies[] = {std::chrono::milliseconds(0), std::chrono::milliseconds(1), std::chrono::milliseconds(5)};
+
+// A root directory for the simulated device, holding one named pipe.
+class SimRoot {
+ public:
+	SimRoot(const std::vector<uint8_t> &contents) {
+		char tmpl[] = "/tmp/twib-sim-XXXXXX";
+		TWIB_CHECK(mkdtemp(tmpl) != nullptr);
+		path = tmpl;
+		TWIB_CHECK(mkdir((path + "/pipes").c_str(), 0700) == 0);
+		FILE *f = fopen(PipePath().c_str(), "wb");
+		TWIB_CHECK(f != nullptr);
+		TWIB_CHECK(fwrite(contents.data(), 1, contents.size(), f) == contents.size());
+		fclose(f);
+	}
+
+	~SimRoot() {
+		unlink(PipePath().c_str());
+		rmdir((path + "/pipes").c_str());
+		rmdir(path.c_str());
+	}
+
+	std::string path;
+
+ private:
+	std::string PipePath() {
+		return path + "/pipes/stdout";
+	}
+};
+
+std::vector<uint8_t> ReadBack(FILE *f) {
+	std::vector<uint8_t> data;
+	rewind(f);
+	uint8_t buffer[0x4000];
+	size_t r;
+	while((r = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		data.insert(data.end(), buffer, buffer + r);
+	}
+	return data;
+}
+
+} // namespace
+
+// Pumps a named pipe from the simulated device the way `twib run` and
+// `open-named-pipe` do, with one read in flight and with the full window,
+// and checks that everything arrived intact. The device answers each read
+// with at most 16 KiB, after the configured latency.
+TWIB_BENCHMARK(SimPipeThroughput) {
+	std::vector<uint8_t> contents(PipeSize);
+	FillRandom(contents.data(), contents.size(), 1);
+	SimRoot root(contents);
+
+	for(std::chrono::milliseconds latency : Latencies) {
+		for(size_t window : {(size_t) 1, (size_t) protocol::ITwibPipeReader::READ_WINDOW}) {
+			int fds[2] = {-1, -1};
+			TWIB_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+			daemon::backend::sim::SimDevice::Config config;
+			config.root = root.path;
+			config.serial_number = "sim";
+			config.nickname = "sim";
+			config.latency = latency;
+			daemon::backend::sim::SimDevice device(config, platform::Socket(platform::File(fds[1])));
+			tool::client::SocketClient client {platform::Socket(platform::File(fds[0]))};
+
+			FILE *out = tmpfile();
+			TWIB_CHECK(out != nullptr);
+			auto start = std::chrono::steady_clock::now();
+			{
+				tool::RemoteObject iface(client, 0, 0);
+				std::optional<tool::ITwibPipeReader> reader;
+				iface.SendSmartSyncRequest(
+					protocol::ITwibDeviceInterface::Command::OPEN_NAMED_PIPE,
+					tool::in<std::string>(std::string("stdout")),
+					tool::out_object<tool::ITwibPipeReader>(reader));
+				TWIB_CHECK(reader);
+
+				tool::PipePump pump(window);
+				pump.Add(std::move(*reader), out);
+				pump.Run();
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			bool intact = ReadBack(out) == contents;
+			fclose(out);
+			TWIB_CHECK(intact);
+
+			std::string description = std::to_string(latency.count()) + " ms latency, window " + std::to_string(window);
+			Report("sim_pipe", description, PipeSize / seconds / (1 << 20), "MiB/s");
+		}
+	}
+}
@@ -0,0 +1,152 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+#include "EchoServer.hpp"
+
+#include<atomic>
+#include<chrono>
+#include<deque>
+#include<functional>
+#include<map>
+#include<mutex>
+#include<random>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include "common/SlotTable.hpp"
+
+#include "tool/RemoteObject.hpp"
+#include "tool/SocketClient.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tests;
+
+namespace {
+
+const size_t ThreadCounts[] = {1, 2, 4, 8};
+const size_t OperationsPerThread = 200000;
+const size_t RequestsPerThread = 20000;
+const size_t InFlight = 8; // outstanding tags per thread
+
+// Each thread keeps InFlight tags outstanding, inserting a new one and
+// taking back its oldest, the way request threads and the response thread
+// share Client's response map. Returns insert+take pairs per second.
+template<typename Insert, typename Take>
+double RunTable(size_t threads, std::mutex &mutex, Insert insert, Take take) {
+	std::atomic<size_t> missing = 0; // checks can't fail on worker threads
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for(size_t t = 0; t < threads; t++) {
+		workers.emplace_back([&]() {
+			std::deque<uint32_t> tags;
+			for(size_t i = 0; i < OperationsPerThread; i++) {
+				std::lock_guard<std::mutex> lock(mutex);
+				tags.push_back(insert());
+				if(tags.size() > InFlight) {
+					missing+= !take(tags.front());
+					tags.pop_front();
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			for(uint32_t tag : tags) {
+				missing+= !take(tag);
+			}
+		});
+	}
+	for(std::thread &worker : workers) {
+		worker.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	TWIB_CHECK(missing == 0);
+	return threads * OperationsPerThread / seconds;
+}
+
+std::string Describe(size_t threads) {
+	return std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+}
+
+} // namespace
+
+TWIB_BENCHMARK(SlotTableContention) {
+	for(size_t threads : ThreadCounts) {
+		std::mutex mutex;
+		common::SlotTable<tool::ResponseCallback> table;
+		double rate = RunTable(
+			threads, mutex,
+			[&]() {
+				return table.Insert([](tool::Response) {});
+			},
+			[&](uint32_t tag) {
+				return table.Take(tag).has_value();
+			});
+		TWIB_CHECK(table.Size() == 0);
+		Report("slot_table", Describe(threads), rate / 1e6, "Mops/s");
+	}
+}
+
+// What Client used to do: a fresh tag from std::random_device per request,
+// with the callbacks in a std::map. Compare against SlotTableContention.
+TWIB_BENCHMARK(LegacyResponseMapContention) {
+	for(size_t threads : ThreadCounts) {
+		std::mutex mutex;
+		std::map<uint32_t, std::function<void(tool::Response)>> map;
+		std::random_device rng;
+		double rate = RunTable(
+			threads, mutex,
+			[&]() {
+				uint32_t tag = rng();
+				map[tag] = [](tool::Response) {};
+				return tag;
+			},
+			[&](uint32_t tag) {
+				return map.erase(tag) == 1;
+			});
+		Report("legacy_response_map", Describe(threads), rate / 1e6, "Mops/s");
+	}
+}
+
+// Several threads sharing one client, each sending small synchronous
+// requests to an echo server, as twib's parallel file transfers do.
+TWIB_BENCHMARK(ClientRequestContention) {
+	for(size_t threads : ThreadCounts) {
+		EchoServer server;
+		tool::client::SocketClient client {platform::Socket(platform::File(server.client_fd))};
+		tool::RemoteObject obj(client, 0, 0);
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for(size_t t = 0; t < threads; t++) {
+			workers.emplace_back([&]() {
+				uint64_t result;
+				for(uint64_t i = 0; i < RequestsPerThread; i++) {
+					obj.SendSmartSyncRequest(0, tool::in<uint64_t>(i), tool::out<uint64_t>(result));
+				}
+			});
+		}
+		for(std::thread &worker : workers) {
+			worker.join();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		Report("client_requests", Describe(threads), threads * RequestsPerThread / seconds, "req/s");
+	}
+}
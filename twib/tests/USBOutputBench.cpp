@@ -0,0 +1,126 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<queue>
+#include<string>
+#include<vector>
+
+#include<stdint.h>
+
+#include "daemon/USBOutputScheduler.hpp"
+
+using namespace twili;
+using namespace twili::twib::tests;
+using twili::twib::daemon::backend::USBOutputScheduler;
+
+namespace {
+
+// Rough figures for a USB 2.0 bulk link. The per-transfer cost and the
+// time it takes the host to notice a completion and submit more are what
+// the transfer pool and pipelining are meant to hide.
+const double Bandwidth = 40e6; // bytes per second
+const double TransferOverhead = 20e-6; // seconds
+const double Turnarounds[] = {50e-6, 500e-6};
+
+// Runs the scheduler against a simulated link instead of libusb, in
+// simulated time. The link works through submitted transfers one at a
+// time, in submission order, and each completion reaches the scheduler
+// after the host's turnaround.
+class SimulatedLink : public USBOutputScheduler::Submitter {
+ public:
+	SimulatedLink(double turnaround) : turnaround(turnaround) {
+	}
+
+	virtual bool SubmitTransfer(USBOutputScheduler::Endpoint endpoint, size_t slot, uint8_t *, size_t size) override {
+		double start = std::max(now, link_free);
+		link_free = start + TransferOverhead + size / Bandwidth;
+		completions.push(Completion {link_free + turnaround, endpoint, slot, size});
+		return true;
+	}
+
+	// Returns the simulated time it took to get everything through.
+	double Run(USBOutputScheduler &scheduler) {
+		TWIB_CHECK(scheduler.Pump());
+		while(!completions.empty()) {
+			Completion c = completions.top();
+			completions.pop();
+			now = c.time;
+			TWIB_CHECK(scheduler.TransferCompleted(c.endpoint, c.slot, c.size));
+			TWIB_CHECK(scheduler.Pump());
+		}
+		return now;
+	}
+
+ private:
+	class Completion {
+	 public:
+		double time;
+		USBOutputScheduler::Endpoint endpoint;
+		size_t slot;
+		size_t size;
+
+		bool operator>(const Completion &other) const {
+			return time > other.time;
+		}
+	};
+
+	const double turnaround;
+	double now = 0;
+	double link_free = 0;
+	std::priority_queue<Completion, std::vector<Completion>, std::greater<Completion>> completions;
+};
+
+std::string Describe(bool pipelining, double turnaround) {
+	return std::string(pipelining ? "pipelined" : "serial") + ", " + std::to_string((int) (turnaround * 1e6)) + "us turnaround";
+}
+
+void RunLoad(const char *bench, size_t requests, size_t payload_size) {
+	for(double turnaround : Turnarounds) {
+		for(bool pipelining : {false, true}) {
+			SimulatedLink link(turnaround);
+			USBOutputScheduler scheduler(link);
+			scheduler.SetPipelining(pipelining);
+			for(size_t i = 0; i < requests; i++) {
+				protocol::MessageHeader mhdr = {};
+				mhdr.tag = i;
+				mhdr.payload_size = payload_size;
+				scheduler.Queue(mhdr, std::vector<uint8_t>(payload_size));
+			}
+			double seconds = link.Run(scheduler);
+			if(payload_size < 0x10000) {
+				Report(bench, Describe(pipelining, turnaround), requests / seconds, "req/s");
+			} else {
+				Report(bench, Describe(pipelining, turnaround), (double) requests * payload_size / seconds / (1 << 20), "MiB/s");
+			}
+		}
+	}
+}
+
+} // namespace
+
+TWIB_BENCHMARK(USBOutputSmallRequests) {
+	RunLoad("usb_out_small", 10000, 0x40);
+}
+
+TWIB_BENCHMARK(USBOutputLargePayloads) {
+	RunLoad("usb_out_large", 16, 0x800000);
+}
@@ -0,0 +1,248 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Harness.hpp"
+
+#include<algorithm>
+#include<array>
+#include<vector>
+
+#include<stdint.h>
+#include<string.h>
+
+#include "daemon/USBOutputScheduler.hpp"
+
+using namespace twili;
+using namespace twili::twib::tests;
+using twili::twib::daemon::backend::USBOutputScheduler;
+
+namespace {
+
+using Endpoint = USBOutputScheduler::Endpoint;
+
+// Stands in for libusb. Transfers stay in flight until the test completes
+// them, and whatever was submitted on each endpoint is recorded in
+// submission order, which is the order a bulk endpoint puts it on the wire.
+class FakeSubmitter : public USBOutputScheduler::Submitter {
+ public:
+	class Transfer {
+	 public:
+		Endpoint endpoint;
+		size_t slot;
+		size_t size;
+	};
+
+	virtual bool SubmitTransfer(Endpoint endpoint, size_t slot, uint8_t *buffer, size_t size) override {
+		if(fail) {
+			return false;
+		}
+		TWIB_CHECK(slot < USBOutputScheduler::PoolSize);
+		bool &busy = (endpoint == Endpoint::Meta ? meta_busy : data_busy)[slot];
+		TWIB_CHECK(!busy);
+		busy = true;
+		std::vector<uint8_t> &wire = endpoint == Endpoint::Meta ? meta_wire : data_wire;
+		wire.insert(wire.end(), buffer, buffer + size);
+		in_flight.push_back(Transfer {endpoint, slot, size});
+		if(endpoint == Endpoint::Data) {
+			data_sizes.push_back(size);
+		}
+		return true;
+	}
+
+	// Completes the index'th transfer still in flight, in full.
+	void Complete(USBOutputScheduler &scheduler, size_t index) {
+		Transfer t = in_flight[index];
+		in_flight.erase(in_flight.begin() + index);
+		(t.endpoint == Endpoint::Meta ? meta_busy : data_busy)[t.slot] = false;
+		TWIB_CHECK(scheduler.TransferCompleted(t.endpoint, t.slot, t.size));
+	}
+
+	size_t InFlight(Endpoint endpoint) {
+		return std::count_if(in_flight.begin(), in_flight.end(), [&](const Transfer &t) { return t.endpoint == endpoint; });
+	}
+
+	std::vector<protocol::MessageHeader> Headers() {
+		std::vector<protocol::MessageHeader> headers(meta_wire.size() / sizeof(protocol::MessageHeader));
+		TWIB_CHECK(headers.size() * sizeof(protocol::MessageHeader) == meta_wire.size());
+		memcpy(headers.data(), meta_wire.data(), meta_wire.size());
+		return headers;
+	}
+
+	bool fail = false;
+	std::vector<Transfer> in_flight;
+	std::vector<uint8_t> meta_wire;
+	std::vector<uint8_t> data_wire;
+	std::vector<size_t> data_sizes;
+
+ private:
+	std::array<bool, USBOutputScheduler::PoolSize> meta_busy = {};
+	std::array<bool, USBOutputScheduler::PoolSize> data_busy = {};
+};
+
+protocol::MessageHeader MakeHeader(uint32_t tag, size_t payload_size) {
+	protocol::MessageHeader mhdr = {};
+	mhdr.client_id = 1;
+	mhdr.command_id = 0x10;
+	mhdr.tag = tag;
+	mhdr.payload_size = payload_size;
+	return mhdr;
+}
+
+std::vector<uint8_t> MakePayload(size_t size, uint32_t seed) {
+	std::vector<uint8_t> payload(size);
+	FillRandom(payload.data(), payload.size(), seed);
+	return payload;
+}
+
+} // namespace
+
+TWIB_TEST(USBOutputChunkSizes) {
+	struct {
+		size_t remaining;
+		size_t chunk;
+	} table[] = {
+		{0x1, 0x1},
+		{0x8000, 0x8000}, // small payloads go out whole
+		{0x10000, 0x10000},
+		{0x40000, 0x10000}, // a quarter would be under the minimum
+		{0x41000, 0x11000}, // quarters round up to a page
+		{0x100000, 0x40000},
+		{0x400000, 0x100000},
+		{0x10000000, 0x100000}, // capped
+	};
+	for(auto &row : table) {
+		TWIB_CHECK(USBOutputScheduler::ChooseTransferSize(row.remaining) == row.chunk);
+	}
+}
+
+TWIB_TEST(USBOutputPipelinedOrdering) {
+	FakeSubmitter submitter;
+	USBOutputScheduler scheduler(submitter);
+	scheduler.SetPipelining(true);
+
+	size_t sizes[] = {0x0, 0x300, 0x48000, 0x0, 0x500000, 0x20};
+	std::vector<uint8_t> expected_data;
+	uint32_t tag = 0;
+	for(size_t size : sizes) {
+		std::vector<uint8_t> payload = MakePayload(size, tag + 1);
+		expected_data.insert(expected_data.end(), payload.begin(), payload.end());
+		scheduler.Queue(MakeHeader(tag++, size), std::move(payload));
+	}
+
+	// finish transfers out of order, so that slots free up unevenly
+	uint32_t seed = 7;
+	TWIB_CHECK(scheduler.Pump());
+	while(!submitter.in_flight.empty()) {
+		TWIB_CHECK(submitter.InFlight(Endpoint::Meta) <= USBOutputScheduler::PoolSize);
+		TWIB_CHECK(submitter.InFlight(Endpoint::Data) <= USBOutputScheduler::PoolSize);
+		seed = seed * 1103515245 + 12345;
+		submitter.Complete(scheduler, (seed >> 16) % submitter.in_flight.size());
+		TWIB_CHECK(scheduler.Pump());
+	}
+
+	std::vector<protocol::MessageHeader> headers = submitter.Headers();
+	TWIB_CHECK(headers.size() == std::size(sizes));
+	for(size_t i = 0; i < headers.size(); i++) {
+		TWIB_CHECK(headers[i].tag == i);
+		TWIB_CHECK(headers[i].payload_size == sizes[i]);
+	}
+	TWIB_CHECK(submitter.data_wire == expected_data);
+	// no empty transfers for payloadless requests, and chunks stay
+	// page-aligned except for the last one of each payload
+	size_t offset = 0;
+	size_t request = 0;
+	for(size_t chunk : submitter.data_sizes) {
+		TWIB_CHECK(chunk > 0);
+		while(sizes[request] == 0 || offset == sizes[request]) {
+			offset = 0;
+			request++;
+		}
+		offset+= chunk;
+		TWIB_CHECK(offset <= sizes[request]);
+		TWIB_CHECK(offset == sizes[request] || chunk % 0x1000 == 0);
+	}
+}
+
+TWIB_TEST(USBOutputUsesWholePoolForLargePayloads) {
+	FakeSubmitter submitter;
+	USBOutputScheduler scheduler(submitter);
+	scheduler.SetPipelining(true);
+
+	scheduler.Queue(MakeHeader(0, 0x800000), MakePayload(0x800000, 1));
+	scheduler.Queue(MakeHeader(1, 0x10), MakePayload(0x10, 2));
+	TWIB_CHECK(scheduler.Pump());
+	TWIB_CHECK(submitter.InFlight(Endpoint::Data) == USBOutputScheduler::PoolSize);
+	// the second header doesn't wait on the first payload
+	TWIB_CHECK(submitter.InFlight(Endpoint::Meta) == 2);
+}
+
+TWIB_TEST(USBOutputHoldsHeadersWithoutPipelining) {
+	FakeSubmitter submitter;
+	USBOutputScheduler scheduler(submitter);
+
+	scheduler.Queue(MakeHeader(0, 0x30000), MakePayload(0x30000, 1));
+	scheduler.Queue(MakeHeader(1, 0x0), {});
+	scheduler.Queue(MakeHeader(2, 0x10), MakePayload(0x10, 2));
+	TWIB_CHECK(scheduler.Pump());
+	TWIB_CHECK(submitter.InFlight(Endpoint::Meta) == 1);
+	TWIB_CHECK(submitter.Headers().size() == 1);
+	// payloads can still be queued up behind the header: three chunks of
+	// the first one, and the last request's
+	TWIB_CHECK(submitter.InFlight(Endpoint::Data) == 4);
+
+	// the header finishing isn't enough while its payload is outstanding
+	TWIB_CHECK(submitter.in_flight[0].endpoint == Endpoint::Data);
+	TWIB_CHECK(submitter.in_flight.back().endpoint == Endpoint::Meta);
+	submitter.Complete(scheduler, submitter.in_flight.size() - 1);
+	TWIB_CHECK(scheduler.Pump());
+	TWIB_CHECK(submitter.Headers().size() == 1);
+	for(int i = 0; i < 2; i++) {
+		submitter.Complete(scheduler, 0);
+		TWIB_CHECK(scheduler.Pump());
+		TWIB_CHECK(submitter.Headers().size() == 1);
+	}
+	submitter.Complete(scheduler, 0);
+	TWIB_CHECK(scheduler.Pump());
+	TWIB_CHECK(submitter.Headers().size() == 2);
+
+	// a request with no payload only waits on its own header
+	TWIB_CHECK(submitter.in_flight.back().endpoint == Endpoint::Meta);
+	submitter.Complete(scheduler, submitter.in_flight.size() - 1);
+	TWIB_CHECK(scheduler.Pump());
+	TWIB_CHECK(submitter.Headers().size() == 3);
+}
+
+TWIB_TEST(USBOutputReportsFailures) {
+	FakeSubmitter submitter;
+	USBOutputScheduler scheduler(submitter);
+	scheduler.Queue(MakeHeader(0, 0x20000), MakePayload(0x20000, 1));
+	TWIB_CHECK(scheduler.Pump());
+
+	// a short data transfer leaves the device out of step with us
+	FakeSubmitter::Transfer t = submitter.in_flight.front();
+	TWIB_CHECK(t.endpoint == Endpoint::Data);
+	TWIB_CHECK(!scheduler.TransferCompleted(t.endpoint, t.slot, t.size - 1));
+
+	FakeSubmitter failing;
+	failing.fail = true;
+	USBOutputScheduler failing_scheduler(failing);
+	failing_scheduler.Queue(MakeHeader(0, 0), {});
+	TWIB_CHECK(!failing_scheduler.Pump());
+}
@@ -0,0 +1,48 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+// Just enough of libtransistor's result codes to build Twili's platform
+// independent file code on the host.
+
+#include<stdint.h>
+
+#define RESULT_OK 0
+
+namespace trn {
+
+class ResultCode {
+ public:
+	ResultCode(uint32_t code) : code(code) {
+	}
+
+	bool operator==(const ResultCode &other) const {
+		return code == other.code;
+	}
+
+	bool operator!=(const ResultCode &other) const {
+		return code != other.code;
+	}
+
+	uint32_t code;
+};
+
+} // namespace trn
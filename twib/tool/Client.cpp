@@ -20,8 +20,6 @@
 
 #include "Client.hpp"
 
-#include<random>
-
 #include "common/Logger.hpp"
 #include "RemoteObject.hpp"
 
@@ -30,7 +28,7 @@ namespace twib {
 namespace tool {
 namespace client {
 
-void Client::PostResponse(protocol::MessageHeader &mh, util::Buffer &payload, util::Buffer &object_ids) {
+void Client::PostResponse(protocol::MessageHeader &mh, std::vector<uint8_t> &&payload, util::Buffer &object_ids) {
 	// create RAII objects for remote objects
 	std::vector<std::shared_ptr<RemoteObject>> objects(mh.object_count);
 	for(uint32_t i = 0; i < mh.object_count; i++) {
@@ -42,58 +40,57 @@ void Client::PostResponse(protocol::MessageHeader &mh, util::Buffer &payload, ut
 		objects[i] = std::make_shared<RemoteObject>(*this, mh.device_id, id);
 	}
 
-	std::function<void(Response)> func;
+	std::optional<ResponseCallback> func;
 	{
 		std::lock_guard<std::mutex> lock(response_map_mutex);
-		auto it = response_map.find(mh.tag);
-		if(it == response_map.end()) {
-			LogMessage(Warning, "dropping response for unknown tag 0x%x", mh.tag);
-			return;
-		}
-		func = std::move(it->second);
-		response_map.erase(it);
+		func = response_map.Take(mh.tag);
+	}
+	if(!func) {
+		LogMessage(Warning, "dropping response for unknown tag 0x%x", mh.tag);
+		return;
 	}
 		
-	std::invoke(
-		func,
+	(*func)(
 		Response(
 			mh.device_id,
 			mh.object_id,
 			mh.result_code,
 			mh.tag,
-			std::vector<uint8_t>(payload.Read(), payload.Read() + payload.ReadAvailable()),
-			objects));
+			std::move(payload),
+			std::move(objects)));
 }
 
-void Client::SendRequest(Request &&rq, std::function<void(Response)> &&function) {
-	if(failed) {
-		std::invoke(function, Response(0, 0, fail_code, 0, std::vector<uint8_t>(), std::vector<std::shared_ptr<RemoteObject>>()));
-	} else {
-		{
-			std::lock_guard<std::mutex> lock(response_map_mutex);
-			static std::random_device rng;
-
-			uint32_t tag = rng();
-			rq.tag = tag;
-
-			response_map[tag] = std::move(function);
+void Client::SendRequest(Request &&rq, ResponseCallback &&function) {
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lock(response_map_mutex);
+		if(!failed) {
+			rq.tag = response_map.Insert(std::move(function));
+			queued = true;
 		}
+	}
 
-		SendRequestImpl(rq);
+	if(queued) {
+		SendRequestImpl(std::move(rq));
+	} else {
+		function(Response(0, 0, fail_code, 0, std::vector<uint8_t>(), std::vector<std::shared_ptr<RemoteObject>>()));
 	}
 }
 
 void Client::FailAllRequests(uint32_t code) {
-	fail_code = code;
-	failed = true;
-	for(auto i = response_map.begin(); i != response_map.end();) {
-		std::invoke(
-			i->second,
+	std::vector<ResponseCallback> functions;
+	{
+		std::lock_guard<std::mutex> lock(response_map_mutex);
+		fail_code = code;
+		failed = true;
+		functions = response_map.TakeAll();
+	}
+	for(ResponseCallback &function : functions) {
+		function(
 			Response(
 				0, 0, code, 0,
 				std::vector<uint8_t>(),
 				std::vector<std::shared_ptr<RemoteObject>>()));
-		i = response_map.erase(i);
 	}
 }
 
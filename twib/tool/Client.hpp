@@ -20,9 +20,9 @@
 
 #pragma once
 
-#include<functional>
 #include<mutex>
-#include<map>
+
+#include "common/SlotTable.hpp"
 
 #include "Messages.hpp"
 #include "Protocol.hpp"
@@ -36,16 +36,17 @@ namespace client {
 class Client {
  public:
 	virtual ~Client() = default;
-	void SendRequest(Request &&rq, std::function<void(Response)> &&function);
+	void SendRequest(Request &&rq, ResponseCallback &&function);
 	
 	bool deletion_flag = false;
 	
  protected:
-	virtual void SendRequestImpl(const Request &rq) = 0;
-	void PostResponse(protocol::MessageHeader &mh, util::Buffer &payload, util::Buffer &object_ids);
+	virtual void SendRequestImpl(Request &&rq) = 0;
+	void PostResponse(protocol::MessageHeader &mh, std::vector<uint8_t> &&payload, util::Buffer &object_ids);
 	void FailAllRequests(uint32_t code);
  private:
-	std::map<uint32_t, std::function<void(Response r)>> response_map;
+	// tags are keys in this table
+	common::SlotTable<ResponseCallback> response_map;
 	std::mutex response_map_mutex;
 	bool failed = false;
 	uint32_t fail_code;
@@ -0,0 +1,385 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "FileSync.hpp"
+
+#include<algorithm>
+#include<cinttypes>
+#include<cstring>
+
+#include<msgpack11.hpp>
+
+#include "common/Logger.hpp"
+#include "common/ResultError.hpp"
+#include "util.hpp"
+#include "err.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+
+FileSync::FileSync(ITwibFilesystemAccessor &itfsa, FileTransfer &transfer, std::string target_id, uint64_t block_size) :
+	itfsa(itfsa),
+	transfer(transfer),
+	target_id(target_id),
+	block_size(block_size) {
+}
+
+bool FileSync::Run(std::string local_root, std::string remote_root, bool delete_extra, bool use_manifest) {
+	while(local_root.size() > 1 && local_root.back() == '/') {
+		local_root.pop_back();
+	}
+	while(!remote_root.empty() && remote_root.back() == '/') {
+		remote_root.pop_back();
+	}
+	if(!remote_root.empty() && remote_root.front() != '/') {
+		remote_root.insert(remote_root.begin(), '/');
+	}
+	this->local_root = local_root;
+	this->remote_root = remote_root;
+	this->delete_extra = delete_extra;
+
+	std::optional<platform::fs::Stat> root_stat = platform::fs::StatFile(local_root.c_str());
+	if(!root_stat || !root_stat->is_directory) {
+		LogMessage(Error, "'%s' is not a directory", local_root.c_str());
+		return false;
+	}
+
+	std::string manifest_path = local_root + "/" + ManifestName;
+	if(use_manifest) {
+		LoadManifest(manifest_path);
+	}
+
+	if(!remote_root.empty()) {
+		std::optional<bool> is_file = itfsa.IsFile(remote_root);
+		if(is_file && *is_file) {
+			LogMessage(Error, "'%s' is a file on the device", remote_root.c_str());
+			return false;
+		}
+		if(!is_file) {
+			itfsa.CreateDirectory(remote_root);
+		}
+	}
+
+	if(!SyncDirectory("")) {
+		return false;
+	}
+
+	fprintf(stderr, "%" PRIu64 " files checked, %" PRIu64 " need pushing\n", files_checked, files_pushed);
+	if(!transfer.Run()) {
+		return false;
+	}
+
+	if(use_manifest) {
+		return SaveManifest(manifest_path);
+	}
+	return true;
+}
+
+bool FileSync::SyncDirectory(const std::string &rel) {
+	std::string local_path = local_root + "/" + rel;
+	std::string remote_path = remote_root + "/" + rel;
+
+	std::vector<std::string> names;
+	try {
+		names = platform::fs::ListDirectory(local_path.c_str());
+	} catch(std::exception &e) {
+		LogMessage(Error, "%s: %s", local_path.c_str(), e.what());
+		return false;
+	}
+	std::sort(names.begin(), names.end());
+
+	std::map<std::string, ITwibDirectoryAccessor::DirectoryEntry> remote = ListRemote(remote_path);
+
+	for(std::string &name : names) {
+		if(rel.empty() && name == ManifestName) {
+			continue;
+		}
+
+		std::string child_rel = rel + name;
+		std::string child_remote = remote_path + name;
+		std::optional<platform::fs::Stat> local_stat = platform::fs::StatFile((local_path + name).c_str());
+		if(!local_stat) {
+			continue; // disappeared out from under us
+		}
+
+		auto i = remote.find(name);
+		std::optional<ITwibDirectoryAccessor::DirectoryEntry> remote_entry;
+		if(i != remote.end()) {
+			remote_entry = i->second;
+			remote.erase(i);
+		}
+
+		if(local_stat->is_directory) {
+			if(remote_entry && remote_entry->entry_type != 0) {
+				itfsa.DeleteFile(child_remote);
+				remote_entry = std::nullopt;
+			}
+			if(!remote_entry) {
+				itfsa.CreateDirectory(child_remote);
+			}
+			if(!SyncDirectory(child_rel + "/")) {
+				return false;
+			}
+		} else {
+			if(remote_entry && remote_entry->entry_type == 0) {
+				itfsa.DeleteDirectoryRecursively(child_remote);
+				remote_entry = std::nullopt;
+			}
+			std::optional<uint64_t> remote_size;
+			if(remote_entry) {
+				remote_size = remote_entry->file_size;
+			}
+			if(!SyncFile(child_rel, *local_stat, remote_size)) {
+				return false;
+			}
+		}
+	}
+
+	if(delete_extra) {
+		for(auto &p : remote) {
+			std::string child_remote = remote_path + p.first;
+			fprintf(stderr, "deleting %s\n", child_remote.c_str());
+			if(p.second.entry_type == 0) {
+				itfsa.DeleteDirectoryRecursively(child_remote);
+			} else {
+				itfsa.DeleteFile(child_remote);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool FileSync::SyncFile(const std::string &rel, const platform::fs::Stat &local_stat, std::optional<uint64_t> remote_size) {
+	std::string local_path = local_root + "/" + rel;
+	std::string remote_path = remote_root + "/" + rel;
+	files_checked++;
+
+	std::optional<std::vector<uint64_t>> local_hashes;
+	auto i = old_manifest.find(rel);
+	if(i != old_manifest.end() && i->second.size == local_stat.size && i->second.mtime == local_stat.mtime) {
+		if(remote_size && *remote_size == local_stat.size) {
+			// unchanged on our side since the last sync, and the device
+			// doesn't look like anyone has touched it either
+			new_manifest.emplace(rel, i->second);
+			return true;
+		}
+		local_hashes = i->second.hashes;
+	} else {
+		local_hashes = HashLocal(local_path, local_stat.size);
+		if(!local_hashes) {
+			return false;
+		}
+	}
+
+	if(!remote_size) {
+		itfsa.CreateFile(0, local_stat.size, remote_path);
+	}
+
+	std::vector<std::pair<uint64_t, uint64_t>> ranges;
+	std::optional<std::vector<uint64_t>> remote_hashes;
+	if(remote_size) {
+		// closed again before the push; the transfer reopens it when this
+		// file's turn comes up
+		ITwibFileAccessor itfa = itfsa.OpenFile(7, remote_path);
+		if(*remote_size != local_stat.size) {
+			itfa.SetSize(local_stat.size);
+		}
+		remote_hashes = HashRemote(itfa, local_stat.size);
+	}
+
+	if(remote_hashes) {
+		// coalesce runs of differing blocks into single ranges
+		for(size_t b = 0; b < local_hashes->size(); b++) {
+			if(b < remote_hashes->size() && (*remote_hashes)[b] == (*local_hashes)[b]) {
+				continue;
+			}
+			uint64_t offset = b * block_size;
+			uint64_t size = std::min(block_size, local_stat.size - offset);
+			if(!ranges.empty() && ranges.back().first + ranges.back().second == offset) {
+				ranges.back().second+= size;
+			} else {
+				ranges.emplace_back(offset, size);
+			}
+		}
+	} else if(local_stat.size > 0) {
+		ranges.emplace_back(0, local_stat.size);
+	}
+
+	new_manifest.emplace(rel, ManifestEntry {local_stat.size, local_stat.mtime, std::move(*local_hashes)});
+
+	if(ranges.empty()) {
+		return true;
+	}
+	files_pushed++;
+	transfer.AddPush(
+		[this, local_path, remote_path, size = local_stat.size]() {
+			platform::File src = platform::File::OpenForRead(local_path.c_str());
+			return FileTransfer::Endpoints {itfsa.OpenFile(7, remote_path), std::move(src), size};
+		}, std::move(ranges), local_path, remote_path);
+	return true;
+}
+
+std::map<std::string, ITwibDirectoryAccessor::DirectoryEntry> FileSync::ListRemote(const std::string &path) {
+	ITwibDirectoryAccessor itda = itfsa.OpenDirectory(path);
+	std::map<std::string, ITwibDirectoryAccessor::DirectoryEntry> entries;
+	uint64_t count = itda.GetEntryCount();
+	while(entries.size() < count) {
+		std::vector<ITwibDirectoryAccessor::DirectoryEntry> batch = itda.Read();
+		if(batch.empty()) {
+			break;
+		}
+		for(auto &e : batch) {
+			entries.emplace(std::string(e.path, strnlen(e.path, sizeof(e.path))), e);
+		}
+	}
+	return entries;
+}
+
+std::optional<std::vector<uint64_t>> FileSync::HashLocal(const std::string &path, uint64_t size) {
+	std::vector<uint64_t> hashes;
+	try {
+		platform::File file = platform::File::OpenForRead(path.c_str());
+		std::vector<uint8_t> buffer(block_size);
+		for(uint64_t offset = 0; offset < size; offset+= block_size) {
+			size_t block = std::min(block_size, size - offset);
+			size_t total = 0;
+			while(total < block) {
+				size_t r = file.Read(buffer.data() + total, block - total);
+				if(r == 0) {
+					LogMessage(Error, "%s: hit EoF unexpectedly", path.c_str());
+					return std::nullopt;
+				}
+				total+= r;
+			}
+			hashes.push_back(util::HashBlock(buffer.data(), block));
+		}
+	} catch(std::exception &e) {
+		LogMessage(Error, "%s: %s", path.c_str(), e.what());
+		return std::nullopt;
+	}
+	return hashes;
+}
+
+std::optional<std::vector<uint64_t>> FileSync::HashRemote(ITwibFileAccessor &itfa, uint64_t size) {
+	if(!device_hashing) {
+		return std::nullopt;
+	}
+
+	std::vector<uint64_t> hashes;
+	uint64_t block_count = (size + block_size - 1) / block_size;
+	try {
+		while(hashes.size() < block_count) {
+			// the device won't hash more than this in one request
+			uint64_t max_count = std::min(
+				protocol::ITwibFileAccessor::HASH_MAX_BLOCK_COUNT,
+				protocol::ITwibFileAccessor::HASH_MAX_BYTES / block_size);
+			uint64_t count = std::min(max_count, block_count - hashes.size());
+			std::vector<uint64_t> batch = itfa.HashBlocks(hashes.size() * block_size, block_size, count);
+			if(batch.empty()) {
+				break; // file is shorter than we thought; rest gets pushed
+			}
+			hashes.insert(hashes.end(), batch.begin(), batch.end());
+		}
+	} catch(ResultError &e) {
+		if(e.code != TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+			throw;
+		}
+		LogMessage(Warning, "device can't hash files; falling back to pushing whole files");
+		device_hashing = false;
+		return std::nullopt;
+	}
+	return hashes;
+}
+
+void FileSync::LoadManifest(const std::string &path) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if(f == nullptr) {
+		return; // first sync
+	}
+	std::string data;
+	char buffer[0x4000];
+	size_t r;
+	while((r = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		data.append(buffer, r);
+	}
+	fclose(f);
+
+	std::string err;
+	msgpack11::MsgPack manifest = msgpack11::MsgPack::parse(data, err);
+	if(!err.empty()) {
+		LogMessage(Warning, "ignoring bad manifest '%s': %s", path.c_str(), err.c_str());
+		return;
+	}
+	// a manifest only describes what we pushed to one place
+	if(manifest["target"].string_value() != target_id + ":" + remote_root ||
+		 manifest["block_size"].uint64_value() != block_size) {
+		LogMessage(Debug, "manifest is for a different target, ignoring it");
+		return;
+	}
+
+	for(auto &p : manifest["files"].object_items()) {
+		const msgpack11::MsgPack &e = p.second;
+		const msgpack11::MsgPack::binary &hash_bytes = e[2].binary_items();
+		ManifestEntry entry;
+		entry.size = e[0].uint64_value();
+		entry.mtime = e[1].int64_value();
+		entry.hashes.resize(hash_bytes.size() / sizeof(uint64_t));
+		if(entry.hashes.size() != (entry.size + block_size - 1) / block_size) {
+			continue;
+		}
+		memcpy(entry.hashes.data(), hash_bytes.data(), entry.hashes.size() * sizeof(uint64_t));
+		old_manifest.emplace(p.first.string_value(), std::move(entry));
+	}
+}
+
+bool FileSync::SaveManifest(const std::string &path) {
+	msgpack11::MsgPack::object files;
+	for(auto &p : new_manifest) {
+		msgpack11::MsgPack::binary hash_bytes(p.second.hashes.size() * sizeof(uint64_t));
+		memcpy(hash_bytes.data(), p.second.hashes.data(), hash_bytes.size());
+		files.emplace(p.first, msgpack11::MsgPack::array {
+				p.second.size,
+				p.second.mtime,
+				std::move(hash_bytes)});
+	}
+
+	std::string data = msgpack11::MsgPack(msgpack11::MsgPack::object {
+			{"target", target_id + ":" + remote_root},
+			{"block_size", block_size},
+			{"files", std::move(files)}}).dump();
+
+	FILE *f = fopen(path.c_str(), "wb");
+	if(f == nullptr) {
+		LogMessage(Error, "failed to open manifest '%s' for writing", path.c_str());
+		return false;
+	}
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	ok = (fclose(f) == 0) && ok;
+	if(!ok) {
+		LogMessage(Error, "failed to write manifest '%s'", path.c_str());
+	}
+	return ok;
+}
+
+} // namespace tool
+} // namespace twib
+} // namespace twili
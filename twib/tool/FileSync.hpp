@@ -0,0 +1,86 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "platform/platform.hpp"
+
+#include<map>
+#include<string>
+#include<vector>
+
+#include "FileTransfer.hpp"
+#include "interfaces/ITwibFilesystemAccessor.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+
+// Makes a directory on the device match one on the host. Files are split
+// into blocks, and only blocks whose hashes differ from the device's copy
+// are pushed. A manifest of local sizes, mtimes, and block hashes is kept
+// in the host directory so that files that haven't changed since the last
+// sync don't need to be hashed on either side.
+class FileSync {
+ public:
+	static constexpr const char *ManifestName = ".twibsync";
+
+	FileSync(ITwibFilesystemAccessor &itfsa, FileTransfer &transfer, std::string target_id, uint64_t block_size);
+
+	// Returns false on a local I/O error, throws ResultError if the device
+	// reports one.
+	bool Run(std::string local_root, std::string remote_root, bool delete_extra, bool use_manifest);
+
+ private:
+	struct ManifestEntry {
+		uint64_t size;
+		int64_t mtime;
+		std::vector<uint64_t> hashes;
+	};
+
+	ITwibFilesystemAccessor &itfsa;
+	FileTransfer &transfer;
+	const std::string target_id;
+	const uint64_t block_size;
+
+	std::string local_root;
+	std::string remote_root;
+	bool delete_extra;
+	bool device_hashing = true;
+
+	std::map<std::string, ManifestEntry> old_manifest;
+	std::map<std::string, ManifestEntry> new_manifest;
+
+	uint64_t files_checked = 0;
+	uint64_t files_pushed = 0;
+
+	bool SyncDirectory(const std::string &rel);
+	bool SyncFile(const std::string &rel, const platform::fs::Stat &local_stat, std::optional<uint64_t> remote_size);
+	std::map<std::string, ITwibDirectoryAccessor::DirectoryEntry> ListRemote(const std::string &path);
+	std::optional<std::vector<uint64_t>> HashLocal(const std::string &path, uint64_t size);
+	std::optional<std::vector<uint64_t>> HashRemote(ITwibFileAccessor &itfa, uint64_t size);
+
+	void LoadManifest(const std::string &path);
+	bool SaveManifest(const std::string &path);
+};
+
+} // namespace tool
+} // namespace twib
+} // namespace twili
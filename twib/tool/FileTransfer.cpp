@@ -0,0 +1,308 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "FileTransfer.hpp"
+
+#include<algorithm>
+#include<chrono>
+
+#include "common/Logger.hpp"
+#include "common/ResultError.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+
+FileTransfer::FileTransfer(size_t window, size_t chunk_size, size_t max_active_files) :
+	window(std::max(window, (size_t) 1)),
+	chunk_size(std::max(chunk_size, (size_t) 1)),
+	max_active_files(std::max(max_active_files, (size_t) 1)) {
+}
+
+FileTransfer::Job::Job(Opener &&open, bool is_pull, std::string src_name, std::string dst_name) :
+	open(std::move(open)),
+	is_pull(is_pull),
+	src_name(src_name),
+	dst_name(dst_name) {
+}
+
+void FileTransfer::Job::Open() {
+	Endpoints endpoints = open();
+	open = nullptr;
+	remote.emplace(std::move(endpoints.remote));
+	local = std::move(endpoints.local);
+	size = endpoints.size;
+	if(ranged) {
+		issue_offset = size; // skip the sequential sweep
+	} else {
+		transfer_size = size;
+	}
+}
+
+void FileTransfer::Job::Close() {
+	remote.reset();
+	local = platform::File();
+}
+
+bool FileTransfer::Job::HasWork(size_t max_buffered) {
+	// retries fill gaps, so they're allowed even if we're buffering a lot
+	return !retries.empty() || (issue_offset < size && reorder.size() < max_buffered);
+}
+
+bool FileTransfer::Job::IsDone() {
+	return completed == transfer_size && in_flight == 0;
+}
+
+void FileTransfer::AddPull(Opener &&open, std::string src_name, std::string dst_name) {
+	jobs.emplace_back(std::move(open), true, src_name, dst_name);
+}
+
+void FileTransfer::AddPush(Opener &&open, std::string src_name, std::string dst_name) {
+	jobs.emplace_back(std::move(open), false, src_name, dst_name);
+}
+
+void FileTransfer::AddPush(Opener &&open, std::vector<std::pair<uint64_t, uint64_t>> ranges, std::string src_name, std::string dst_name) {
+	Job &job = jobs.emplace_back(std::move(open), false, src_name, dst_name);
+	job.ranged = true;
+	for(auto &range : ranges) {
+		job.retries.push_back(range);
+		job.transfer_size+= range.second;
+	}
+}
+
+void FileTransfer::AddPull(ITwibFileAccessor &&src, platform::File &&dst, uint64_t size, std::string src_name, std::string dst_name) {
+	AddPull(
+		[src = std::move(src), dst = std::move(dst), size]() mutable {
+			return Endpoints {std::move(src), std::move(dst), size};
+		}, src_name, dst_name);
+}
+
+bool FileTransfer::Run() {
+	auto start = std::chrono::steady_clock::now();
+	auto next_job = jobs.begin();
+	std::list<Job*> active;
+	uint32_t remote_error = 0;
+	bool failed = false;
+
+	while(true) {
+		if(!failed) {
+			// retire finished files and start new ones in their place
+			for(auto i = active.begin(); i != active.end(); ) {
+				if((*i)->IsDone()) {
+					fprintf(stderr, "%s -> %s\n", (*i)->src_name.c_str(), (*i)->dst_name.c_str());
+					(*i)->Close();
+					i = active.erase(i);
+				} else {
+					i++;
+				}
+			}
+			while(active.size() < max_active_files && next_job != jobs.end()) {
+				Job &job = *next_job++;
+				if(!Start(job, remote_error)) {
+					failed = true;
+					break;
+				}
+				active.push_back(&job);
+			}
+
+			// fill the window, taking turns between files
+			bool issued;
+			do {
+				issued = false;
+				for(Job *job : active) {
+					if(in_flight < window && job->HasWork(window)) {
+						if(!Issue(*job)) {
+							failed = true;
+							break;
+						}
+						issued = true;
+					}
+				}
+			} while(issued && !failed && in_flight < window);
+		}
+
+		if(in_flight == 0) {
+			if(failed || (active.empty() && next_job == jobs.end())) {
+				break;
+			}
+			if(std::any_of(active.begin(), active.end(), [](Job *job) { return job->IsDone(); })) {
+				continue; // empty files finish without any requests
+			}
+			LogMessage(Error, "file transfer stalled");
+			failed = true;
+			break;
+		}
+
+		std::deque<Completion> batch;
+		{
+			std::unique_lock<std::mutex> lock(completion_mutex);
+			completion_condvar.wait(lock, [this]() { return !completions.empty(); });
+			batch.swap(completions);
+		}
+
+		for(Completion &c : batch) {
+			in_flight--;
+			c.job->in_flight--;
+			if(c.result) {
+				if(!remote_error) {
+					remote_error = c.result;
+				}
+				failed = true;
+			} else if(!failed && !HandleCompletion(c)) {
+				failed = true;
+			}
+		}
+	}
+
+	if(remote_error) {
+		throw ResultError(remote_error);
+	}
+	if(failed) {
+		return false;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fprintf(stderr, "transferred %.2f MiB in %.2f s (%.2f MiB/s)\n",
+					total_bytes / 1048576.0, seconds,
+					seconds > 0 ? total_bytes / 1048576.0 / seconds : 0.0);
+
+	return true;
+}
+
+bool FileTransfer::Start(Job &job, uint32_t &remote_error) {
+	try {
+		job.Open();
+	} catch(ResultError &e) {
+		// reported once everything in flight has come back
+		if(!remote_error) {
+			remote_error = e.code;
+		}
+		return false;
+	} catch(std::exception &e) {
+		LogMessage(Error, "%s -> %s: %s", job.src_name.c_str(), job.dst_name.c_str(), e.what());
+		return false;
+	}
+	total_bytes+= job.transfer_size;
+	return true;
+}
+
+bool FileTransfer::Issue(Job &job) {
+	// asking for more than the device will send back only costs us a retry
+	uint64_t max_size = job.is_pull ? std::min((uint64_t) chunk_size, protocol::ITwibFileAccessor::READ_MAX_SIZE) : chunk_size;
+	uint64_t offset;
+	uint64_t size;
+	if(!job.retries.empty()) {
+		std::tie(offset, size) = job.retries.front();
+		if(size > max_size) {
+			job.retries.front() = std::make_pair(offset + max_size, size - max_size);
+			size = max_size;
+		} else {
+			job.retries.pop_front();
+		}
+	} else {
+		offset = job.issue_offset;
+		size = std::min(max_size, job.size - offset);
+		job.issue_offset+= size;
+	}
+
+	Job *job_ptr = &job;
+	if(job.is_pull) {
+		job.remote->ReadAsync(
+			offset, size,
+			[this, job_ptr, offset, size](uint32_t r, std::vector<uint8_t> data) {
+				PostCompletion(Completion {job_ptr, offset, size, r, std::move(data)});
+			});
+	} else {
+		// pushes are issued in order, so the local file is usually read
+		// sequentially
+		std::vector<uint8_t> data(size);
+		try {
+			if(offset != job.read_offset) {
+				job.local.Seek(offset);
+			}
+			size_t r;
+			if((r = job.local.Read(data.data(), data.size())) < data.size()) {
+				LogMessage(Error, "%s: hit EoF unexpectedly? expected 0x%lx, got 0x%lx", job.src_name.c_str(), data.size(), r);
+				return false;
+			}
+			job.read_offset = offset + size;
+		} catch(std::exception &e) {
+			LogMessage(Error, "%s: %s", job.src_name.c_str(), e.what());
+			return false;
+		}
+		job.remote->WriteAsync(
+			offset, std::move(data),
+			[this, job_ptr, offset, size](uint32_t r) {
+				PostCompletion(Completion {job_ptr, offset, size, r, std::vector<uint8_t>()});
+			});
+	}
+
+	in_flight++;
+	job.in_flight++;
+	return true;
+}
+
+bool FileTransfer::HandleCompletion(Completion &c) {
+	Job &job = *c.job;
+	if(!job.is_pull) {
+		job.completed+= c.size;
+		return true;
+	}
+
+	if(c.data.size() == 0) {
+		LogMessage(Error, "%s: hit EoF/IO error unexpectedly?", job.src_name.c_str());
+		return false;
+	}
+	if(c.data.size() > c.size) {
+		// device is allowed to read more than we asked for
+		c.data.resize(c.size);
+	} else if(c.data.size() < c.size) {
+		job.retries.emplace_back(c.offset + c.data.size(), c.size - c.data.size());
+	}
+	job.completed+= c.data.size();
+	job.reorder.emplace(c.offset, std::move(c.data));
+
+	// write out whatever is contiguous now
+	try {
+		for(auto i = job.reorder.begin(); i != job.reorder.end() && i->first == job.write_offset; i = job.reorder.erase(i)) {
+			if(job.local.Write(i->second.data(), i->second.size()) < i->second.size()) {
+				LogMessage(Error, "%s: short write", job.dst_name.c_str());
+				return false;
+			}
+			job.write_offset+= i->second.size();
+		}
+	} catch(std::exception &e) {
+		LogMessage(Error, "%s: %s", job.dst_name.c_str(), e.what());
+		return false;
+	}
+	return true;
+}
+
+void FileTransfer::PostCompletion(Completion &&c) {
+	{
+		std::lock_guard<std::mutex> lock(completion_mutex);
+		completions.push_back(std::move(c));
+	}
+	completion_condvar.notify_one();
+}
+
+} // namespace tool
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,130 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "platform/platform.hpp"
+
+#include<vector>
+#include<deque>
+#include<list>
+#include<map>
+#include<optional>
+#include<mutex>
+#include<condition_variable>
+
+#include "common/UniqueFunction.hpp"
+
+#include "interfaces/ITwibFileAccessor.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+
+// Moves file contents between host and device with several requests in
+// flight at once, instead of waiting out a round trip for every chunk.
+class FileTransfer {
+ public:
+	FileTransfer(size_t window, size_t chunk_size, size_t max_active_files);
+
+	// Both ends of a transfer, and the size of the file being moved.
+	class Endpoints {
+	 public:
+		ITwibFileAccessor remote;
+		platform::File local;
+		uint64_t size;
+	};
+
+	// Called when a file's turn comes up, so that only the files being
+	// transferred at the moment are held open. May throw.
+	using Opener = common::UniqueFunction<Endpoints()>;
+
+	void AddPull(Opener &&open, std::string src_name, std::string dst_name);
+	void AddPush(Opener &&open, std::string src_name, std::string dst_name);
+	// Only pushes the given (offset, size) ranges of the file.
+	void AddPush(Opener &&open, std::vector<std::pair<uint64_t, uint64_t>> ranges, std::string src_name, std::string dst_name);
+	void AddPull(ITwibFileAccessor &&src, platform::File &&dst, uint64_t size, std::string src_name, std::string dst_name);
+
+	// Runs until every file has been transferred or something goes wrong.
+	// Returns false on a local I/O error, throws ResultError if the device
+	// reports one.
+	bool Run();
+
+ private:
+	class Job {
+	 public:
+		Job(Opener &&open, bool is_pull, std::string src_name, std::string dst_name);
+
+		Opener open; // null once the job has started
+		std::optional<ITwibFileAccessor> remote;
+		platform::File local;
+		uint64_t size = 0;
+		const bool is_pull;
+		const std::string src_name;
+		const std::string dst_name;
+		bool ranged = false; // only moves what's in retries
+
+		uint64_t issue_offset = 0; // next byte we haven't asked for yet
+		std::deque<std::pair<uint64_t, uint64_t>> retries; // ranges that came back short, or were requested explicitly
+		uint64_t transfer_size = 0; // bytes we expect to move
+		uint64_t completed = 0;
+		uint64_t read_offset = 0; // position of local file when pushing
+		size_t in_flight = 0;
+
+		// pulled chunks that arrived ahead of an earlier one, keyed by offset
+		std::map<uint64_t, std::vector<uint8_t>> reorder;
+		uint64_t write_offset = 0;
+
+		void Open();
+		void Close();
+		bool HasWork(size_t max_buffered);
+		bool IsDone();
+	};
+
+	class Completion {
+	 public:
+		Job *job;
+		uint64_t offset;
+		uint64_t size;
+		uint32_t result;
+		std::vector<uint8_t> data;
+	};
+
+	const size_t window;
+	const size_t chunk_size;
+	const size_t max_active_files;
+
+	std::list<Job> jobs;
+	size_t in_flight = 0;
+	uint64_t total_bytes = 0;
+
+	std::mutex completion_mutex;
+	std::condition_variable completion_condvar;
+	std::deque<Completion> completions;
+
+	bool Start(Job &job, uint32_t &remote_error);
+	bool Issue(Job &job);
+	bool HandleCompletion(Completion &c);
+	void PostCompletion(Completion &&c);
+};
+
+} // namespace tool
+} // namespace twib
+} // namespace twili
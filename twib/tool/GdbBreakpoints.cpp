@@ -0,0 +1,477 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "GdbBreakpoints.hpp"
+
+#include<algorithm>
+#include<cstring>
+
+#include "common/Logger.hpp"
+#include "common/ResultError.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+namespace gdb {
+
+namespace {
+
+// opcodes from gdb's ax.def
+enum class Op : uint8_t {
+	Add = 0x02,
+	Sub = 0x03,
+	Mul = 0x04,
+	DivSigned = 0x05,
+	DivUnsigned = 0x06,
+	RemSigned = 0x07,
+	RemUnsigned = 0x08,
+	Lsh = 0x09,
+	RshSigned = 0x0a,
+	RshUnsigned = 0x0b,
+	LogNot = 0x0e,
+	BitAnd = 0x0f,
+	BitOr = 0x10,
+	BitXor = 0x11,
+	BitNot = 0x12,
+	Equal = 0x13,
+	LessSigned = 0x14,
+	LessUnsigned = 0x15,
+	Ext = 0x16,
+	Ref8 = 0x17,
+	Ref16 = 0x18,
+	Ref32 = 0x19,
+	Ref64 = 0x1a,
+	IfGoto = 0x20,
+	Goto = 0x21,
+	Const8 = 0x22,
+	Const16 = 0x23,
+	Const32 = 0x24,
+	Const64 = 0x25,
+	Reg = 0x26,
+	End = 0x27,
+	Dup = 0x28,
+	Pop = 0x29,
+	ZeroExt = 0x2a,
+	Swap = 0x2b,
+	Pick = 0x32,
+	Rot = 0x33,
+};
+
+// keeps a buggy expression from hanging the stub
+static constexpr size_t MaxSteps = 0x10000;
+
+uint64_t SignExtend(uint64_t value, unsigned int bits) {
+	if(bits >= 64) {
+		return value;
+	}
+	unsigned int shift = 64 - bits;
+	return (uint64_t) (((int64_t) (value << shift)) >> shift);
+}
+
+} // anonymous namespace
+
+AgentExpression::AgentExpression(std::vector<uint8_t> bytecode) : bytecode(bytecode) {
+}
+
+std::optional<uint64_t> AgentExpression::Evaluate(const ThreadContext &tc, const MemoryReader &read) const {
+	std::vector<uint64_t> stack;
+	size_t pc = 0;
+
+	// operands are big-endian
+	auto fetch = [&](size_t size, uint64_t &out) {
+		if(pc + size > bytecode.size()) {
+			return false;
+		}
+		out = 0;
+		for(size_t i = 0; i < size; i++) {
+			out = (out << 8) | bytecode[pc++];
+		}
+		return true;
+	};
+	auto pop = [&](uint64_t &out) {
+		if(stack.empty()) {
+			return false;
+		}
+		out = stack.back();
+		stack.pop_back();
+		return true;
+	};
+
+	for(size_t steps = 0; steps < MaxSteps && pc < bytecode.size(); steps++) {
+		Op op = (Op) bytecode[pc++];
+		uint64_t a, b, c;
+		switch(op) {
+		case Op::Add: case Op::Sub: case Op::Mul:
+		case Op::DivSigned: case Op::DivUnsigned: case Op::RemSigned: case Op::RemUnsigned:
+		case Op::Lsh: case Op::RshSigned: case Op::RshUnsigned:
+		case Op::BitAnd: case Op::BitOr: case Op::BitXor:
+		case Op::Equal: case Op::LessSigned: case Op::LessUnsigned:
+			if(!pop(b) || !pop(a)) {
+				return std::nullopt;
+			}
+			switch(op) {
+			case Op::Add: a+= b; break;
+			case Op::Sub: a-= b; break;
+			case Op::Mul: a*= b; break;
+			case Op::DivSigned:
+				if(b == 0) { return std::nullopt; }
+				a = (uint64_t) ((int64_t) a / (int64_t) b); break;
+			case Op::DivUnsigned:
+				if(b == 0) { return std::nullopt; }
+				a/= b; break;
+			case Op::RemSigned:
+				if(b == 0) { return std::nullopt; }
+				a = (uint64_t) ((int64_t) a % (int64_t) b); break;
+			case Op::RemUnsigned:
+				if(b == 0) { return std::nullopt; }
+				a%= b; break;
+			case Op::Lsh: a = b >= 64 ? 0 : a << b; break;
+			case Op::RshSigned: a = (uint64_t) ((int64_t) a >> std::min(b, (uint64_t) 63)); break;
+			case Op::RshUnsigned: a = b >= 64 ? 0 : a >> b; break;
+			case Op::BitAnd: a&= b; break;
+			case Op::BitOr: a|= b; break;
+			case Op::BitXor: a^= b; break;
+			case Op::Equal: a = a == b; break;
+			case Op::LessSigned: a = (int64_t) a < (int64_t) b; break;
+			case Op::LessUnsigned: a = a < b; break;
+			default: break;
+			}
+			stack.push_back(a);
+			break;
+		case Op::LogNot:
+		case Op::BitNot:
+			if(!pop(a)) {
+				return std::nullopt;
+			}
+			stack.push_back(op == Op::LogNot ? !a : ~a);
+			break;
+		case Op::Ext:
+		case Op::ZeroExt:
+			if(!fetch(1, b) || !pop(a)) {
+				return std::nullopt;
+			}
+			if(op == Op::Ext) {
+				a = SignExtend(a, b);
+			} else if(b < 64) {
+				a&= (((uint64_t) 1) << b) - 1;
+			}
+			stack.push_back(a);
+			break;
+		case Op::Ref8:
+		case Op::Ref16:
+		case Op::Ref32:
+		case Op::Ref64: {
+			size_t size = 1 << ((uint8_t) op - (uint8_t) Op::Ref8);
+			if(!pop(a)) {
+				return std::nullopt;
+			}
+			std::vector<uint8_t> bytes;
+			try {
+				bytes = read(a, size);
+			} catch(ResultError &e) {
+				LogMessage(Debug, "caught 0x%x reading memory for agent expression", e.code);
+				return std::nullopt;
+			}
+			if(bytes.size() != size) {
+				return std::nullopt;
+			}
+			a = 0;
+			std::memcpy(&a, bytes.data(), size); // debuggee is little-endian, like us
+			stack.push_back(a);
+			break; }
+		case Op::IfGoto:
+			if(!fetch(2, b) || !pop(a)) {
+				return std::nullopt;
+			}
+			if(a) {
+				pc = b;
+			}
+			break;
+		case Op::Goto:
+			if(!fetch(2, b)) {
+				return std::nullopt;
+			}
+			pc = b;
+			break;
+		case Op::Const8:
+		case Op::Const16:
+		case Op::Const32:
+		case Op::Const64:
+			if(!fetch(1 << ((uint8_t) op - (uint8_t) Op::Const8), a)) {
+				return std::nullopt;
+			}
+			stack.push_back(a);
+			break;
+		case Op::Reg:
+			// gdb's aarch64 register numbering
+			if(!fetch(2, b)) {
+				return std::nullopt;
+			}
+			if(b < 31) {
+				stack.push_back(tc.x[b]);
+			} else if(b == 31) {
+				stack.push_back(tc.sp);
+			} else if(b == 32) {
+				stack.push_back(tc.pc);
+			} else if(b == 33) {
+				stack.push_back(tc.psr);
+			} else {
+				LogMessage(Debug, "agent expression wants unsupported register %ld", b);
+				return std::nullopt;
+			}
+			break;
+		case Op::End:
+			if(!pop(a)) {
+				return std::nullopt;
+			}
+			return a;
+		case Op::Dup:
+			if(stack.empty()) {
+				return std::nullopt;
+			}
+			stack.push_back(stack.back());
+			break;
+		case Op::Pop:
+			if(!pop(a)) {
+				return std::nullopt;
+			}
+			break;
+		case Op::Swap:
+			if(stack.size() < 2) {
+				return std::nullopt;
+			}
+			std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+			break;
+		case Op::Pick:
+			if(!fetch(1, b) || b >= stack.size()) {
+				return std::nullopt;
+			}
+			stack.push_back(stack[stack.size() - 1 - b]);
+			break;
+		case Op::Rot: // a b c => c a b
+			if(!pop(c) || !pop(b) || !pop(a)) {
+				return std::nullopt;
+			}
+			stack.push_back(c);
+			stack.push_back(a);
+			stack.push_back(b);
+			break;
+		default:
+			LogMessage(Debug, "unsupported agent expression opcode 0x%x", (uint8_t) op);
+			return std::nullopt;
+		}
+	}
+
+	return std::nullopt;
+}
+
+bool BreakpointManager::Breakpoint::Wanted() {
+	return (user || step) && !lifted;
+}
+
+void BreakpointManager::Add(uint64_t address, std::vector<AgentExpression> conditions) {
+	Breakpoint &bp = breakpoints[address];
+	bp.user = true;
+	bp.conditions = std::move(conditions);
+}
+
+void BreakpointManager::Remove(uint64_t address) {
+	auto i = breakpoints.find(address);
+	if(i != breakpoints.end()) {
+		i->second.user = false;
+		i->second.conditions.clear();
+	}
+}
+
+void BreakpointManager::RemoveAll() {
+	for(auto &bp : breakpoints) {
+		bp.second.user = false;
+		bp.second.step = false;
+		bp.second.lifted = false;
+		bp.second.conditions.clear();
+	}
+}
+
+void BreakpointManager::AddStepBreakpoints(const std::vector<uint64_t> &addresses) {
+	for(uint64_t address : addresses) {
+		breakpoints[address].step = true;
+	}
+}
+
+void BreakpointManager::ClearStepBreakpoints() {
+	for(auto &bp : breakpoints) {
+		bp.second.step = false;
+	}
+}
+
+void BreakpointManager::Lift(uint64_t address) {
+	auto i = breakpoints.find(address);
+	if(i != breakpoints.end()) {
+		i->second.lifted = true;
+	}
+}
+
+void BreakpointManager::Unlift(uint64_t address) {
+	auto i = breakpoints.find(address);
+	if(i != breakpoints.end()) {
+		i->second.lifted = false;
+	}
+}
+
+bool BreakpointManager::IsUserBreakpoint(uint64_t address) {
+	auto i = breakpoints.find(address);
+	return i != breakpoints.end() && i->second.user;
+}
+
+bool BreakpointManager::IsStepBreakpoint(uint64_t address) {
+	auto i = breakpoints.find(address);
+	return i != breakpoints.end() && i->second.step;
+}
+
+bool BreakpointManager::ShouldStop(uint64_t address, const ThreadContext &tc, const MemoryReader &read) {
+	auto i = breakpoints.find(address);
+	if(i == breakpoints.end() || i->second.conditions.empty()) {
+		return true;
+	}
+	for(AgentExpression &condition : i->second.conditions) {
+		std::optional<uint64_t> result = condition.Evaluate(tc, read);
+		if(!result || *result) {
+			return true; // let gdb sort out anything we couldn't evaluate
+		}
+	}
+	return false;
+}
+
+void BreakpointManager::Sync(ITwibDebugger &debugger) {
+	std::vector<protocol::MemoryRange> to_insert;
+	for(auto i = breakpoints.begin(); i != breakpoints.end(); ) {
+		Breakpoint &bp = i->second;
+		if(bp.inserted && !bp.Wanted()) {
+			LogMessage(Debug, "removing breakpoint at 0x%lx", i->first);
+			std::vector<uint8_t> bytes(sizeof(bp.original));
+			std::memcpy(bytes.data(), &bp.original, sizeof(bp.original));
+			debugger.WriteMemory(i->first, bytes);
+			bp.inserted = false;
+		}
+		if(!bp.inserted && !bp.user && !bp.step) {
+			i = breakpoints.erase(i);
+			continue;
+		}
+		if(!bp.inserted && bp.Wanted()) {
+			to_insert.push_back({i->first, sizeof(bp.original)});
+		}
+		i++;
+	}
+
+	if(to_insert.empty()) {
+		return;
+	}
+
+	// read all of the original instructions at once
+	std::vector<std::pair<uint32_t, std::vector<uint8_t>>> originals;
+	try {
+		originals = debugger.ReadMemoryV(to_insert);
+	} catch(ResultError &e) {
+		if(e.code != TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+			throw;
+		}
+		for(protocol::MemoryRange &range : to_insert) {
+			try {
+				originals.emplace_back(0, debugger.ReadMemory(range.address, range.size));
+			} catch(ResultError &e) {
+				originals.emplace_back(e.code, std::vector<uint8_t>());
+			}
+		}
+	}
+
+	for(size_t i = 0; i < to_insert.size(); i++) {
+		uint64_t address = to_insert[i].address;
+		Breakpoint &bp = breakpoints[address];
+		if(originals[i].first != 0 || originals[i].second.size() != sizeof(bp.original)) {
+			LogMessage(Warning, "couldn't read original instruction for breakpoint at 0x%lx (0x%x), dropping it", address, originals[i].first);
+			breakpoints.erase(address);
+			continue;
+		}
+		std::memcpy(&bp.original, originals[i].second.data(), sizeof(bp.original));
+
+		LogMessage(Debug, "inserting breakpoint at 0x%lx (replacing 0x%08x)", address, bp.original);
+		std::vector<uint8_t> bytes(sizeof(BrkInstruction));
+		std::memcpy(bytes.data(), &BrkInstruction, sizeof(BrkInstruction));
+		debugger.WriteMemory(address, bytes);
+		bp.inserted = true;
+	}
+}
+
+void BreakpointManager::Shadow(uint64_t address, std::vector<uint8_t> &bytes) {
+	uint64_t end = address + bytes.size();
+	for(auto i = breakpoints.lower_bound(address - std::min(address, (uint64_t) sizeof(uint32_t) - 1)); i != breakpoints.end() && i->first < end; i++) {
+		if(!i->second.inserted) {
+			continue;
+		}
+		for(size_t j = 0; j < sizeof(uint32_t); j++) {
+			if(i->first + j >= address && i->first + j < end) {
+				bytes[i->first + j - address] = ((uint8_t*) &i->second.original)[j];
+			}
+		}
+	}
+}
+
+void BreakpointManager::Unshadow(uint64_t address, std::vector<uint8_t> &bytes) {
+	uint64_t end = address + bytes.size();
+	for(auto i = breakpoints.lower_bound(address - std::min(address, (uint64_t) sizeof(uint32_t) - 1)); i != breakpoints.end() && i->first < end; i++) {
+		if(!i->second.inserted) {
+			continue;
+		}
+		for(size_t j = 0; j < sizeof(uint32_t); j++) {
+			if(i->first + j >= address && i->first + j < end) {
+				((uint8_t*) &i->second.original)[j] = bytes[i->first + j - address];
+				bytes[i->first + j - address] = ((const uint8_t*) &BrkInstruction)[j];
+			}
+		}
+	}
+}
+
+std::vector<uint64_t> BreakpointManager::Successors(uint64_t pc, uint32_t insn, const ThreadContext &tc) {
+	auto reg = [&tc](uint32_t n) -> uint64_t {
+		return n < 31 ? tc.x[n] : 0; // register 31 is xzr here
+	};
+
+	if((insn & 0x7c000000) == 0x14000000) { // b, bl
+		return {pc + (SignExtend(insn & 0x3ffffff, 26) << 2)};
+	}
+	if((insn & 0xff000010) == 0x54000000) { // b.cond
+		return {pc + 4, pc + (SignExtend((insn >> 5) & 0x7ffff, 19) << 2)};
+	}
+	if((insn & 0x7e000000) == 0x34000000) { // cbz, cbnz
+		return {pc + 4, pc + (SignExtend((insn >> 5) & 0x7ffff, 19) << 2)};
+	}
+	if((insn & 0x7e000000) == 0x36000000) { // tbz, tbnz
+		return {pc + 4, pc + (SignExtend((insn >> 5) & 0x3fff, 14) << 2)};
+	}
+	if((insn & 0xff9ffc1f) == 0xd61f0000) { // br, blr, ret
+		return {reg((insn >> 5) & 0x1f)};
+	}
+	return {pc + 4};
+}
+
+} // namespace gdb
+} // namespace tool
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,107 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<functional>
+#include<map>
+#include<optional>
+#include<vector>
+
+#include "interfaces/ITwibDebugger.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+namespace gdb {
+
+using MemoryReader = std::function<std::vector<uint8_t>(uint64_t, uint64_t)>;
+
+// GDB agent expression bytecode, used for breakpoint conditions that gdb
+// asks us to evaluate on our side.
+class AgentExpression {
+ public:
+	AgentExpression(std::vector<uint8_t> bytecode);
+
+	// Returns std::nullopt if the expression uses something we can't
+	// evaluate here (tracing, floats, state variables) or goes wrong.
+	std::optional<uint64_t> Evaluate(const ThreadContext &tc, const MemoryReader &read) const;
+ private:
+	std::vector<uint8_t> bytecode;
+};
+
+// Keeps track of software breakpoints for one process. Requests from gdb
+// only update the table; debuggee memory is brought up to date by Sync(),
+// right before the process is continued. gdb removes and reinserts all of
+// its breakpoints around every stop, so most of that churn cancels out
+// without touching the device.
+class BreakpointManager {
+ public:
+	static constexpr uint32_t BrkInstruction = 0xd4200000; // brk #0
+
+	void Add(uint64_t address, std::vector<AgentExpression> conditions);
+	void Remove(uint64_t address);
+	void RemoveAll();
+
+	// temporary breakpoints used to emulate single-stepping
+	void AddStepBreakpoints(const std::vector<uint64_t> &addresses);
+	void ClearStepBreakpoints();
+
+	// Keeps a breakpoint out of memory while a thread steps past it.
+	void Lift(uint64_t address);
+	void Unlift(uint64_t address);
+
+	bool IsUserBreakpoint(uint64_t address);
+	bool IsStepBreakpoint(uint64_t address);
+	// true if any condition holds, or if there are none
+	bool ShouldStop(uint64_t address, const ThreadContext &tc, const MemoryReader &read);
+
+	// Writes and removes breakpoint instructions so that memory matches
+	// the table. Throws ResultError.
+	void Sync(ITwibDebugger &debugger);
+
+	// Replaces inserted breakpoint instructions in bytes read from the
+	// debuggee with the instructions they replaced.
+	void Shadow(uint64_t address, std::vector<uint8_t> &bytes);
+	// Takes bytes about to be written over inserted breakpoints as the new
+	// original instructions, and keeps the breakpoints in place.
+	void Unshadow(uint64_t address, std::vector<uint8_t> &bytes);
+
+	// Works out where the instruction at pc can go next.
+	static std::vector<uint64_t> Successors(uint64_t pc, uint32_t instruction, const ThreadContext &tc);
+ private:
+	struct Breakpoint {
+		uint32_t original = 0; // instruction replaced by the brk, when inserted
+		bool inserted = false;
+		bool user = false; // requested by gdb
+		bool step = false;
+		bool lifted = false;
+		std::vector<AgentExpression> conditions;
+
+		bool Wanted();
+	};
+
+	std::map<uint64_t, Breakpoint> breakpoints;
+};
+
+} // namespace gdb
+} // namespace tool
+} // namespace twib
+} // namespace twili
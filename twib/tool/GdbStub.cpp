@@ -20,7 +20,10 @@
 
 #include "GdbStub.hpp"
 
+#include<algorithm>
+#include<cstring>
 #include<functional>
+#include<set>
 
 #include "common/Logger.hpp"
 #include "common/ResultError.hpp"
@@ -37,7 +40,8 @@ GdbStub::GdbStub(ITwibDeviceInterface &itdi) :
 		platform::File(STDOUT_FILENO, false)),
 	logic(*this),
 	loop(logic),
-	xfer_libraries(*this, &GdbStub::XferReadLibraries) {
+	xfer_libraries(*this, &GdbStub::XferReadLibraries),
+	xfer_memory_map(*this, &GdbStub::XferReadMemoryMap) {
 	AddGettableQuery(Query(*this, "Supported", &GdbStub::QueryGetSupported, false));
 	AddGettableQuery(Query(*this, "C", &GdbStub::QueryGetCurrentThread, false));
 	AddGettableQuery(Query(*this, "fThreadInfo", &GdbStub::QueryGetFThreadInfo, false));
@@ -52,6 +56,16 @@ GdbStub::GdbStub(ITwibDeviceInterface &itdi) :
 	AddMultiletterHandler("Cont?", &GdbStub::HandleVContQuery);
 	AddMultiletterHandler("Cont", &GdbStub::HandleVCont);
 	AddXferObject("libraries", xfer_libraries);
+	AddXferObject("memory-map", xfer_memory_map);
+	AddFeature("binary-upload+");
+	AddFeature("ConditionalBreakpoints+");
+	{
+		std::stringstream packet_size;
+		packet_size << "PacketSize=" << std::hex << PacketSize;
+		AddFeature(packet_size.str());
+	}
+
+	loop.AddMember(connection.in_member);
 }
 
 GdbStub::~GdbStub() {
@@ -224,11 +238,18 @@ void GdbStub::HandleDetach(util::Buffer &packet) {
 			current_thread = nullptr;
 		}
 		get_thread_info.valid = false;
-		attached_processes.erase(pid);
+		auto i = attached_processes.find(pid);
+		if(i != attached_processes.end()) {
+			i->second.ClearBreakpoints();
+			attached_processes.erase(i);
+		}
 	} else { // detach all
 		LogMessage(Debug, "detaching from all");
 		current_thread = nullptr;
 		get_thread_info.valid = false;
+		for(auto &p : attached_processes) {
+			p.second.ClearBreakpoints();
+		}
 		attached_processes.clear();
 	}
 	stop_reason = "W00";
@@ -358,7 +379,7 @@ void GdbStub::HandleReadMemory(util::Buffer &packet) {
 
 	try {
 		util::Buffer response;
-		std::vector<uint8_t> mem = current_thread->process.debugger.ReadMemory(address, size);
+		std::vector<uint8_t> mem = current_thread->process.ReadMemory(address, size);
 		GdbConnection::Encode(mem.data(), mem.size(), response);
 		connection.Respond(response);
 	} catch(ResultError &e) {
@@ -391,13 +412,161 @@ void GdbStub::HandleWriteMemory(util::Buffer &packet) {
 	
 	try {
 		util::Buffer response;
-		current_thread->process.debugger.WriteMemory(address, bytes);
+		current_thread->process.WriteMemory(address, bytes);
+		connection.RespondOk();
+	} catch(ResultError &e) {
+		connection.RespondError(e.code);
+	}
+}
+
+void GdbStub::HandleReadMemoryBinary(util::Buffer &packet) {
+	uint64_t address, size;
+	GdbConnection::DecodeWithSeparator(address, ',', packet);
+	GdbConnection::Decode(size, packet);
+
+	if(!current_thread) {
+		LogMessage(Warning, "attempted to read without selected thread");
+		connection.RespondError(1);
+		return;
+	}
+
+	LogMessage(Debug, "reading 0x%lx bytes from 0x%lx (binary)", size, address);
+
+	try {
+		util::Buffer response;
+		std::vector<uint8_t> mem;
+		if(size > 0) {
+			// worst case, every byte needs escaping
+			mem = current_thread->process.ReadMemory(address, std::min(size, (uint64_t) PacketSize / 2));
+		}
+		// Respond() takes care of escaping
+		response.Write('b');
+		response.Write(mem);
+		connection.Respond(response);
+	} catch(ResultError &e) {
+		connection.RespondError(e.code);
+	}
+}
+
+void GdbStub::HandleWriteMemoryBinary(util::Buffer &packet) {
+	uint64_t address, size;
+	GdbConnection::DecodeWithSeparator(address, ',', packet);
+	GdbConnection::DecodeWithSeparator(size, ':', packet);
+
+	if(!current_thread) {
+		LogMessage(Warning, "attempted to write without selected thread");
+		connection.RespondError(1);
+		return;
+	}
+
+	if(packet.ReadAvailable() != size) {
+		LogMessage(Error, "size mismatch (0x%lx != 0x%lx)", packet.ReadAvailable(), size);
+		connection.RespondError(1);
+		return;
+	}
+
+	LogMessage(Debug, "writing 0x%lx bytes to 0x%lx (binary)", size, address);
+
+	if(size == 0) { // gdb probes for X support this way
+		connection.RespondOk();
+		return;
+	}
+	
+	std::vector<uint8_t> bytes(packet.Read(), packet.Read() + size);
+	packet.MarkRead(size);
+	
+	try {
+		current_thread->process.WriteMemory(address, bytes);
 		connection.RespondOk();
 	} catch(ResultError &e) {
 		connection.RespondError(e.code);
 	}
 }
 
+void GdbStub::HandleAddBreakpoint(util::Buffer &packet) {
+	char type;
+	if(!packet.Read(type) || type != '0') { // only software breakpoints
+		connection.RespondEmpty();
+		return;
+	}
+
+	char ch;
+	uint64_t address, kind;
+	packet.Read(ch);
+	GdbConnection::DecodeWithSeparator(address, ',', packet);
+	GdbConnection::DecodeWithSeparator(kind, ';', packet);
+
+	if(!current_thread) {
+		LogMessage(Warning, "attempted to insert breakpoint without selected thread");
+		connection.RespondError(1);
+		return;
+	}
+
+	if(kind != 4) {
+		LogMessage(Warning, "unsupported breakpoint kind: %ld", kind);
+		connection.RespondError(1);
+		return;
+	}
+
+	// cond_list, as ";X<len>,<bytecode>" entries
+	std::vector<AgentExpression> conditions;
+	while(packet.Read(ch) && ch == 'X') {
+		uint64_t length;
+		GdbConnection::DecodeWithSeparator(length, ',', packet);
+		if(packet.ReadAvailable() < length * 2) {
+			LogMessage(Warning, "truncated breakpoint condition");
+			connection.RespondError(1);
+			return;
+		}
+		std::vector<uint8_t> bytecode;
+		for(uint64_t i = 0; i < length; i++) {
+			bytecode.push_back(GdbConnection::DecodeHexByte((char*) packet.Read()));
+			packet.MarkRead(2);
+		}
+		conditions.emplace_back(std::move(bytecode));
+		if(!packet.Read(ch) || ch != ';') {
+			break;
+		}
+	}
+
+	LogMessage(Debug, "adding breakpoint at 0x%lx with %ld conditions", address, conditions.size());
+	
+	try {
+		// make sure we'll be able to insert it later
+		current_thread->process.ReadMemory(address, sizeof(uint32_t));
+	} catch(ResultError &e) {
+		connection.RespondError(e.code);
+		return;
+	}
+	
+	current_thread->process.breakpoints.Add(address, std::move(conditions));
+	connection.RespondOk();
+}
+
+void GdbStub::HandleRemoveBreakpoint(util::Buffer &packet) {
+	char type;
+	if(!packet.Read(type) || type != '0') {
+		connection.RespondEmpty();
+		return;
+	}
+
+	char ch;
+	uint64_t address, kind;
+	packet.Read(ch);
+	GdbConnection::DecodeWithSeparator(address, ',', packet);
+	GdbConnection::Decode(kind, packet);
+
+	if(!current_thread) {
+		LogMessage(Warning, "attempted to remove breakpoint without selected thread");
+		connection.RespondError(1);
+		return;
+	}
+
+	LogMessage(Debug, "removing breakpoint at 0x%lx", address);
+	current_thread->process.breakpoints.Remove(address);
+	connection.RespondOk();
+}
+
 void GdbStub::HandleVAttach(util::Buffer &packet) {
 	uint64_t pid = 0;
 	char ch;
@@ -438,7 +607,7 @@ void GdbStub::HandleVAttach(util::Buffer &packet) {
 
 void GdbStub::HandleVContQuery(util::Buffer &packet) {
 	util::Buffer response;
-	response.Write(std::string("vCont;c;C"));
+	response.Write(std::string("vCont;c;C;s;S"));
 	connection.Respond(response);
 }
 
@@ -452,7 +621,8 @@ void GdbStub::HandleVCont(util::Buffer &packet) {
 	struct Action {
 		enum class Type {
 			Invalid,
-			Continue
+			Continue,
+			Step
 		} type = Type::Invalid;
 	};
 
@@ -475,6 +645,12 @@ void GdbStub::HandleVCont(util::Buffer &packet) {
 			case 'c':
 				action.type = Action::Type::Continue;
 				break;
+			case 'S':
+				LogMessage(Warning, "vCont 'S' action not well supported");
+				// fall-through
+			case 's':
+				action.type = Action::Type::Step;
+				break;
 			default:
 				LogMessage(Warning, "unsupported vCont action: %c", ch);
 			}
@@ -549,13 +725,22 @@ void GdbStub::HandleVCont(util::Buffer &packet) {
 				continue;
 			}
 			proc.running_thread_ids.push_back(t.first);
+			if(t.second.type == Action::Type::Step) {
+				try {
+					proc.StartStep(t.first, t_i->second.GetRegisters(), false);
+				} catch(ResultError &e) {
+					LogMessage(Warning, "caught 0x%x setting up single step", e.code);
+					proc.FinishStep();
+					Stop(); // report the old stop again, having gone nowhere
+					return;
+				}
+			}
 		}
 		LogMessage(Debug, "continuing process");
 		for(auto &t : proc.running_thread_ids) {
 			LogMessage(Debug, "  tid 0x%lx", t);
 		}
-		proc.debugger.ContinueDebugEvent(7, proc.running_thread_ids);
-		proc.running = true;
+		proc.Continue();
 	}
 	waiting_for_stop = true;
 	LogMessage(Debug, "reached end of vCont");
@@ -674,14 +859,16 @@ void GdbStub::QueryGetThreadExtraInfo(util::Buffer &packet) {
 
 	std::string extra_info;
 
+	p.PrefetchThreadNames();
+	
 	try {
-		std::vector<uint8_t> tls_ctx_ptr_u8 = p.debugger.ReadMemory(t.tls_addr + 0x1f8, 8);
+		std::vector<uint8_t> tls_ctx_ptr_u8 = p.ReadMemory(t.tls_addr + 0x1f8, 8);
 		uint64_t tls_ctx_addr = *(uint64_t*) tls_ctx_ptr_u8.data();
-		std::vector<uint8_t> name_ptr_u8 = p.debugger.ReadMemory(tls_ctx_addr + 0x1a8, 8);
+		std::vector<uint8_t> name_ptr_u8 = p.ReadMemory(tls_ctx_addr + 0x1a8, 8);
 		uint64_t name_addr = *(uint64_t*) name_ptr_u8.data();
 	
 		if(name_addr != 0) {
-			std::vector<uint8_t> name = p.debugger.ReadMemory(name_addr, 0x40);
+			std::vector<uint8_t> name = p.ReadMemory(name_addr, 0x40);
 			for(size_t i = 0; i < name.size(); i++) {
 				if(name[i] == 0) {
 					break;
@@ -689,7 +876,7 @@ void GdbStub::QueryGetThreadExtraInfo(util::Buffer &packet) {
 				extra_info.push_back(name[i]);
 				if(i == name.size()-1) {
 					name_addr+= name.size();
-					name = p.debugger.ReadMemory(name_addr, 0x40);
+					name = p.ReadMemory(name_addr, 0x40);
 					i = 0;
 				}
 			}
@@ -737,6 +924,8 @@ void GdbStub::QueryGetRemoteCommand(util::Buffer &packet) {
 		if(command == "help") {
 			response << "Available commands:" << std::endl;
 			response << "  - get base" << std::endl;
+			response << "  - cache" << std::endl;
+			response << "  - cache flush" << std::endl;
 			response << "  - wait application" << std::endl;
 			response << "  - wait title <title id>" << std::endl;
 		} else if(command == "wait") {
@@ -782,6 +971,32 @@ void GdbStub::QueryGetRemoteCommand(util::Buffer &packet) {
 			} else {
 				response << "Unknown value '" << get_what << "'" << std::endl;
 			}
+		} else if(command == "cache") {
+			std::string action;
+			while(message.Read(ch) && ch != ' ') {
+				action.push_back(ch);
+			}
+			if(action == "flush") {
+				for(auto &p : attached_processes) {
+					p.second.InvalidateMemoryCache();
+				}
+				response << "flushed memory cache" << std::endl;
+			} else if(!action.empty()) {
+				response << "Unknown cache action '" << action << "'" << std::endl;
+			} else if(attached_processes.empty()) {
+				response << "no processes attached" << std::endl;
+			} else {
+				for(auto &p : attached_processes) {
+					auto &stats = p.second.cache_stats;
+					uint64_t total = stats.hits + stats.misses;
+					response << "pid 0x" << std::hex << p.first << std::dec << ": ";
+					response << stats.hits << " hits, " << stats.misses << " misses";
+					if(total) {
+						response << " (" << (stats.hits * 100 / total) << "% hit rate)";
+					}
+					response << ", " << stats.fetches << " fetches, " << stats.invalidations << " invalidations" << std::endl;
+				}
+			}
 		} else {
 			response << "Unknown command '" << command << "'" << std::endl;
 		}
@@ -930,6 +1145,11 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 			}
 			break; }
 		case nx::DebugEvent::EventType::Exception: {
+			if((event->exception.exception_type == nx::DebugEvent::ExceptionType::Trap ||
+					event->exception.exception_type == nx::DebugEvent::ExceptionType::BreakPoint) &&
+				 ConsumeTrap(thread_id, event->exception.fault_register)) {
+				break;
+			}
 			LogMessage(Warning, "hit exception");
 			stopped = true;
 			switch(event->exception.exception_type) {
@@ -979,6 +1199,10 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 	}
 
 	if(stopped) {
+		if(!stepping_thread_ids.empty()) {
+			FinishStep(); // something else happened first
+		}
+		
 		util::Buffer stop_reason;
 		if(style == 'T') { // signal
 			stop_reason.Write('T');
@@ -1027,8 +1251,7 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 
 	if(was_running && !running && !stopped) { // if we're not running but we should be...
 		LogMessage(Debug, "got debug events but didn't stop, so continuing...");
-		debugger.ContinueDebugEvent(7, running_thread_ids);
-		running = true;
+		Continue();
 	}
 	
 	return stopped;
@@ -1087,6 +1310,338 @@ std::string GdbStub::Process::BuildLibraryList() {
 	return ss.str();
 }
 
+std::string GdbStub::Process::BuildMemoryMap() {
+	if(memory_map && !running) {
+		return *memory_map;
+	}
+	
+	std::stringstream ss;
+	ss << "<?xml version=\"1.0\"?>" << std::endl;
+	ss << "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" \"http://sourceware.org/gdb/gdb-memory-map.dtd\">" << std::endl;
+	ss << "<memory-map>" << std::endl;
+
+	// Everything the debugger can touch is reported as ram, since we can
+	// write to read-only code to place breakpoints. Inaccessible regions
+	// are left out so gdb doesn't bother trying to read them.
+	try {
+		uint64_t address = 0;
+		std::optional<std::pair<uint64_t, uint64_t>> pending; // adjacent regions get merged
+		do {
+			nx::MemoryInfo mi = std::get<0>(debugger.QueryMemory(address));
+			if(mi.memory_type != 0 && mi.permission != 0) {
+				if(pending && pending->first + pending->second == mi.base_addr) {
+					pending->second+= mi.size;
+				} else {
+					if(pending) {
+						ss << "  <memory type=\"ram\" start=\"0x" << std::hex << pending->first << "\" length=\"0x" << pending->second << "\"/>" << std::endl;
+					}
+					pending = std::make_pair(mi.base_addr, mi.size);
+				}
+			}
+			if(mi.base_addr + mi.size <= address) {
+				break; // wrapped around
+			}
+			address = mi.base_addr + mi.size;
+		} while(address != 0);
+		if(pending) {
+			ss << "  <memory type=\"ram\" start=\"0x" << std::hex << pending->first << "\" length=\"0x" << pending->second << "\"/>" << std::endl;
+		}
+	} catch(ResultError &e) {
+		LogMessage(Warning, "caught 0x%x building memory map", e.code);
+		// gdb treats an empty map the same as having no map at all
+		return "<memory-map></memory-map>";
+	}
+
+	ss << "</memory-map>" << std::endl;
+
+	if(!running) {
+		memory_map = ss.str();
+	}
+	return ss.str();
+}
+
+std::vector<uint8_t> GdbStub::Process::ReadMemory(uint64_t address, uint64_t size) {
+	std::vector<uint8_t> bytes = ReadCachedMemory(address, size);
+	breakpoints.Shadow(address, bytes); // gdb shouldn't see our breakpoints
+	return bytes;
+}
+
+std::vector<uint8_t> GdbStub::Process::ReadCachedMemory(uint64_t address, uint64_t size) {
+	if(running || size == 0 || address + size < address) {
+		return debugger.ReadMemory(address, size);
+	}
+
+	uint64_t first_page = address & ~(PageSize - 1);
+	uint64_t page_count = ((address + size - 1) & ~(PageSize - 1)) - first_page + PageSize;
+	page_count/= PageSize;
+
+	if(memory_cache.size() + page_count + ReadaheadPages > MaxCachedPages) {
+		memory_cache.clear();
+	}
+	
+	for(uint64_t i = 0; i < page_count; i++) {
+		if(memory_cache.find(first_page + (i * PageSize)) != memory_cache.end()) {
+			cache_stats.hits++;
+			continue;
+		}
+		// fetch the rest of the range in one go, plus a little past it
+		if(!FetchPages(first_page + (i * PageSize), page_count - i, true)) {
+			// let the device report whatever is wrong with the exact range
+			return debugger.ReadMemory(address, size);
+		}
+		cache_stats.misses+= page_count - i;
+		break;
+	}
+
+	std::vector<uint8_t> bytes;
+	bytes.reserve(size);
+	for(uint64_t page = first_page; page < address + size; page+= PageSize) {
+		std::vector<uint8_t> &contents = memory_cache.at(page);
+		uint64_t begin = std::max(page, address) - page;
+		uint64_t end = std::min(page + PageSize, address + size) - page;
+		bytes.insert(bytes.end(), contents.begin() + begin, contents.begin() + end);
+	}
+	return bytes;
+}
+
+void GdbStub::Process::WriteMemory(uint64_t address, std::vector<uint8_t> &bytes) {
+	breakpoints.Unshadow(address, bytes);
+	for(auto i = memory_cache.lower_bound(address & ~(PageSize - 1)); i != memory_cache.end() && i->first < address + bytes.size(); ) {
+		i = memory_cache.erase(i);
+	}
+	debugger.WriteMemory(address, bytes);
+}
+
+void GdbStub::Process::Continue() {
+	breakpoints.Sync(debugger);
+	InvalidateMemoryCache();
+	if(stepping_thread_ids.empty()) {
+		// exception handled | enable exception events | continue all
+		debugger.ContinueDebugEvent(7, running_thread_ids);
+	} else {
+		// only the stepping threads get to run
+		debugger.ContinueDebugEvent(3, stepping_thread_ids);
+	}
+	running = true;
+}
+
+void GdbStub::Process::StartStep(uint64_t thread_id, const ThreadContext &tc, bool internal) {
+	std::vector<uint8_t> bytes = ReadMemory(tc.pc, sizeof(uint32_t));
+	uint32_t instruction;
+	std::memcpy(&instruction, bytes.data(), sizeof(instruction));
+
+	// the thread has to get past any breakpoint sitting under it
+	if(breakpoints.IsUserBreakpoint(tc.pc)) {
+		breakpoints.Lift(tc.pc);
+		lifted_breakpoints.push_back(tc.pc);
+	}
+	
+	std::vector<uint64_t> successors = BreakpointManager::Successors(tc.pc, instruction, tc);
+	for(uint64_t successor : successors) {
+		LogMessage(Debug, "stepping thread 0x%lx from 0x%lx (0x%08x) to 0x%lx", thread_id, tc.pc, instruction, successor);
+	}
+	breakpoints.AddStepBreakpoints(successors);
+	stepping_thread_ids.push_back(thread_id);
+	internal_step = internal;
+}
+
+void GdbStub::Process::FinishStep() {
+	breakpoints.ClearStepBreakpoints();
+	for(uint64_t address : lifted_breakpoints) {
+		breakpoints.Unlift(address);
+	}
+	lifted_breakpoints.clear();
+	stepping_thread_ids.clear();
+	internal_step = false;
+}
+
+void GdbStub::Process::ClearBreakpoints() {
+	FinishStep();
+	breakpoints.RemoveAll();
+	try {
+		breakpoints.Sync(debugger);
+	} catch(ResultError &e) {
+		LogMessage(Warning, "caught 0x%x removing breakpoints", e.code);
+	}
+}
+
+bool GdbStub::Process::ConsumeTrap(uint64_t thread_id, uint64_t address) {
+	bool is_stepping = std::find(stepping_thread_ids.begin(), stepping_thread_ids.end(), thread_id) != stepping_thread_ids.end();
+	if(is_stepping && breakpoints.IsStepBreakpoint(address)) {
+		bool was_internal = internal_step;
+		FinishStep();
+		if(was_internal) {
+			LogMessage(Debug, "stepped thread 0x%lx past conditional breakpoint", thread_id);
+		}
+		return was_internal;
+	}
+
+	if(!breakpoints.IsUserBreakpoint(address) || !stepping_thread_ids.empty()) {
+		return false;
+	}
+
+	auto t = threads.find(thread_id);
+	if(t == threads.end()) {
+		return false;
+	}
+	
+	try {
+		ThreadContext tc = t->second.GetRegisters();
+		if(breakpoints.ShouldStop(address, tc, [this](uint64_t address, uint64_t size) { return ReadMemory(address, size); })) {
+			return false;
+		}
+		LogMessage(Debug, "condition for breakpoint at 0x%lx didn't hold", address);
+		StartStep(thread_id, tc, true);
+	} catch(ResultError &e) {
+		LogMessage(Warning, "caught 0x%x checking breakpoint condition", e.code);
+		FinishStep();
+		return false;
+	}
+	condition_skips++;
+	return true;
+}
+
+void GdbStub::Process::InvalidateMemoryCache() {
+	if(!memory_cache.empty()) {
+		cache_stats.invalidations++;
+	}
+	memory_cache.clear();
+	memory_map.reset();
+	thread_names_prefetched = false;
+}
+
+void GdbStub::Process::PrefetchThreadNames() {
+	if(running || thread_names_prefetched) {
+		return;
+	}
+	thread_names_prefetched = true;
+
+	// each step depends on pointers read by the one before it
+	std::vector<std::pair<uint64_t, uint64_t>> ranges;
+	std::vector<uint64_t> addresses;
+	for(auto &t : threads) {
+		addresses.push_back(t.second.tls_addr + 0x1f8);
+	}
+	for(uint64_t offset : {(uint64_t) 0x1a8, (uint64_t) 0}) {
+		ranges.clear();
+		for(uint64_t address : addresses) {
+			ranges.emplace_back(address, 8);
+		}
+		Prefetch(ranges);
+
+		std::vector<uint64_t> next;
+		for(uint64_t address : addresses) {
+			std::optional<uint64_t> ptr = ReadPointer(address);
+			if(ptr && *ptr != 0) {
+				next.push_back(*ptr + offset);
+			}
+		}
+		addresses = std::move(next);
+	}
+	ranges.clear();
+	for(uint64_t address : addresses) {
+		ranges.emplace_back(address, 0x40);
+	}
+	Prefetch(ranges);
+}
+
+bool GdbStub::Process::FetchPages(uint64_t first_page, uint64_t page_count, bool readahead) {
+	// readahead may run off the end of a mapping, so fall back to exactly
+	// what was asked for before giving up
+	for(uint64_t count : {page_count + (readahead ? ReadaheadPages : 0), page_count}) {
+		try {
+			cache_stats.fetches++;
+			std::vector<uint8_t> bytes = debugger.ReadMemory(first_page, count * PageSize);
+			if(bytes.size() != count * PageSize) {
+				LogMessage(Warning, "short memory read (0x%lx != 0x%lx)", bytes.size(), count * PageSize);
+				continue;
+			}
+			for(uint64_t i = 0; i < count; i++) {
+				memory_cache[first_page + (i * PageSize)].assign(
+					bytes.begin() + (i * PageSize),
+					bytes.begin() + ((i + 1) * PageSize));
+			}
+			return true;
+		} catch(ResultError &e) {
+			LogMessage(Debug, "caught 0x%x fetching 0x%lx pages at 0x%lx", e.code, count, first_page);
+		}
+		if(!readahead) {
+			break;
+		}
+	}
+	return false;
+}
+
+void GdbStub::Process::Prefetch(const std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+	std::set<uint64_t> pages;
+	for(auto &range : ranges) {
+		if(range.second == 0 || range.first + range.second < range.first) {
+			continue;
+		}
+		for(uint64_t page = range.first & ~(PageSize - 1); page < range.first + range.second; page+= PageSize) {
+			if(memory_cache.find(page) == memory_cache.end()) {
+				pages.insert(page);
+			}
+		}
+	}
+
+	if(memory_cache.size() + pages.size() > MaxCachedPages) {
+		memory_cache.clear();
+	}
+	
+	// coalesce adjacent pages into a single range
+	std::vector<protocol::MemoryRange> runs;
+	for(auto i = pages.begin(); i != pages.end(); ) {
+		protocol::MemoryRange run = {*i, 0};
+		do {
+			i++;
+			run.size+= PageSize;
+		} while(i != pages.end() && *i == run.address + run.size);
+		runs.push_back(run);
+	}
+
+	if(runs.size() > 1 && supports_read_memory_v) {
+		try {
+			cache_stats.fetches++;
+			auto results = debugger.ReadMemoryV(runs);
+			for(size_t i = 0; i < runs.size(); i++) {
+				if(results[i].first != 0 || results[i].second.size() != runs[i].size) {
+					continue;
+				}
+				for(uint64_t offset = 0; offset < runs[i].size; offset+= PageSize) {
+					memory_cache[runs[i].address + offset].assign(
+						results[i].second.begin() + offset,
+						results[i].second.begin() + offset + PageSize);
+				}
+				cache_stats.misses+= runs[i].size / PageSize;
+			}
+			return;
+		} catch(ResultError &e) {
+			if(e.code != TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+				LogMessage(Warning, "caught 0x%x prefetching memory", e.code);
+				return;
+			}
+			LogMessage(Info, "device doesn't support vectored memory reads");
+			supports_read_memory_v = false;
+		}
+	}
+
+	for(protocol::MemoryRange &run : runs) {
+		if(FetchPages(run.address, run.size / PageSize, false)) {
+			cache_stats.misses+= run.size / PageSize;
+		}
+	}
+}
+
+std::optional<uint64_t> GdbStub::Process::ReadPointer(uint64_t address) {
+	try {
+		std::vector<uint8_t> bytes = ReadMemory(address, sizeof(uint64_t));
+		return *(uint64_t*) bytes.data();
+	} catch(ResultError &e) {
+		return std::nullopt;
+	}
+}
+
 GdbStub::Thread::Thread(Process &process, uint64_t thread_id, uint64_t tls_addr) : process(process), thread_id(thread_id), tls_addr(tls_addr) {
 }
 
@@ -1105,8 +1660,7 @@ GdbStub::Process::Process(uint64_t pid, ITwibDebugger debugger) : pid(pid), debu
 GdbStub::Logic::Logic(GdbStub &stub) : stub(stub) {
 }
 
-void GdbStub::Logic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
+void GdbStub::Logic::Prepare(platform::EventLoop &) {
 	util::Buffer *buffer;
 	bool interrupted;
 	while((buffer = stub.connection.Process(interrupted)) != nullptr) {
@@ -1143,6 +1697,18 @@ void GdbStub::Logic::Prepare(platform::EventLoop &loop) {
 		case 'M': // write memory
 			stub.HandleWriteMemory(*buffer);
 			break;
+		case 'z': // remove breakpoint
+			stub.HandleRemoveBreakpoint(*buffer);
+			break;
+		case 'Z': // insert breakpoint
+			stub.HandleAddBreakpoint(*buffer);
+			break;
+		case 'x': // read memory (binary)
+			stub.HandleReadMemoryBinary(*buffer);
+			break;
+		case 'X': // write memory (binary)
+			stub.HandleWriteMemoryBinary(*buffer);
+			break;
 		case 'q': // general get query
 			stub.HandleGeneralGetQuery(*buffer);
 			break;
@@ -1175,8 +1741,6 @@ void GdbStub::Logic::Prepare(platform::EventLoop &loop) {
 			}
 		}
 	}
-	
-	loop.AddMember(stub.connection.in_member);
 }
 
 bool GdbStub::XferObject::AdvertiseRead() {
@@ -1225,6 +1789,14 @@ std::string GdbStub::XferReadLibraries() {
 	}
 }
 
+std::string GdbStub::XferReadMemoryMap() {
+	if(current_thread == nullptr) {
+		return "<memory-map></memory-map>";
+	} else {
+		return current_thread->process.BuildMemoryMap();
+	}
+}
+
 } // namespace gdb
 } // namespace tool
 } // namespace twib
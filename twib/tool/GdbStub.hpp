@@ -24,6 +24,7 @@
 #include<unordered_map>
 
 #include "GdbConnection.hpp"
+#include "GdbBreakpoints.hpp"
 #include "interfaces/ITwibDeviceInterface.hpp"
 #include "interfaces/ITwibDebugger.hpp"
 
@@ -100,12 +101,60 @@ class GdbStub {
 		Process(uint64_t pid, ITwibDebugger debugger);
 		bool IngestEvents(GdbStub &stub); // returns whether process is stopped
 		std::string BuildLibraryList();
+		std::string BuildMemoryMap(); // cached until the process is continued
+
+		// Memory reads go through a page cache while the process is stopped.
+		// The cache must be invalidated whenever the process is continued or
+		// its memory is written.
+		std::vector<uint8_t> ReadMemory(uint64_t address, uint64_t size);
+		void WriteMemory(uint64_t address, std::vector<uint8_t> &bytes);
+		void Continue();
+		void InvalidateMemoryCache();
+		// Puts temporary breakpoints after the thread's current instruction.
+		// Internal steps are how we get past a breakpoint whose condition
+		// didn't hold, and are never reported to gdb.
+		void StartStep(uint64_t thread_id, const ThreadContext &tc, bool internal);
+		void FinishStep();
+		void ClearBreakpoints(); // takes every breakpoint out of memory, before detaching
+		// returns whether a trap was ours to swallow, leaving the process running
+		bool ConsumeTrap(uint64_t thread_id, uint64_t address);
+		// Pulls in the pages behind every thread's name pointer chain, so
+		// naming all threads takes a few requests instead of a few per thread.
+		void PrefetchThreadNames();
+		
 		uint64_t pid;
 		ITwibDebugger debugger;
 		std::map<uint64_t, Thread> threads;
 		std::vector<uint64_t> running_thread_ids;
 		std::shared_ptr<bool> has_events;
 		bool running = false;
+
+		BreakpointManager breakpoints;
+		std::vector<uint64_t> stepping_thread_ids;
+		std::vector<uint64_t> lifted_breakpoints;
+		bool internal_step = false;
+		uint64_t condition_skips = 0;
+
+		struct {
+			uint64_t hits = 0; // pages served from cache
+			uint64_t misses = 0; // pages that had to be fetched
+			uint64_t fetches = 0; // requests sent to the device
+			uint64_t invalidations = 0;
+		} cache_stats;
+	 private:
+		static constexpr uint64_t PageSize = 0x1000;
+		static constexpr uint64_t ReadaheadPages = 3;
+		static constexpr size_t MaxCachedPages = 1024;
+
+		std::vector<uint8_t> ReadCachedMemory(uint64_t address, uint64_t size);
+		bool FetchPages(uint64_t first_page, uint64_t page_count, bool readahead);
+		void Prefetch(const std::vector<std::pair<uint64_t, uint64_t>> &ranges);
+		std::optional<uint64_t> ReadPointer(uint64_t address);
+		
+		std::map<uint64_t, std::vector<uint8_t>> memory_cache; // keyed by page address
+		bool thread_names_prefetched = false;
+		bool supports_read_memory_v = true;
+		std::optional<std::string> memory_map;
 	};
 	
 	Thread *current_thread = nullptr;
@@ -123,6 +172,9 @@ class GdbStub {
 	bool multiprocess_enabled = false;
 
 	void Stop();
+
+	// advertised to gdb, in bytes of packet data
+	static constexpr size_t PacketSize = 0x10000;
 	
  private:
 	ITwibDeviceInterface &itdi;
@@ -163,6 +215,10 @@ class GdbStub {
 	void HandleSetCurrentThread(util::Buffer &packet);
 	void HandleReadMemory(util::Buffer &packet);
 	void HandleWriteMemory(util::Buffer &packet);
+	void HandleReadMemoryBinary(util::Buffer &packet);
+	void HandleWriteMemoryBinary(util::Buffer &packet);
+	void HandleAddBreakpoint(util::Buffer &packet);
+	void HandleRemoveBreakpoint(util::Buffer &packet);
 	
 	// multiletter packets
 	void HandleVAttach(util::Buffer &packet);
@@ -185,7 +241,9 @@ class GdbStub {
 
 	// xfer objects
 	std::string XferReadLibraries();
+	std::string XferReadMemoryMap();
 	ReadOnlyStringXferObject xfer_libraries;
+	ReadOnlyStringXferObject xfer_memory_map;
 	
 	bool thread_events_enabled = false;
 };
@@ -25,6 +25,8 @@
 
 #include<stdint.h>
 
+#include "common/UniqueFunction.hpp"
+
 namespace twili {
 namespace twib {
 namespace tool {
@@ -49,6 +51,8 @@ class Response {
 	std::vector<std::shared_ptr<RemoteObject>> objects;
 };
 
+using ResponseCallback = common::UniqueFunction<void(Response)>;
+
 class Request {
  public:
 	Request();
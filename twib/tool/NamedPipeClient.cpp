@@ -39,7 +39,7 @@ NamedPipeClient::~NamedPipeClient() {
 	event_loop.Destroy();
 }
 
-void NamedPipeClient::SendRequestImpl(const Request &rq) {
+void NamedPipeClient::SendRequestImpl(Request &&rq) {
 	protocol::MessageHeader mh;
 	mh.device_id = rq.device_id;
 	mh.object_id = rq.object_id;
@@ -47,8 +47,9 @@ void NamedPipeClient::SendRequestImpl(const Request &rq) {
 	mh.tag = rq.tag;
 	mh.payload_size = rq.payload.size();
 	mh.object_count = 0;
+	mh.flags = 0;
 
-	connection.SendMessage(mh, rq.payload, std::vector<uint32_t>());
+	connection.SendMessage(mh, std::move(rq.payload), std::vector<uint32_t>());
 	LogMessage(Debug, "sent request");
 }
 
@@ -60,7 +61,7 @@ void NamedPipeClient::Logic::Prepare(platform::EventLoop &loop) {
 	loop.Clear();
 	common::MessageConnection::Request *rq;
 	while((rq = client.connection.Process()) != nullptr) {
-		client.PostResponse(rq->mh, rq->payload, rq->object_ids);
+		client.PostResponse(rq->mh, std::move(rq->payload), rq->object_ids);
 	}
 	if(!client.connection.error_flag) {
 		loop.AddMember(client.connection.input_member);
@@ -37,7 +37,7 @@ public:
 	NamedPipeClient(platform::windows::Pipe &&pipe);
 	~NamedPipeClient();
 protected:
-	virtual void SendRequestImpl(const Request &rq) override;
+	virtual void SendRequestImpl(Request &&rq) override;
 private:
 	class Logic : public platform::EventLoop::Logic {
 	public:
@@ -0,0 +1,170 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "PipePump.hpp"
+
+#include<system_error>
+
+#include "common/Logger.hpp"
+#include "common/ResultError.hpp"
+
+#include "err.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+
+PipePump::PipePump(size_t window) : window(window) {
+}
+
+PipePump::Pipe::Pipe(ITwibPipeReader &&reader, FILE *stream, std::string prefix) : reader(std::move(reader)), stream(stream), prefix(prefix) {
+}
+
+bool PipePump::Pipe::Write(const std::vector<uint8_t> &data) {
+	if(prefix.empty()) {
+		return fwrite(data.data(), sizeof(data[0]), data.size(), stream) == data.size();
+	}
+	std::string out;
+	for(uint8_t c : data) {
+		line.push_back(c);
+		if(c == '\n' || line.size() >= MaxLineLength) {
+			// break up very long lines rather than holding on to them
+			out+= prefix;
+			out+= line;
+			if(c != '\n') {
+				out+= '\n';
+			}
+			line.clear();
+		}
+	}
+	return fwrite(out.data(), sizeof(out[0]), out.size(), stream) == out.size();
+}
+
+bool PipePump::Pipe::Finish() {
+	if(line.empty()) {
+		return true;
+	}
+	std::string out = prefix + line + "\n";
+	line.clear();
+	return fwrite(out.data(), sizeof(out[0]), out.size(), stream) == out.size();
+}
+
+void PipePump::Add(ITwibPipeReader &&reader, FILE *stream, std::string prefix) {
+	pipes.emplace_back(std::move(reader), stream, prefix);
+}
+
+void PipePump::Run() {
+	size_t in_flight = 0;
+	uint32_t remote_error = 0;
+	int local_error = 0;
+
+	while(true) {
+		if(!remote_error && !local_error) {
+			for(Pipe &pipe : pipes) {
+				while(!pipe.eof && pipe.in_flight < window) {
+					Issue(pipe);
+					in_flight++;
+				}
+			}
+		}
+
+		if(in_flight == 0) {
+			break;
+		}
+
+		std::deque<Completion> batch;
+		{
+			std::unique_lock<std::mutex> lock(completion_mutex);
+			completion_condvar.wait(lock, [this]() { return !completions.empty(); });
+			batch.swap(completions);
+		}
+
+		for(Completion &c : batch) {
+			in_flight--;
+			c.pipe->in_flight--;
+			c.pipe->reorder.emplace(c.sequence, std::make_pair(c.result, std::move(c.data)));
+		}
+
+		// write out whatever is now in order, and flush each stream once
+		// per batch instead of once per read
+		for(Pipe &pipe : pipes) {
+			bool wrote = false;
+			for(auto i = pipe.reorder.begin(); i != pipe.reorder.end() && i->first == pipe.write_sequence; i = pipe.reorder.erase(i)) {
+				pipe.write_sequence++;
+				uint32_t result = i->second.first;
+				std::vector<uint8_t> &data = i->second.second;
+				if(pipe.eof) {
+					continue; // reads that were already in flight when we hit EoF
+				}
+				if(result == TWILI_ERR_EOF) {
+					LogMessage(Debug, "output pump hit EoF");
+					pipe.eof = true;
+					if(!pipe.Finish()) {
+						local_error = errno;
+					}
+					wrote = true;
+				} else if(result) {
+					if(!remote_error) {
+						remote_error = result;
+					}
+					pipe.eof = true;
+				} else if(!pipe.Write(data)) {
+					// wait for what's in flight before bailing, since it refers to us
+					local_error = errno;
+					pipe.eof = true;
+				} else {
+					wrote = true;
+				}
+			}
+			if(wrote) {
+				fflush(pipe.stream);
+			}
+		}
+	}
+
+	if(local_error) {
+		throw std::system_error(local_error, std::generic_category());
+	}
+	if(remote_error) {
+		throw ResultError(remote_error);
+	}
+}
+
+void PipePump::Issue(Pipe &pipe) {
+	Pipe *pipe_ptr = &pipe;
+	uint64_t sequence = pipe.issue_sequence++;
+	pipe.in_flight++;
+	pipe.reader.ReadAsync(
+		[this, pipe_ptr, sequence](uint32_t r, std::vector<uint8_t> data) {
+			PostCompletion(Completion {pipe_ptr, sequence, r, std::move(data)});
+		});
+}
+
+void PipePump::PostCompletion(Completion &&c) {
+	{
+		std::lock_guard<std::mutex> lock(completion_mutex);
+		completions.push_back(std::move(c));
+	}
+	completion_condvar.notify_one();
+}
+
+} // namespace tool
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,100 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<cstdio>
+#include<string>
+#include<vector>
+#include<deque>
+#include<list>
+#include<map>
+#include<mutex>
+#include<condition_variable>
+
+#include "interfaces/ITwibPipeReader.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+
+// Copies device pipes to local streams, keeping several reads in flight on
+// each one so that output doesn't stall for a round trip after every read.
+// Every pipe is serviced from the thread that calls Run.
+class PipePump {
+ public:
+	PipePump(size_t window);
+
+	// If prefix is given, it's put at the start of each line, and lines are
+	// written out whole so that several pumps can share a stream.
+	void Add(ITwibPipeReader &&reader, FILE *stream, std::string prefix = "");
+
+	// Runs until every pipe has hit EoF. Throws ResultError if the device
+	// reports anything else, or std::system_error if a stream can't be
+	// written to.
+	void Run();
+
+ private:
+	class Pipe {
+	 public:
+		Pipe(ITwibPipeReader &&reader, FILE *stream, std::string prefix);
+
+		ITwibPipeReader reader;
+		FILE *stream;
+		const std::string prefix;
+		std::string line; // unterminated line, when prefixing
+		static const size_t MaxLineLength = 0x1000;
+
+		uint64_t issue_sequence = 0;
+		uint64_t write_sequence = 0;
+		size_t in_flight = 0;
+		bool eof = false;
+
+		// reads that came back ahead of an earlier one, keyed by sequence
+		std::map<uint64_t, std::pair<uint32_t, std::vector<uint8_t>>> reorder;
+
+		// Returns false if the stream couldn't be written to.
+		bool Write(const std::vector<uint8_t> &data);
+		// Writes out whatever is left of the last line.
+		bool Finish();
+	};
+
+	class Completion {
+	 public:
+		Pipe *pipe;
+		uint64_t sequence;
+		uint32_t result;
+		std::vector<uint8_t> data;
+	};
+
+	const size_t window;
+	std::list<Pipe> pipes;
+
+	std::mutex completion_mutex;
+	std::condition_variable completion_condvar;
+	std::deque<Completion> completions;
+
+	void Issue(Pipe &pipe);
+	void PostCompletion(Completion &&c);
+};
+
+} // namespace tool
+} // namespace twib
+} // namespace twili
@@ -42,8 +42,8 @@ RemoteObject::~RemoteObject() {
 	}
 }
 
-void RemoteObject::SendRequest(uint32_t command_id, std::vector<uint8_t> payload, std::function<void(Response)> &&func) {
-	return client.SendRequest(Request(device_id, object_id, command_id, 0, payload), std::move(func));
+void RemoteObject::SendRequest(uint32_t command_id, std::vector<uint8_t> payload, ResponseCallback &&func) {
+	return client.SendRequest(Request(device_id, object_id, command_id, 0, std::move(payload)), std::move(func));
 }
 
 Response RemoteObject::SendSyncRequestWithoutAssert(uint32_t command_id, std::vector<uint8_t> payload) {
@@ -53,20 +53,20 @@ Response RemoteObject::SendSyncRequestWithoutAssert(uint32_t command_id, std::ve
 	std::optional<Response> rs;
 
 	SendRequest(
-		command_id, payload,
+		command_id, std::move(payload),
 		[&](Response rs_actual) {
-			rs = rs_actual;
+			rs = std::move(rs_actual);
 			condvar.notify_all();
 		});
 	
 	while(!rs) {
 		condvar.wait(lock);
 	}
-	return *rs;
+	return std::move(*rs);
 }
 
 Response RemoteObject::SendSyncRequest(uint32_t command_id, std::vector<uint8_t> payload) {
-	Response rs = SendSyncRequestWithoutAssert(command_id, payload);
+	Response rs = SendSyncRequestWithoutAssert(command_id, std::move(payload));
 	if(rs.result_code != 0) {
 		throw ResultError(rs.result_code);
 	}
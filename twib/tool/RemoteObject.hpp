@@ -22,6 +22,7 @@
 
 #include<functional>
 
+#include "common/BufferPool.hpp"
 #include "common/ResultError.hpp"
 
 #include "err.hpp"
@@ -37,20 +38,23 @@ class RemoteObject {
 	RemoteObject(client::Client &client, uint32_t device_id, uint32_t object_id);
 	~RemoteObject();
 
-	void SendRequest(uint32_t command_id, std::vector<uint8_t> payload, std::function<void(Response)> &&func);
+	void SendRequest(uint32_t command_id, std::vector<uint8_t> payload, ResponseCallback &&func);
 	Response SendSyncRequestWithoutAssert(uint32_t command_id, std::vector<uint8_t> payload = std::vector<uint8_t>());
 	Response SendSyncRequest(uint32_t command_id, std::vector<uint8_t> payload = std::vector<uint8_t>());
 
 	template<typename T, typename... Args>
 	uint32_t SendSmartSyncRequestWithoutAssert(T command_id, Args&&... args) {
-		util::Buffer input_buffer;
+		util::Buffer input_buffer(common::BufferPool::Acquire());
 		(detail::WrappingHelper<Args>::Pack(std::move(args), input_buffer), ...);
-		Response r = SendSyncRequestWithoutAssert((uint32_t) command_id, input_buffer.GetData());
+		Response r = SendSyncRequestWithoutAssert((uint32_t) command_id, input_buffer.TakeData());
 		if(r.result_code) {
+			common::BufferPool::Release(std::move(r.payload));
 			return r.result_code;
 		}
-		util::Buffer output_buffer(r.payload);
-		if(!(detail::WrappingHelper<Args>::Unpack(std::move(args), output_buffer, r.objects) && ... && true)) {
+		util::Buffer output_buffer(std::move(r.payload));
+		bool ok = (detail::WrappingHelper<Args>::Unpack(std::move(args), output_buffer, r.objects) && ... && true);
+		common::BufferPool::Release(output_buffer.TakeData());
+		if(!ok) {
 			throw ResultError(TWILI_ERR_PROTOCOL_BAD_RESPONSE);
 		}
 		return 0;
@@ -66,17 +70,20 @@ class RemoteObject {
 
 	template<typename T, typename... Args>
 	void SendSmartRequest(T command_id, std::function<void(uint32_t)> &&func, Args&&... args) {
-		util::Buffer input_buffer;
+		util::Buffer input_buffer(common::BufferPool::Acquire());
 		(detail::WrappingHelper<Args>::Pack(std::move(args), input_buffer), ...);
 		SendRequest(
 			(uint32_t) command_id,
-			input_buffer.GetData(),
+			input_buffer.TakeData(),
 			[&, func{std::move(func)}](Response r) {
 				if(r.result_code) {
 					func(r.result_code);
+					return;
 				}
-				util::Buffer output_buffer(r.payload);
-				if(!(detail::WrappingHelper<Args>::Unpack(std::move(args), output_buffer, r.objects) && ... && true)) {
+				util::Buffer output_buffer(std::move(r.payload));
+				bool ok = (detail::WrappingHelper<Args>::Unpack(std::move(args), output_buffer, r.objects) && ... && true);
+				common::BufferPool::Release(output_buffer.TakeData());
+				if(!ok) {
 					func(TWILI_ERR_PROTOCOL_BAD_RESPONSE);
 				} else {
 					func(0);
@@ -28,6 +28,7 @@ namespace tool {
 namespace client {
 
 SocketClient::SocketClient(platform::Socket &&socket) : server_logic(*this), event_loop(server_logic), connection(std::move(socket), event_loop.GetNotifier()) {
+	event_loop.AddMember(connection.member);
 	event_loop.Begin();
 }
 
@@ -36,7 +37,7 @@ SocketClient::~SocketClient() {
 	connection.member.socket.Close();
 }
 
-void SocketClient::SendRequestImpl(const Request &rq) {
+void SocketClient::SendRequestImpl(Request &&rq) {
 	protocol::MessageHeader mh;
 	mh.device_id = rq.device_id;
 	mh.object_id = rq.object_id;
@@ -44,8 +45,9 @@ void SocketClient::SendRequestImpl(const Request &rq) {
 	mh.tag = rq.tag;
 	mh.payload_size = rq.payload.size();
 	mh.object_count = 0;
+	mh.flags = 0;
 
-	connection.SendMessage(mh, rq.payload, std::vector<uint32_t>());
+	connection.SendMessage(mh, std::move(rq.payload), std::vector<uint32_t>());
 	LogMessage(Debug, "sent request");
 }
 
@@ -53,14 +55,12 @@ SocketClient::Logic::Logic(SocketClient &client) : client(client) {
 }
 
 void SocketClient::Logic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
 	common::MessageConnection::Request *rq;
 	while((rq = client.connection.Process()) != nullptr) {
-		client.PostResponse(rq->mh, rq->payload, rq->object_ids);
+		client.PostResponse(rq->mh, std::move(rq->payload), rq->object_ids);
 	}
-	if(!client.connection.error_flag) {
-		loop.AddMember(client.connection.member);
-	} else {
+	if(client.connection.error_flag) {
+		loop.RemoveMember(client.connection.member);
 		client.FailAllRequests(TWILI_ERR_IO_ERROR);
 	}
 }
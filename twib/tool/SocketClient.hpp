@@ -36,7 +36,7 @@ class SocketClient : public Client {
 	~SocketClient();
 	
  protected:
-	virtual void SendRequestImpl(const Request &rq) override;
+	virtual void SendRequestImpl(Request &&rq) override;
  private:
 	class Logic : public platform::EventLoop::Logic {
 	 public:
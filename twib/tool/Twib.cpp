@@ -22,8 +22,17 @@
 
 #include<iomanip>
 #include<array>
+#include<chrono>
+#include<fstream>
+#include<future>
+#include<iostream>
+#include<list>
+#include<mutex>
+#include<optional>
+#include<sstream>
 
 #include<string.h>
+#include<errno.h>
 #include<inttypes.h>
 
 #include<msgpack11.hpp>
@@ -39,6 +48,9 @@
 #include "Protocol.hpp"
 #include "interfaces/ITwibMetaInterface.hpp"
 #include "interfaces/ITwibDeviceInterface.hpp"
+#include "FileTransfer.hpp"
+#include "PipePump.hpp"
+#include "FileSync.hpp"
 
 #if TWIB_GDB_ENABLED == 1
 #include "GdbStub.hpp"
@@ -59,8 +71,8 @@ namespace twib {
 namespace tool {
 
 template<size_t N>
-void PrintTable(std::vector<std::array<std::string, N>> rows) {
-	std::array<int, N> lengths = {0};
+void PrintTable(std::vector<std::array<std::string, N>> rows, FILE *out) {
+	std::array<size_t, N> lengths = {0};
 	for(auto r : rows) {
 		for(size_t i = 0; i < N; i++) {
 			if(r[i].size() > lengths[i]) {
@@ -70,7 +82,7 @@ void PrintTable(std::vector<std::array<std::string, N>> rows) {
 	}
 	for(auto r : rows) {
 		for(size_t i = 0; i < N; i++) {
-			printf("%-*s%s", lengths[i], r[i].c_str(), (i + 1 == N) ? "\n" : " | ");
+			fprintf(out, "%-*s%s", (int) lengths[i], r[i].c_str(), (i + 1 == N) ? "\n" : " | ");
 		}
 	}
 }
@@ -89,7 +101,7 @@ std::string ToHex(T num, bool prefix) {
 	return stream.str();
 }
 
-void ListDevices(ITwibMetaInterface &iface) {
+void ListDevices(ITwibMetaInterface &iface, FILE *out) {
 	std::vector<std::array<std::string, 4>> rows;
 	rows.push_back({"Device ID", "Nickname", "Firmware Version", "Bridge Type"});
 	auto devices = iface.ListDevices();
@@ -103,10 +115,78 @@ void ListDevices(ITwibMetaInterface &iface) {
 		
 		rows.push_back({ToHex(device_id, 8, false), nickname, fw_version, bridge_type});
 	}
-	PrintTable(rows);
+	PrintTable(rows, out);
 }
 
-void ListProcesses(ITwibDeviceInterface &iface) {
+void PrintStats(ITwibMetaInterface &iface, FILE *out) {
+	msgpack11::MsgPack stats = iface.GetMetrics();
+	double uptime = stats["uptime_ms"].uint64_value() / 1000.0;
+	uint64_t requests = stats["requests_dispatched"].uint64_value();
+	fprintf(out, "uptime: %.1f s\n", uptime);
+	fprintf(out, "requests dispatched: %" PRIu64" (%.1f/s)\n", requests, uptime > 0 ? requests / uptime : 0.0);
+	fprintf(out, "responses dispatched: %" PRIu64"\n", stats["responses_dispatched"].uint64_value());
+	fprintf(out, "dispatch queue depths:");
+	for(auto &depth : stats["dispatch_queue_depths"].array_items()) {
+		fprintf(out, " %" PRIu64, depth.uint64_value());
+	}
+	fprintf(out, "\n\n");
+
+	std::vector<std::array<std::string, 8>> devices;
+	devices.push_back({"Device ID", "Bridge Type", "In Flight", "Peak", "Completed", "Timed Out", "Bytes In", "Bytes Out"});
+	std::vector<std::array<std::string, 6>> commands;
+	commands.push_back({"Device ID", "Interface", "Command", "Count", "p50 (ms)", "p99 (ms)"});
+	for(auto &device : stats["devices"].array_items()) {
+		std::string device_id = ToHex(device["device_id"].uint32_value(), 8, false);
+		msgpack11::MsgPack requests = device["requests"];
+		devices.push_back({
+				device_id,
+				device["bridge_type"].string_value(),
+				std::to_string(requests["in_flight"].uint64_value()),
+				std::to_string(requests["peak_in_flight"].uint64_value()),
+				std::to_string(requests["completed"].uint64_value()),
+				std::to_string(requests["timed_out"].uint64_value()),
+				std::to_string(device["bytes_in"].uint64_value()),
+				std::to_string(device["bytes_out"].uint64_value())});
+		for(auto &command : device["commands"].array_items()) {
+			commands.push_back({
+					device_id,
+					command["interface"].string_value(),
+					std::to_string(command["command_id"].uint32_value()),
+					std::to_string(command["count"].uint64_value()),
+					std::to_string(command["p50_ms"].uint64_value()),
+					std::to_string(command["p99_ms"].uint64_value())});
+		}
+	}
+	PrintTable(devices, out);
+	fprintf(out, "\n");
+	PrintTable(commands, out);
+	fprintf(out, "\n");
+
+	std::vector<std::array<std::string, 3>> backends;
+	backends.push_back({"Bridge Type", "Devices Added", "Devices Removed"});
+	for(auto &backend : stats["backends"].object_items()) {
+		backends.push_back({
+				backend.first.string_value(),
+				std::to_string(backend.second["devices_added"].uint64_value()),
+				std::to_string(backend.second["devices_removed"].uint64_value())});
+	}
+	PrintTable(backends, out);
+	fprintf(out, "\n");
+
+	std::vector<std::array<std::string, 5>> clients;
+	clients.push_back({"Client ID", "Owned Objects", "Queued Output", "Peak Output", "Throttled"});
+	for(auto &client : stats["clients"].array_items()) {
+		clients.push_back({
+				ToHex(client["client_id"].uint32_value(), 8, false),
+				std::to_string(client["owned_objects"].uint64_value()),
+				std::to_string(client["output_queued"].uint64_value()),
+				std::to_string(client["output_high_water"].uint64_value()),
+				std::to_string(client["output_throttle_count"].uint64_value())});
+	}
+	PrintTable(clients, out);
+}
+
+void ListProcesses(ITwibDeviceInterface &iface, FILE *out) {
 	std::vector<std::array<std::string, 5>> rows;
 	rows.push_back({"Process ID", "Result", "Title ID", "Process Name", "MMU Flags"});
 	auto processes = iface.ListProcesses();
@@ -118,9 +198,87 @@ void ListProcesses(ITwibDeviceInterface &iface) {
 			std::string(p.process_name, 12),
 			ToHex(p.mmu_flags, true)});
 	}
-	PrintTable(rows);
+	PrintTable(rows, out);
+}
+
+// Devices that predate protocol 5 can only have one READ outstanding per pipe.
+size_t PipeReadWindow(ITwibDeviceInterface &iface) {
+	if(iface.Identify()["protocol"].int_value() >= 5) {
+		return protocol::ITwibPipeReader::READ_WINDOW;
+	} else {
+		return 1;
+	}
+}
+
+// Maps a name given to `coredump --types` to a mask of memory types.
+uint64_t CoreDumpMemoryTypes(std::string name) {
+	const uint64_t code = (1ull << 0x3) | (1ull << 0x4) | (1ull << 0x8) | (1ull << 0x9) | (1ull << 0x14) | (1ull << 0x15);
+	const uint64_t heap = 1ull << 0x5;
+	const uint64_t stack = 1ull << 0xb;
+	const uint64_t tls = 1ull << 0xc;
+	const uint64_t shared = 1ull << 0x6;
+	const uint64_t ipc = (1ull << 0xa) | (1ull << 0x11) | (1ull << 0x12);
+	const uint64_t transfer = (1ull << 0xd) | (1ull << 0xe);
+	const uint64_t alias = 1ull << 0x7;
+	
+	if(name == "code") { return code; }
+	if(name == "heap") { return heap; }
+	if(name == "stack") { return stack; }
+	if(name == "tls") { return tls; }
+	if(name == "shared") { return shared; }
+	if(name == "ipc") { return ipc; }
+	if(name == "transfer") { return transfer; }
+	if(name == "alias") { return alias; }
+	if(name == "other") { return ~(code | heap | stack | tls | shared | ipc | transfer | alias); }
+	if(name == "all") { return ~0ull; }
+	return 0;
 }
 
+// Connection state shared by every command run by one twib process. Batch
+// mode runs many commands on one Session, so connecting to twibd and
+// working out which device to use only happens once.
+class Session {
+ public:
+	Session(client::Client &client, std::string device_id_str) :
+		client(client),
+		itmi(RemoteObject(client, 0, 0)),
+		device_id_str(device_id_str) {
+	}
+
+	// Picks the device the first time it's called. Returns nullptr if there
+	// isn't exactly one device to pick and none was specified.
+	ITwibDeviceInterface *GetDevice(uint32_t &device_id) {
+		std::lock_guard<std::mutex> lock(device_mutex);
+		if(!device) {
+			if(device_id_str.size() > 0) {
+				this->device_id = std::stoul(device_id_str, NULL, 16);
+			} else {
+				std::vector<msgpack11::MsgPack> devices = itmi.ListDevices();
+				if(devices.size() == 0) {
+					LogMessage(Fatal, "No devices were detected.");
+					return nullptr;
+				}
+				if(devices.size() > 1) {
+					LogMessage(Fatal, "Multiple devices were detected. Please use -d to specify which one you mean.");
+					return nullptr;
+				}
+				this->device_id = devices[0]["device_id"].uint32_value();
+			}
+			device.emplace(std::make_shared<RemoteObject>(client, this->device_id, 0));
+		}
+		device_id = this->device_id;
+		return &*device;
+	}
+
+	client::Client &client;
+	ITwibMetaInterface itmi;
+ private:
+	const std::string device_id_str;
+	std::mutex device_mutex;
+	std::optional<ITwibDeviceInterface> device;
+	uint32_t device_id;
+};
+
 std::unique_ptr<client::Client> connect_tcp(uint16_t port);
 std::unique_ptr<client::Client> connect_unix(std::string path);
 std::unique_ptr<client::Client> connect_named_pipe(std::string path);
@@ -129,11 +287,23 @@ std::unique_ptr<client::Client> connect_named_pipe(std::string path);
 } // namespace twib
 } // namespace twili
 
-void show(msgpack11::MsgPack const& blob);
+void show(msgpack11::MsgPack const& blob, std::ostream &out);
 
 using namespace twili;
 using namespace twili::twib;
 
+// Where a command's output goes. `twib --all` runs the same command on
+// several devices at once: regular output is collected in `out` and printed
+// with the device's prefix once the command finishes, process and pipe
+// output is streamed to stdout with the prefix as it arrives, and commands
+// that would write to a host file refuse to run, since every device would
+// be writing the same one.
+struct CommandOutput {
+	FILE *out = stdout;
+	std::string prefix;
+	bool shared = false;
+};
+
 class FSCommands {
  public:
 	FSCommands(CLI::App &app, const char *cmdname, const char *desc, const char *fsname) :
@@ -145,10 +315,12 @@ class FSCommands {
 		pull = subcommand->add_subcommand("pull", "Pulls files from device filesystem to host filesystem");
 		pull->add_option("from", pull_from, "Path(s) to pull from (on device)")->expected(-1);
 		pull->add_option("to", pull_to, "Path to write to (on host)");
+		AddTransferOptions(pull);
 
 		push = subcommand->add_subcommand("push", "Pushes files from host filesystem to device filesystem");
 		push->add_option("from", push_from, "Path(s) to read from (on host)")->expected(-1);
 		push->add_option("to", push_to, "Path to write to (on device)");
+		AddTransferOptions(push);
 
 		ls = subcommand->add_subcommand("ls", "Lists files on device filesystem");
 		ls->add_flag("-l", ls_details, "Show more details");
@@ -164,19 +336,37 @@ class FSCommands {
 		mv = subcommand->add_subcommand("mv", "Rename a file or directory");
 		mv->add_option("src", mv_src, "Source path")->required();
 		mv->add_option("dst", mv_dst, "Destination path")->required();
+
+		sync = subcommand->add_subcommand("sync", "Makes a directory on the device match one on the host, pushing only what changed");
+		sync->add_option("from", sync_from, "Directory to read from (on host)")->required();
+		sync->add_option("to", sync_to, "Directory to write to (on device)")->required();
+		sync->add_option("-b,--block-size", sync_block_size, "Size of blocks to compare, in bytes", true);
+		sync->add_flag("--delete", sync_delete, "Delete files on the device that aren't on the host");
+		sync->add_flag("--no-manifest", sync_no_manifest, "Don't read or write the manifest in the host directory");
+		AddTransferOptions(sync);
 		
 		subcommand->require_subcommand(1);
 	}
 
-	int Run(tool::ITwibDeviceInterface &itdi) {
+	void AddTransferOptions(CLI::App *cmd) {
+		cmd->add_option("-w,--window", transfer_window, "Number of requests to keep in flight", true);
+		cmd->add_option("-c,--chunk-size", transfer_chunk_size, "Size of each request, in bytes", true);
+		cmd->add_option("-j,--jobs", transfer_jobs, "Number of files to transfer at once", true);
+	}
+
+	int Run(tool::ITwibDeviceInterface &itdi, uint32_t device_id, const CommandOutput &output) {
 		if(pull->parsed()) {
+			if(output.shared) {
+				LogMessage(Error, "%s pull can't be used on several devices at once", cmdname);
+				return 1;
+			}
 			return DoPull(itdi);
 		}
 		if(push->parsed()) {
 			return DoPush(itdi);
 		}
 		if(ls->parsed()) {
-			return DoLs(itdi);
+			return DoLs(itdi, output.out);
 		}
 		if(rm->parsed()) {
 			return DoRm(itdi);
@@ -187,6 +377,13 @@ class FSCommands {
 		if(mv->parsed()) {
 			return DoMv(itdi);
 		}
+		if(sync->parsed()) {
+			if(output.shared && !sync_no_manifest) {
+				LogMessage(Error, "%s sync needs --no-manifest to be used on several devices at once", cmdname);
+				return 1;
+			}
+			return DoSync(itdi, device_id);
+		}
 		return 0;
 	}
 
@@ -217,40 +414,32 @@ class FSCommands {
 		}
 
 		tool::ITwibFilesystemAccessor itfsa = itdi.OpenFilesystemAccessor(fsname);
+
+		// everything going to stdout has to come out in order
+		tool::FileTransfer transfer(transfer_window, transfer_chunk_size, pull_to == "-" ? 1 : transfer_jobs);
 		
 		for(std::string &src : pull_from) {
-			tool::ITwibFileAccessor itfa = itfsa.OpenFile(1, "/" + src);
-			
 			std::string dst_path;
-			platform::File dst;
 			if(pull_to == "-") {
 				dst_path = "<stdout>";
-				dst = platform::File::BorrowStdout();
+			} else if(is_target_directory) {
+				dst_path = pull_to + src;
 			} else {
-				if(is_target_directory) {
-					dst_path = pull_to + src;
-				} else {
-					dst_path = pull_to;
-				}
-				dst = platform::File::OpenForClobberingWrite(dst_path.c_str());
+				dst_path = pull_to;
 			}
 
-			size_t total_size = itfa.GetSize();
-			size_t offset = 0;
-			while(offset < total_size) {
-				std::vector<uint8_t> data = itfa.Read(offset, total_size - offset);
-				if(data.size() == 0 || dst.Write(data.data(), data.size()) < data.size()) {
-					LogMessage(Error, "hit EoF/IO error unexpectedly?");
-					return 1;
-				}
-				offset+= data.size();
-			}
-
-			if(pull_to != "-") {
-				fprintf(stderr, "%s -> %s\n", src.c_str(), dst_path.c_str());
-			}
+			// opened once the file's turn comes up, so pulling lots of files
+			// doesn't hold lots of handles open on either end
+			transfer.AddPull(
+				[&itfsa, src, dst_path, to_stdout = pull_to == "-"]() {
+					tool::ITwibFileAccessor itfa = itfsa.OpenFile(1, "/" + src);
+					uint64_t total_size = itfa.GetSize();
+					platform::File dst = to_stdout ? platform::File::BorrowStdout() : platform::File::OpenForClobberingWrite(dst_path.c_str());
+					return tool::FileTransfer::Endpoints {std::move(itfa), std::move(dst), total_size};
+				}, src, dst_path);
 		}
-		return 0;
+		
+		return transfer.Run() ? 0 : 1;
 	}
 
 	int DoPush(tool::ITwibDeviceInterface &itdi) {
@@ -284,46 +473,36 @@ class FSCommands {
 			}
 		}
 		
+		tool::FileTransfer transfer(transfer_window, transfer_chunk_size, transfer_jobs);
+		
 		for(std::string &src_path : push_from) {
 			std::string dst_path;
-			platform::File src = platform::File::OpenForRead(src_path.c_str());
-			
 			if(is_target_directory) {
 				dst_path = push_to + platform::fs::BaseName(src_path.c_str()); // lmao super dangerous don't ever do this
 			} else {
 				dst_path = push_to;
 			}
 
-			size_t total_size = src.GetSize();
-
-			LogMessage(Debug, "creating %s", dst_path.c_str());
-			itfsa.CreateFile(0, total_size, dst_path);
-			LogMessage(Debug, "opening %s", dst_path.c_str());
-			tool::ITwibFileAccessor itfa = itfsa.OpenFile(6, dst_path);
-			LogMessage(Debug, "setting size");
-			itfa.SetSize(total_size);
+			transfer.AddPush(
+				[&itfsa, src_path, dst_path]() {
+					platform::File src = platform::File::OpenForRead(src_path.c_str());
+					uint64_t total_size = src.GetSize();
 
-			size_t offset = 0;
-			std::vector<uint8_t> data;
-			while(offset < total_size) {
-				data.resize(std::min(total_size - offset, (size_t) 0x10000));
-				size_t r;
-				if((r = src.Read(data.data(), data.size())) < data.size()) {
-					LogMessage(Error, "hit EoF unexpectedly? expected 0x%lx, got 0x%lx", data.size(), r);
-					return 1;
-				}
-				
-				itfa.Write(offset, data);
-				offset+= data.size();
-			}
+					LogMessage(Debug, "creating %s", dst_path.c_str());
+					itfsa.CreateFile(0, total_size, dst_path);
+					LogMessage(Debug, "opening %s", dst_path.c_str());
+					tool::ITwibFileAccessor itfa = itfsa.OpenFile(6, dst_path);
+					LogMessage(Debug, "setting size");
+					itfa.SetSize(total_size);
 
-			fprintf(stderr, "%s -> %s\n", src_path.c_str(), dst_path.c_str());
+					return tool::FileTransfer::Endpoints {std::move(itfa), std::move(src), total_size};
+				}, src_path, dst_path);
 		}
 
-		return 0;
+		return transfer.Run() ? 0 : 1;
 	}
 
-	int DoLs(tool::ITwibDeviceInterface &itdi) {
+	int DoLs(tool::ITwibDeviceInterface &itdi, FILE *out) {
 		tool::ITwibFilesystemAccessor itfsa = itdi.OpenFilesystemAccessor(fsname);
 		tool::ITwibDirectoryAccessor itda = itfsa.OpenDirectory(ls_path);
 
@@ -345,9 +524,9 @@ class FSCommands {
 		
 		for(auto &e : entries) {
 			if(ls_details) {
-				printf("%s%s %9" PRIu64"  %s\n", e.entry_type == 0 ? "d" : "-", e.attributes & 1 ? "a" : "-", e.file_size, e.path);
+				fprintf(out, "%s%s %9" PRIu64"  %s\n", e.entry_type == 0 ? "d" : "-", e.attributes & 1 ? "a" : "-", e.file_size, e.path);
 			} else {
-				printf("%s\n", e.path);
+				fprintf(out, "%s\n", e.path);
 			}
 		}
 
@@ -408,6 +587,23 @@ class FSCommands {
 		return 0;
 	}
 
+	int DoSync(tool::ITwibDeviceInterface &itdi, uint32_t device_id) {
+		if(sync_block_size < protocol::ITwibFileAccessor::HASH_MIN_BLOCK_SIZE || sync_block_size > protocol::ITwibFileAccessor::HASH_MAX_BLOCK_SIZE) {
+			LogMessage(Error, "block size must be between 0x%" PRIx64 " and 0x%" PRIx64,
+								 protocol::ITwibFileAccessor::HASH_MIN_BLOCK_SIZE, protocol::ITwibFileAccessor::HASH_MAX_BLOCK_SIZE);
+			return 1;
+		}
+
+		char target_id[32];
+		snprintf(target_id, sizeof(target_id), "%08x:%s", device_id, fsname);
+
+		tool::ITwibFilesystemAccessor itfsa = itdi.OpenFilesystemAccessor(fsname);
+		tool::FileTransfer transfer(transfer_window, transfer_chunk_size, transfer_jobs);
+		tool::FileSync file_sync(itfsa, transfer, target_id, sync_block_size);
+
+		return file_sync.Run(sync_from, sync_to, sync_delete, !sync_no_manifest) ? 0 : 1;
+	}
+
 	CLI::App &app;
 	CLI::App *subcommand;
 	
@@ -420,6 +616,10 @@ class FSCommands {
 	std::vector<std::string> push_from;
 	std::string push_to = "/";
 
+	size_t transfer_window = 8;
+	size_t transfer_chunk_size = 0x40000;
+	size_t transfer_jobs = 4;
+
 	CLI::App *ls;
 	bool ls_details;
 	std::string ls_path = "/";
@@ -434,222 +634,111 @@ class FSCommands {
 	CLI::App *mv;
 	std::string mv_src;
 	std::string mv_dst;
+
+	CLI::App *sync;
+	std::string sync_from;
+	std::string sync_to;
+	uint64_t sync_block_size = 0x40000;
+	bool sync_delete = false;
+	bool sync_no_manifest = false;
 	
 	const char *cmdname;
 	const char *fsname;
 };
 
-int main(int argc, char *argv[]) {
-#ifdef _WIN32
-	WSADATA wsaData;
-	int err;
-	err = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (err != 0) {
-		printf("WSAStartup failed with error: %d\n", err);
-		return 1;
-	}
-#endif
-
-	CLI::App app {"Twili debug monitor client"};
-
-	std::string device_id_str;
-	app.add_option("-d,--device", device_id_str, "Use a specific device")
-		->type_name("DeviceId")
-		->envname("TWIB_DEVICE");
-
-	bool is_verbose;
-	app.add_flag("-v,--verbose", is_verbose, "Enable debug logging");
-
-	std::string frontend;
-	std::string unix_frontend_path = TWIB_UNIX_FRONTEND_DEFAULT_PATH;
-	uint16_t tcp_frontend_port = TWIB_TCP_FRONTEND_DEFAULT_PORT;
-	std::string named_pipe_frontend_path = TWIB_NAMED_PIPE_FRONTEND_DEFAULT_NAME;
-	
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-	frontend = "named_pipe";
-#elif TWIB_UNIX_FRONTEND_ENABLED == 1
-	frontend = "unix";
-#else
-	frontend = "tcp";
-#endif
-	
-	app.add_set("-f,--frontend", frontend, {
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-			"named_pipe",
-#endif
-#if TWIB_UNIX_FRONTEND_ENABLED == 1
-			"unix",
-#endif
-#if TWIB_TCP_FRONTEND_ENABLED == 1
-			"tcp",
-#endif
-		})->envname("TWIB_FRONTEND");
-
-#if TWIB_UNIX_FRONTEND_ENABLED == 1
-	app.add_option(
-		"-P,--unix-path", unix_frontend_path,
-		"Path to the twibd UNIX socket")
-		->envname("TWIB_UNIX_FRONTEND_PATH");
-#endif
-
-#if TWIB_TCP_FRONTEND_ENABLED == 1
-	app.add_option(
-		"-p,--tcp-port", tcp_frontend_port,
-		"Port for the twibd TCP socket")
-		->envname("TWIB_TCP_FRONTEND_PORT");
-#endif
-
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-	app.add_option(
-		"-n,--pipe-name", named_pipe_frontend_path,
-		"Named for the twibd pipe")
-		->envname("TWIB_NAMED_PIPE_FRONTEND_NAME");
-#endif
-	
-	CLI::App *ld = app.add_subcommand("list-devices", "List devices");
-	
-	CLI::App *cmd_connect_tcp = app.add_subcommand("connect-tcp", "Connect to a device over TCP");
-	std::string connect_tcp_hostname;
-	std::string connect_tcp_port = "15152";
-	cmd_connect_tcp->add_option("hostname", connect_tcp_hostname, "Hostname to connect to")->required();
-	cmd_connect_tcp->add_option("port", connect_tcp_port, "Port to connect to");
-	
-	CLI::App *run = app.add_subcommand("run", "Run an executable");
-	std::string run_file;
-	bool run_applet = false;
-	bool run_shell = false;
-	bool run_suspend = false;
-	bool run_quiet = false;
-	run->add_flag("-a,--applet", run_applet, "Run as an applet");
-	run->add_flag("-s,--shell", run_shell, "Run as a shell program");
-	run->add_flag("-d,--debug-suspend", run_suspend, "Suspends for debug");
-	run->add_flag("-q,--quiet", run_quiet, "Suppress any output except from the program being run");
-	run->add_option("file", run_file, "Executable to run")->check(CLI::ExistingFile)->required();
-	
-	CLI::App *reboot = app.add_subcommand("reboot", "Reboot the device");
-	bool reboot_unsafe;
-	reboot->add_flag("-u,--unsafe", reboot_unsafe, "Reboot quickly but forcefully and unsafely");
+// All of the subcommands that talk to twibd, except for batch and shell. Batch
+// mode makes a new set for every line so that options don't carry over from
+// one command to the next.
+class Commands {
+ public:
+	Commands(CLI::App &app) {
+		ld = app.add_subcommand("list-devices", "List devices");
 
-	CLI::App *coredump = app.add_subcommand("coredump", "Make a coredump of a crashed process");
-	std::string core_file;
-	uint64_t core_process_id;
-	coredump->add_option("file", core_file, "File to dump core to")->required();
-	coredump->add_option("pid", core_process_id, "Process ID")->required();
-	
-	CLI::App *terminate = app.add_subcommand("terminate", "Terminate a process on the device");
-	uint64_t terminate_process_id;
-	terminate->add_option("pid", terminate_process_id, "Process ID")->required();
-	
-	CLI::App *ps = app.add_subcommand("ps", "List processes on the device");
+		cmd_stats = app.add_subcommand("stats", "Show twibd metrics");
+		
+		cmd_connect_tcp = app.add_subcommand("connect-tcp", "Connect to a device over TCP");
+		cmd_connect_tcp->add_option("hostname", connect_tcp_hostname, "Hostname to connect to")->required();
+		cmd_connect_tcp->add_option("port", connect_tcp_port, "Port to connect to");
+		
+		run = app.add_subcommand("run", "Run an executable");
+		run->add_flag("-a,--applet", run_applet, "Run as an applet");
+		run->add_flag("-s,--shell", run_shell, "Run as a shell program");
+		run->add_flag("-d,--debug-suspend", run_suspend, "Suspends for debug");
+		run->add_flag("-q,--quiet", run_quiet, "Suppress any output except from the program being run");
+		run->add_option("file", run_file, "Executable to run")->check(CLI::ExistingFile)->required();
+		
+		reboot = app.add_subcommand("reboot", "Reboot the device");
+		reboot->add_flag("-u,--unsafe", reboot_unsafe, "Reboot quickly but forcefully and unsafely");
+
+		coredump = app.add_subcommand("coredump", "Make a coredump of a crashed process");
+		coredump->add_option("file", core_file, "File to dump core to")->required();
+		coredump->add_option("pid", core_process_id, "Process ID")->required();
+		coredump->add_option("-t,--types", core_types, "Memory types to include (code, heap, stack, tls, shared, ipc, transfer, alias, other, all)");
+		coredump->add_option("-m,--max-region-size", core_max_region_mib, "Leave out regions larger than this many MiB");
+		coredump->add_flag("--no-sparse", core_no_sparse, "Store pages of zeroes instead of leaving them out");
+		coredump->add_option("-w,--window", core_window, "Number of requests to keep in flight", true);
+		
+		terminate = app.add_subcommand("terminate", "Terminate a process on the device");
+		terminate->add_option("pid", terminate_process_id, "Process ID")->required();
+		
+		ps = app.add_subcommand("ps", "List processes on the device");
 
-	CLI::App *identify = app.add_subcommand("identify", "Identify the device");
+		identify = app.add_subcommand("identify", "Identify the device");
 
-	CLI::App *list_named_pipes = app.add_subcommand("list-named-pipes", "List named pipes on the device");
+		list_named_pipes = app.add_subcommand("list-named-pipes", "List named pipes on the device");
 
-	CLI::App *open_named_pipe = app.add_subcommand("open-named-pipe", "Open a named pipe on the device");
-	std::string open_named_pipe_name;
-	open_named_pipe->add_option("name", open_named_pipe_name, "Name of pipe to open")->required();
+		open_named_pipe = app.add_subcommand("open-named-pipe", "Open a named pipe on the device");
+		open_named_pipe->add_option("name", open_named_pipe_name, "Name of pipe to open")->required();
 
-	CLI::App *get_memory_info = app.add_subcommand("get-memory-info", "Gets memory usage information from the device");
+		get_memory_info = app.add_subcommand("get-memory-info", "Gets memory usage information from the device");
 
-	CLI::App *print_debug_info = app.add_subcommand("debug", "Prints debug info");
+		print_debug_info = app.add_subcommand("debug", "Prints debug info");
 
 #if TWIB_GDB_ENABLED == 1
-	CLI::App *gdb = app.add_subcommand("gdb", "Opens an enhanced GDB stub for the device");
+		gdb = app.add_subcommand("gdb", "Opens an enhanced GDB stub for the device");
 #endif
 
-	CLI::App *launch = app.add_subcommand("launch", "Launches an installed title");
-	std::string launch_title_id;
-	std::string launch_storage;
-	uint32_t launch_flags = 0;
-	launch->add_option("title-id", launch_title_id, "Title ID to launch")->required();
-	launch->add_set_ignore_case("storage", launch_storage, {"none", "host", "gamecard", "gc", "nand-system", "system", "nand-user", "user", "sdcard", "sd"}, "Storage for title")->required();
-	launch->add_option("launch-flags", launch_flags, "Flags for launch");
+		launch = app.add_subcommand("launch", "Launches an installed title");
+		launch->add_option("title-id", launch_title_id, "Title ID to launch")->required();
+		launch->add_set_ignore_case("storage", launch_storage, {"none", "host", "gamecard", "gc", "nand-system", "system", "nand-user", "user", "sdcard", "sd"}, "Storage for title")->required();
+		launch->add_option("launch-flags", launch_flags, "Flags for launch");
 
-	FSCommands sd_commands(app, "sd", "Perform operations on target SD card", "sd");
-	FSCommands nand_user_commands(app, "nu", "Perform operations on target NAND user filesystem", "nand_user");
-	FSCommands nand_system_commands(app, "ns", "Perform operations on target NAND system filesystem", "nand_system");
+		sd_commands.emplace(app, "sd", "Perform operations on target SD card", "sd");
+		nand_user_commands.emplace(app, "nu", "Perform operations on target NAND user filesystem", "nand_user");
+		nand_system_commands.emplace(app, "ns", "Perform operations on target NAND system filesystem", "nand_system");
 
-	CLI::App *get_module_info = app.add_subcommand("get-module-info", "Lists loaded module info for a specific process");
-	uint64_t get_module_info_process_id;
-	get_module_info->add_option("pid", get_module_info_process_id, "Process ID")->required();
+		get_module_info = app.add_subcommand("get-module-info", "Lists loaded module info for a specific process");
+		get_module_info->add_option("pid", get_module_info_process_id, "Process ID")->required();
 
-	CLI::App *lookup_error = app.add_subcommand("err", "Looks up a Twili error code");
-	bool lookup_error_decimal = false;
-	std::string lookup_error_code;
-	lookup_error->add_flag("-d,--decimal", lookup_error_decimal, "Parses error code as a decimal number");
-	lookup_error->add_option("code", lookup_error_code, "Error code to look up")->required();
-	
-	app.require_subcommand(1);
-	
-	try {
-		app.parse(argc, argv);
-	} catch(const CLI::ParseError &e) {
-		return app.exit(e);
+		lookup_error = app.add_subcommand("err", "Looks up a Twili error code");
+		lookup_error->add_flag("-d,--decimal", lookup_error_decimal, "Parses error code as a decimal number");
+		lookup_error->add_option("code", lookup_error_code, "Error code to look up")->required();
 	}
 
-	log::init_color();
-	if(is_verbose) {
-#if TWIB_GDB_ENABLED == 1
-		if(gdb->parsed()) {
-			// for gdb stub, all logging should go to stderr
-			log::add_log(std::make_shared<log::PrettyFileLogger>(stderr, log::Level::Debug, log::Level::Error));
-#else
-		if(false) {
-#endif
-		} else {
-			log::add_log(std::make_shared<log::PrettyFileLogger>(stdout, log::Level::Debug, log::Level::Error));
+	// Standard input is only forwarded to processes started with `run` if
+	// forward_stdin is set.
+	int Run(tool::Session &session, bool forward_stdin, const CommandOutput &output = CommandOutput()) {
+		if(ld->parsed()) {
+			ListDevices(session.itmi, output.out);
+			return 0;
 		}
-	}
-	log::add_log(std::make_shared<log::PrettyFileLogger>(stderr, log::Level::Error));
-	
-	LogMessage(Message, "starting twib");
 
-	try {
-	
-		std::unique_ptr<tool::client::Client> client;
-		if(TWIB_UNIX_FRONTEND_ENABLED && frontend == "unix") {
-			client = tool::connect_unix(unix_frontend_path);
-		} else if(TWIB_TCP_FRONTEND_ENABLED && frontend == "tcp") {
-			client = tool::connect_tcp(tcp_frontend_port);
-		} else if(TWIB_NAMED_PIPE_FRONTEND_ENABLED && frontend == "named_pipe") {
-			client = tool::connect_named_pipe(named_pipe_frontend_path);
-		} else {
-			LogMessage(Fatal, "unrecognized frontend: %s", frontend.c_str());
-			return 1;
-		}
-		if(!client) {
-			return 1;
-		}
-	
-		tool::ITwibMetaInterface itmi(tool::RemoteObject(*client, 0, 0));
-	
-		if(ld->parsed()) {
-			ListDevices(itmi);
+		if(cmd_stats->parsed()) {
+			PrintStats(session.itmi, output.out);
 			return 0;
 		}
 
 		if(cmd_connect_tcp->parsed()) {
-			printf("%s\n", itmi.ConnectTcp(connect_tcp_hostname, connect_tcp_port).c_str());
+			fprintf(output.out, "%s\n", session.itmi.ConnectTcp(connect_tcp_hostname, connect_tcp_port).c_str());
 			return 0;
 		}
 
 		uint32_t device_id;
-		if(device_id_str.size() > 0) {
-			device_id = std::stoul(device_id_str, NULL, 16);
-		} else {
-			std::vector<msgpack11::MsgPack> devices = itmi.ListDevices();
-			if(devices.size() == 0) {
-				LogMessage(Fatal, "No devices were detected.");
-				return 1;
-			}
-			if(devices.size() > 1) {
-				LogMessage(Fatal, "Multiple devices were detected. Please use -d to specify which one you mean.");
-				return 1;
-			}
-			device_id = devices[0]["device_id"].uint32_value();
+		tool::ITwibDeviceInterface *device = session.GetDevice(device_id);
+		if(!device) {
+			return 1;
 		}
-		tool::ITwibDeviceInterface itdi(std::make_shared<tool::RemoteObject>(*client, device_id, 0));
+		tool::ITwibDeviceInterface &itdi = *device;
 	
 		if(run->parsed()) {
 			auto code_opt = util::ReadFile(run_file.c_str());
@@ -667,44 +756,22 @@ int main(int argc, char *argv[]) {
 			mon.AppendCode(*code_opt);
 			uint64_t pid = run_suspend ? mon.LaunchSuspended() : mon.Launch();
 			if(!run_quiet) {
-				printf("PID: 0x%" PRIx64"\n", pid);
-			}
-			auto pump_output =
-				[](tool::ITwibPipeReader reader, FILE *stream) {
-					try {
-						while(true) {
-							std::vector<uint8_t> str = reader.ReadSync();
-							size_t r = fwrite(str.data(), sizeof(str[0]), str.size(), stream);
-							if(r < str.size() && str.size() > 0) {
-								throw std::system_error(errno, std::generic_category());
-							}
-							fflush(stream);
-						}
-					} catch(ResultError &e) {
-						LogMessage(Debug, "output pump got 0x%x", e.code);
-						if(e.code == TWILI_ERR_EOF) {
-							LogMessage(Debug, "  EoF");
-							return;
-						} else {
-							e.Die();
-						}
-					}
-				};
-			std::thread stdout_pump(pump_output, mon.OpenStdout(), stdout);
-			std::thread stderr_pump(pump_output, mon.OpenStderr(), stderr);
+				printf("%sPID: 0x%" PRIx64"\n", output.prefix.c_str(), pid);
+			}
+			tool::PipePump output_pump(PipeReadWindow(itdi));
+			output_pump.Add(mon.OpenStdout(), stdout, output.prefix);
+			output_pump.Add(mon.OpenStderr(), stderr, output.prefix);
 
 			class Logic : public platform::EventLoop::Logic {
 			 public:
-				Logic(std::function<void(platform::EventLoop&)> f) : f(f) {
-				}
-				virtual void Prepare(platform::EventLoop &loop) override {
-					f(loop);
+				virtual void Prepare(platform::EventLoop &) override {
 				};
-			 private:
-				std::function<void(platform::EventLoop&)> f;
 			};
 
 			tool::ITwibPipeWriter r = mon.OpenStdin();
+			if(!forward_stdin) {
+				r.Close();
+			}
 			platform::InputPump input_pump(4096,
 																		 [&r](std::vector<uint8_t> &data) {
 																			 r.WriteSync(data);
@@ -712,24 +779,21 @@ int main(int argc, char *argv[]) {
 																			 r.Close();
 																		 });
 		
-			Logic logic(
-				[&](platform::EventLoop &l) {
-					l.Clear();
-					l.AddMember(input_pump);
-				});
+			Logic logic;
 			platform::EventLoop stdin_loop(logic);
+			if(forward_stdin) {
+				stdin_loop.AddMember(input_pump);
+			}
 			stdin_loop.Begin();
 		
-			stdout_pump.join();
-			stderr_pump.join();
-			LogMessage(Debug, "output pump threads exited");
-			try {
-				uint32_t state;
-				while((state = mon.WaitStateChange()) != 6) {
-					LogMessage(Debug, "  state %d change...", state);
-				}
-			} catch(ResultError &e) {
-				e.Die();
+			// errors propagate instead of dying here so that batch mode,
+			// shell and --all can carry on with their other commands;
+			// stdin_loop's destructor stops the input thread on the way out
+			output_pump.Run();
+			LogMessage(Debug, "output pump exited");
+			uint32_t state;
+			while((state = mon.WaitStateChange()) != 6) {
+				LogMessage(Debug, "  state %d change...", state);
 			}
 			LogMessage(Debug, "  process exited");
 			stdin_loop.Destroy();
@@ -746,6 +810,51 @@ int main(int argc, char *argv[]) {
 		}
 
 		if(coredump->parsed()) {
+			if(output.shared) {
+				LogMessage(Error, "coredump can't be used on several devices at once");
+				return 1;
+			}
+			protocol::CoreDumpFilter filter;
+			filter.memory_types = 0;
+			filter.permissions = 0;
+			filter.flags = core_no_sparse ? 0 : (uint32_t) protocol::CoreDumpFilter::SKIP_ZERO_PAGES;
+			filter.max_region_size = core_max_region_mib * 1024 * 1024;
+			if(core_types.empty()) {
+				core_types.push_back("all");
+			}
+			for(std::string &type : core_types) {
+				uint64_t mask = tool::CoreDumpMemoryTypes(type);
+				if(!mask) {
+					LogMessage(Fatal, "unknown memory type '%s'", type.c_str());
+					return 1;
+				}
+				filter.memory_types|= mask;
+			}
+
+			std::optional<tool::ITwibFileAccessor> dump;
+			try {
+				dump = itdi.OpenCoreDump(core_process_id, filter);
+			} catch(ResultError &e) {
+				if(e.code != TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+					throw;
+				}
+				LogMessage(Warning, "device can't stream core dumps; falling back to an unfiltered dump");
+			}
+
+			if(dump) {
+				platform::File f;
+				try {
+					f = platform::File::OpenForClobberingWrite(core_file.c_str());
+				} catch(std::exception &e) {
+					LogMessage(Fatal, "could not open '%s': %s", core_file.c_str(), e.what());
+					return 1;
+				}
+				uint64_t size = dump->GetSize();
+				tool::FileTransfer transfer(core_window, 0x40000, 1);
+				transfer.AddPull(std::move(*dump), std::move(f), size, "core", core_file);
+				return transfer.Run() ? 0 : 1;
+			}
+
 			FILE *f = fopen(core_file.c_str(), "wb");
 			if(!f) {
 				LogMessage(Fatal, "could not open '%s': %s", core_file.c_str(), strerror(errno));
@@ -756,7 +865,8 @@ int main(int argc, char *argv[]) {
 			while(written < core.size()) {
 				ssize_t r = fwrite(core.data() + written, 1, core.size() - written, f);
 				if(r <= 0 || ferror(f)) {
-					LogMessage(Fatal, "write error on '%s'");
+					LogMessage(Fatal, "write error on '%s'", core_file.c_str());
+					return 1;
 				} else {
 					written+= r;
 				}
@@ -770,36 +880,28 @@ int main(int argc, char *argv[]) {
 		}
 
 		if(ps->parsed()) {
-			ListProcesses(itdi);
+			ListProcesses(itdi, output.out);
 			return 0;
 		}
 
 		if(identify->parsed()) {
-			show(itdi.Identify());
+			std::ostringstream text;
+			show(itdi.Identify(), text);
+			fputs(text.str().c_str(), output.out);
 			return 0;
 		}
 
 		if(list_named_pipes->parsed()) {
 			for(auto n : itdi.ListNamedPipes()) {
-				printf("%s\n", n.c_str());
+				fprintf(output.out, "%s\n", n.c_str());
 			}
 			return 0;
 		}
 
 		if(open_named_pipe->parsed()) {
-			auto reader = itdi.OpenNamedPipe(open_named_pipe_name);
-			try {
-				while(true) {
-					std::vector<uint8_t> str = reader.ReadSync();
-					std::cout << std::string(str.begin(), str.end());
-				}
-			} catch(ResultError &e) {
-				if(e.code == TWILI_ERR_EOF) {
-					return 0;
-				} else {
-					throw e;
-				}
-			}
+			tool::PipePump pump(PipeReadWindow(itdi));
+			pump.Add(itdi.OpenNamedPipe(open_named_pipe_name), stdout, output.prefix);
+			pump.Run();
 			return 0;
 		}
 
@@ -808,7 +910,8 @@ int main(int argc, char *argv[]) {
 			uint64_t total_memory_available = meminfo["total_memory_available"].uint64_value();
 			uint64_t total_memory_usage     = meminfo["total_memory_usage"    ].uint64_value();
 			const size_t one_mib = 1024 * 1024;
-			printf(
+			fprintf(
+				output.out,
 				"Twili Memory: %" PRIu64" MiB / %" PRIu64" MiB (%" PRIu64"%%)\n",
 				total_memory_usage / one_mib,
 				total_memory_available / one_mib,
@@ -816,7 +919,8 @@ int main(int argc, char *argv[]) {
 
 			std::vector<const char*> category_labels = {"System", "Application", "Applet"};
 			for(auto &cat_info : meminfo["limits"].array_items()) {
-				printf(
+				fprintf(
+					output.out,
 					"%s Category Limit: %" PRIu64" MiB / %" PRIu64" MiB (%" PRIu64"%%)\n",
 					category_labels[cat_info["category"].int_value()],
 					cat_info["current_value"].uint64_value() / one_mib,
@@ -851,7 +955,7 @@ int main(int argc, char *argv[]) {
 
 			uint64_t title_id = std::stoull(launch_title_id, nullptr, 16);
 
-			printf("0x%" PRIx64"\n", itdi.LaunchUnmonitoredProcess(title_id, storage_id, launch_flags));
+			fprintf(output.out, "0x%" PRIx64"\n", itdi.LaunchUnmonitoredProcess(title_id, storage_id, launch_flags));
 		}
 
 #if TWIB_GDB_ENABLED == 1
@@ -862,26 +966,26 @@ int main(int argc, char *argv[]) {
 		}
 #endif
 
-		if(sd_commands.subcommand->parsed()) {
-			return sd_commands.Run(itdi);
+		if(sd_commands->subcommand->parsed()) {
+			return sd_commands->Run(itdi, device_id, output);
 		}
 
-		if(nand_user_commands.subcommand->parsed()) {
-			return nand_user_commands.Run(itdi);
+		if(nand_user_commands->subcommand->parsed()) {
+			return nand_user_commands->Run(itdi, device_id, output);
 		}
 
-		if(nand_system_commands.subcommand->parsed()) {
-			return nand_system_commands.Run(itdi);
+		if(nand_system_commands->subcommand->parsed()) {
+			return nand_system_commands->Run(itdi, device_id, output);
 		}
 
 		if(get_module_info->parsed()) {
 			auto debugger = itdi.OpenActiveDebugger(get_module_info_process_id);
 			for(auto info : debugger.GetNsoInfos()) {
-				printf("module ");
+				fprintf(output.out, "module ");
 				for(int i = 0; i < 0x20; i++) {
-					printf("%02x", info.build_id[i]);
+					fprintf(output.out, "%02x", info.build_id[i]);
 				}
-				printf(": loaded at 0x%lx,  +0x%lx\n", info.base_addr, info.size);
+				fprintf(output.out, ": loaded at 0x%lx,  +0x%lx\n", info.base_addr, info.size);
 			}
 			return 0;
 		}
@@ -909,11 +1013,11 @@ int main(int argc, char *argv[]) {
 			{
 				uint32_t module = result & 511;
 				uint32_t code = result >> 9;
-				printf("Result %04d-%04d (0x%x):\n", module + 2000, code, result);
-				printf("  Name: %s\n", desc.name);
-				printf("  Description: %s\n", desc.description);
+				fprintf(output.out, "Result %04d-%04d (0x%x):\n", module + 2000, code, result);
+				fprintf(output.out, "  Name: %s\n", desc.name);
+				fprintf(output.out, "  Description: %s\n", desc.description);
 				if(desc.help) {
-					printf("  Help: %s\n", desc.help);
+					fprintf(output.out, "  Help: %s\n", desc.help);
 				}
 				const char *visibility = nullptr;
 				switch(desc.visibility) {
@@ -923,14 +1027,481 @@ int main(int argc, char *argv[]) {
 				default:
 					visibility = "Invalid";
 				}
-				printf("  Visibility: %s\n", visibility);
+				fprintf(output.out, "  Visibility: %s\n", visibility);
+			}
+		}
+		return 0;
+	}
+
+	CLI::App *ld;
+
+	CLI::App *cmd_stats;
+
+	CLI::App *cmd_connect_tcp;
+	std::string connect_tcp_hostname;
+	std::string connect_tcp_port = "15152";
+
+	CLI::App *run;
+	std::string run_file;
+	bool run_applet = false;
+	bool run_shell = false;
+	bool run_suspend = false;
+	bool run_quiet = false;
+
+	CLI::App *reboot;
+	bool reboot_unsafe;
+
+	CLI::App *coredump;
+	std::string core_file;
+	uint64_t core_process_id;
+	std::vector<std::string> core_types;
+	uint64_t core_max_region_mib = 0;
+	bool core_no_sparse = false;
+	size_t core_window = 8;
+
+	CLI::App *terminate;
+	uint64_t terminate_process_id;
+
+	CLI::App *ps;
+
+	CLI::App *identify;
+
+	CLI::App *list_named_pipes;
+
+	CLI::App *open_named_pipe;
+	std::string open_named_pipe_name;
+
+	CLI::App *get_memory_info;
+
+	CLI::App *print_debug_info;
+
+#if TWIB_GDB_ENABLED == 1
+	CLI::App *gdb;
+#endif
+
+	CLI::App *launch;
+	std::string launch_title_id;
+	std::string launch_storage;
+	uint32_t launch_flags = 0;
+
+	std::optional<FSCommands> sd_commands;
+	std::optional<FSCommands> nand_user_commands;
+	std::optional<FSCommands> nand_system_commands;
+
+	CLI::App *get_module_info;
+	uint64_t get_module_info_process_id;
+
+	CLI::App *lookup_error;
+	bool lookup_error_decimal = false;
+	std::string lookup_error_code;
+};
+
+// Splits a line into arguments the way a shell would, without any
+// expansion. Returns std::nullopt if a quote is left open.
+static std::optional<std::vector<std::string>> SplitCommandLine(const std::string &line) {
+	std::vector<std::string> args;
+	std::string arg;
+	bool in_arg = false;
+	char quote = 0;
+	for(size_t i = 0; i < line.size(); i++) {
+		char c = line[i];
+		if(quote) {
+			if(c == quote) {
+				quote = 0;
+			} else if(c == '\\' && quote == '"' && i + 1 < line.size()) {
+				arg.push_back(line[++i]);
+			} else {
+				arg.push_back(c);
+			}
+		} else if(c == '\'' || c == '"') {
+			quote = c;
+			in_arg = true;
+		} else if(c == '\\' && i + 1 < line.size()) {
+			arg.push_back(line[++i]);
+			in_arg = true;
+		} else if(c == '#' && !in_arg) {
+			break;
+		} else if(isspace((unsigned char) c)) {
+			if(in_arg) {
+				args.push_back(std::move(arg));
+				arg.clear();
+				in_arg = false;
+			}
+		} else {
+			arg.push_back(c);
+			in_arg = true;
+		}
+	}
+	if(quote) {
+		return std::nullopt;
+	}
+	if(in_arg) {
+		args.push_back(std::move(arg));
+	}
+	return args;
+}
+
+static int RunBatchCommand(tool::Session &session, std::vector<std::string> args, bool timings, CommandOutput output = CommandOutput()) {
+	std::string display = output.prefix;
+	for(std::string &arg : args) {
+		display+= (display.size() == output.prefix.size() ? "" : " ") + arg;
+	}
+	
+	auto start = std::chrono::steady_clock::now();
+	int r = 1;
+	
+	CLI::App app {"Twili debug monitor client"};
+	Commands commands(app);
+	app.require_subcommand(1);
+
+	std::string program_name = "twib";
+	std::vector<char*> argv;
+	argv.push_back(program_name.data());
+	for(std::string &arg : args) {
+		argv.push_back(arg.data());
+	}
+
+	try {
+		app.parse(argv.size(), argv.data());
+#if TWIB_GDB_ENABLED == 1
+		if(commands.gdb->parsed()) {
+			throw std::runtime_error("gdb can't be used in batch mode");
+		}
+#endif
+		r = commands.Run(session, false, output);
+	} catch(const CLI::ParseError &e) {
+		r = app.exit(e);
+	} catch(ResultError &e) {
+		LogMessage(Error, "%s: caught 0x%x (%s)", display.c_str(), e.code, e.what());
+	} catch(std::exception &e) {
+		LogMessage(Error, "%s: %s", display.c_str(), e.what());
+	}
+
+	if(timings) {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		fprintf(stderr, "[%9.3f ms] %s%s\n", ms, display.c_str(), r ? " (failed)" : "");
+	}
+	
+	return r;
+}
+
+// Runs commands read from `in`, one per line, over a single connection to
+// twibd. A line ending in " &" is run in the background so that independent
+// commands can have their requests in flight at the same time, and "wait"
+// waits for all of the background commands to finish.
+static int RunBatch(tool::Session &session, std::istream &in, bool interactive, bool keep_going, bool timings) {
+	std::list<std::future<int>> background;
+	bool failed = false;
+
+	auto wait_background = [&]() {
+		for(std::future<int> &f : background) {
+			if(f.get()) {
+				failed = true;
+			}
+		}
+		background.clear();
+	};
+	
+	std::string line;
+	size_t line_number = 0;
+	while(!failed || keep_going) {
+		if(interactive) {
+			printf("twib> ");
+			fflush(stdout);
+		}
+		if(!std::getline(in, line)) {
+			break;
+		}
+		line_number++;
+		
+		std::optional<std::vector<std::string>> args = SplitCommandLine(line);
+		if(!args) {
+			LogMessage(Error, "line %zu: unterminated quote", line_number);
+			failed = true;
+			continue;
+		}
+
+		bool in_background = !args->empty() && args->back() == "&";
+		if(in_background) {
+			args->pop_back();
+		}
+		if(args->empty()) {
+			continue;
+		}
+
+		if((*args)[0] == "wait") {
+			wait_background();
+		} else if((*args)[0] == "exit" || (*args)[0] == "quit") {
+			break;
+		} else if(in_background) {
+			background.push_back(std::async(std::launch::async, RunBatchCommand, std::ref(session), std::move(*args), timings, CommandOutput()));
+		} else if(RunBatchCommand(session, std::move(*args), timings)) {
+			failed = true;
+		}
+	}
+	wait_background();
+	
+	return failed ? 1 : 0;
+}
+
+// Copies everything written to `buffer` to stdout, with `prefix` at the start
+// of each line. Each line goes out in one write so that it can't be split up
+// by process output being streamed from other devices at the same time.
+static void EmitPrefixed(FILE *buffer, const std::string &prefix) {
+	rewind(buffer);
+	std::string line = prefix;
+	char chunk[512];
+	while(fgets(chunk, sizeof(chunk), buffer)) {
+		line+= chunk;
+		if(line.back() == '\n') {
+			fwrite(line.data(), 1, line.size(), stdout);
+			line = prefix;
+		}
+	}
+	if(line.size() > prefix.size()) {
+		line.push_back('\n');
+		fwrite(line.data(), 1, line.size(), stdout);
+	}
+	fflush(stdout);
+}
+
+// Runs one command on several devices at once over a single connection to
+// twibd, the same way a background batch command would. See CommandOutput
+// for where each device's output goes; buffered output is printed in device
+// order as the commands finish. Fails if the command failed on any of the
+// devices.
+static int RunOnDevices(tool::client::Client &client, std::vector<uint32_t> device_ids, std::vector<std::string> args) {
+	struct DeviceRun {
+		uint32_t device_id;
+		CommandOutput output;
+		std::future<int> result;
+	};
+	
+	std::list<tool::Session> sessions;
+	std::list<DeviceRun> runs;
+	for(uint32_t device_id : device_ids) {
+		std::string id = tool::ToHex(device_id, 8, false);
+		CommandOutput output;
+		output.out = tmpfile();
+		output.prefix = "[" + id + "] ";
+		output.shared = true;
+		if(!output.out) {
+			LogMessage(Error, "[%s] could not create output buffer: %s", id.c_str(), strerror(errno));
+			runs.push_back({device_id, output, std::future<int>()});
+			continue;
+		}
+		tool::Session &session = sessions.emplace_back(client, id);
+		runs.push_back({device_id, output, std::async(std::launch::async, RunBatchCommand, std::ref(session), args, false, output)});
+	}
+
+	size_t failures = 0;
+	for(DeviceRun &run : runs) {
+		int r = 1;
+		if(run.output.out) {
+			r = run.result.get();
+			EmitPrefixed(run.output.out, run.output.prefix);
+			fclose(run.output.out);
+		}
+		if(r) {
+			LogMessage(Error, "[%08x] failed", run.device_id);
+			failures++;
+		}
+	}
+	if(failures) {
+		LogMessage(Error, "failed on %zu of %zu devices", failures, runs.size());
+	}
+	return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+#ifdef _WIN32
+	WSADATA wsaData;
+	int err;
+	err = WSAStartup(MAKEWORD(2, 2), &wsaData);
+	if (err != 0) {
+		printf("WSAStartup failed with error: %d\n", err);
+		return 1;
+	}
+#endif
+
+	CLI::App app {"Twili debug monitor client"};
+
+	std::string device_id_str;
+	app.add_option("-d,--device", device_id_str, "Use a specific device")
+		->type_name("DeviceId")
+		->envname("TWIB_DEVICE");
+
+	bool all_devices = false;
+	app.add_flag("-a,--all", all_devices, "Run the command on every device at once");
+
+	std::string devices_str;
+	app.add_option("--devices", devices_str, "Run the command on each of a comma-separated list of devices at once")
+		->type_name("DeviceId,...");
+
+	bool is_verbose;
+	app.add_flag("-v,--verbose", is_verbose, "Enable debug logging");
+
+	std::string frontend;
+	std::string unix_frontend_path = TWIB_UNIX_FRONTEND_DEFAULT_PATH;
+	uint16_t tcp_frontend_port = TWIB_TCP_FRONTEND_DEFAULT_PORT;
+	std::string named_pipe_frontend_path = TWIB_NAMED_PIPE_FRONTEND_DEFAULT_NAME;
+	
+#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
+	frontend = "named_pipe";
+#elif TWIB_UNIX_FRONTEND_ENABLED == 1
+	frontend = "unix";
+#else
+	frontend = "tcp";
+#endif
+	
+	app.add_set("-f,--frontend", frontend, {
+#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
+			"named_pipe",
+#endif
+#if TWIB_UNIX_FRONTEND_ENABLED == 1
+			"unix",
+#endif
+#if TWIB_TCP_FRONTEND_ENABLED == 1
+			"tcp",
+#endif
+		})->envname("TWIB_FRONTEND");
+
+#if TWIB_UNIX_FRONTEND_ENABLED == 1
+	app.add_option(
+		"-P,--unix-path", unix_frontend_path,
+		"Path to the twibd UNIX socket")
+		->envname("TWIB_UNIX_FRONTEND_PATH");
+#endif
+
+#if TWIB_TCP_FRONTEND_ENABLED == 1
+	app.add_option(
+		"-p,--tcp-port", tcp_frontend_port,
+		"Port for the twibd TCP socket")
+		->envname("TWIB_TCP_FRONTEND_PORT");
+#endif
+
+#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
+	app.add_option(
+		"-n,--pipe-name", named_pipe_frontend_path,
+		"Named for the twibd pipe")
+		->envname("TWIB_NAMED_PIPE_FRONTEND_NAME");
+#endif
+	
+	Commands commands(app);
+
+	CLI::App *batch = app.add_subcommand("batch", "Run commands from a file or standard input over one connection");
+	std::string batch_file;
+	bool batch_keep_going = false;
+	bool batch_no_timings = false;
+	batch->add_option("file", batch_file, "File to read commands from, instead of standard input");
+	batch->add_flag("-k,--keep-going", batch_keep_going, "Keep going after a command fails");
+	batch->add_flag("--no-timings", batch_no_timings, "Don't print how long each command took");
+
+	CLI::App *shell = app.add_subcommand("shell", "Run commands interactively over one connection");
+	
+	app.require_subcommand(1);
+	
+	try {
+		app.parse(argc, argv);
+	} catch(const CLI::ParseError &e) {
+		return app.exit(e);
+	}
+
+	log::init_color();
+	if(is_verbose) {
+#if TWIB_GDB_ENABLED == 1
+		if(commands.gdb->parsed()) {
+			// for gdb stub, all logging should go to stderr
+			log::add_log(std::make_shared<log::PrettyFileLogger>(stderr, log::Level::Debug, log::Level::Error));
+#else
+		if(false) {
+#endif
+		} else {
+			log::add_log(std::make_shared<log::PrettyFileLogger>(stdout, log::Level::Debug, log::Level::Error));
+		}
+	}
+	log::add_log(std::make_shared<log::PrettyFileLogger>(stderr, log::Level::Error));
+	
+	LogMessage(Message, "starting twib");
+
+	try {
+	
+		std::unique_ptr<tool::client::Client> client;
+		if(TWIB_UNIX_FRONTEND_ENABLED && frontend == "unix") {
+			client = tool::connect_unix(unix_frontend_path);
+		} else if(TWIB_TCP_FRONTEND_ENABLED && frontend == "tcp") {
+			client = tool::connect_tcp(tcp_frontend_port);
+		} else if(TWIB_NAMED_PIPE_FRONTEND_ENABLED && frontend == "named_pipe") {
+			client = tool::connect_named_pipe(named_pipe_frontend_path);
+		} else {
+			LogMessage(Fatal, "unrecognized frontend: %s", frontend.c_str());
+			return 1;
+		}
+		if(!client) {
+			return 1;
+		}
+	
+
+		tool::Session session(*client, device_id_str);
+
+		if(all_devices || devices_str.size() > 0) {
+			if(all_devices && devices_str.size() > 0) {
+				LogMessage(Fatal, "--all and --devices can't be used together");
+				return 1;
+			}
+			if(batch->parsed() || shell->parsed()) {
+				LogMessage(Fatal, "--all and --devices can't be used with batch or shell");
+				return 1;
+			}
+
+			std::vector<uint32_t> device_ids;
+			if(all_devices) {
+				for(msgpack11::MsgPack &device : session.itmi.ListDevices()) {
+					device_ids.push_back(device["device_id"].uint32_value());
+				}
+				if(device_ids.empty()) {
+					LogMessage(Fatal, "No devices were detected.");
+					return 1;
+				}
+			} else {
+				std::stringstream stream(devices_str);
+				std::string id;
+				while(std::getline(stream, id, ',')) {
+					if(id.size() > 0) {
+						device_ids.push_back(std::stoul(id, NULL, 16));
+					}
+				}
+			}
+
+			// hand everything from the subcommand onwards to each device
+			std::string subcommand_name = app.get_subcommands().front()->get_name();
+			int first = 1;
+			while(first < argc && subcommand_name != argv[first]) {
+				first++;
 			}
+			return RunOnDevices(*client, device_ids, std::vector<std::string>(argv + first, argv + argc));
 		}
+
+		if(batch->parsed()) {
+			if(batch_file.size() > 0 && batch_file != "-") {
+				std::ifstream file(batch_file);
+				if(!file) {
+					LogMessage(Fatal, "could not open '%s'", batch_file.c_str());
+					return 1;
+				}
+				return RunBatch(session, file, false, batch_keep_going, !batch_no_timings);
+			}
+			return RunBatch(session, std::cin, false, batch_keep_going, !batch_no_timings);
+		}
+
+		if(shell->parsed()) {
+			return RunBatch(session, std::cin, true, true, true);
+		}
+
+		return commands.Run(session, true);
 	} catch(ResultError &e) {
 		e.Die();
 	}
-	
-	return 0;
 }
 
 namespace twili {
@@ -74,6 +74,51 @@ std::vector<uint8_t> ITwibDebugger::ReadMemory(uint64_t addr, uint64_t size) {
 	return bytes;
 }
 
+std::vector<std::pair<uint32_t, std::vector<uint8_t>>> ITwibDebugger::ReadMemoryV(const std::vector<protocol::MemoryRange> &ranges) {
+	std::vector<std::pair<uint32_t, std::vector<uint8_t>>> results;
+	results.reserve(ranges.size());
+	
+	LogMessage(Debug, "ITwibDebugger::ReadMemoryV(%ld ranges)", ranges.size());
+
+	for(auto i = ranges.begin(); i != ranges.end(); ) {
+		// split into batches that the device will accept
+		std::vector<protocol::MemoryRange> batch;
+		uint64_t batch_size = 0;
+		do {
+			batch_size+= i->size;
+			batch.push_back(*i++);
+		} while(i != ranges.end() && i->size <= protocol::ITwibDebugger::READ_MEMORY_V_MAX_SIZE - batch_size);
+
+		std::vector<uint32_t> codes;
+		std::vector<uint8_t> data;
+		obj->SendSmartSyncRequest(
+			CommandID::READ_MEMORY_V,
+			in<std::vector<protocol::MemoryRange>>(batch),
+			out<std::vector<uint32_t>>(codes),
+			out<std::vector<uint8_t>>(data));
+
+		if(codes.size() != batch.size()) {
+			throw ResultError(TWILI_ERR_PROTOCOL_BAD_RESPONSE);
+		}
+		size_t offset = 0;
+		for(size_t j = 0; j < batch.size(); j++) {
+			if(codes[j] != 0) {
+				results.emplace_back(codes[j], std::vector<uint8_t>());
+				continue;
+			}
+			if(batch[j].size > data.size() - offset) {
+				throw ResultError(TWILI_ERR_PROTOCOL_BAD_RESPONSE);
+			}
+			results.emplace_back(0, std::vector<uint8_t>(data.begin() + offset, data.begin() + offset + batch[j].size));
+			offset+= batch[j].size;
+		}
+	}
+
+	LogMessage(Debug, "  => OK");
+	
+	return results;
+}
+
 void ITwibDebugger::WriteMemory(uint64_t addr, std::vector<uint8_t> &bytes) {
 	LogMessage(Debug, "ITwibDebugger::WriteMemory(0x%lx, 0x%lx)", bytes.size());
 	
@@ -50,6 +50,10 @@ class ITwibDebugger {
 
 	std::tuple<nx::MemoryInfo, nx::PageInfo> QueryMemory(uint64_t addr);
 	std::vector<uint8_t> ReadMemory(uint64_t addr, uint64_t size);
+	// Reads several ranges in as few requests as possible. Each range gets
+	// its own result code; data is only filled in for ranges that read
+	// successfully. Throws if the device doesn't support READ_MEMORY_V.
+	std::vector<std::pair<uint32_t, std::vector<uint8_t>>> ReadMemoryV(const std::vector<protocol::MemoryRange> &ranges);
 	void WriteMemory(uint64_t addr, std::vector<uint8_t> &bytes);
 	std::optional<nx::DebugEvent> GetDebugEvent();
 	ThreadContext GetThreadContext(uint64_t thread_id);
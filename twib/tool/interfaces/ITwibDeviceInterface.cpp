@@ -55,6 +55,16 @@ std::vector<uint8_t> ITwibDeviceInterface::CoreDump(uint64_t process_id) {
 	return dump;
 }
 
+ITwibFileAccessor ITwibDeviceInterface::OpenCoreDump(uint64_t process_id, protocol::CoreDumpFilter filter) {
+	std::optional<ITwibFileAccessor> dump;
+	obj->SendSmartSyncRequest(
+		CommandID::OPEN_CORE_DUMP,
+		in<uint64_t>(process_id),
+		in<protocol::CoreDumpFilter>(filter),
+		out_object<ITwibFileAccessor>(dump));
+	return *dump;
+}
+
 void ITwibDeviceInterface::Terminate(uint64_t process_id) {
 	uint8_t *process_id_bytes = (uint8_t*) &process_id;
 	obj->SendSmartSyncRequest(
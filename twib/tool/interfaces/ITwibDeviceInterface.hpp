@@ -52,6 +52,8 @@ class ITwibDeviceInterface {
 	ITwibProcessMonitor CreateMonitoredProcess(std::string type);
 	void Reboot();
 	std::vector<uint8_t> CoreDump(uint64_t process_id);
+	// The returned object only supports Read, ReadAsync, and GetSize.
+	ITwibFileAccessor OpenCoreDump(uint64_t process_id, protocol::CoreDumpFilter filter);
 	void Terminate(uint64_t process_id);
 	std::vector<ProcessListEntry> ListProcesses();
 	msgpack11::MsgPack Identify();
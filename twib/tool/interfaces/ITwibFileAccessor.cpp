@@ -21,6 +21,7 @@
 #include "ITwibFileAccessor.hpp"
 
 #include "Protocol.hpp"
+#include "err.hpp"
 
 #include<cstring>
 
@@ -63,6 +64,50 @@ size_t ITwibFileAccessor::GetSize() {
 	return size;
 }
 
+std::vector<uint64_t> ITwibFileAccessor::HashBlocks(uint64_t offset, uint64_t block_size, uint64_t block_count) {
+	std::vector<uint64_t> hashes;
+	obj->SendSmartSyncRequest(
+		CommandID::HASH_BLOCKS,
+		in<uint64_t>(offset),
+		in<uint64_t>(block_size),
+		in<uint64_t>(block_count),
+		out<std::vector<uint64_t>>(hashes));
+	return hashes;
+}
+
+void ITwibFileAccessor::ReadAsync(uint64_t offset, uint64_t size, std::function<void(uint32_t, std::vector<uint8_t>)> &&cb) {
+	util::Buffer input_buffer;
+	input_buffer.Write<uint64_t>(offset);
+	input_buffer.Write<uint64_t>(size);
+	obj->SendRequest(
+		(uint32_t) CommandID::READ,
+		input_buffer.GetData(),
+		[cb{std::move(cb)}](Response r) {
+			std::vector<uint8_t> vec;
+			if(r.result_code) {
+				cb(r.result_code, std::move(vec));
+				return;
+			}
+			util::Buffer output_buffer(std::move(r.payload));
+			if(!detail::PackingHelper<std::vector<uint8_t>>::Unpack(std::move(vec), output_buffer)) {
+				cb(TWILI_ERR_PROTOCOL_BAD_RESPONSE, std::vector<uint8_t>());
+				return;
+			}
+			cb(0, std::move(vec));
+		});
+}
+
+void ITwibFileAccessor::WriteAsync(uint64_t offset, std::vector<uint8_t> &&vec, std::function<void(uint32_t)> &&cb) {
+	util::Buffer input_buffer;
+	input_buffer.Write<uint64_t>(offset);
+	detail::PackingHelper<std::vector<uint8_t>>::Pack(std::move(vec), input_buffer);
+	obj->SendRequest(
+		(uint32_t) CommandID::WRITE,
+		input_buffer.GetData(),
+		[cb{std::move(cb)}](Response r) {
+			cb(r.result_code);
+		});
+}
 
 } // namespace tool
 } // namespace twib
@@ -23,6 +23,7 @@
 #include<vector>
 #include<optional>
 #include<tuple>
+#include<functional>
 
 #include "../RemoteObject.hpp"
 
@@ -41,6 +42,15 @@ class ITwibFileAccessor {
 	void Flush();
 	void SetSize(size_t size);
 	size_t GetSize();
+	// Hashes up to block_count blocks starting at offset with
+	// util::HashBlock. The last block may be short; nothing is returned
+	// for blocks past the end of the file.
+	std::vector<uint64_t> HashBlocks(uint64_t offset, uint64_t block_size, uint64_t block_count);
+
+	// These don't wait for a response. The callback is invoked on the
+	// client's event thread with the result code.
+	void ReadAsync(uint64_t offset, uint64_t size, std::function<void(uint32_t, std::vector<uint8_t>)> &&cb);
+	void WriteAsync(uint64_t offset, std::vector<uint8_t> &&vec, std::function<void(uint32_t)> &&cb);
 
  private:
 	std::shared_ptr<RemoteObject> obj;
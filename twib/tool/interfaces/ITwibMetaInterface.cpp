@@ -47,6 +47,14 @@ std::string ITwibMetaInterface::ConnectTcp(std::string hostname, std::string por
 	return message;
 }
 
+msgpack11::MsgPack ITwibMetaInterface::GetMetrics() {
+	msgpack11::MsgPack ret;
+	obj.SendSmartSyncRequest(
+		CommandID::GET_METRICS,
+		out(ret));
+	return ret;
+}
+
 } // namespace tool
 } // namespace twib
 } // namespace twili
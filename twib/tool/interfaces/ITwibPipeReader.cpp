@@ -21,6 +21,7 @@
 #include "ITwibPipeReader.hpp"
 
 #include "Protocol.hpp"
+#include "err.hpp"
 
 namespace twili {
 namespace twib {
@@ -38,6 +39,25 @@ std::vector<uint8_t> ITwibPipeReader::ReadSync() {
 	return data;
 }
 
+void ITwibPipeReader::ReadAsync(std::function<void(uint32_t, std::vector<uint8_t>)> &&cb) {
+	obj->SendRequest(
+		(uint32_t) CommandID::READ,
+		std::vector<uint8_t>(),
+		[cb{std::move(cb)}](Response r) {
+			std::vector<uint8_t> vec;
+			if(r.result_code) {
+				cb(r.result_code, std::move(vec));
+				return;
+			}
+			util::Buffer output_buffer(std::move(r.payload));
+			if(!detail::PackingHelper<std::vector<uint8_t>>::Unpack(std::move(vec), output_buffer)) {
+				cb(TWILI_ERR_PROTOCOL_BAD_RESPONSE, std::vector<uint8_t>());
+				return;
+			}
+			cb(0, std::move(vec));
+		});
+}
+
 } // namespace tool
 } // namespace twib
 } // namespace twili
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include<functional>
 #include<vector>
 
 #include "../RemoteObject.hpp"
@@ -35,6 +36,8 @@ class ITwibPipeReader {
 	using CommandID = protocol::ITwibPipeReader::Command;
 	
 	std::vector<uint8_t> ReadSync();
+	// Callback runs on the client's thread.
+	void ReadAsync(std::function<void(uint32_t, std::vector<uint8_t>)> &&cb);
  private:
 	std::shared_ptr<RemoteObject> obj;
 };
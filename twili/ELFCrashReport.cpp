@@ -23,6 +23,7 @@
 #include<libtransistor/cpp/svc.hpp>
 #include<libtransistor/util.h>
 
+#include<algorithm>
 #include<vector>
 #include<string>
 
@@ -36,10 +37,6 @@ namespace twili {
 ELFCrashReport::ELFCrashReport() {
 }
 
-void ELFCrashReport::AddVMA(uint64_t virtual_addr, uint64_t size, uint32_t flags) {
-	vmas.push_back({0, virtual_addr, size, flags});
-}
-
 void ELFCrashReport::AddNote(std::string name, uint32_t type, std::vector<uint8_t> desc) {
 	std::vector<uint8_t> name_vec(name.begin(), name.end());
 	while(name_vec.size() % 4 != 0) {
@@ -61,18 +58,21 @@ ELFCrashReport::Thread *ELFCrashReport::GetThread(uint64_t thread_id) {
 	return &threads.find(thread_id)->second;
 }
 
-void ELFCrashReport::Generate(process::Process &process, twili::bridge::ResponseOpener ro) {
+trn::ResultCode ELFCrashReport::Prepare(process::Process &process, const protocol::CoreDumpFilter &filter) {
 	process.AddNotes(*this);
+
+	{
+		auto r = trn::svc::DebugActiveProcess(process.GetPid());
+		if(!r) {
+			return r.error();
+		}
+		debug.emplace(std::move(*r));
+	}
 	
-	trn::KDebug debug = ({
-			auto r = trn::svc::DebugActiveProcess(process.GetPid());
-			if(!r) { ro.RespondError(r.error()); return; }
-			std::move(*r); });
-	
-	printf("  opened debug: 0x%x\n", debug.handle);
+	printf("  opened debug: 0x%x\n", debug->handle);
 
 	while(1) {
-		auto r = trn::svc::GetDebugEvent(debug);
+		auto r = trn::svc::GetDebugEvent(*debug);
 		if(!r) {
 			if(r.error().code == 0x8c01) {
 				break;
@@ -205,85 +205,92 @@ void ELFCrashReport::Generate(process::Process &process, twili::bridge::Response
 		}
 	} // debug event loop
 
-	// add VMA regions
+	// add memory regions
 	uint64_t vaddr = 0;
 	do {
 		std::tuple<memory_info_t, uint32_t> r = twili::Assert(
-			trn::svc::QueryDebugProcessMemory(debug, vaddr));
+			trn::svc::QueryDebugProcessMemory(*debug, vaddr));
 		memory_info_t mi = std::get<0>(r);
 
 		// skip I/O mappings; these are volatile and reading them might hang or break things
-		if(mi.permission & 1 && mi.memory_type != 1) {
+		bool included = mi.permission & 1 && mi.memory_type != 1
+			&& mi.memory_type < 64 && (filter.memory_types & (1ull << mi.memory_type))
+			&& (mi.permission & filter.permissions) == filter.permissions
+			&& (filter.max_region_size == 0 || mi.size <= filter.max_region_size);
+		if(included) {
 			uint32_t elf_flags = 0;
 			if(mi.permission & 1) { elf_flags|= ELF::PF_R; }
 			if(mi.permission & 2) { elf_flags|= ELF::PF_W; }
 			if(mi.permission & 4) { elf_flags|= ELF::PF_X; }
-			
-			AddVMA((uint64_t) mi.base_addr, mi.size, elf_flags);
+
+			TWILI_CHECK(AddRegion((uint64_t) mi.base_addr, mi.size, elf_flags, filter.flags & protocol::CoreDumpFilter::SKIP_ZERO_PAGES));
 		}
 		
 		vaddr = ((uint64_t) mi.base_addr) + mi.size;
 	} while(vaddr > 0);
 
 	for(auto i = threads.begin(); i != threads.end(); i++) {
-		AddNote<ELF::Note::elf_prstatus>("CORE", ELF::NT_PRSTATUS, i->second.GeneratePRSTATUS(debug));
-	}
-	
-	size_t total_size = 0;
-	total_size+= sizeof(ELF::Elf64_Ehdr);
-	for(auto i = vmas.begin(); i != vmas.end(); i++) {
-		i->file_offset = total_size;
-		total_size+= i->size;
+		AddNote<ELF::Note::elf_prstatus>("CORE", ELF::NT_PRSTATUS, i->second.GeneratePRSTATUS(*debug));
 	}
-	
-	size_t notes_offset = total_size;
-	for(auto i = notes.begin(); i != notes.end(); i++) {
-		total_size+=
-			4 + // namesz
-			4 + // descsz
-			4 + // type
-			i->name.size() +
-			i->desc.size();
-	}
-	
-	size_t ph_offset = total_size;
-	total_size+= sizeof(ELF::Elf64_Phdr) * (1 + vmas.size());
 
-	bridge::ResponseWriter r = ro.BeginOk(sizeof(uint64_t) + total_size);
-	r.Write<uint64_t>(total_size);
-	r.Write<ELF::Elf64_Ehdr>({
-			.e_ident = {
-				.ei_class = ELF::ELFCLASS64,
-				.ei_data = ELF::ELFDATALSB,
-				.ei_version = 1,
-				.ei_osabi = 3 // pretend to be a Linux core dump
-			},
-			.e_type = ELF::ET_CORE,
-			.e_machine = ELF::EM_AARCH64,
-			.e_version = 1,
-			.e_entry = 0,
-			.e_phoff = ph_offset,
-			.e_shoff = 0,
-			.e_flags = 0,
-			.e_phnum = static_cast<uint16_t>(1 + vmas.size()),
-			.e_shnum = 0,
-			.e_shstrndx = 0,
-		});
+	BuildHeader();
+	return RESULT_OK;
+}
 
-	// write VMAs
-	std::vector<uint8_t> transfer_buffer(r.GetMaxTransferSize(), 0);
-	for(auto i = vmas.begin(); i != vmas.end(); i++) {
-		for(size_t offset = 0; offset < i->size; offset+= transfer_buffer.size()) {
-			size_t size = transfer_buffer.size();
-			if(size > i->size - offset) {
-				size = i->size - offset;
+trn::ResultCode ELFCrashReport::AddRegion(uint64_t virtual_addr, uint64_t size, uint32_t flags, bool skip_zero_pages) {
+	if(!skip_zero_pages) {
+		AddSegment(virtual_addr, size, flags, true);
+		return RESULT_OK;
+	}
+
+	// Split runs of zero pages out of the region. Short runs stay in with
+	// the data around them, since every split costs two program headers
+	// and a heap region can be scattered with single zero pages.
+	const size_t page_size = 0x1000;
+	const uint64_t min_zero_run = page_size * 16;
+	std::vector<uint8_t> buffer(page_size * 16);
+	uint64_t data_start = 0; // start of the pages we haven't added yet
+	uint64_t zero_start = 0;
+	bool in_zero_run = false;
+	auto end_zero_run = [&](uint64_t zero_end) {
+		in_zero_run = false;
+		if(zero_end - zero_start < min_zero_run) {
+			return;
+		}
+		if(zero_start > data_start) {
+			AddSegment(virtual_addr + data_start, zero_start - data_start, flags, true);
+		}
+		AddSegment(virtual_addr + zero_start, zero_end - zero_start, flags, false);
+		data_start = zero_end;
+	};
+	for(uint64_t offset = 0; offset < size; offset+= buffer.size()) {
+		size_t chunk = std::min((uint64_t) buffer.size(), size - offset);
+		TWILI_CHECK(twili::Unwrap(trn::svc::ReadDebugProcessMemory(buffer.data(), *debug, virtual_addr + offset, chunk)));
+		for(size_t page = 0; page < chunk; page+= page_size) {
+			size_t page_end = std::min(page + page_size, chunk);
+			bool has_data = std::any_of(buffer.begin() + page, buffer.begin() + page_end, [](uint8_t b) { return b != 0; });
+			if(has_data && in_zero_run) {
+				end_zero_run(offset + page);
+			} else if(!has_data && !in_zero_run) {
+				in_zero_run = true;
+				zero_start = offset + page;
 			}
-			twili::Assert(trn::svc::ReadDebugProcessMemory(transfer_buffer.data(), debug, i->virtual_addr + offset, size));
-			r.Write(transfer_buffer.data(), size);
 		}
 	}
-			
-	// write notes
+	if(in_zero_run) {
+		end_zero_run(size);
+	}
+	if(data_start < size) {
+		AddSegment(virtual_addr + data_start, size - data_start, flags, true);
+	}
+	return RESULT_OK;
+}
+
+void ELFCrashReport::AddSegment(uint64_t virtual_addr, uint64_t size, uint32_t flags, bool has_data) {
+	segments.push_back({0, virtual_addr, size, has_data ? size : 0, flags});
+}
+
+void ELFCrashReport::BuildHeader() {
 	std::vector<uint8_t> notes_bytes;
 	for(auto i = notes.begin(); i != notes.end(); i++) {
 		struct NoteHeader {
@@ -302,9 +309,48 @@ void ELFCrashReport::Generate(process::Process &process, twili::bridge::Response
 		note.insert(note.end(), i->desc.begin(), i->desc.end());
 		notes_bytes.insert(notes_bytes.end(), note.begin(), note.end());
 	}
-	r.Write(notes_bytes);
-			
-	// write phdrs
+
+	// layout: ELF header, program headers, notes, a section header if we
+	// need one to hold the program header count, then memory contents
+	// starting on a page boundary
+	size_t phnum = 1 + segments.size();
+	bool extended_phnum = phnum >= ELF::PN_XNUM;
+	size_t ph_offset = sizeof(ELF::Elf64_Ehdr);
+	size_t notes_offset = ph_offset + sizeof(ELF::Elf64_Phdr) * phnum;
+	size_t sh_offset = (notes_offset + notes_bytes.size() + 7) & ~7;
+	size_t headers_end = extended_phnum ? sh_offset + sizeof(ELF::Elf64_Shdr) : notes_offset + notes_bytes.size();
+	size_t data_offset = (headers_end + 0xfff) & ~0xfff;
+
+	total_size = data_offset;
+	for(size_t i = 0; i < segments.size(); i++) {
+		if(segments[i].file_size > 0) {
+			segments[i].file_offset = total_size;
+			file_segments.emplace(total_size, i);
+			total_size+= segments[i].file_size;
+		} else {
+			segments[i].file_offset = total_size;
+		}
+	}
+	
+	ELF::Elf64_Ehdr ehdr = {
+		.e_ident = {
+			.ei_class = ELF::ELFCLASS64,
+			.ei_data = ELF::ELFDATALSB,
+			.ei_version = 1,
+			.ei_osabi = 3 // pretend to be a Linux core dump
+		},
+		.e_type = ELF::ET_CORE,
+		.e_machine = ELF::EM_AARCH64,
+		.e_version = 1,
+		.e_entry = 0,
+		.e_phoff = ph_offset,
+		.e_shoff = extended_phnum ? sh_offset : 0,
+		.e_flags = 0,
+		.e_phnum = static_cast<uint16_t>(extended_phnum ? ELF::PN_XNUM : phnum),
+		.e_shnum = static_cast<uint16_t>(extended_phnum ? 1 : 0),
+		.e_shstrndx = 0,
+	};
+
 	std::vector<ELF::Elf64_Phdr> phdrs;
 	phdrs.push_back({
 			.p_type = ELF::PT_NOTE,
@@ -316,19 +362,86 @@ void ELFCrashReport::Generate(process::Process &process, twili::bridge::Response
 			.p_memsz = 0,
 			.p_align = 4
 		});
-	for(auto i = vmas.begin(); i != vmas.end(); i++) {
+	for(auto i = segments.begin(); i != segments.end(); i++) {
+		// zero runs have no file contents; debuggers fill p_memsz past
+		// p_filesz with zeroes
 		phdrs.push_back({
 				.p_type = ELF::PT_LOAD,
 				.p_flags = i->flags,
 				.p_offset = i->file_offset,
 				.p_vaddr = i->virtual_addr,
 				.p_paddr = 0,
-				.p_filesz = i->size,
+				.p_filesz = i->file_size,
 				.p_memsz = i->size,
 				.p_align = 0x1000
 			});
 	}
-	r.Write(phdrs);
+
+	header.resize(data_offset, 0);
+	memcpy(header.data(), &ehdr, sizeof(ehdr));
+	memcpy(header.data() + ph_offset, phdrs.data(), phdrs.size() * sizeof(ELF::Elf64_Phdr));
+	memcpy(header.data() + notes_offset, notes_bytes.data(), notes_bytes.size());
+	if(extended_phnum) {
+		ELF::Elf64_Shdr shdr = {
+			.sh_name = 0,
+			.sh_type = ELF::SHT_NULL,
+			.sh_flags = 0,
+			.sh_addr = 0,
+			.sh_offset = 0,
+			.sh_size = 0,
+			.sh_link = 0,
+			.sh_info = static_cast<uint32_t>(phnum),
+			.sh_addralign = 0,
+			.sh_entsize = 0,
+		};
+		memcpy(header.data() + sh_offset, &shdr, sizeof(shdr));
+	}
+}
+
+size_t ELFCrashReport::GetSize() {
+	return total_size;
+}
+
+trn::ResultCode ELFCrashReport::Read(uint64_t offset, uint8_t *buffer, size_t size, size_t *actual_size) {
+	size_t done = 0;
+	while(done < size && offset + done < total_size) {
+		uint64_t position = offset + done;
+		size_t chunk;
+		if(position < header.size()) {
+			chunk = std::min(size - done, header.size() - position);
+			memcpy(buffer + done, header.data() + position, chunk);
+		} else {
+			auto i = std::prev(file_segments.upper_bound(position));
+			Segment &segment = segments[i->second];
+			uint64_t segment_offset = position - segment.file_offset;
+			chunk = std::min(size - done, segment.file_size - segment_offset);
+			TWILI_CHECK(twili::Unwrap(trn::svc::ReadDebugProcessMemory(buffer + done, *debug, segment.virtual_addr + segment_offset, chunk)));
+		}
+		done+= chunk;
+	}
+	*actual_size = done;
+	return RESULT_OK;
+}
+
+void ELFCrashReport::Generate(process::Process &process, twili::bridge::ResponseOpener opener) {
+	protocol::CoreDumpFilter filter = {
+		.memory_types = ~0ull,
+		.permissions = 0,
+		.flags = 0,
+		.max_region_size = 0,
+	};
+	TWILI_BRIDGE_CHECK(Prepare(process, filter));
+
+	bridge::ResponseWriter r = opener.BeginStreamingOk(sizeof(uint64_t) + total_size);
+	r.Write<uint64_t>(total_size);
+
+	std::vector<uint8_t> transfer_buffer(r.GetMaxTransferSize(), 0);
+	for(uint64_t offset = 0; offset < total_size; ) {
+		size_t actual_size;
+		twili::Assert(Read(offset, transfer_buffer.data(), transfer_buffer.size(), &actual_size));
+		r.Write(transfer_buffer.data(), actual_size);
+		offset+= actual_size;
+	}
 	r.Finalize();
 }
 
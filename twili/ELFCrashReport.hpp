@@ -27,9 +27,11 @@
 #include<vector>
 #include<string>
 #include<map>
+#include<optional>
 
 #include "Elf.hpp"
 #include "bridge/ResponseOpener.hpp"
+#include "../common/Protocol.hpp"
 
 namespace twili {
 namespace process {
@@ -37,10 +39,11 @@ class Process;
 }
 
 class ELFCrashReport {
-	struct VMA {
+	struct Segment {
 		uint64_t file_offset;
 		uint64_t virtual_addr;
 		size_t size;
+		size_t file_size; // zero for runs of zero pages
 		uint32_t flags;
 	};
 
@@ -75,6 +78,14 @@ class ELFCrashReport {
 		AddNote(name, type, bytes);
 	}
 	
+	// Attaches to the process, collects notes, and lays out the file.
+	// Memory is read lazily by Read(), so the process stays attached
+	// until this object is destroyed.
+	trn::ResultCode Prepare(process::Process &process, const protocol::CoreDumpFilter &filter);
+	size_t GetSize();
+	trn::ResultCode Read(uint64_t offset, uint8_t *buffer, size_t size, size_t *actual_size);
+
+	// Sends the whole core dump as one response.
 	void Generate(process::Process &process, bridge::ResponseOpener opener);
 	void AddNote(std::string name, uint32_t type, std::vector<uint8_t> desc);
 
@@ -87,11 +98,17 @@ class ELFCrashReport {
 	}
 	
  private:
-	std::vector<VMA> vmas;
+	std::optional<trn::KDebug> debug;
+	std::vector<Segment> segments;
+	std::map<uint64_t, size_t> file_segments; // file offset -> index into segments
 	std::vector<Note> notes;
 	std::map<uint64_t, Thread> threads;
+	std::vector<uint8_t> header; // ELF header, program headers, and notes
+	size_t total_size = 0;
 
-	void AddVMA(uint64_t virtual_addr, uint64_t size, uint32_t flags);
+	trn::ResultCode AddRegion(uint64_t virtual_addr, uint64_t size, uint32_t flags, bool skip_zero_pages);
+	void AddSegment(uint64_t virtual_addr, uint64_t size, uint32_t flags, bool has_data);
+	void BuildHeader();
 	void AddThread(uint64_t thread_id, uint64_t tls_pointer, uint64_t entrypoint);
 	Thread *GetThread(uint64_t thread_id);
 };
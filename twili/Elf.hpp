@@ -62,6 +62,16 @@ enum {
 	PT_NOTE = 4,
 };
 
+enum {
+	// e_phnum is set to this when there are too many program headers to fit;
+	// the real count goes in sh_info of section header 0
+	PN_XNUM = 0xffff,
+};
+
+enum {
+	SHT_NULL = 0,
+};
+
 enum {
 	PF_X = 1,
 	PF_W = 2,
@@ -201,24 +201,33 @@ void TwibPipe::Write(uint8_t *data, size_t size, std::function<void(bool eof)> c
 				twili::Abort(TWILI_ERR_INVALID_PIPE_STATE);
 			},
 			[&](ReadPendingState &rps) {
-				// move this out so we control lifetime
-				std::function<size_t(uint8_t*, size_t)> read_cb = std::move(rps.cb);
-
-				// signal to async read handler that we have data
-				size_t read_size = read_cb(data, size);
-
-				if(read_size < size) {
-					// if we didn't read everything,
-					// transition to write pending state.
-					state.template emplace<WritePendingState>(data + read_size, size - read_size, cb);
-				} else if(read_size == size) {
-					// if we read everything, enter idle state
+				// the read handler is allowed to queue up another read from
+				// here, so keep handing data over for as long as it does.
+				while(std::holds_alternative<ReadPendingState>(state)) {
+					// move this out so we control lifetime
+					std::function<size_t(uint8_t*, size_t)> read_cb = std::move(std::get<ReadPendingState>(state).cb);
 					state.template emplace<IdleState>();
-					// signal async write handler that we finished
-					cb(false);
-				} else {
-					twili::Abort(TWILI_ERR_INVALID_PIPE_STATE);
+
+					// signal to async read handler that we have data
+					size_t read_size = read_cb(data, size);
+
+					if(read_size > size || (read_size == 0 && std::holds_alternative<ReadPendingState>(state))) {
+						twili::Abort(TWILI_ERR_INVALID_PIPE_STATE);
+					}
+
+					data+= read_size;
+					size-= read_size;
+					if(size == 0) {
+						// we're either idle or have a new read pending;
+						// signal async write handler that we finished
+						cb(false);
+						return;
+					}
 				}
+
+				// if we didn't read everything,
+				// transition to write pending state.
+				state.template emplace<WritePendingState>(data, size, cb);
 			}
 		}, state);
 }
@@ -35,7 +35,8 @@ class TwibPipe {
 	~TwibPipe();
 	
 	// Callback returns how much data was read.
-	// Callback may not call Read or Write.
+	// Callback may not call Write. It may only call Read if it was
+	// invoked from Write with non-empty data.
 	void Read(std::function<size_t(uint8_t *data, size_t actual_size)> cb);
 	void Write(uint8_t *data, size_t size, std::function<void(bool eof)> cb);
 	void CloseReader();
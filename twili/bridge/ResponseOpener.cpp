@@ -33,6 +33,22 @@ ResponseOpener::ResponseOpener(std::shared_ptr<detail::ResponseState> state) : s
 }
 
 ResponseWriter ResponseOpener::BeginError(ResultCode code, size_t payload_size, uint32_t object_count) const {
+	return Begin(code, payload_size, object_count, true);
+}
+
+ResponseWriter ResponseOpener::BeginOk(size_t payload_size, uint32_t object_count) const {
+	return Begin(ResultCode(0), payload_size, object_count, true);
+}
+
+ResponseWriter ResponseOpener::BeginStreamingOk(size_t payload_size, uint32_t object_count) const {
+	return Begin(ResultCode(0), payload_size, object_count, false);
+}
+
+void ResponseOpener::RespondError(ResultCode code) const {
+	BeginError(code).Finalize();
+}
+
+ResponseWriter ResponseOpener::Begin(ResultCode code, size_t payload_size, uint32_t object_count, bool compressible) const {
 	if(state->has_begun) {
 		twili::Abort(TWILI_ERR_FATAL_BRIDGE_STATE);
 	}
@@ -46,23 +62,22 @@ ResponseWriter ResponseOpener::BeginError(ResultCode code, size_t payload_size,
 	hdr.tag = state->tag;
 	hdr.payload_size = payload_size;
 	hdr.object_count = object_count;
+	hdr.flags = 0;
 	state->has_begun = true;
 	state->total_size = payload_size;
 	state->object_count = object_count;
 
-	state->SendHeader(hdr);
+	if(compressible && state->compression_enabled && payload_size >= protocol::COMPRESSION_THRESHOLD && payload_size <= protocol::COMPRESSION_MAX_SIZE) {
+		state->compressing = true;
+		state->deferred_header = hdr;
+		state->deferred_payload.reserve(payload_size);
+	} else {
+		state->SendHeader(hdr);
+	}
 
 	ResponseWriter writer(state);
 	return writer;
 }
 
-ResponseWriter ResponseOpener::BeginOk(size_t payload_size, uint32_t object_count) const {
-	return BeginError(ResultCode(0), payload_size, object_count);
-}
-
-void ResponseOpener::RespondError(ResultCode code) const {
-	BeginError(code).Finalize();
-}
-
 } // namespace bridge
 } // namespace twili
@@ -41,6 +41,10 @@ class ResponseOpener {
 	ResponseOpener(std::shared_ptr<detail::ResponseState> state);
 	ResponseWriter BeginOk(size_t payload_size=0, uint32_t object_count=0) const;
 	ResponseWriter BeginError(trn::ResultCode code, size_t payload_size=0, uint32_t object_count=0) const;
+	// Like BeginOk, but never compressed. Compressing holds the whole payload
+	// until Finalize, so responses that are written a transfer at a time to
+	// keep them out of the heap should use this.
+	ResponseWriter BeginStreamingOk(size_t payload_size=0, uint32_t object_count=0) const;
 
 	template<typename... Args>
 	void RespondOk(Args&&... args) const {
@@ -52,6 +56,8 @@ class ResponseOpener {
 	}
 
 	void RespondError(trn::ResultCode code) const;
+
+	inline size_t GetMaxTransferSize() const { return state->GetMaxTransferSize(); }
 	
 	template<typename T, typename... Args>
 	std::shared_ptr<T> MakeObject(Args &&... args) const {
@@ -62,6 +68,8 @@ class ResponseOpener {
 	}
 
  private:
+	ResponseWriter Begin(trn::ResultCode code, size_t payload_size, uint32_t object_count, bool compressible) const;
+	
 	std::shared_ptr<detail::ResponseState> state;
 };
 
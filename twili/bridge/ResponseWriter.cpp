@@ -20,6 +20,8 @@
 
 #include "ResponseOpener.hpp"
 
+#include "../twili.hpp"
+#include "Compression.hpp"
 #include "err.hpp"
 
 namespace twili {
@@ -32,7 +34,11 @@ ResponseWriter::ResponseWriter(std::shared_ptr<detail::ResponseState> state) : s
 }
 
 void ResponseWriter::Write(uint8_t *data, size_t size) {
-	state->SendData(data, size);
+	if(state->compressing) {
+		state->deferred_payload.insert(state->deferred_payload.end(), data, data + size);
+	} else {
+		state->SendData(data, size);
+	}
 }
 
 void ResponseWriter::Write(std::string str) {
@@ -46,8 +52,25 @@ uint32_t ResponseWriter::Object(std::shared_ptr<bridge::Object> object) {
 }
 
 void ResponseWriter::Finalize() {
+	if(state->compressing) {
+		state->compressing = false;
+		if(state->deferred_payload.size() != state->total_size) {
+			twili::Abort(TWILI_ERR_BAD_RESPONSE);
+		}
+		protocol::CompressPayload(state->deferred_header, state->deferred_payload);
+		state->total_size = state->deferred_header.payload_size;
+		state->SendHeader(state->deferred_header);
+		state->SendData(state->deferred_payload.data(), state->deferred_payload.size());
+		std::vector<uint8_t>().swap(state->deferred_payload);
+	}
 	state->Finalize();
 }
 
+void ResponseWriter::Abort() {
+	state->compressing = false;
+	std::vector<uint8_t>().swap(state->deferred_payload);
+	state->Abort();
+}
+
 } // namespace bridge
 } // namespace twili
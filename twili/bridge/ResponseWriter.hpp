@@ -44,6 +44,8 @@ class ResponseState {
 	virtual void SendHeader(protocol::MessageHeader &hdr) = 0;
 	virtual void SendData(uint8_t *data, size_t size) = 0;
 	virtual void Finalize() = 0;
+	// Drops the transport out from under a response that can't be finished.
+	virtual void Abort() = 0;
 	virtual uint32_t ReserveObjectId() = 0;
 	virtual void InsertObject(std::pair<uint32_t, std::shared_ptr<Object>> &&pair) = 0;
 
@@ -55,6 +57,14 @@ class ResponseState {
 	size_t total_size = 0;
 	uint32_t object_count = 0;
 	bool has_begun = false;
+
+	// Set by the bridge if the host negotiated compression. While
+	// compressing, the header and payload are held back until Finalize so
+	// that the payload can be compressed as a whole.
+	bool compression_enabled = false;
+	bool compressing = false;
+	protocol::MessageHeader deferred_header;
+	std::vector<uint8_t> deferred_payload;
 };
 
 } // namespace detail
@@ -82,6 +92,13 @@ class ResponseWriter {
 	uint32_t Object(std::shared_ptr<bridge::Object> object);
 
 	void Finalize();
+	// For when the rest of a response can't be produced after its header
+	// has gone out. The host can't be told about the error in-band anymore,
+	// so this resets the connection instead, and the host fails everything
+	// it had outstanding on it. A TCP connection belongs to one twibd, but
+	// the USB interface is shared by every twibd client, so over USB all of
+	// them lose their requests and objects.
+	void Abort();
  private:
 	std::shared_ptr<detail::ResponseState> state;
 };
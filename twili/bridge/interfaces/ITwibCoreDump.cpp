@@ -0,0 +1,47 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ITwibCoreDump.hpp"
+
+#include<algorithm>
+
+namespace twili {
+namespace bridge {
+
+ITwibCoreDump::ITwibCoreDump(uint32_t object_id, std::unique_ptr<ELFCrashReport> &&report) : ObjectDispatcherProxy(*this, object_id), report(std::move(report)), dispatcher(*this) {
+}
+
+void ITwibCoreDump::Read(bridge::ResponseOpener opener, uint64_t offset, uint64_t size) {
+	std::vector<uint8_t> buffer(std::min(size, protocol::ITwibFileAccessor::READ_MAX_SIZE));
+	size_t actual_size;
+
+	TWILI_BRIDGE_CHECK(report->Read(offset, buffer.data(), buffer.size(), &actual_size));
+	buffer.resize(actual_size);
+	
+	opener.RespondOk(std::move(buffer));
+}
+
+void ITwibCoreDump::GetSize(bridge::ResponseOpener opener) {
+	uint64_t size = report->GetSize();
+	opener.RespondOk(std::move(size));
+}
+
+} // namespace bridge
+} // namespace twili
@@ -265,5 +265,35 @@ void ITwibDebugger::GetNroInfos(bridge::ResponseOpener opener) {
 	opener.RespondOk(std::move(nro_info));
 }
 
+void ITwibDebugger::ReadMemoryV(bridge::ResponseOpener opener, std::vector<protocol::MemoryRange> ranges) {
+	uint64_t total_size = 0;
+	for(protocol::MemoryRange &range : ranges) {
+		if(range.size > protocol::ITwibDebugger::READ_MEMORY_V_MAX_SIZE - total_size) {
+			opener.RespondError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+			return;
+		}
+		total_size+= range.size;
+	}
+
+	// a bad range shouldn't sink the rest of them
+	std::vector<uint32_t> results;
+	std::vector<uint8_t> data(total_size);
+	size_t offset = 0;
+	results.reserve(ranges.size());
+	for(protocol::MemoryRange &range : ranges) {
+		trn::ResultCode r = RESULT_OK;
+		if(range.size > 0) {
+			r = twili::Unwrap(trn::svc::ReadDebugProcessMemory(data.data() + offset, debug, range.address, range.size));
+		}
+		if(r == RESULT_OK) {
+			offset+= range.size;
+		}
+		results.push_back(r.code);
+	}
+	data.resize(offset);
+
+	opener.RespondOk(std::move(results), std::move(data));
+}
+
 } // namespace bridge
 } // namespace twili
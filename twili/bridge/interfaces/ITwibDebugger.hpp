@@ -72,6 +72,7 @@ class ITwibDebugger : public ObjectDispatcherProxy<ITwibDebugger> {
 	void GetTargetEntry(bridge::ResponseOpener opener);
 	void LaunchDebugProcess(bridge::ResponseOpener opener);
 	void GetNroInfos(bridge::ResponseOpener opener);
+	void ReadMemoryV(bridge::ResponseOpener opener, std::vector<protocol::MemoryRange> ranges);
 
  public:
 	SmartRequestDispatcher<
@@ -89,7 +90,8 @@ class ITwibDebugger : public ObjectDispatcherProxy<ITwibDebugger> {
 		SmartCommand<CommandID::WAIT_EVENT, &ITwibDebugger::WaitEvent>,
 		SmartCommand<CommandID::GET_TARGET_ENTRY, &ITwibDebugger::GetTargetEntry>,
 		SmartCommand<CommandID::LAUNCH_DEBUG_PROCESS, &ITwibDebugger::LaunchDebugProcess>,
-		SmartCommand<CommandID::GET_NRO_INFOS, &ITwibDebugger::GetNroInfos>
+		SmartCommand<CommandID::GET_NRO_INFOS, &ITwibDebugger::GetNroInfos>,
+		SmartCommand<CommandID::READ_MEMORY_V, &ITwibDebugger::ReadMemoryV>
 		> dispatcher;
 };
 
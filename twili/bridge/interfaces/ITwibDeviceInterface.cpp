@@ -43,6 +43,7 @@
 #include "ITwibDebugger.hpp"
 #include "ITwibProcessMonitor.hpp"
 #include "ITwibFilesystemAccessor.hpp"
+#include "ITwibCoreDump.hpp"
 
 #include "err.hpp"
 
@@ -85,6 +86,13 @@ void ITwibDeviceInterface::CoreDump(bridge::ResponseOpener opener, uint64_t pid)
 	report.Generate(*proc, opener);
 }
 
+void ITwibDeviceInterface::OpenCoreDump(bridge::ResponseOpener opener, uint64_t pid, protocol::CoreDumpFilter filter) {
+	std::shared_ptr<process::Process> proc = twili.FindProcess(pid);
+	std::unique_ptr<ELFCrashReport> report = std::make_unique<ELFCrashReport>();
+	TWILI_BRIDGE_CHECK(report->Prepare(*proc, filter));
+	opener.RespondOk(opener.MakeObject<ITwibCoreDump>(std::move(report)));
+}
+
 void ITwibDeviceInterface::Terminate(bridge::ResponseOpener opener, uint64_t pid) {
 	twili.FindProcess(pid)->Terminate();
 
@@ -56,6 +56,7 @@ class ITwibDeviceInterface : public ObjectDispatcherProxy<ITwibDeviceInterface>
 	void WaitToDebugApplication(bridge::ResponseOpener opener);
 	void WaitToDebugTitle(bridge::ResponseOpener opener, uint64_t tid);
 	void RebootUnsafe(bridge::ResponseOpener opener);
+	void OpenCoreDump(bridge::ResponseOpener opener, uint64_t pid, protocol::CoreDumpFilter filter);
 
  public:
 	SmartRequestDispatcher<
@@ -76,7 +77,8 @@ class ITwibDeviceInterface : public ObjectDispatcherProxy<ITwibDeviceInterface>
 		SmartCommand<CommandID::OPEN_FILESYSTEM_ACCESSOR, &ITwibDeviceInterface::OpenFilesystemAccessor>,
 		SmartCommand<CommandID::WAIT_TO_DEBUG_APPLICATION, &ITwibDeviceInterface::WaitToDebugApplication>,
 		SmartCommand<CommandID::WAIT_TO_DEBUG_TITLE, &ITwibDeviceInterface::WaitToDebugTitle>,
-		SmartCommand<CommandID::REBOOT_UNSAFE, &ITwibDeviceInterface::RebootUnsafe>
+		SmartCommand<CommandID::REBOOT_UNSAFE, &ITwibDeviceInterface::RebootUnsafe>,
+		SmartCommand<CommandID::OPEN_CORE_DUMP, &ITwibDeviceInterface::OpenCoreDump>
 		> dispatcher;
 
 	trn::KEvent ev_debug_application;
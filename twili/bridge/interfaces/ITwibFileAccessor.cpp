@@ -23,7 +23,9 @@
 #include<libtransistor/cpp/svc.hpp>
 
 #include "err.hpp"
+#include "util.hpp"
 
+#include<algorithm>
 #include<cstring>
 
 using namespace trn;
@@ -40,15 +42,58 @@ ITwibFileAccessor::~ITwibFileAccessor() {
 }
 
 void ITwibFileAccessor::Read(bridge::ResponseOpener opener, uint64_t offset, uint64_t size) {
-	const size_t limit = 0x40000;
-
-	std::vector<uint8_t> buffer(std::max(size, limit));
-	size_t actual_size;
+	size_t file_size;
+	TWILI_BRIDGE_CHECK(ifile_get_size(ifile, &file_size));
+	size = std::min(size, protocol::ITwibFileAccessor::READ_MAX_SIZE);
+	size = offset < file_size ? std::min(size, file_size - offset) : 0;
+
+	// Stream the range through a transfer-sized buffer instead of holding
+	// all of it in our heap at once.
+	if(transfer_buffer.size() != opener.GetMaxTransferSize()) {
+		transfer_buffer.resize(opener.GetMaxTransferSize());
+	}
+
+	// The first chunk is read before the header goes out, so that a file
+	// that can't be read at all gets a proper error response.
+	size_t chunk = std::min(size, (uint64_t) transfer_buffer.size());
+	TWILI_BRIDGE_CHECK(ReadChunk(offset, chunk));
+
+	bridge::ResponseWriter w = opener.BeginStreamingOk(sizeof(uint64_t) + size);
+	w.Write<uint64_t>(size);
+
+	uint64_t done = 0;
+	while(chunk > 0) {
+		w.Write(transfer_buffer.data(), chunk);
+		done+= chunk;
+		chunk = std::min(size - done, (uint64_t) transfer_buffer.size());
+		if(chunk > 0) {
+			trn::ResultCode r = ReadChunk(offset + done, chunk);
+			if(r != RESULT_OK) {
+				// too late for an error response, and padding would hand the
+				// host bytes that aren't in the file. over USB this takes
+				// every other client's requests down with it.
+				printf("ITwibFileAccessor::Read: failed at 0x%lx (0x%x), aborting\n", offset + done, r.code);
+				w.Abort();
+				return;
+			}
+		}
+	}
+	w.Finalize();
+}
 
-	TWILI_BRIDGE_CHECK(ifile_read(ifile, &actual_size, buffer.data(), buffer.size(), 0, offset, buffer.size()));
-	buffer.resize(actual_size);
-	
-	opener.RespondOk(std::move(buffer));
+trn::ResultCode ITwibFileAccessor::ReadChunk(uint64_t offset, size_t size) {
+	if(size == 0) {
+		return RESULT_OK;
+	}
+	size_t actual_size = 0;
+	trn::ResultCode r = ifile_read(ifile, &actual_size, transfer_buffer.data(), size, 0, offset, size);
+	if(r != RESULT_OK) {
+		return r;
+	}
+	if(actual_size < size) {
+		return TWILI_ERR_IO_ERROR;
+	}
+	return RESULT_OK;
 }
 
 void ITwibFileAccessor::Write(bridge::ResponseOpener opener, uint64_t offset, InputStream &stream) {
@@ -93,5 +138,34 @@ void ITwibFileAccessor::GetSize(bridge::ResponseOpener opener) {
 	opener.RespondOk(std::move(size));
 }
 
+void ITwibFileAccessor::HashBlocks(bridge::ResponseOpener opener, uint64_t offset, uint64_t block_size, uint64_t block_count) {
+	// keep the read buffer and the time spent in one request bounded
+	using Limits = protocol::ITwibFileAccessor;
+	if(block_size < Limits::HASH_MIN_BLOCK_SIZE || block_size > Limits::HASH_MAX_BLOCK_SIZE ||
+		 block_count > Limits::HASH_MAX_BLOCK_COUNT || block_size * block_count > Limits::HASH_MAX_BYTES) {
+		opener.RespondError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+		return;
+	}
+
+	size_t file_size;
+	TWILI_BRIDGE_CHECK(ifile_get_size(ifile, &file_size));
+
+	std::vector<uint8_t> buffer(block_size);
+	std::vector<uint64_t> hashes;
+	for(uint64_t i = 0; i < block_count && offset < file_size; i++) {
+		size_t size = std::min(block_size, file_size - offset);
+		size_t actual_size;
+		TWILI_BRIDGE_CHECK(ifile_read(ifile, &actual_size, buffer.data(), size, 0, offset, size));
+		if(actual_size != size) {
+			opener.RespondError(TWILI_ERR_IO_ERROR);
+			return;
+		}
+		hashes.push_back(util::HashBlock(buffer.data(), size));
+		offset+= size;
+	}
+
+	opener.RespondOk(std::move(hashes));
+}
+
 } // namespace bridge
 } // namespace twili
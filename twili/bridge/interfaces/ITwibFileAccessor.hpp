@@ -38,12 +38,16 @@ class ITwibFileAccessor : public ObjectDispatcherProxy<ITwibFileAccessor> {
 	
  private:
 	ifile_t ifile;
+	std::vector<uint8_t> transfer_buffer; // reused between reads
 
+	// fills the front of transfer_buffer, treating a short read as an error
+	trn::ResultCode ReadChunk(uint64_t offset, size_t size);
 	void Read(bridge::ResponseOpener opener, uint64_t offset, uint64_t size);
 	void Write(bridge::ResponseOpener opener, uint64_t offset, InputStream &stream);
 	void Flush(bridge::ResponseOpener opener);
 	void SetSize(bridge::ResponseOpener opener, uint64_t size);
 	void GetSize(bridge::ResponseOpener opener);
+	void HashBlocks(bridge::ResponseOpener opener, uint64_t offset, uint64_t block_size, uint64_t block_count);
 
  public:
 	SmartRequestDispatcher<
@@ -52,7 +56,8 @@ class ITwibFileAccessor : public ObjectDispatcherProxy<ITwibFileAccessor> {
 		SmartCommand<CommandID::WRITE, &ITwibFileAccessor::Write>,
 		SmartCommand<CommandID::FLUSH, &ITwibFileAccessor::Flush>,
 		SmartCommand<CommandID::SET_SIZE, &ITwibFileAccessor::SetSize>,
-		SmartCommand<CommandID::GET_SIZE, &ITwibFileAccessor::GetSize>
+		SmartCommand<CommandID::GET_SIZE, &ITwibFileAccessor::GetSize>,
+		SmartCommand<CommandID::HASH_BLOCKS, &ITwibFileAccessor::HashBlocks>
 	 > dispatcher;
 };
 
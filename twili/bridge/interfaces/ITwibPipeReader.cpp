@@ -28,20 +28,57 @@ using trn::ResultError;
 namespace twili {
 namespace bridge {
 
-ITwibPipeReader::ITwibPipeReader(uint32_t device_id, std::shared_ptr<TwibPipe> pipe) : ObjectDispatcherProxy(*this, device_id), pipe(pipe), dispatcher(*this) {
+ITwibPipeReader::ITwibPipeReader(uint32_t device_id, std::shared_ptr<TwibPipe> pipe) : ObjectDispatcherProxy(*this, device_id), pipe(pipe), queue(std::make_shared<ReadQueue>()), dispatcher(*this) {
 }
 
 void ITwibPipeReader::Read(bridge::ResponseOpener opener) {
-	pipe->Read(
-		[opener](uint8_t *data, size_t actual_size) mutable {
-			if(actual_size == 0) {
-				opener.RespondError(TWILI_ERR_EOF);
-			} else {
-				opener.RespondOk(std::vector<uint8_t>(data, data + actual_size));
-			}
-			return actual_size;
+	if(queue->openers.size() >= protocol::ITwibPipeReader::READ_WINDOW) {
+		opener.RespondError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+		return;
+	}
+	queue->openers.push_back(opener);
+	queue->Pump(*pipe);
+}
+
+void ITwibPipeReader::ReadQueue::Pump(TwibPipe &pipe) {
+	// reads that complete immediately aren't allowed to start the next
+	// one themselves, so that happens here instead.
+	pumping = true;
+	while(!reading && !openers.empty()) {
+		Arm(pipe);
+	}
+	pumping = false;
+}
+
+void ITwibPipeReader::ReadQueue::Arm(TwibPipe &pipe) {
+	reading = true;
+	pipe.Read(
+		[self = shared_from_this(), &pipe](uint8_t *data, size_t actual_size) {
+			return self->Complete(pipe, data, actual_size);
 		});
 }
 
+size_t ITwibPipeReader::ReadQueue::Complete(TwibPipe &pipe, uint8_t *data, size_t actual_size) {
+	reading = false;
+	if(actual_size == 0) {
+		// EoF is final, so it answers everything that's queued.
+		for(bridge::ResponseOpener &opener : openers) {
+			opener.RespondError(TWILI_ERR_EOF);
+		}
+		openers.clear();
+		return 0;
+	}
+
+	bridge::ResponseOpener opener = openers.front();
+	openers.pop_front();
+	opener.RespondOk(std::vector<uint8_t>(data, data + actual_size));
+
+	if(!pumping && !openers.empty()) {
+		// we were called from the writer, which lets us wait for more
+		Arm(pipe);
+	}
+	return actual_size;
+}
+
 } // namespace bridge
 } // namespace twili
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include<deque>
 #include<memory>
 
 #include "../Object.hpp"
@@ -37,7 +38,24 @@ class ITwibPipeReader : public ObjectDispatcherProxy<ITwibPipeReader> {
 	using CommandID = protocol::ITwibPipeReader::Command;
 	
  private:
+	// READs waiting on the pipe, oldest first. This is kept apart from us
+	// because the pipe may hang on to a callback after we're closed.
+	class ReadQueue : public std::enable_shared_from_this<ReadQueue> {
+	 public:
+		void Pump(TwibPipe &pipe);
+	 private:
+		std::deque<bridge::ResponseOpener> openers;
+		bool reading = false; // pipe is holding our callback
+		bool pumping = false; // callbacks can't call back into the pipe
+
+		void Arm(TwibPipe &pipe);
+		size_t Complete(TwibPipe &pipe, uint8_t *data, size_t actual_size);
+
+		friend class ITwibPipeReader;
+	};
+
 	std::shared_ptr<TwibPipe> pipe;
+	std::shared_ptr<ReadQueue> queue;
 
 	void Read(bridge::ResponseOpener opener);
 
@@ -22,62 +22,194 @@
 
 #include<libtransistor/ipc/bsd.h>
 
+#include<errno.h>
 #include<mutex>
 
 #include "../../Threading.hpp"
 #include "../Object.hpp"
 
+#include "Compression.hpp"
 #include "err.hpp"
 
 namespace twili {
 namespace bridge {
 namespace tcp {
 
+#ifdef MSG_DONTWAIT
+static const int SendFlags = MSG_DONTWAIT;
+#else
+static const int SendFlags = 0;
+#endif
+
+// socket thread stops reading from a connection once this much input is
+// waiting on the main thread
+static const size_t InputLimit = 0x10000;
+// new requests wait for the host once this much output is queued
+static const size_t OutputLimit = 0x20000;
+// Past OutputLimit, output only grows by whatever the requests already in
+// progress still have to send. Streamed reads are capped well under this,
+// and COREDUMP, which sends a whole process in one response, is refused on
+// TCP. Responses whose size the host picks, like READ_MEMORY, can still get
+// here; the connection is dropped then rather than letting it eat Twili's
+// heap.
+static const size_t OutputDropLimit = 0x800000;
+
 TCPBridge::Connection::Connection(TCPBridge &bridge, util::Socket &&socket) :
+	socket(std::move(socket)),
 	bridge(bridge),
-	socket(std::move(socket)) {
+	out_queue(ResponseState::TransferSize) {
 	objects.insert(std::pair<uint32_t, std::shared_ptr<bridge::Object>>(0, bridge.object_zero));
 }
 
 void TCPBridge::Connection::PumpInput() {
-	std::tuple<uint8_t*, size_t> target = in_buffer.Reserve(8192);
-	ssize_t r = bsd_recv(socket.fd, (void*) std::get<0>(target), std::get<1>(target), 0);
-	if(r <= 0) {
+	{
+		std::unique_lock<thread::Mutex> lock(in_mutex);
+		std::tuple<uint8_t*, size_t> target = in_buffer.Reserve(8192);
+		ssize_t r = bsd_recv(socket.fd, (void*) std::get<0>(target), std::get<1>(target), 0);
+		if(r <= 0) {
+			lock.unlock();
+			Kill();
+			return;
+		}
+		in_buffer.MarkWritten(r);
+	}
+	bridge.QueueProcessing(shared_from_this());
+}
+
+void TCPBridge::Connection::PumpOutput() {
+	std::unique_lock<thread::Mutex> lock(out_mutex);
+	bool ok = out_queue.Drain(
+		[this](const uint8_t *data, size_t size) -> ssize_t {
+			ssize_t r = bsd_send(socket.fd, data, size, SendFlags);
+			if(r < 0 && (bsd_errno == EAGAIN || bsd_errno == EWOULDBLOCK)) {
+				return 0;
+			}
+			return r;
+		});
+	bool resume = ok && output_blocked && out_queue.Size() < OutputLimit;
+	if(resume) {
+		output_blocked = false;
+	}
+	lock.unlock();
+	if(!ok) {
+		Kill();
+	} else if(resume) {
+		bridge.QueueProcessing(shared_from_this());
+	}
+}
+
+bool TCPBridge::Connection::WantsInput() {
+	std::unique_lock<thread::Mutex> lock(in_mutex);
+	return in_buffer.ReadAvailable() < InputLimit;
+}
+
+bool TCPBridge::Connection::WantsOutput() {
+	std::unique_lock<thread::Mutex> lock(out_mutex);
+	return !out_queue.Empty();
+}
+
+void TCPBridge::Connection::Kill() {
+	deletion_flag = true;
+	std::unique_lock<thread::Mutex> lock(out_mutex);
+	out_queue.Clear();
+}
+
+void TCPBridge::Connection::QueueOutput(uint8_t *data, size_t size) {
+	std::unique_lock<thread::Mutex> lock(out_mutex);
+	if(deletion_flag) {
+		return;
+	}
+	if(out_queue.Size() + size > OutputDropLimit) {
+		lock.unlock();
+		printf("TCPConnection: host isn't keeping up with output, dropping it\n");
 		Panic();
 		return;
-	} else {
-		in_buffer.MarkWritten(r);
+	}
+	bool was_empty = out_queue.Empty();
+	out_queue.Push(data, size);
+	if(was_empty) {
+		bridge.Wake();
 	}
 }
 
+bool TCPBridge::Connection::DeferForOutput() {
+	std::unique_lock<thread::Mutex> lock(out_mutex);
+	if(out_queue.Size() < OutputLimit) {
+		return false;
+	}
+	output_blocked = true;
+	return true;
+}
+
 void TCPBridge::Connection::Process() {
-	while(!deletion_flag && in_buffer.ReadAvailable() > 0) {
+	// leave input where it is, so that the socket thread stops reading
+	// once it fills up
+	if(!has_current_mh && DeferForOutput()) {
+		return;
+	}
+
+	size_t taken;
+	{
+		std::unique_lock<thread::Mutex> lock(in_mutex);
+		taken = in_buffer.ReadAvailable();
+		in_buffer.Read(process_buffer, taken);
+	}
+	if(taken >= InputLimit) {
+		bridge.Wake(); // socket thread may have stopped reading from us
+	}
+	
+	while(!deletion_flag && process_buffer.ReadAvailable() > 0) {
 		if(!has_current_mh) {
-			if(in_buffer.Read(current_mh)) {
+			if(DeferForOutput()) {
+				// PumpOutput queues us again once the host catches up
+				return;
+			}
+			if(process_buffer.Read(current_mh)) {
 				has_current_mh = true;
 				payload_size = 0;
 				payload_buffer.Clear();
 				has_current_payload = false;
+
+				// compressed requests can't be handed to their handler until
+				// the whole payload is here
+				current_compressed = compression_enabled && (current_mh.flags & protocol::FLAG_COMPRESSED);
+				if(current_compressed && current_mh.payload_size > protocol::COMPRESSION_MAX_SIZE) {
+					Panic();
+					return;
+				}
 				
 				// pick command handler
-				Synchronize(Task::BeginProcessingCommand);
+				if(!current_compressed) {
+					BeginProcessingCommand();
+				}
 			} else {
-				in_buffer.Reserve(sizeof(protocol::MessageHeader));
+				process_buffer.Reserve(sizeof(protocol::MessageHeader));
+				return;
 			}
 		}
 
 		if(!has_current_payload) {
-			size_t payload_avail = in_buffer.ReadAvailable();
+			size_t payload_avail = process_buffer.ReadAvailable();
 			if(payload_avail > current_mh.payload_size - payload_size) {
 				payload_avail = current_mh.payload_size - payload_size;
 			}
-			in_buffer.Read(payload_buffer, payload_avail);
+			process_buffer.Read(payload_buffer, payload_avail);
 			payload_size+= payload_avail;
 
-			Synchronize(Task::FlushReceiveBuffer);
+			if(!current_compressed) {
+				FlushReceiveBuffer();
+			}
 			
 			if(payload_size == current_mh.payload_size) {
-				Synchronize(Task::FinalizeCommand);
+				if(current_compressed) {
+					if(!protocol::DecompressPayload(current_mh, payload_buffer)) {
+						Panic();
+						return;
+					}
+					BeginProcessingCommand();
+					FlushReceiveBuffer();
+				}
+				FinalizeCommand();
 				has_current_mh = false;
 				has_current_payload = false;
 			} else {
@@ -87,53 +219,43 @@ void TCPBridge::Connection::Process() {
 	}
 }
 
-void TCPBridge::Connection::Synchronize(Task task) {
-	std::unique_lock<thread::Mutex> lock(bridge.request_processing_mutex);
-	
-	this->pending_task = task;
-	// request that the main thread service us
-	bridge.request_processing_connection = shared_from_this();
-	bridge.request_processing_signal_wh->Signal();
-	while(this->pending_task != Task::Idle) {
-		bridge.request_processing_condvar.Wait(bridge.request_processing_mutex, -1);
+void TCPBridge::Connection::Cleanup() {
+	ResetHandler();
+	current_object.reset();
+	objects.clear(); // breaks cycles through objects holding our ResponseStates
+}
+
+void TCPBridge::Connection::FlushReceiveBuffer() {
+	try {
+		current_handler->FlushReceiveBuffer(payload_buffer);
+	} catch(trn::ResultError &e) {
+		printf("TCPConnection: Somebody is still throwing exceptions!\n");
+		twili::Abort(e);
 	}
 }
 
-void TCPBridge::Connection::Synchronized() {
-	switch(pending_task) {
-	case Task::BeginProcessingCommand:
-		BeginProcessingCommandImpl();
-		break;
-	case Task::FlushReceiveBuffer:
-		try {
-			current_handler->FlushReceiveBuffer(payload_buffer);
-		} catch(trn::ResultError &e) {
-			printf("TCPConnection: Somebody is still throwing exceptions!\n");
-			twili::Abort(e);
-		}
-		break;
-	case Task::FinalizeCommand:
-		try {
-			current_handler->Finalize(payload_buffer);
-			if(current_object) {
-				current_object->FinalizeCommand();
-				current_object.reset();
-			}
-			ResetHandler();
-		} catch(trn::ResultError &e) {
-			printf("TCPConnection: Somebody is still throwing exceptions!\n");
-			twili::Abort(e);
+void TCPBridge::Connection::FinalizeCommand() {
+	try {
+		current_handler->Finalize(payload_buffer);
+		if(current_object) {
+			current_object->FinalizeCommand();
+			current_object.reset();
 		}
-		break;
-	case Task::Idle:
-		printf("TCPConnection: synchronized on idle task?\n");
-		break;
+		ResetHandler();
+	} catch(trn::ResultError &e) {
+		printf("TCPConnection: Somebody is still throwing exceptions!\n");
+		twili::Abort(e);
 	}
-	pending_task = Task::Idle;
 }
 
-void TCPBridge::Connection::BeginProcessingCommandImpl() {
+void TCPBridge::Connection::BeginProcessingCommand() {
 	current_state = std::make_shared<Connection::ResponseState>(shared_from_this(), current_mh.client_id, current_mh.tag);
+	current_state->compression_enabled = compression_enabled;
+	// the host offers compression every time it identifies us, and the
+	// identify response itself goes out before compression takes effect
+	if(current_mh.object_id == 0 && current_mh.command_id == (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY) {
+		compression_enabled = current_mh.flags == protocol::COMPRESSION_OFFER;
+	}
 	ResponseOpener opener(current_state);
 	auto i = objects.find(current_mh.object_id);
 	if(i == objects.end()) {
@@ -141,6 +263,14 @@ void TCPBridge::Connection::BeginProcessingCommandImpl() {
 		return;
 	}
 
+	// the whole dump would end up in out_queue. hosts that know about
+	// OPEN_CORE_DUMP read it in bounded chunks instead, and twib only falls
+	// back to COREDUMP when that isn't recognized.
+	if(current_mh.object_id == 0 && current_mh.command_id == (uint32_t) protocol::ITwibDeviceInterface::Command::COREDUMP) {
+		opener.BeginError(TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION).Finalize();
+		return;
+	}
+
 	// check for a close object request
 	if(current_mh.command_id == 0xffffffff) {
 		printf("got close command for %d\n", current_mh.object_id);
@@ -169,9 +299,9 @@ void TCPBridge::Connection::ResetHandler() {
 }
 
 void TCPBridge::Connection::Panic() {
-	deletion_flag = true;
-	socket.Close();
-	// this is about the best we can do
+	// the socket thread notices, hangs up, and hands us back for Cleanup
+	Kill();
+	bridge.Wake();
 }
 
 } // namespace tcp
@@ -20,8 +20,6 @@
 
 #include "TCPBridge.hpp"
 
-#include<libtransistor/ipc/bsd.h>
-
 #include "../Object.hpp"
 #include "../ResponseOpener.hpp"
 
@@ -40,7 +38,7 @@ TCPBridge::Connection::ResponseState::ResponseState(std::shared_ptr<Connection>
 }
 
 size_t TCPBridge::Connection::ResponseState::GetMaxTransferSize() {
-	return 16384;
+	return TransferSize;
 }
 
 void TCPBridge::Connection::ResponseState::SendHeader(protocol::MessageHeader &hdr) {
@@ -70,6 +68,10 @@ void TCPBridge::Connection::ResponseState::Finalize() {
 	}
 }
 
+void TCPBridge::Connection::ResponseState::Abort() {
+	connection->Panic();
+}
+
 uint32_t TCPBridge::Connection::ResponseState::ReserveObjectId() {
 	return connection->next_object_id++;
 }
@@ -79,16 +81,7 @@ void TCPBridge::Connection::ResponseState::InsertObject(std::pair<uint32_t, std:
 }
 
 void TCPBridge::Connection::ResponseState::Send(uint8_t *data, size_t size) {
-	while(!connection->deletion_flag && size > 0) {
-		ssize_t r = bsd_send(connection->socket.fd, data, size, 0);
-		if(r <= 0) {
-			connection->deletion_flag = true;
-			connection->Panic();
-			return;
-		}
-		size-= r;
-		data+= r;
-	}
+	connection->QueueOutput(data, size);
 }
 
 } // namespace tcp
@@ -36,6 +36,12 @@ namespace tcp {
 using trn::ResultCode;
 using trn::ResultError;
 
+#ifdef MSG_DONTWAIT
+static const int NonBlocking = MSG_DONTWAIT;
+#else
+static const int NonBlocking = 0;
+#endif
+
 TCPBridge::TCPBridge(Twili &twili, std::shared_ptr<bridge::Object> object_zero) :
 	twili(twili),
 	object_zero(object_zero) {
@@ -71,21 +77,45 @@ TCPBridge::TCPBridge(Twili &twili, std::shared_ptr<bridge::Object> object_zero)
 
 	request_processing_signal_wh = twili.event_waiter.AddSignal(
 		[this]() {
-			std::unique_lock<thread::Mutex> lock(request_processing_mutex);
-
-			request_processing_signal_wh->ResetSignal();
-			try {
-				request_processing_connection->Synchronized();
-			} catch(ResultError &e) {
-				printf("caught 0x%x while processing request\n", e.code.code);
-				request_processing_connection->deletion_flag = true;
+			std::list<std::shared_ptr<Connection>> queue;
+			{
+				std::unique_lock<thread::Mutex> lock(request_processing_mutex);
+				request_processing_signal_wh->ResetSignal();
+				queue.swap(request_processing_queue);
+				for(auto &c : queue) {
+					c->processing_queued = false;
+				}
 			}
-			request_processing_connection.reset();
 
-			request_processing_condvar.Signal(-1); // resume I/O thread after we unlock
+			for(auto &c : queue) {
+				if(!c->deletion_flag) {
+					try {
+						c->Process();
+					} catch(ResultError &e) {
+						printf("caught 0x%x while processing request\n", e.code.code);
+						c->Panic();
+					}
+				}
+				if(c->deletion_flag) {
+					c->Cleanup();
+				}
+			}
 
 			return true;
 		});
+
+	wake_socket = {bsd_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)};
+	memset(&wake_address, 0, sizeof(wake_address));
+	wake_address.sin_family = AF_INET;
+	wake_address.sin_port = 0;
+	wake_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t wake_address_size = sizeof(wake_address);
+	if(wake_socket.fd == -1 ||
+		 bsd_bind(wake_socket.fd, (struct sockaddr*) &wake_address, sizeof(wake_address)) < 0 ||
+		 bsd_getsockname(wake_socket.fd, (struct sockaddr*) &wake_address, &wake_address_size) < 0) {
+		printf("failed to set up wake socket, falling back to polling\n");
+		wake_socket.Close();
+	}
 	
 	twili::Assert(trn_thread_create(&thread, TCPBridge::ThreadEntryShim, this, -1, -2, 0x4000, nullptr));
 	twili::Assert(trn_thread_start(&thread));
@@ -102,7 +132,12 @@ void TCPBridge::SocketThread() {
 			std::unique_lock<thread::Mutex> lock(network_state_mutex);
 			if(network_state != nifm::IRequest::State::Connected) {
 				printf("network is down\n");
-				connections.clear(); // kill all our connections
+				// kill all our connections
+				for(auto &c : connections) {
+					c->Kill();
+					QueueProcessing(c);
+				}
+				connections.clear();
 				
 				// wait for network to come back up
 				printf("waiting for network to come up\n");
@@ -120,12 +155,21 @@ void TCPBridge::SocketThread() {
 		
 		std::vector<pollfd> fds;
 		fds.push_back({server_socket.fd, POLLIN}); // server socket
+		fds.push_back({wake_socket.fd, POLLIN});
 
 		for(auto &c : connections) {
-			fds.push_back({c->socket.fd, POLLIN});
+			short events = 0;
+			if(c->WantsInput()) {
+				events|= POLLIN;
+			}
+			if(c->WantsOutput()) {
+				events|= POLLOUT;
+			}
+			fds.push_back({c->socket.fd, events});
 		}
 
-		if(bsd_poll(fds.data(), fds.size(), -1) < 0) {
+		// without a wake socket, check back for new output every so often
+		if(bsd_poll(fds.data(), fds.size(), wake_socket.fd == -1 ? 10 : -1) < 0) {
 			printf("poll failure\n");
 			thread_destroy = 1;
 			return;
@@ -167,38 +211,61 @@ void TCPBridge::SocketThread() {
 			}
 		}
 
-		size_t fdi = 1;
-		for(auto ci = connections.begin(); ci != connections.end(); fdi++) {
+		if(fds[1].revents & POLLIN) {
+			DrainWakeSocket();
+		}
+
+		// connections accepted just now weren't polled
+		size_t fdi = 2;
+		for(auto ci = connections.begin(); ci != connections.end() && fdi < fds.size(); ci++, fdi++) {
 			if(fds[fdi].revents & (POLLERR | POLLHUP | POLLNVAL)) {
-				(*ci)->deletion_flag = true;
-				ci = connections.erase(ci);
+				(*ci)->Kill();
 				continue;
 			}
 			if(fds[fdi].revents & POLLIN) {
 				(*ci)->PumpInput();
 			}
-			ci++;
+			if(fds[fdi].revents & POLLOUT) {
+				(*ci)->PumpOutput();
+			}
 		}
 
+		// dead connections go back to the main thread to release their objects
 		for(auto i = connections.begin(); i != connections.end(); ) {
-			try {
-				(*i)->Process();
-			} catch(trn::ResultError &e) {
-				printf("error 0x%x\n", e.code.code);
-				(*i)->deletion_flag = true;
-			}
-			
 			if((*i)->deletion_flag) {
+				QueueProcessing(*i);
 				i = connections.erase(i);
 				continue;
 			}
-			
 			i++;
 		}
 	}
 	printf("socket thread exiting\n");
 }
 
+void TCPBridge::QueueProcessing(std::shared_ptr<Connection> connection) {
+	std::unique_lock<thread::Mutex> lock(request_processing_mutex);
+	if(!connection->processing_queued) {
+		connection->processing_queued = true;
+		request_processing_queue.push_back(connection);
+		request_processing_signal_wh->Signal();
+	}
+}
+
+void TCPBridge::Wake() {
+	if(wake_socket.fd != -1) {
+		uint8_t byte = 0;
+		bsd_sendto(wake_socket.fd, &byte, sizeof(byte), NonBlocking, (struct sockaddr*) &wake_address, sizeof(wake_address));
+	}
+}
+
+void TCPBridge::DrainWakeSocket() {
+	uint8_t buffer[64];
+	// without MSG_DONTWAIT, only take the datagram that poll() told us about
+	while(bsd_recv(wake_socket.fd, buffer, sizeof(buffer), NonBlocking) > 0 && NonBlocking) {
+	}
+}
+
 void TCPBridge::ResetSockets() {
 	// recreate server socket
 	server_socket = {bsd_socket(AF_INET, SOCK_STREAM, 0)};
@@ -252,6 +319,7 @@ TCPBridge::~TCPBridge() {
 	printf("destroying TCPBridge\n");
 	thread_destroy = true;
 	server_socket.Close();
+	Wake();
 	network_state_condvar.Signal(-1);
 	printf("waiting for socket thread to die\n");
 	trn_thread_join(&thread, -1);
@@ -22,12 +22,15 @@
 
 #include<libtransistor/cpp/waiter.hpp>
 #include<libtransistor/thread.h>
+#include<libtransistor/ipc/bsd.h>
 
+#include<atomic>
 #include<list>
 #include<memory>
 
 #include "../../../common/Protocol.hpp"
 #include "../../../common/Buffer.hpp"
+#include "../../../common/SendQueue.hpp"
 #include "../ResponseOpener.hpp"
 #include "../RequestHandler.hpp"
 
@@ -77,10 +80,20 @@ class TCPBridge {
 	thread::Condvar network_state_condvar;
 	std::shared_ptr<trn::WaitHandle> network_state_wh;
 
+	// The socket thread only moves bytes. Connections that have new input
+	// (or that died) are queued here for the main thread, which parses and
+	// dispatches requests.
 	thread::Mutex request_processing_mutex;
-	thread::Condvar request_processing_condvar;
 	std::shared_ptr<trn::WaitHandle> request_processing_signal_wh;
-	std::shared_ptr<Connection> request_processing_connection;
+	std::list<std::shared_ptr<Connection>> request_processing_queue;
+	void QueueProcessing(std::shared_ptr<Connection> connection);
+
+	// Datagrams sent to ourselves over loopback kick the socket thread out
+	// of poll() when there's new output to send.
+	util::Socket wake_socket;
+	struct sockaddr_in wake_address;
+	void Wake();
+	void DrainWakeSocket();
 };
 
 class TCPBridge::Connection : public std::enable_shared_from_this<TCPBridge::Connection> {
@@ -89,47 +102,46 @@ class TCPBridge::Connection : public std::enable_shared_from_this<TCPBridge::Con
 	
 	Connection(TCPBridge &bridge, util::Socket &&socket);
 
+	// called on the socket thread
 	void PumpInput();
-	void Process();
+	void PumpOutput();
+	bool WantsInput();
+	bool WantsOutput();
+	void Kill(); // marks for deletion and drops queued output
 
+	// called on the main thread
+	void Process();
+	void Panic(); // unrecoverable protocol error- abort!
+	void Cleanup(); // drops objects once the connection is dead
 	// called when command processing has ended and further input should be discarded
 	void ResetHandler();
 	
-	bool deletion_flag = false;
-
-	enum class Task {
-		Idle, BeginProcessingCommand, FlushReceiveBuffer, FinalizeCommand
-	};
-	
-	volatile Task pending_task = Task::Idle;
-
-	void Synchronized(); // called on main thread
+	std::atomic<bool> deletion_flag {false};
+	bool processing_queued = false; // protected by bridge.request_processing_mutex
 	
 	util::Socket socket;
  private:
-	void Panic(); // unrecoverable protocol error- abort!
-	
 	TCPBridge &bridge;
 	
-	/*
-	 * Requests that the main thread process something,
-	 * and then blocks until the main thread finishes. I know that this
-	 * isn't very parallel, but I'm only using threads here to work around
-	 * bad socket synchronization primitives so I don't really care.
-	 * The faster we can block this (the I/O) thread and keep it from breaking
-	 * things, the better.
-	 */
-	// TODO: use a mutex here and run things on this thread to simplify
-	//       control flow.
-	void Synchronize(Task task);
-	
-	void BeginProcessingCommandImpl(); // should run on main thread
-	
-	util::Buffer in_buffer;
+	void BeginProcessingCommand();
+	void FlushReceiveBuffer();
+	void FinalizeCommand();
+
+	// Never blocks, since it runs on the main thread. Backpressure comes from
+	// Process holding off on new requests while output is backed up.
+	void QueueOutput(uint8_t *data, size_t size);
+	// True if output is backed up, in which case PumpOutput will queue
+	// processing again once it drains.
+	bool DeferForOutput();
+
+	thread::Mutex in_mutex;
+	util::Buffer in_buffer; // filled by the socket thread
 
+	util::Buffer process_buffer; // what the main thread is parsing
 	bool has_current_mh = false;
 	bool has_current_payload = false;
 	protocol::MessageHeader current_mh;
+	bool current_compressed = false;
 	size_t payload_size;
 	util::Buffer payload_buffer;
 	util::Buffer current_object_ids;
@@ -140,16 +152,27 @@ class TCPBridge::Connection : public std::enable_shared_from_this<TCPBridge::Con
 	
 	uint32_t next_object_id = 1;
 	std::map<uint32_t, std::shared_ptr<bridge::Object>> objects;
+
+	bool compression_enabled = false; // negotiated during IDENTIFY
+
+	thread::Mutex out_mutex;
+	util::SendQueue out_queue;
+	bool output_blocked = false; // protected by out_mutex
 };
 
 class TCPBridge::Connection::ResponseState : public bridge::detail::ResponseState {
  public:
 	ResponseState(std::shared_ptr<Connection> connection, uint32_t client_id, uint32_t tag);
+
+	// Sends only queue data for the socket thread, so this no longer has to
+	// be small to keep a slow host from holding up the main thread.
+	static const size_t TransferSize = 0x10000;
 	
 	virtual size_t GetMaxTransferSize() override;
 	virtual void SendHeader(protocol::MessageHeader &hdr) override;
 	virtual void SendData(uint8_t *data, size_t size) override;
 	virtual void Finalize() override;
+	virtual void Abort() override;
 	virtual uint32_t ReserveObjectId() override;
 	virtual void InsertObject(std::pair<uint32_t, std::shared_ptr<Object>> &&pair) override;
 	
@@ -33,6 +33,7 @@ typedef bool _Bool;
 #include "../ResponseOpener.hpp"
 #include "USBBridge.hpp"
 
+#include "Compression.hpp"
 #include "err.hpp"
 
 namespace twili {
@@ -54,7 +55,6 @@ void USBBridge::RequestReader::Begin() {
 			bridge->endpoint_request_meta->completion_event, [this]() {
 				try {
 					this->MetadataTransactionCompleted();
-					this->PostMetaBuffer();
 					return true;
 				} catch(ResultError &e) {
 					bridge->ResetInterface();
@@ -133,6 +133,7 @@ void USBBridge::RequestReader::MetadataTransactionCompleted() {
 		return;
 	}
 	if(entry->transferred_size == 0) {
+		PostMetaBuffer();
 		return;
 	}
 	if(entry->transferred_size != sizeof(protocol::MessageHeader)) {
@@ -148,9 +149,20 @@ void USBBridge::RequestReader::MetadataTransactionCompleted() {
 	object_ids.clear();
 	payload_buffer.Clear();
 	ResetHandler();
+
+	// compressed requests can't be handed to their handler until the whole
+	// payload is here
+	current_compressed = bridge->compression_enabled && (current_header.flags & protocol::FLAG_COMPRESSED);
+	if(current_compressed && (current_header.payload_size == 0 || current_header.payload_size > protocol::COMPRESSION_MAX_SIZE)) {
+		printf("Bad compressed request size\n");
+		bridge->ResetInterface();
+		return;
+	}
 	
 	// pick command handler
-	BeginProcessingCommand();
+	if(!current_compressed) {
+		BeginProcessingCommand();
+	}
 	
 	if(current_header.payload_size > 0) {
 		PostDataBuffer();
@@ -158,6 +170,7 @@ void USBBridge::RequestReader::MetadataTransactionCompleted() {
 		PostObjectBuffer();
 	} else {
 		FinalizeCommand();
+		PostMetaBuffer();
 	}
 }
 
@@ -183,6 +196,7 @@ void USBBridge::RequestReader::DataTransactionCompleted() {
 			((uint32_t*) bridge->request_data_buffer.data) + current_header.object_count,
 			object_ids.insert(object_ids.end(), current_header.object_count, 0));
 		FinalizeCommand();
+		PostMetaBuffer();
 
 		return;
 	}
@@ -200,10 +214,27 @@ void USBBridge::RequestReader::DataTransactionCompleted() {
 	}
 
 	payload_size+= entry->transferred_size;
+
+	if(current_compressed) {
+		payload_buffer.Write(bridge->request_data_buffer.data, entry->transferred_size);
+		if(payload_size < current_header.payload_size) {
+			PostDataBuffer();
+			return;
+		}
+		if(!protocol::DecompressPayload(current_header, payload_buffer)) {
+			printf("Bad compressed payload\n");
+			bridge->ResetInterface();
+			return;
+		}
+		payload_size = current_header.payload_size;
+		BeginProcessingCommand();
+	}
 	
 	try {
 		// fill input buffer with data from USB
-		payload_buffer.Write(bridge->request_data_buffer.data, entry->transferred_size);
+		if(!current_compressed) {
+			payload_buffer.Write(bridge->request_data_buffer.data, entry->transferred_size);
+		}
 
 		// pass to request handler
 		current_handler->FlushReceiveBuffer(payload_buffer);
@@ -229,11 +260,18 @@ void USBBridge::RequestReader::DataTransactionCompleted() {
 		PostObjectBuffer();
 	} else {
 		FinalizeCommand();
+		PostMetaBuffer();
 	}
 }
 
 void USBBridge::RequestReader::BeginProcessingCommand() {
 	current_state = std::make_shared<USBBridge::ResponseState>(*bridge, current_header.client_id, current_header.tag);
+	current_state->compression_enabled = bridge->compression_enabled;
+	// the host offers compression every time it identifies us, and the
+	// identify response itself goes out before compression takes effect
+	if(current_header.object_id == 0 && current_header.command_id == (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY) {
+		bridge->compression_enabled = current_header.flags == protocol::COMPRESSION_OFFER;
+	}
 	ResponseOpener opener(current_state);
 	auto i = bridge->objects.find(current_header.object_id);
 	if(i == bridge->objects.end()) {
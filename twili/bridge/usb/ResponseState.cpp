@@ -88,6 +88,14 @@ void USBBridge::ResponseState::Finalize() {
 	}
 }
 
+void USBBridge::ResponseState::Abort() {
+	// the protocol has no way to cancel one response partway through, so
+	// the only way to get the host back in sync is to start over. twibd sees
+	// the device go away and fails every client's requests, not just the
+	// one this response belonged to.
+	bridge.ResetInterface();
+}
+
 uint32_t USBBridge::ResponseState::ReserveObjectId() {
 	return bridge.object_id++;
 }
@@ -155,6 +155,7 @@ bool USBBridge::USBStateChangeCallback() {
 }
 
 void USBBridge::ResetInterface() {
+	compression_enabled = false;
 	interface->Disable();
 	interface->Enable();
 }
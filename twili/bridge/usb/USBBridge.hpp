@@ -60,6 +60,9 @@ class USBBridge {
 		void Begin();
 		void MetadataTransactionCompleted();
 		void DataTransactionCompleted();
+		// Only posted once the previous request's payload and object IDs
+		// have all arrived, so the host is free to queue up the next header
+		// while a payload is still in flight.
 		void PostMetaBuffer();
 		void PostDataBuffer();
 		void PostObjectBuffer();
@@ -83,6 +86,7 @@ class USBBridge {
 		void CleanupCommand();
 		
 		protocol::MessageHeader current_header;
+		bool current_compressed = false;
 		size_t payload_size;
 		util::Buffer payload_buffer;
 		std::vector<uint32_t> object_ids;
@@ -116,6 +120,7 @@ class USBBridge {
 
 	uint32_t object_id = 1;
 	std::map<uint32_t, std::shared_ptr<bridge::Object>> objects;
+	bool compression_enabled = false; // negotiated during IDENTIFY
 	
 	RequestReader request_reader;
 	USBBuffer request_meta_buffer;
@@ -137,6 +142,7 @@ class USBBridge::ResponseState : public bridge::detail::ResponseState {
 	virtual void SendHeader(protocol::MessageHeader &hdr) override;
 	virtual void SendData(uint8_t *data, size_t size) override;
 	virtual void Finalize() override;
+	virtual void Abort() override;
 	virtual uint32_t ReserveObjectId() override;
 	virtual void InsertObject(std::pair<uint32_t, std::shared_ptr<Object>> &&pair) override;
 
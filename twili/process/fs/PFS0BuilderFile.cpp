@@ -20,6 +20,12 @@
 
 #include "PFS0BuilderFile.hpp"
 
+#include<algorithm>
+
+#include "err.hpp"
+
+#include "../../ResultCheck.hpp"
+
 namespace twili {
 namespace process {
 namespace fs {
@@ -28,13 +34,14 @@ struct PFS0Header {
 	uint32_t magic = 0x30534650;
 	uint32_t num_files;
 	uint32_t string_table_size;
-	uint32_t padding;
+	uint32_t padding = 0;
 };
 
 struct PFS0Entry {
 	uint64_t file_image_offset;
 	uint64_t size;
 	uint32_t string_table_offset;
+	uint32_t reserved = 0;
 };
 
 static_assert(sizeof(PFS0Header) == 0x10, "pfs0 header size should be 0x10");
@@ -43,134 +50,94 @@ static_assert(sizeof(PFS0Entry) == 0x18, "pfs0 entry size should be 0x18");
 PFS0BuilderFile::PFS0BuilderFile() {
 }
 
-void PFS0BuilderFile::Append(std::string name, std::shared_ptr<ProcessFile> file) {
+trn::ResultCode PFS0BuilderFile::Append(std::string name, std::shared_ptr<ProcessFile> file) {
 	Entry e;
 	e.name = name;
 	e.file = file;
+	TWILI_CHECK(file->GetSize(&e.size));
 	e.string_table_offset = string_table_size;
 	e.file_image_offset = file_image_size;
 
 	string_table_size+= name.size() + 1;
-	file_image_size+= file->GetSize();
+	file_image_size+= e.size;
 	
 	entries.push_back(e);
+	metadata.clear();
+	return RESULT_OK;
 }
 
-size_t PFS0BuilderFile::Read(size_t offset, size_t size, uint8_t *out) {
-	size_t total_read = 0;
+void PFS0BuilderFile::BuildMetadata() {
+	// pad the string table out so that file images start aligned
+	size_t strtab_offset = sizeof(PFS0Header) + sizeof(PFS0Entry) * entries.size();
+	size_t strtab_size = ((strtab_offset + string_table_size + 0x1f) & ~0x1f) - strtab_offset;
+	metadata.clear();
+	metadata.resize(strtab_offset + strtab_size, 0);
+
+	PFS0Header header;
+	header.num_files = entries.size();
+	header.string_table_size = strtab_size;
+	std::copy_n((uint8_t*) &header, sizeof(header), metadata.begin());
+
+	for(size_t i = 0; i < entries.size(); i++) {
+		PFS0Entry e;
+		e.file_image_offset = entries[i].file_image_offset;
+		e.size = entries[i].size;
+		e.string_table_offset = entries[i].string_table_offset;
+		std::copy_n((uint8_t*) &e, sizeof(e), metadata.begin() + sizeof(PFS0Header) + sizeof(PFS0Entry) * i);
+		std::copy(entries[i].name.begin(), entries[i].name.end(), metadata.begin() + strtab_offset + entries[i].string_table_offset);
+	}
+}
 
-	printf("pfs0: read offset=0x%lx size=0x%lx\n", offset, size);
+trn::ResultCode PFS0BuilderFile::Read(size_t offset, size_t size, uint8_t *out, size_t *out_size) {
+	if(metadata.empty()) {
+		BuildMetadata();
+	}
 	
-	// Header
-	if(offset < sizeof(PFS0Header) && size > 0) {
-		PFS0Header header;
-		header.num_files = entries.size();
-		header.string_table_size = string_table_size;
-		size_t sz = std::min(size, sizeof(PFS0Header) - offset);
-		std::copy_n((uint8_t*) &header + offset, sz, out);
+	size_t total_read = 0;
+
+	if(offset < metadata.size() && size > 0) {
+		size_t sz = std::min(size, metadata.size() - offset);
+		std::copy_n(metadata.begin() + offset, sz, out);
 		out+= sz;
 		total_read+= sz;
 		offset+= sz;
 		size-= sz;
 	}
-	offset-= sizeof(PFS0Header);
-	printf("pfs0: fet(offset=0x%lx size=0x%lx)\n", offset, size);
-
-	// File Entry Table
-	if(offset < sizeof(PFS0Entry)*entries.size() && size > 0) {
-		auto i = entries.begin() + (offset/sizeof(PFS0Entry));
-		while(size > 0 && i != entries.end()) {
-			size_t local_offset = offset % sizeof(PFS0Entry);
-			size_t sz = std::min(size, sizeof(PFS0Entry) - local_offset);
-			
-			PFS0Entry e;
-			e.file_image_offset = i->file_image_offset;
-			e.string_table_offset = i->string_table_offset;
-			e.size = i->file->GetSize();
-			std::copy_n((uint8_t*) &e + local_offset, sz, out);
-			out+= sz;
-			total_read+= sz;
-			offset+= sz;
-			size-= sz;
-			i++;
-		}
-	}
-	offset-= sizeof(PFS0Entry)*entries.size();
-
-	// Padding
-	printf("pfs0: pad(offset=0x%lx size=0x%lx)\n", offset, size);
-	size_t fet_end = sizeof(PFS0Header) + sizeof(PFS0Entry) * entries.size();
-	size_t strtab_offset = (fet_end+0x1f) & ~0x1f;
-	size_t strtab_pad = strtab_offset - fet_end;
-	if(offset < strtab_pad) {
-		out+= strtab_pad;
-		total_read+= strtab_pad;
-		size-= strtab_pad;
-	}
-
-	// String Table
-	printf("pfs0: strtab(offset=0x%lx size=0x%lx)\n", offset, size);
-	if(offset < string_table_size && size > 0) {
-		auto i = std::lower_bound(
-			entries.begin(), entries.end(), offset,
-			[](Entry &e, size_t offset) {
-				return (e.string_table_offset + e.name.size() + 1) < offset;
+	
+	if(size > 0 && offset >= metadata.size()) {
+		size_t image_offset = offset - metadata.size();
+		// first file that ends past image_offset
+		auto i = std::upper_bound(
+			entries.begin(), entries.end(), image_offset,
+			[](size_t offset, const Entry &e) {
+				return offset < e.file_image_offset + e.size;
 			});
-		while(offset < string_table_size && size > 0 && i != entries.end()) {
-			size_t local_offset = (offset - i->string_table_offset);
-			size_t sz = std::min(size, i->name.size() - local_offset);
-			printf("  reading 0x%lx bytes from +0x%lx in \"%s\"\n", sz, local_offset, i->name.c_str());
-			std::copy_n(i->name.begin() + local_offset, sz, out);
-			if(size > i->name.size() - local_offset) {
-				out[sz++] = 0; // null terminator
-			}
-			out+= sz;
-			total_read+= sz;
-			offset+= sz;
-			size-= sz;
-			printf("  offset is 0x%lx\n", offset);
-			while(i != entries.end() && i->string_table_offset + i->name.size() + 1 <= offset) {
-				printf("  advancing past \"%s\"\n", i->name.c_str());
-				i++;
+		for(; i != entries.end() && size > 0; i++) {
+			size_t local_offset = image_offset - i->file_image_offset;
+			size_t sz = std::min(size, i->size - local_offset);
+			size_t actual_read;
+			TWILI_CHECK(i->file->Read(local_offset, sz, out, &actual_read));
+			total_read+= actual_read;
+			if(actual_read < sz) {
+				*out_size = total_read;
+				return TWILI_ERR_IO_ERROR;
 			}
-		}
-	}
-	offset-= string_table_size;
-
-	// File Images
-	printf("pfs0: img(offset=0x%lx size=0x%lx)\n", offset, size);
-	if(offset < file_image_size && size > 0) {
-		auto i = std::lower_bound(
-			entries.begin(), entries.end(), offset,
-			[](Entry &e, size_t offset) {
-				return (e.file_image_offset + e.file->GetSize()) < offset;
-			});
-		while(offset < file_image_size && size > 0 && i != entries.end()) {
-			size_t local_offset = (offset - i->file_image_offset);
-			size_t sz = std::min(size, i->file->GetSize() - local_offset);
-			printf("  reading 0x%lx bytes from +0x%lx in %s\n", sz, local_offset, i->name.c_str());
-			i->file->Read(local_offset, sz, out);
 			out+= sz;
-			total_read+= sz;
-			offset+= sz;
+			image_offset+= sz;
 			size-= sz;
-			while(i != entries.end() && i->file_image_offset + i->file->GetSize() <= offset) {
-				i++;
-			}
 		}
 	}
 
-	return total_read;
+	*out_size = total_read;
+	return RESULT_OK;
 }
 
-size_t PFS0BuilderFile::GetSize() {
-	size_t total_size = 0;
-	total_size+= sizeof(PFS0Header);
-	total_size+= sizeof(PFS0Entry) * entries.size();
-	total_size = (total_size + 0x1f) & ~0x1f;
-	total_size+= string_table_size;
-	total_size+= file_image_size;
-	return total_size;
+trn::ResultCode PFS0BuilderFile::GetSize(size_t *out_size) {
+	if(metadata.empty()) {
+		BuildMetadata();
+	}
+	*out_size = metadata.size() + file_image_size;
+	return RESULT_OK;
 }
 
 } // namespace fs
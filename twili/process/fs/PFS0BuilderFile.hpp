@@ -25,6 +25,7 @@
 
 #include "ProcessFile.hpp"
 
+#include<memory>
 #include<string>
 #include<vector>
 
@@ -36,22 +37,27 @@ class PFS0BuilderFile : public ProcessFile {
  public:
 	PFS0BuilderFile();
 
-	void Append(std::string name, std::shared_ptr<ProcessFile> file);
-	virtual size_t Read(size_t offset, size_t size, uint8_t *out) override;
-	virtual size_t GetSize() override;
+	trn::ResultCode Append(std::string name, std::shared_ptr<ProcessFile> file);
+	virtual trn::ResultCode Read(size_t offset, size_t size, uint8_t *out, size_t *out_size) override;
+	virtual trn::ResultCode GetSize(size_t *out_size) override;
  private:
-	size_t string_table_size = 0;
-	size_t file_image_size = 0;
-	
 	struct Entry {
 		std::string name;
 		std::shared_ptr<ProcessFile> file;
+		size_t size;
 
 		size_t string_table_offset;
 		size_t file_image_offset;
 	};
 	
 	std::vector<Entry> entries;
+	size_t string_table_size = 0;
+	size_t file_image_size = 0;
+
+	// header, file entry table, and string table, built on first use
+	std::vector<uint8_t> metadata;
+
+	void BuildMetadata();
 };
 
 } // namespace fs
@@ -22,61 +22,77 @@
 
 #include<stdio.h>
 
-#include "../../twili.hpp"
+#include<algorithm>
+
+#include "err.hpp"
+
+#include "../../ResultCheck.hpp"
 
 namespace twili {
 namespace process {
 namespace fs {
 
-TransmutationFile::TransmutationFile() {
+TransmutationFile::TransmutationFile() : segment_offsets(1, 0) {
 }
 
 void TransmutationFile::SetSegments(std::vector<std::unique_ptr<Segment>> &&segments) {
-	this->segments = std::move(segments);
+	this->segments.clear();
+	segment_offsets.clear();
+
+	size_t offset = 0;
+	for(std::unique_ptr<Segment> &segment : segments) {
+		if(segment->Size() == 0) {
+			continue;
+		}
+		offset+= segment->Size();
+
+		// Merge backed segments that carry straight on from the one before
+		// them, so that reads spanning both go to the file in one piece.
+		if(!this->segments.empty()) {
+			BackedSegment *prev = dynamic_cast<BackedSegment*>(this->segments.back().get());
+			BackedSegment *next = dynamic_cast<BackedSegment*>(segment.get());
+			if(prev && next && prev->Absorb(*next)) {
+				continue;
+			}
+		}
+		
+		segment_offsets.push_back(offset - segment->Size());
+		this->segments.push_back(std::move(segment));
+	}
+	segment_offsets.push_back(offset);
 }
 
 trn::ResultCode TransmutationFile::Read(size_t offset, size_t size, uint8_t *out, size_t *size_out) {
-	size_t segment_begin = 0;
-	size_t segment_end = 0;
 	size_t total_read = 0;
-	
-	// read from virtual segments
-	for(auto i = segments.begin(); i != segments.end() && size > 0; i++) {
-		segment_end = segment_begin + (*i)->Size();
-		if(offset < segment_end) {
-			size_t seg_off = offset - segment_begin;
-			size_t seg_size = segment_end - offset;
-			if(seg_size > size) {
-				seg_size = size;
-			}
-			size_t actual_read;
-			TWILI_CHECK((*i)->Read(seg_off, seg_size, out, &actual_read));
-			if(actual_read < seg_size) {
-				// if we get a short read, give up
-				printf(
-					"TransmutationFile: short read [(0x%lx, 0x%lx) -> (0x%lx, 0x%lx)]\n",
-					offset, seg_size,
-					seg_off, actual_read);
-				*size_out = total_read + actual_read;
-				return TWILI_ERR_IO_ERROR;
-			}
-			offset+= seg_size;
-			out+= seg_size;
-			total_read+= seg_size;
-			size-= seg_size;
+
+	// find the segment containing offset; if offset is past the end, this
+	// lands on segments.size() and nothing is read
+	size_t i = (std::upper_bound(segment_offsets.begin(), segment_offsets.end(), offset) - segment_offsets.begin()) - 1;
+	for(; i < segments.size() && size > 0; i++) {
+		size_t seg_off = offset - segment_offsets[i];
+		size_t seg_size = std::min(segment_offsets[i + 1] - offset, size);
+		size_t actual_read;
+		TWILI_CHECK(segments[i]->Read(seg_off, seg_size, out, &actual_read));
+		if(actual_read < seg_size) {
+			// if we get a short read, give up
+			printf(
+				"TransmutationFile: short read [(0x%lx, 0x%lx) -> (0x%lx, 0x%lx)]\n",
+				offset, seg_size,
+				seg_off, actual_read);
+			*size_out = total_read + actual_read;
+			return TWILI_ERR_IO_ERROR;
 		}
-		segment_begin = segment_end;
+		offset+= seg_size;
+		out+= seg_size;
+		total_read+= seg_size;
+		size-= seg_size;
 	}
 	*size_out = total_read;
 	return RESULT_OK;
 }
 
 trn::ResultCode TransmutationFile::GetSize(size_t *size_out) {
-	size_t total_size = 0;
-	for(auto i = segments.begin(); i != segments.end(); i++) {
-		total_size+= (*i)->Size();
-	}
-	*size_out = total_size;
+	*size_out = segment_offsets.back();
 	return RESULT_OK;
 }
 
@@ -92,6 +108,14 @@ size_t TransmutationFile::BackedSegment::Size() {
 	return size;
 }
 
+bool TransmutationFile::BackedSegment::Absorb(const BackedSegment &next) {
+	if(next.file != file || next.file_offset != file_offset + size) {
+		return false;
+	}
+	size+= next.size;
+	return true;
+}
+
 TransmutationFile::MemorySegment::MemorySegment(uint8_t *buffer, size_t size) : buffer(buffer), size(size) {
 }
 
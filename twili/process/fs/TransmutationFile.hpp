@@ -23,6 +23,7 @@
 #include<stdlib.h>
 #include<stdint.h>
 
+#include<memory>
 #include<vector>
 
 #include "ProcessFile.hpp"
@@ -51,6 +52,10 @@ class TransmutationFile : public ProcessFile {
 		BackedSegment(std::shared_ptr<ProcessFile> file, size_t file_offset, size_t size);
 		virtual trn::ResultCode Read(size_t offset, size_t size, uint8_t *out, size_t *out_size) override;
 		virtual size_t Size() override;
+
+		// If next picks up in the same file right where this segment leaves
+		// off, grows this segment to cover it too and returns true.
+		bool Absorb(const BackedSegment &next);
 	 private:
 		std::shared_ptr<ProcessFile> file;
 		size_t file_offset;
@@ -70,6 +75,8 @@ class TransmutationFile : public ProcessFile {
 	void SetSegments(std::vector<std::unique_ptr<Segment>> &&segments);
 
 	std::vector<std::unique_ptr<Segment>> segments;
+	// where each segment starts, followed by the total size
+	std::vector<size_t> segment_offsets;
 };
 
 } // namespace fs
@@ -20,6 +20,8 @@
 
 #include "VectorFile.hpp"
 
+#include<algorithm>
+
 namespace twili {
 namespace process {
 namespace fs {
@@ -33,12 +33,12 @@
 #include "FileManager.hpp"
 
 #include "Watchdog.hpp"
+#include "ResultCheck.hpp"
 
 namespace twili {
 
 _Noreturn void Abort(trn::ResultError &e);
 _Noreturn void Abort(trn::ResultCode code);
-#define TWILI_CHECK(code) do { trn::ResultCode _tmp = (code); if(_tmp != RESULT_OK) { return _tmp; }} while(0)
 
 template<typename T>
 inline T Assert(trn::Result<T> &r) {